@@ -0,0 +1,97 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "database/archive_database.hpp"
+
+ArchiveDatabase::ArchiveDatabase(SQLiteConnection& db) :
+  m_db(db),
+  m_archive_table(m_db),
+  m_get_archive_stmt(m_db, "SELECT archiveid, size, mtime, loader FROM archives WHERE path = ?1;"),
+  m_get_files_stmt(m_db, "SELECT filename, offset, size FROM archive_files WHERE archiveid = ?1 ORDER BY rowid;"),
+  m_delete_files_stmt(m_db, "DELETE FROM archive_files WHERE archiveid IN (SELECT archiveid FROM archives WHERE path = ?1);"),
+  m_store_archive_stmt(m_db, "INSERT OR REPLACE INTO archives (path, size, mtime, loader) VALUES (?1, ?2, ?3, ?4);"),
+  m_store_file_stmt(m_db, "INSERT INTO archive_files (archiveid, filename, offset, size) VALUES (?1, ?2, ?3, ?4);")
+{
+}
+
+ArchiveDatabase::~ArchiveDatabase()
+{
+}
+
+bool
+ArchiveDatabase::get_listing(const std::string& path, int64_t size, int64_t mtime,
+                             ArchiveListing& listing_out)
+{
+  m_get_archive_stmt.bind_text(1, path);
+  SQLiteReader archive_reader = m_get_archive_stmt.execute_query();
+  if (!archive_reader.next() ||
+      archive_reader.get_int64(1) != size ||
+      archive_reader.get_int64(2) != mtime)
+  {
+    return false;
+  }
+  else
+  {
+    listing_out.path   = path;
+    listing_out.size   = size;
+    listing_out.mtime  = mtime;
+    listing_out.loader = archive_reader.get_text(3);
+    listing_out.entries.clear();
+
+    m_get_files_stmt.bind_int64(1, archive_reader.get_int64(0));
+    SQLiteReader reader = m_get_files_stmt.execute_query();
+    while(reader.next())
+    {
+      listing_out.entries.push_back(ArchiveLoader::Entry(reader.get_text(0),
+                                                         reader.get_int64(1),
+                                                         reader.get_int64(2)));
+    }
+    return true;
+  }
+}
+
+void
+ArchiveDatabase::store_listings(const std::vector<ArchiveListing>& listings)
+{
+  m_db.exec("BEGIN;");
+  for(std::vector<ArchiveListing>::const_iterator i = listings.begin(); i != listings.end(); ++i)
+  {
+    m_delete_files_stmt.bind_text(1, i->path);
+    m_delete_files_stmt.execute();
+
+    m_store_archive_stmt.bind_text(1, i->path);
+    m_store_archive_stmt.bind_int64(2, i->size);
+    m_store_archive_stmt.bind_int64(3, i->mtime);
+    m_store_archive_stmt.bind_text(4, i->loader);
+    m_store_archive_stmt.execute();
+
+    int64_t archiveid = sqlite3_last_insert_rowid(m_db.get_db());
+    for(std::vector<ArchiveLoader::Entry>::const_iterator entry = i->entries.begin();
+        entry != i->entries.end(); ++entry)
+    {
+      m_store_file_stmt.bind_int64(1, archiveid);
+      m_store_file_stmt.bind_text(2, entry->filename);
+      m_store_file_stmt.bind_int64(3, entry->offset);
+      m_store_file_stmt.bind_int64(4, entry->size);
+      m_store_file_stmt.execute();
+    }
+  }
+  m_db.exec("END;");
+}
+
+/* EOF */
@@ -0,0 +1,56 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_DATABASE_ARCHIVE_DATABASE_HPP
+#define HEADER_GALAPIX_DATABASE_ARCHIVE_DATABASE_HPP
+
+#include "sqlite/statement.hpp"
+#include "database/archive_table.hpp"
+#include "util/archive_listing_cache.hpp"
+
+/** The ArchiveDatabase keeps the listings of the archives that were
+    scanned, keyed by path, size and mtime of the archive, so that
+    only new or changed archives have to be listed again. */
+class ArchiveDatabase : public ArchiveListingCache
+{
+private:
+  SQLiteConnection& m_db;
+
+  ArchiveTable m_archive_table;
+  SQLiteStatement m_get_archive_stmt;
+  SQLiteStatement m_get_files_stmt;
+  SQLiteStatement m_delete_files_stmt;
+  SQLiteStatement m_store_archive_stmt;
+  SQLiteStatement m_store_file_stmt;
+
+public:
+  ArchiveDatabase(SQLiteConnection& db);
+  ~ArchiveDatabase();
+
+  bool get_listing(const std::string& path, int64_t size, int64_t mtime,
+                   ArchiveListing& listing_out);
+  void store_listings(const std::vector<ArchiveListing>& listings);
+
+private:
+  ArchiveDatabase(const ArchiveDatabase&);
+  ArchiveDatabase& operator=(const ArchiveDatabase&);
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,56 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_DATABASE_ARCHIVE_TABLE_HPP
+#define HEADER_GALAPIX_DATABASE_ARCHIVE_TABLE_HPP
+
+class ArchiveTable
+{
+private:
+  SQLiteConnection& m_db;
+
+public:
+  ArchiveTable(SQLiteConnection& db) :
+    m_db(db)
+  {
+    m_db.exec("CREATE TABLE IF NOT EXISTS archives ("
+              "archiveid INTEGER PRIMARY KEY AUTOINCREMENT, "
+              "path      TEXT UNIQUE, "
+              "size      INTEGER, "
+              "mtime     INTEGER, "
+              "loader    TEXT"     // ArchiveLoader::str() of the loader that produced the listing
+              ");");
+
+    m_db.exec("CREATE TABLE IF NOT EXISTS archive_files ("
+              "archiveid INTEGER, "
+              "filename  TEXT, "
+              "offset    INTEGER, " // -1 if the loader doesn't know it
+              "size      INTEGER"   // uncompressed size, -1 if unknown
+              ");");
+
+    m_db.exec("CREATE INDEX IF NOT EXISTS archive_files_index ON archive_files ( archiveid );");
+  }
+
+private:
+  ArchiveTable(const ArchiveTable&);
+  ArchiveTable& operator=(const ArchiveTable&);
+};
+
+#endif
+
+/* EOF */
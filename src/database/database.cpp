@@ -27,7 +27,9 @@ Database::Database(const std::string& prefix) :
   m_db(),
   m_tile_db(),
   m_files(),
-  m_tiles()
+  m_tiles(),
+  m_journal(),
+  m_archives()
 {
   Filesystem::mkdir(prefix);
 
@@ -35,6 +37,8 @@ Database::Database(const std::string& prefix) :
   m_tile_db.reset(new SQLiteConnection(prefix + "/cache3_tiles.sqlite3"));
 
   m_files.reset(new FileDatabase(*m_db));
+  m_journal.reset(new JournalDatabase(*m_db));
+  m_archives.reset(new ArchiveDatabase(*m_db));
 
   if (true)
   {
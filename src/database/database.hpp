@@ -21,8 +21,10 @@
 
 #include <memory>
 
+#include "database/archive_database.hpp"
 #include "database/tile_database_interface.hpp"
 #include "database/file_database.hpp"
+#include "database/journal_database.hpp"
 #include "database/tile_cache.hpp"
 
 /** */
@@ -33,6 +35,8 @@ private:
   std::unique_ptr<SQLiteConnection> m_tile_db;
   std::unique_ptr<FileDatabase> m_files;
   std::unique_ptr<TileDatabaseInterface> m_tiles;
+  std::unique_ptr<JournalDatabase> m_journal;
+  std::unique_ptr<ArchiveDatabase> m_archives;
 
 public:
   Database(const std::string& prefix);
@@ -40,6 +44,8 @@ public:
 
   FileDatabase& get_files() { return *m_files; }
   TileDatabaseInterface& get_tiles() { return *m_tiles; }
+  JournalDatabase& get_journal() { return *m_journal; }
+  ArchiveDatabase& get_archives() { return *m_archives; }
 
   void delete_file_entry(const FileId& fileid);
 
@@ -156,6 +156,7 @@ FileTileDatabase::store_tile(const FileEntry& file_entry, const Tile& tile)
   switch(tile.get_surface()->get_format())
   {
     case SoftwareSurface::RGB_FORMAT:
+    case SoftwareSurface::L8_FORMAT:
       JPEG::save(tile.get_surface(), 75, filename);
       break;
 
@@ -0,0 +1,73 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "database/journal_database.hpp"
+
+#include "util/url.hpp"
+
+JournalDatabase::JournalDatabase(SQLiteConnection& db) :
+  m_db(db),
+  m_journal_table(m_db),
+  m_plan_stmt(m_db, "INSERT OR IGNORE INTO journal (url, state) VALUES (?1, 0);"),
+  m_mark_done_stmt(m_db, "INSERT OR REPLACE INTO journal (url, state) "
+                   "VALUES (?1, MAX(?2, IFNULL((SELECT state FROM journal WHERE url = ?1), 0)));"),
+  m_get_done_stmt(m_db, "SELECT url FROM journal WHERE state >= ?1;")
+{
+}
+
+JournalDatabase::~JournalDatabase()
+{
+}
+
+void
+JournalDatabase::plan(const std::vector<URL>& urls)
+{
+  m_db.exec("BEGIN;");
+  for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+  {
+    m_plan_stmt.bind_text(1, i->str());
+    m_plan_stmt.execute();
+  }
+  m_db.exec("END;");
+}
+
+void
+JournalDatabase::mark_done(const std::vector<URL>& urls, State state)
+{
+  m_db.exec("BEGIN;");
+  for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+  {
+    m_mark_done_stmt.bind_text(1, i->str());
+    m_mark_done_stmt.bind_int(2, state);
+    m_mark_done_stmt.execute();
+  }
+  m_db.exec("END;");
+}
+
+void
+JournalDatabase::get_done(State state, std::unordered_set<std::string>& urls_out)
+{
+  m_get_done_stmt.bind_int(1, state);
+  SQLiteReader reader = m_get_done_stmt.execute_query();
+  while(reader.next())
+  {
+    urls_out.insert(reader.get_text(0));
+  }
+}
+
+/* EOF */
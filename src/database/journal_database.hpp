@@ -0,0 +1,75 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_DATABASE_JOURNAL_DATABASE_HPP
+#define HEADER_GALAPIX_DATABASE_JOURNAL_DATABASE_HPP
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "sqlite/statement.hpp"
+#include "database/journal_table.hpp"
+
+class URL;
+
+/** The JournalDatabase records which urls "galapix thumbgen" and
+    "galapix prepare" have planned and finished, so that an
+    interrupted run can be restarted without going through the
+    finished urls again. */
+class JournalDatabase
+{
+public:
+  enum State
+  {
+    PLANNED         = 0,
+    THUMBNAILS_DONE = 1, // tiles for "galapix thumbgen" are stored
+    ALL_TILES_DONE  = 2  // tiles for "galapix prepare" are stored
+  };
+
+private:
+  SQLiteConnection& m_db;
+
+  JournalTable m_journal_table;
+  SQLiteStatement m_plan_stmt;
+  SQLiteStatement m_mark_done_stmt;
+  SQLiteStatement m_get_done_stmt;
+
+public:
+  JournalDatabase(SQLiteConnection& db);
+  ~JournalDatabase();
+
+  /** Record \a urls as planned, urls that are already in the journal
+      keep their state */
+  void plan(const std::vector<URL>& urls);
+
+  /** Record that \a urls reached \a state, the tiles must already be
+      stored in the database */
+  void mark_done(const std::vector<URL>& urls, State state);
+
+  /** Get all urls that reached \a state or a later one */
+  void get_done(State state, std::unordered_set<std::string>& urls_out);
+
+private:
+  JournalDatabase(const JournalDatabase&);
+  JournalDatabase& operator=(const JournalDatabase&);
+};
+
+#endif
+
+/* EOF */
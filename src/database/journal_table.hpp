@@ -0,0 +1,47 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HEADER_GALAPIX_DATABASE_JOURNAL_TABLE_HPP
+#define HEADER_GALAPIX_DATABASE_JOURNAL_TABLE_HPP
+
+class JournalTable
+{
+private:
+  SQLiteConnection& m_db;
+
+public:
+  JournalTable(SQLiteConnection& db) :
+    m_db(db)
+  {
+    m_db.exec("CREATE TABLE IF NOT EXISTS journal ("
+              "url       TEXT PRIMARY KEY, "
+              "state     INTEGER"  // see JournalDatabase::State
+              ");");
+
+    m_db.exec("CREATE INDEX IF NOT EXISTS journal_state_index ON journal ( state );");
+  }
+
+private:
+  JournalTable(const JournalTable&);
+  JournalTable& operator=(const JournalTable&);
+};
+
+#endif
+
+/* EOF */
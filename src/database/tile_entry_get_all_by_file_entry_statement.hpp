@@ -19,13 +19,8 @@
 #ifndef HEADER_GALAPIX_DATABASE_TILE_ENTRY_GET_ALL_BY_FILE_ENTRY_STATEMENT_HPP
 #define HEADER_GALAPIX_DATABASE_TILE_ENTRY_GET_ALL_BY_FILE_ENTRY_STATEMENT_HPP
 
-#include <assert.h>
-
 #include "database/file_entry.hpp"
 #include "database/tile_entry.hpp"
-#include "util/software_surface_factory.hpp"
-#include "plugins/png.hpp"
-#include "plugins/jpeg.hpp"
 
 class TileEntryGetAllByFileEntryStatement
 {
@@ -52,25 +47,9 @@ public:
                                 reader.get_int (3)), // y
                        reader.get_blob(4),
                        static_cast<TileEntry::Format>(reader.get_int(6)));
-      
-        // FIXME: TileEntry shouldn't contain a SoftwareSurface, but a
-        // Blob, so we don't do encode/decode when doing a database
-        // merge
-        BlobPtr blob = tile.get_blob();
-        switch(tile.get_format())
-        {
-          case TileEntry::JPEG_FORMAT:
-            tile.set_surface(JPEG::load_from_mem(blob->get_data(), blob->size()));
-            break;
-
-          case TileEntry::PNG_FORMAT:
-            tile.set_surface(PNG::load_from_mem(blob->get_data(), blob->size()));
-            break;
-
-          default:
-            assert(!"never reached");
-        }
 
+        // only the Blob is loaded, the tiles are just copied around
+        // in a database merge, so decoding them would be wasted work
         tiles.push_back(tile);
       }
     }
@@ -19,8 +19,12 @@
 #ifndef HEADER_GALAPIX_DATABASE_TILE_ENTRY_STORE_STATEMENT_HPP
 #define HEADER_GALAPIX_DATABASE_TILE_ENTRY_STORE_STATEMENT_HPP
 
+#include <assert.h>
 #include <iostream>
 
+#include "plugins/jpeg.hpp"
+#include "plugins/png.hpp"
+
 class TileEntryStoreStatement
 {
 private:
@@ -49,6 +53,7 @@ public:
       switch(tile.get_surface()->get_format())
       {
         case SoftwareSurface::RGB_FORMAT:
+        case SoftwareSurface::L8_FORMAT:
           tile.set_blob(JPEG::save(tile.get_surface(), 75));
           tile.set_format(TileEntry::JPEG_FORMAT);
           break;
@@ -40,7 +40,7 @@ public:
     glEnable(GL_TEXTURE_RECTANGLE_ARB);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT,  1);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, src->get_width());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, src->get_pitch() / src->get_bytes_per_pixel());
     
     int gl_format = GL_RGB;
     switch(src->get_format())
@@ -53,6 +53,10 @@ public:
         gl_format = GL_RGBA;
         break;
 
+      case SoftwareSurface::L8_FORMAT:
+        gl_format = GL_LUMINANCE;
+        break;
+
       default:
         assert(!"Texture: Not supposed to be reached");
     }
@@ -22,22 +22,31 @@
 
 #include "database/database.hpp"
 #include "job/job_manager.hpp"
+#include "jobs/fetch_job.hpp"
 #include "jobs/file_entry_generation_job.hpp"
 #include "jobs/multiple_tile_generation_job.hpp"
 #include "jobs/tile_generation_job.hpp"
+#include "jobs/tile_pipeline.hpp"
 #include "util/log.hpp"
 
 DatabaseThread* DatabaseThread::current_ = 0;
 
 DatabaseThread::DatabaseThread(Database& database,
-                               JobManager& tile_job_manager) :
+                               JobManager& tile_job_manager,
+                               JobManager& io_job_manager,
+                               int num_fetch_slots) :
   m_database(database),
   m_tile_job_manager(tile_job_manager),
+  m_io_job_manager(io_job_manager),
+  m_fetch_slots(num_fetch_slots),
+  m_tile_pipeline(0),
   m_quit(false),
   m_abort(false),
   m_request_queue(),
   m_receive_queue(256), // FIXME: Make this configurable
-  m_tile_generation_jobs()
+  m_tile_request_queue(1024),
+  m_tile_generation_jobs(),
+  m_region_tiles()
 {
   assert(current_ == 0);
   current_ = this;
@@ -50,45 +59,16 @@ DatabaseThread::~DatabaseThread()
 
 JobHandle
 DatabaseThread::request_tile(const FileEntry& file_entry, int tilescale, const Vector2i& pos, 
-                             const std::function<void (Tile)>& callback)
+                             std::function<void (Tile)> callback)
 {
   assert(file_entry);
 
-  JobHandle job_handle_ = JobHandle::create();
+  JobHandle job_handle = JobHandle::create();
 
-  m_request_queue.wait_and_push([this, job_handle_, file_entry, tilescale, pos, callback](){
-      JobHandle job_handle = job_handle_;
-      if (!job_handle.is_aborted())
-      {
-        TileEntry tile;
-        if (m_database.get_tiles().get_tile(file_entry, tilescale, pos, tile))
-        {
-          // Tile has been found, so return it and finish up
-          if (callback)
-          {
-            callback(tile);
-          }
-          job_handle.set_finished();
-        }
-        else
-        {
-          // Tile hasn't been found, so we need to generate it
-          if (0)
-            std::cout << "Error: Couldn't get tile: " 
-                      << file_entry.get_fileid() << " "
-                      << pos.x << " "
-                      << pos.y << " "
-                      << tilescale
-                      << std::endl;
-        
-          {
-            DatabaseThread::current()->generate_tile(job_handle, file_entry, tilescale, pos, callback);
-          }
-        }
-      }
-    });
+  // never block here, the GUI thread requests tiles while drawing
+  m_tile_request_queue.force_push(TileRequest(job_handle, file_entry, tilescale, pos, std::move(callback)));
 
-  return job_handle_;
+  return job_handle;
 }
 
 JobHandle
@@ -209,11 +189,52 @@ DatabaseThread::receive_tile(const FileEntry& file_entry, const Tile& tile)
     });
 }
 
+void
+DatabaseThread::receive_region_tile(const FileEntry& file_entry, const Tile& tile)
+{
+  m_receive_queue.wait_and_push([this, file_entry, tile](){
+      m_region_tiles.push_front(TileEntry(file_entry, tile.get_scale(), tile.get_pos(), tile.get_surface()));
+      if (m_region_tiles.size() > kMaxRegionTiles)
+      {
+        m_region_tiles.pop_back();
+      }
+    });
+}
+
+void
+DatabaseThread::receive_tiles(const std::vector<TileEntry>& tiles,
+                              const std::function<void ()>& callback)
+{
+  m_receive_queue.wait_and_push([this, tiles, callback](){
+      // the tiles might refer to FileEntries that are still waiting
+      // in the cache and don't have a fileid yet
+      m_database.get_files().flush_cache();
+      m_database.get_tiles().store_tiles(tiles);
+      if (callback)
+      {
+        callback();
+      }
+    });
+}
+
+void
+DatabaseThread::update_journal(const std::vector<URL>& urls, JournalDatabase::State state)
+{
+  m_receive_queue.wait_and_push([this, urls, state](){
+      // the journal must never claim more than what is in the database
+      m_database.get_tiles().flush_cache();
+      m_database.get_journal().mark_done(urls, state);
+    });
+}
+
 void
 DatabaseThread::delete_file_entry(const FileId& fileid)
 {
   m_request_queue.wait_and_push([this, fileid](){
       m_database.delete_file_entry(fileid);
+      m_region_tiles.remove_if([&fileid](const TileEntry& tile) {
+          return tile.get_file_entry().get_fileid() == fileid;
+        });
     });
 }
 
@@ -223,6 +244,7 @@ DatabaseThread::stop_thread()
   m_quit  = true;
   m_request_queue.wakeup();
   m_receive_queue.wakeup();
+  m_tile_request_queue.wakeup();
 }
 
 void
@@ -232,6 +254,7 @@ DatabaseThread::abort_thread()
   m_abort = true;
   m_request_queue.wakeup();
   m_receive_queue.wakeup();
+  m_tile_request_queue.wakeup();
 }
 
 void
@@ -243,14 +266,16 @@ DatabaseThread::run()
   {
     // FIXME: This really should be a priority queue
     process_queue(m_receive_queue);
+    process_tile_requests();
     process_queue(m_request_queue);
     
     usleep(10000); // FIXME: evil busy wait
   }
 }
 
+template<typename Queue>
 void
-DatabaseThread::process_queue(ThreadMessageQueue2<std::function<void()>>& queue)
+DatabaseThread::process_queue(Queue& queue)
 { 
   std::function<void()> func;
   while(!m_abort && queue.try_pop(func))
@@ -260,6 +285,86 @@ DatabaseThread::process_queue(ThreadMessageQueue2<std::function<void()>>& queue)
   }
 }
 
+bool
+DatabaseThread::get_region_tile(const FileEntry& file_entry, int scale, const Vector2i& pos, TileEntry& tile_out)
+{
+  for(std::list<TileEntry>::iterator i = m_region_tiles.begin(); i != m_region_tiles.end(); ++i)
+  {
+    if (i->get_file_entry() == file_entry &&
+        i->get_scale() == scale &&
+        i->get_pos()   == pos)
+    {
+      // move it to the front, so the tiles in use stay
+      tile_out = *i;
+      m_region_tiles.splice(m_region_tiles.begin(), m_region_tiles, i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+DatabaseThread::process_tile_requests()
+{
+  TileRequest request;
+  while(!m_abort && m_tile_request_queue.try_pop(request))
+  {
+    process_tile_request(request);
+  }
+}
+
+void
+DatabaseThread::process_tile_request(TileRequest& request)
+{
+  if (!request.job_handle.is_aborted())
+  {
+    TileEntry tile;
+    if (m_database.get_tiles().get_tile(request.file_entry, request.scale, request.pos, tile))
+    {
+      // Tile has been found, so return it and finish up
+      if (request.callback)
+      {
+        request.callback(tile);
+      }
+      request.job_handle.set_finished();
+    }
+    else if (get_region_tile(request.file_entry, request.scale, request.pos, tile))
+    {
+      if (request.callback)
+      {
+        request.callback(tile);
+      }
+      request.job_handle.set_finished();
+    }
+    else
+    {
+      // Tile hasn't been found, so we need to generate it
+      generate_tile(request.job_handle, request.file_entry, request.scale, request.pos, request.callback);
+    }
+  }
+}
+
+template<typename JobType>
+void
+DatabaseThread::submit_job(std::shared_ptr<JobType> job, const URL& url,
+                           const std::function<void (std::shared_ptr<Job>, bool)>& callback)
+{
+  if (FetchJob::wants_prefetch(url))
+  {
+    FetchJob::request(m_io_job_manager,
+                      std::make_shared<FetchJob>(job, url,
+                                                 [job](BlobPtr blob, const std::string& mime_type) {
+                                                   job->set_blob(blob, mime_type);
+                                                 },
+                                                 m_tile_job_manager, callback,
+                                                 m_fetch_slots));
+  }
+  else
+  {
+    m_tile_job_manager.request(job, callback);
+  }
+}
+
 void
 DatabaseThread::remove_job(std::shared_ptr<Job> job)
 {
@@ -268,6 +373,10 @@ DatabaseThread::remove_job(std::shared_ptr<Job> job)
   {
     if (*i == job)
     {
+      // the tiles of the job were pushed to m_receive_queue before
+      // this removal, which run() works off before the next tile
+      // request, so from now on they come from the database
+      (*i)->release_tiles();
       m_tile_generation_jobs.erase(i);
       break;
     }
@@ -288,15 +397,24 @@ DatabaseThread::generate_tiles(const JobHandle& job_handle, const FileEntry& fil
 
   m_database.get_tiles().get_min_max_scale(file_entry, min_scale_in_db, max_scale_in_db);
 
-  std::shared_ptr<MultipleTileGenerationJob> 
-    job_ptr(new MultipleTileGenerationJob(job_handle, 
-                                          file_entry,
-                                          min_scale_in_db, max_scale_in_db,
-                                          min_scale, max_scale,
-                                          std::bind(&DatabaseThread::receive_tile, this, file_entry, std::placeholders::_1)));
-
-  // Not removing the job from the queue
-  m_tile_job_manager.request(job_ptr);
+  if (m_tile_pipeline)
+  {
+    m_tile_pipeline->request(job_handle, file_entry,
+                             min_scale_in_db, max_scale_in_db,
+                             min_scale, max_scale);
+  }
+  else
+  {
+    std::shared_ptr<MultipleTileGenerationJob> 
+      job_ptr(new MultipleTileGenerationJob(job_handle, 
+                                            file_entry,
+                                            min_scale_in_db, max_scale_in_db,
+                                            min_scale, max_scale,
+                                            std::bind(&DatabaseThread::receive_tile, this, file_entry, std::placeholders::_1)));
+
+    // Not removing the job from the queue
+    submit_job(job_ptr, file_entry.get_url());
+  }
 }
 
 void
@@ -347,10 +465,13 @@ DatabaseThread::generate_tile(const JobHandle& job_handle,
 
     std::shared_ptr<TileGenerationJob> job_ptr(new TileGenerationJob(file_entry, min_scale_in_db, max_scale_in_db));
     job_ptr->sig_tile_callback().connect(std::bind(&DatabaseThread::receive_tile, this, std::placeholders::_1, std::placeholders::_2));
+    job_ptr->sig_region_tile_callback().connect(std::bind(&DatabaseThread::receive_region_tile, this,
+                                                          std::placeholders::_1, std::placeholders::_2));
 
     job_ptr->request_tile(job_handle, tilescale, pos, callback);
 
-    m_tile_job_manager.request(job_ptr, std::bind(&DatabaseThread::request_job_removal, this, std::placeholders::_1, std::placeholders::_2));
+    submit_job(job_ptr, file_entry.get_url(),
+               std::bind(&DatabaseThread::request_job_removal, this, std::placeholders::_1, std::placeholders::_2));
 
     m_tile_generation_jobs.push_front(job_ptr);
   }
@@ -377,7 +498,7 @@ DatabaseThread::generate_file_entry(const JobHandle& job_handle, const URL& url,
   job_ptr->sig_file_callback().connect(std::bind(&DatabaseThread::receive_file, this, std::placeholders::_1));
   job_ptr->sig_tile_callback().connect(std::bind(&DatabaseThread::receive_tile, this, std::placeholders::_1, std::placeholders::_2));
 
-  m_tile_job_manager.request(job_ptr);
+  submit_job(job_ptr, url);
   //m_tile_job_manager.request(job_ptr, std::bind(&DatabaseThread::request_job_removal, this, _1, _2));
   //m_tile_generation_jobs.push_front(job_ptr);
 }
@@ -20,11 +20,16 @@
 #define HEADER_GALAPIX_GALAPIX_DATABASE_THREAD_HPP
 
 #include <list>
+#include <utility>
 
+#include "database/file_entry.hpp"
+#include "database/journal_database.hpp"
 #include "database/tile_entry.hpp"
 #include "galapix/tile.hpp"
 #include "job/job_handle.hpp"
 #include "job/job_manager.hpp"
+#include "job/mpsc_queue.hpp"
+#include "job/semaphore.hpp"
 #include "job/thread.hpp"
 #include "job/thread_message_queue2.hpp"
 
@@ -33,37 +38,93 @@ class Database;
 class DatabaseMessage;
 class TileDatabaseMessage;
 class TileGenerationJob;
+class TilePipeline;
 class FileEntry;
 
 class DatabaseThread : public Thread
 {
 private:
   static DatabaseThread* current_;
+
+  /** At 192KB each, enough for the tiles on a large screen */
+  static const size_t kMaxRegionTiles = 64;
 public:
   static DatabaseThread* current() { return current_; }
 
-private:
+  /** request_tile() is by far the most frequent request, so it gets
+      its own queue of plain structs instead of a heap allocated
+      closure in m_request_queue */
+  struct TileRequest
+  {
+    JobHandle job_handle;
+    FileEntry file_entry;
+    int scale;
+    Vector2i pos;
+    std::function<void (Tile)> callback;
+
+    /** The empty cells of the queue, doesn't allocate */
+    TileRequest() :
+      job_handle(JobHandle::null()),
+      file_entry(),
+      scale(0),
+      pos(),
+      callback()
+    {}
+
+    TileRequest(const JobHandle& job_handle_, const FileEntry& file_entry_,
+                int scale_, const Vector2i& pos_,
+                std::function<void (Tile)> callback_) :
+      job_handle(job_handle_),
+      file_entry(file_entry_),
+      scale(scale_),
+      pos(pos_),
+      callback(std::move(callback_))
+    {}
+  };
   
 private:
   Database& m_database;
 
   JobManager& m_tile_job_manager;
 
+  /** JobManager for fetching the image data, see FetchJob */
+  JobManager& m_io_job_manager;
+
+  /** Limits how many fetched images can wait for m_tile_job_manager */
+  Semaphore m_fetch_slots;
+
+  /** Used for generate_tiles() instead of MultipleTileGenerationJob when set */
+  TilePipeline* m_tile_pipeline;
+
   bool m_quit;
   bool m_abort;
   
   ThreadMessageQueue2<std::function<void()>> m_request_queue;
-  ThreadMessageQueue2<std::function<void()>> m_receive_queue;
+  MPSCQueue<std::function<void()>> m_receive_queue;
+  MPSCQueue<TileRequest> m_tile_request_queue;
   std::list<std::shared_ptr<TileGenerationJob> > m_tile_generation_jobs;
 
+  /** Tiles decoded on their own by TileGenerationJob, which can't go
+      into the database, newest first, so repeated requests for them
+      don't decode the image again */
+  std::list<TileEntry> m_region_tiles;
+
 protected: 
   void run();
 
 public:
+  /** @param num_fetch_slots number of images that \a io_job_manager
+      may fetch ahead of \a tile_job_manager */
   DatabaseThread(Database& database,
-                 JobManager& tile_job_manager);
+                 JobManager& tile_job_manager,
+                 JobManager& io_job_manager,
+                 int num_fetch_slots);
   virtual ~DatabaseThread();
 
+  /** Let \a tile_pipeline handle request_tiles(), must be called
+      before the thread is started */
+  void set_tile_pipeline(TilePipeline* tile_pipeline) { m_tile_pipeline = tile_pipeline; }
+
   void stop_thread();
   void abort_thread();
 
@@ -88,7 +149,7 @@ public:
    *  tile will be generated from the source image
    */
   JobHandle request_tile(const FileEntry&, int tilescale, const Vector2i& pos, 
-                         const std::function<void (Tile)>& callback);
+                         std::function<void (Tile)> callback);
 
   JobHandle request_tiles(const FileEntry&, int min_scale, int max_scale, 
                           const std::function<void (Tile)>& callback);
@@ -112,15 +173,41 @@ public:
 
   /** Place tile into the database */
   void      receive_tile(const FileEntry& file_entry, const Tile& tile);
+
+  /** Keep a tile that can't go into the database around for later
+      requests, see m_region_tiles */
+  void      receive_region_tile(const FileEntry& file_entry, const Tile& tile);
   void      receive_file(const FileEntry& file_entry);
-  void      receive_tiles(const std::vector<TileEntry>& tiles);
+  /** Place already encoded tiles into the database in a single
+      transaction, \a callback is called from the DatabaseThread once
+      they are stored */
+  void      receive_tiles(const std::vector<TileEntry>& tiles,
+                          const std::function<void ()>& callback = std::function<void ()>());
+
+  /** Record in the journal that \a urls reached \a state, pending
+      tiles are written to the database first */
+  void      update_journal(const std::vector<URL>& urls, JournalDatabase::State state);
 
   /** Delete the given FileEntry along with all TileEntry refering to it */
   void      delete_file_entry(const FileId& fileid);
   /* @} */
 
 private:
-  void process_queue(ThreadMessageQueue2<std::function<void()>>& queue);
+  template<typename Queue>
+  void process_queue(Queue& queue);
+
+  void process_tile_requests();
+  void process_tile_request(TileRequest& request);
+
+  /** Looks \a scale, \a pos up in m_region_tiles */
+  bool get_region_tile(const FileEntry& file_entry, int scale, const Vector2i& pos, TileEntry& tile_out);
+
+  /** Submit \a job to m_tile_job_manager, the content of \a url gets
+      fetched by m_io_job_manager first when that makes sense */
+  template<typename JobType>
+  void submit_job(std::shared_ptr<JobType> job, const URL& url,
+                  const std::function<void (std::shared_ptr<Job>, bool)>& callback
+                  = std::function<void (std::shared_ptr<Job>, bool)>());
 
 private:
   DatabaseThread (const DatabaseThread&);
@@ -38,9 +38,9 @@ public:
   }
 
   JobHandle request_tile(int tilescale, const Vector2i& pos, 
-                         const std::function<void (Tile)>& callback)
+                         std::function<void (Tile)> callback)
   {
-    return DatabaseThread::current()->request_tile(m_file_entry, tilescale, pos, callback);
+    return DatabaseThread::current()->request_tile(m_file_entry, tilescale, pos, std::move(callback));
   }
   
   int get_max_scale() const 
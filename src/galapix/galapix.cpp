@@ -22,10 +22,13 @@
 #include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <mutex>
 #include <stdlib.h>
 #include <stdexcept>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #include <Magick++.h>
 
@@ -41,8 +44,10 @@
 #include "galapix/zoomify_tile_provider.hpp"
 #include "job/job_handle_group.hpp"
 #include "job/job_manager.hpp"
+#include "job/memory_budget.hpp"
 #include "jobs/test_job.hpp"
 #include "jobs/tile_generation_job.hpp"
+#include "jobs/tile_pipeline.hpp"
 #include "math/rect.hpp"
 #include "math/size.hpp"
 #include "math/vector2i.hpp"
@@ -51,7 +56,10 @@
 #include "plugins/png.hpp"
 #include "plugins/xcf.hpp"
 #include "util/archive_manager.hpp"
+#include "util/exec.hpp"
+#include "util/exec_limiter.hpp"
 #include "util/filesystem.hpp"
+#include "util/log.hpp"
 #include "util/software_surface.hpp"
 #include "util/software_surface_factory.hpp"
 #include "util/string_util.hpp"
@@ -82,11 +90,13 @@ Galapix::test(const Options& opts,
   std::cout << "Running test case" << std::endl;
 
   Database database(opts.database);
-  JobManager job_manager(opts.threads);
-  DatabaseThread database_thread(database, job_manager);
+  JobManager job_manager(opts.threads, "cpu");
+  JobManager io_job_manager(opts.io_threads, "io");
+  DatabaseThread database_thread(database, job_manager, io_job_manager, 2 * opts.threads + opts.io_threads);
 
   database_thread.start_thread();
   job_manager.start_thread();
+  io_job_manager.start_thread();
 
   std::cout << "<<<--- launching jobs" << std::endl;
   JobHandle handle1 = job_manager.request(std::shared_ptr<Job>(new TestJob()));
@@ -100,9 +110,11 @@ Galapix::test(const Options& opts,
 
   database_thread.stop_thread();
   job_manager.stop_thread();
+  io_job_manager.stop_thread();
 
   database_thread.join_thread();
   job_manager.join_thread();
+  io_job_manager.join_thread();
 }
 
 /** Merge content of the databases given by filenames into database */
@@ -118,27 +130,107 @@ Galapix::merge(const std::string& database,
           
     std::vector<FileEntry> entries;
     in_db.get_files().get_file_entries(entries);
+
+    // files and tiles are written in batches, one transaction each,
+    // the urls of a batch only count as merged once it is written
+    std::vector<TileEntry> tiles;
+    std::vector<std::string> batch_urls;
+    std::unordered_set<std::string> merged_urls;
+    auto flush_batch = [&]{
+      try {
+        // the tiles need the fileids that get assigned when the
+        // FileEntries are written
+        out_db.get_files().flush_cache();
+        out_db.get_tiles().store_tiles(tiles);
+        merged_urls.insert(batch_urls.begin(), batch_urls.end());
+      } catch(std::exception& err) {
+        std::cout << "Galapix:merge: Error: " << err.what() << std::endl;
+      }
+      tiles.clear();
+      batch_urls.clear();
+    };
+
     for(std::vector<FileEntry>::iterator i = entries.begin(); i != entries.end(); ++i)
     {
       try {
         std::cout << "Processing: " << i - entries.begin() << "/" << entries.size() << '\r' << std::flush;
 
-        // FIXME: Must catch URL collisions here (or maybe not?)
-        FileEntry file_entry = out_db.get_files().store_file_entry(*i);
+        // read everything first, so an error leaves nothing of this
+        // entry behind and doesn't affect the rest of the batch
+        std::vector<TileEntry> in_tiles;
+        in_db.get_tiles().get_tiles(*i, in_tiles);
 
-        std::vector<TileEntry> tiles;
-        in_db.get_tiles().get_tiles(*i, tiles);
-        for(std::vector<TileEntry>::iterator j = tiles.begin(); j != tiles.end(); ++j)
+        FileEntry out_entry = out_db.get_files().get_file_entry(i->get_url());
+        if (out_entry)
         {
-          // Change the fileid
-          j->set_file_entry(file_entry);
-          out_db.get_tiles().store_tile(file_entry, *j);
+          // merged by an earlier run or from another database, which
+          // might have generated fewer tiles, e.g. "thumbgen" before
+          // "prepare", so take over the tiles that are still missing
+          std::vector<TileEntry> missing_tiles;
+          for(std::vector<TileEntry>::iterator j = in_tiles.begin(); j != in_tiles.end(); ++j)
+          {
+            if (!out_db.get_tiles().has_tile(out_entry, j->get_pos(), j->get_scale()))
+            {
+              j->set_file_entry(out_entry);
+              missing_tiles.push_back(*j);
+            }
+          }
+          tiles.insert(tiles.end(), missing_tiles.begin(), missing_tiles.end());
         }
+        else
+        {
+          // the fileid of in_db is meaningless in out_db, so create a fresh entry
+          FileEntry file_entry = FileEntry::create_without_fileid(i->get_url(), i->get_size(), i->get_mtime(),
+                                                                  i->get_width(), i->get_height(), i->get_format());
+          for(std::vector<TileEntry>::iterator j = in_tiles.begin(); j != in_tiles.end(); ++j)
+          {
+            j->set_file_entry(file_entry);
+          }
+          out_db.get_files().store_file_entry(file_entry);
+          tiles.insert(tiles.end(), in_tiles.begin(), in_tiles.end());
+        }
+        batch_urls.push_back(i->get_url().str());
       } catch(std::exception& err) {
         std::cout << "Galapix:merge: Error: " << err.what() << std::endl;
       }
+
+      if (tiles.size() >= 4096)
+      {
+        flush_batch();
+      }
+    }
+
+    if (!batch_urls.empty())
+    {
+      flush_batch();
     }
     std::cout << std::endl;
+
+    // carry over the progress of "thumbgen" and "prepare"
+    std::unordered_set<std::string> thumbnails_done;
+    std::unordered_set<std::string> all_tiles_done;
+    in_db.get_journal().get_done(JournalDatabase::THUMBNAILS_DONE, thumbnails_done);
+    in_db.get_journal().get_done(JournalDatabase::ALL_TILES_DONE, all_tiles_done);
+
+    // only for the urls whose tiles actually made it into out_db
+    std::vector<URL> thumbnails_done_urls;
+    for(std::unordered_set<std::string>::const_iterator i = thumbnails_done.begin(); i != thumbnails_done.end(); ++i)
+    {
+      if (merged_urls.count(*i))
+      {
+        thumbnails_done_urls.push_back(URL::from_string(*i));
+      }
+    }
+    std::vector<URL> all_tiles_done_urls;
+    for(std::unordered_set<std::string>::const_iterator i = all_tiles_done.begin(); i != all_tiles_done.end(); ++i)
+    {
+      if (merged_urls.count(*i))
+      {
+        all_tiles_done_urls.push_back(URL::from_string(*i));
+      }
+    }
+    out_db.get_journal().mark_done(thumbnails_done_urls, JournalDatabase::THUMBNAILS_DONE);
+    out_db.get_journal().mark_done(all_tiles_done_urls, JournalDatabase::ALL_TILES_DONE);
   }
 }
 
@@ -252,10 +344,12 @@ Galapix::filegen(const Options& opts,
                  const std::vector<URL>& url)
 {
   Database database(opts.database);
-  JobManager job_manager(opts.threads);
-  DatabaseThread database_thread(database, job_manager);
+  JobManager job_manager(opts.threads, "cpu");
+  JobManager io_job_manager(opts.io_threads, "io");
+  DatabaseThread database_thread(database, job_manager, io_job_manager, 2 * opts.threads + opts.io_threads);
 
   job_manager.start_thread();
+  io_job_manager.start_thread();
   database_thread.start_thread();
   
   for(std::vector<URL>::size_type i = 0; i < url.size(); ++i)
@@ -265,6 +359,11 @@ Galapix::filegen(const Options& opts,
                                  std::function<void (FileEntry, Tile)>());
   }
 
+  // the I/O threads hand their jobs over to the CPU threads, so they
+  // have to be finished first
+  io_job_manager.stop_thread();
+  io_job_manager.join_thread();
+
   job_manager.stop_thread();
   database_thread.stop_thread();
 
@@ -278,21 +377,52 @@ Galapix::thumbgen(const Options& opts,
                   bool generate_all_tiles)
 {
   Database       database(opts.database);
-  JobManager     job_manager(opts.threads);
-  DatabaseThread database_thread(database, job_manager);
+  JobManager     job_manager(opts.threads, "cpu");
+  JobManager     io_job_manager(opts.io_threads, "io");
+  DatabaseThread database_thread(database, job_manager, io_job_manager, 2 * opts.threads + opts.io_threads);
+  TilePipeline   tile_pipeline(database_thread, opts.threads, opts.io_threads, opts.lossless_tiles);
+
+  database_thread.set_tile_pipeline(&tile_pipeline);
+
+  // skip the urls that a previous, interrupted run already finished
+  JournalDatabase::State journal_state = generate_all_tiles ? 
+    JournalDatabase::ALL_TILES_DONE : JournalDatabase::THUMBNAILS_DONE;
+  std::vector<URL> pending_urls;
+  {
+    std::unordered_set<std::string> done_urls;
+    database.get_journal().get_done(journal_state, done_urls);
+    for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+    {
+      if (done_urls.find(i->str()) == done_urls.end())
+      {
+        pending_urls.push_back(*i);
+      }
+    }
+    database.get_journal().plan(pending_urls);
+
+    if (pending_urls.size() != urls.size())
+    {
+      std::cout << "Skipping " << urls.size() - pending_urls.size() << " already finished files" << std::endl;
+    }
+  }
   
+  tile_pipeline.start();
   database_thread.start_thread();
   job_manager.start_thread();
+  io_job_manager.start_thread();
 
   std::vector<FileEntry> file_entries;
+  std::mutex file_entries_mutex;
 
   JobHandleGroup job_handle_group;
 
   // gather FileEntries
-  for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+  for(std::vector<URL>::const_iterator i = pending_urls.begin(); i != pending_urls.end(); ++i)
   {
     job_handle_group.add(database_thread.request_file(*i, 
-                                                      [&file_entries](const FileEntry& entry) { 
+                                                      [&file_entries, &file_entries_mutex](const FileEntry& entry) { 
+                                                        // called from the worker threads for new files
+                                                        std::lock_guard<std::mutex> lock(file_entries_mutex);
                                                         file_entries.push_back(entry); 
                                                       },
                                                       std::function<void (FileEntry, Tile)>())); 
@@ -303,6 +433,7 @@ Galapix::thumbgen(const Options& opts,
   std::cout << "Got " << file_entries.size() << " files, generating tiles...: "  << generate_all_tiles << std::endl;
 
   // gather thumbnails
+  std::vector<JobHandle> job_handles;
   for(std::vector<FileEntry>::const_iterator i = file_entries.begin(); i != file_entries.end(); ++i)
   {
     int min_scale = 0;
@@ -313,26 +444,219 @@ Galapix::thumbgen(const Options& opts,
       min_scale = std::max(0, max_scale - 3);
     }
 
-    job_handle_group.add(database_thread.request_tiles(*i, min_scale, max_scale,
-                                                       std::function<void(Tile)>()));
+    job_handles.push_back(database_thread.request_tiles(*i, min_scale, max_scale,
+                                                        std::function<void(Tile)>()));
   }
 
-  job_handle_group.wait();
-  job_handle_group.clear();
+  // record finished files in batches, so a restart can skip them
+  std::vector<URL> done_urls;
+  for(size_t i = 0; i < job_handles.size(); ++i)
+  {
+    job_handles[i].wait();
+    if (!job_handles[i].is_failed() && !job_handles[i].is_aborted())
+    {
+      done_urls.push_back(file_entries[i].get_url());
+    }
+
+    if (done_urls.size() >= 256 || (i == job_handles.size() - 1 && !done_urls.empty()))
+    {
+      database_thread.update_journal(done_urls, journal_state);
+      done_urls.clear();
+    }
+  }
+
+  // the pipeline hands its tiles to the DatabaseThread, so it has to
+  // be finished while that is still running
+  tile_pipeline.finish();
+
+  // the I/O threads hand their jobs over to the CPU threads, so they
+  // have to be finished first
+  io_job_manager.stop_thread();
+  io_job_manager.join_thread();
 
   job_manager.stop_thread();
   database_thread.stop_thread();
 
   job_manager.join_thread();
   database_thread.join_thread();
+
+  job_manager.print_stats(std::cout);
+  io_job_manager.print_stats(std::cout);
+  tile_pipeline.print_stats(std::cout);
+  ExecLimiter::current()->print_stats(std::cout);
+  std::cout << "Peak memory reserved for decoding: "
+            << MemoryBudget::current().get_peak() / (1024 * 1024) << "MB" << std::endl;
+}
+
+void
+Galapix::coordinate(const Options& opts,
+                    const std::vector<URL>& urls_in,
+                    const std::string& command)
+{
+  int num_shards = opts.processes;
+
+  // urls that were merged by an earlier, interrupted run need no shard
+  std::vector<URL> urls;
+  {
+    Database database(opts.database);
+    std::unordered_set<std::string> done_urls;
+    database.get_journal().get_done(command == "prepare" ? 
+                                    JournalDatabase::ALL_TILES_DONE : JournalDatabase::THUMBNAILS_DONE,
+                                    done_urls);
+    for(std::vector<URL>::const_iterator i = urls_in.begin(); i != urls_in.end(); ++i)
+    {
+      if (done_urls.find(i->str()) == done_urls.end())
+      {
+        urls.push_back(*i);
+      }
+    }
+  }
+
+  std::vector<std::vector<URL> > shard_urls(static_cast<size_t>(num_shards));
+  for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+  {
+    shard_urls[static_cast<size_t>(get_shard(*i, num_shards))].push_back(*i);
+  }
+
+  std::string exe = Filesystem::realpath_system("/proc/self/exe");
+
+  std::vector<std::string> databases;
+  std::vector<std::unique_ptr<Exec> > processes;
+  for(int shard = 0; shard < num_shards; ++shard)
+  {
+    std::string shard_database = get_shard_database(opts.database, shard, num_shards);
+    databases.push_back(shard_database);
+
+    // the url list can be far too long for the command line
+    Filesystem::mkdir(shard_database);
+    std::string url_list = shard_database + "/urls.txt";
+    {
+      std::ofstream out(url_list.c_str());
+      const std::vector<URL>& lst = shard_urls[static_cast<size_t>(shard)];
+      for(std::vector<URL>::const_iterator i = lst.begin(); i != lst.end(); ++i)
+      {
+        out << i->str() << '\n';
+      }
+      if (!out)
+      {
+        throw std::runtime_error("Galapix::coordinate(): couldn't write " + url_list);
+      }
+    }
+
+    std::ostringstream shard_str;
+    shard_str << shard << "/" << num_shards;
+    // the processes share the cores, the memory and the external
+    // loaders, so each gets its part of --threads, --memory-budget and
+    // --exec-processes, not all of it; a shard can't run with no
+    // loader at all, so with more shards than --exec-processes each
+    // still gets one
+    std::ostringstream threads_str;
+    threads_str << std::max(1, opts.threads / num_shards + (shard < opts.threads % num_shards ? 1 : 0));
+    std::ostringstream io_threads_str;
+    io_threads_str << opts.io_threads;
+    std::ostringstream memory_budget_str;
+    memory_budget_str << (opts.memory_budget == 0 ? 0 : std::max(1, opts.memory_budget / num_shards));
+    std::ostringstream exec_processes_str;
+    exec_processes_str << (opts.exec_processes == 0 ? 0 :
+                           std::max(1, opts.exec_processes / num_shards +
+                                    (shard < opts.exec_processes % num_shards ? 1 : 0)));
+    std::ostringstream exec_timeout_str;
+    exec_timeout_str << opts.exec_timeout;
+
+    std::unique_ptr<Exec> process(new Exec(exe, Exec::ABSOLUTE_PATH));
+    process->arg(command)
+      .arg("--database").arg(opts.database)
+      .arg("--shard").arg(shard_str.str())
+      .arg("--threads").arg(threads_str.str())
+      .arg("--io-threads").arg(io_threads_str.str())
+      .arg("--memory-budget").arg(memory_budget_str.str())
+      .arg("--exec-processes").arg(exec_processes_str.str())
+      .arg("--exec-timeout").arg(exec_timeout_str.str())
+      .arg("--files-from").arg(url_list);
+    if (opts.lossless_tiles)
+    {
+      process->arg("--lossless-tiles");
+    }
+    processes.push_back(std::move(process));
+  }
+
+  std::cout << "Galapix::coordinate(): running " << num_shards << " processes" << std::endl;
+
+  // Exec::exec() blocks till the process is done, so each one gets a thread
+  std::vector<int> exit_codes(static_cast<size_t>(num_shards), EXIT_FAILURE);
+  std::vector<std::thread> threads;
+  for(int shard = 0; shard < num_shards; ++shard)
+  {
+    Exec& process = *processes[static_cast<size_t>(shard)];
+    int& exit_code = exit_codes[static_cast<size_t>(shard)];
+    threads.push_back(std::thread([&process, &exit_code]{
+          try
+          {
+            exit_code = process.exec();
+          }
+          catch(const std::exception& err)
+          {
+            log_error << process.str() << ": " << err.what() << std::endl;
+          }
+        }));
+  }
+
+  bool success = true;
+  for(int shard = 0; shard < num_shards; ++shard)
+  {
+    threads[static_cast<size_t>(shard)].join();
+
+    const Exec& process = *processes[static_cast<size_t>(shard)];
+    std::cout << "--- shard " << shard << "/" << num_shards << ": exit code " 
+              << exit_codes[static_cast<size_t>(shard)] << " ---" << std::endl;
+    std::cout.write(reinterpret_cast<const char*>(process.get_stdout()->get_data()), process.get_stdout()->size());
+    std::cout.write(process.get_stderr().data(), static_cast<std::streamsize>(process.get_stderr().size()));
+
+    if (exit_codes[static_cast<size_t>(shard)] != EXIT_SUCCESS)
+    {
+      success = false;
+    }
+  }
+
+  if (!success)
+  {
+    // the shards keep their journals, so running the same command
+    // again continues where they stopped
+    throw std::runtime_error("Galapix::coordinate(): some shards failed, not merging");
+  }
+
+  merge(opts.database, databases);
+}
+
+int
+Galapix::get_shard(const URL& url, int num_shards)
+{
+  // FNV-1a, std::hash<> isn't guaranteed to be the same everywhere
+  const std::string& str = url.str();
+  uint64_t hash = 14695981039346656037ULL;
+  for(std::string::const_iterator i = str.begin(); i != str.end(); ++i)
+  {
+    hash ^= static_cast<uint8_t>(*i);
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<int>(hash % static_cast<uint64_t>(num_shards));
+}
+
+std::string
+Galapix::get_shard_database(const std::string& database, int shard_index, int num_shards)
+{
+  std::ostringstream out;
+  out << database << ".shard-" << shard_index << "-of-" << num_shards;
+  return out.str();
 }
 
 void
 Galapix::view(const Options& opts, const std::vector<URL>& urls)
 {
   Database       database(opts.database);
-  JobManager     job_manager(opts.threads);
-  DatabaseThread database_thread(database, job_manager);
+  JobManager     job_manager(opts.threads, "cpu");
+  JobManager     io_job_manager(opts.io_threads, "io");
+  DatabaseThread database_thread(database, job_manager, io_job_manager, 2 * opts.threads + opts.io_threads);
 
   Workspace workspace;
 
@@ -405,7 +729,7 @@ Galapix::view(const Options& opts, const std::vector<URL>& urls)
     }
     else if (Filesystem::has_extension(i->str(), "ImageProperties.xml"))
     {
-      workspace.add_image(Image::create(*i, ZoomifyTileProvider::create(*i, job_manager)));
+      workspace.add_image(Image::create(*i, ZoomifyTileProvider::create(*i, io_job_manager)));
     }
     else
     {
@@ -435,6 +759,7 @@ Galapix::view(const Options& opts, const std::vector<URL>& urls)
   }
 
   job_manager.start_thread();  
+  io_job_manager.start_thread();
   database_thread.start_thread();
 
 #ifdef GALAPIX_SDL
@@ -453,9 +778,11 @@ Galapix::view(const Options& opts, const std::vector<URL>& urls)
 #endif
 
   job_manager.abort_thread();
+  io_job_manager.abort_thread();
   database_thread.abort_thread();
 
   job_manager.join_thread();
+  io_job_manager.join_thread();
   database_thread.join_thread();
 }
 
@@ -485,7 +812,14 @@ Galapix::print_usage()
             << "  -d, --database FILE    Use FILE has database (default: none)\n"
             << "  -f, --fullscreen       Start in fullscreen mode\n"
             << "  -t, --threads          Number of worker threads (default: 2)\n"
+            << "  -T, --io-threads       Number of threads for reading files (default: 4)\n"
+            << "  -M, --memory-budget MB Memory for decoded images, 0 for unlimited (default: 2048)\n"
             << "  -F, --files-from FILE  Get urls from FILE\n"
+            << "      --shard I/N        Only handle shard I (0 <= I < N) of the urls, using a database of its own\n"
+            << "  -j, --processes N      Split prepare/thumbgen over N processes and merge the results\n"
+            << "      --exec-processes N Instances of each external loader program at once, 0 for unlimited (default: 2)\n"
+            << "      --exec-timeout SEC Kill external loader programs after SEC seconds, 0 for never (default: 300)\n"
+            << "      --lossless-tiles   Cut the full size tiles out of JPEGs without recompressing them\n"
             << "  -p, --pattern GLOB     Select files from the database via globbing pattern\n"
             << "  -g, --geometry WxH     Start with window size WxH\n"        
             << "  -a, --anti-aliasing N  Anti-aliasing factor 0,2,4 (default: 0)\n"
@@ -510,6 +844,11 @@ Galapix::main(int argc, char** argv)
   {
     Options opts;
     opts.threads  = 2;
+    opts.io_threads = 4;
+    opts.memory_budget = 2048;
+    opts.processes = 1;
+    opts.exec_processes = 2;
+    opts.exec_timeout = 300;
     opts.database = Filesystem::get_home() + "/.galapix/cache3";
     parse_args(argc, argv, opts);
 
@@ -523,6 +862,17 @@ Galapix::main(int argc, char** argv)
 
     ArchiveManager archive_manager;
     SoftwareSurfaceFactory software_surface_factory;
+    MemoryBudget memory_budget(static_cast<size_t>(opts.memory_budget) * 1024 * 1024);
+
+    // the programs the loaders and archive handlers run, the
+    // processes started by coordinate() stay unlimited
+    ExecLimiter exec_limiter;
+    const char* loader_programs[] = { "koconverter", "rar", "rsvg", "7zr", "tar", "ufraw-batch",
+                                      "unzip", "vidthumb", "xcf2png", "xcfinfo" };
+    for(size_t i = 0; i < sizeof(loader_programs) / sizeof(loader_programs[0]); ++i)
+    {
+      exec_limiter.set_limit(loader_programs[i], opts.exec_processes, opts.exec_timeout);
+    }
 
     run(opts);
 
@@ -555,12 +905,17 @@ Galapix::run(const Options& opts)
   else
   {
     std::cout << "Scanning directories... " << std::flush;
-    for(std::vector<std::string>::const_iterator i = opts.rest.begin()+1; i != opts.rest.end(); ++i)
     {
-      if (URL::is_url(*i))
-        urls.push_back(URL::from_string(*i));
-      else
-        Filesystem::generate_image_file_list(*i, urls);
+      // the listings of unchanged archives come from the database,
+      // it is closed again before the command opens its own
+      Database database(opts.database);
+      for(std::vector<std::string>::const_iterator i = opts.rest.begin()+1; i != opts.rest.end(); ++i)
+      {
+        if (URL::is_url(*i))
+          urls.push_back(URL::from_string(*i));
+        else
+          Filesystem::generate_image_file_list(*i, urls, &database.get_archives());
+      }
     }
     std::sort(urls.begin(), urls.end(),
               [](const URL& lhs, const URL& rhs) {
@@ -609,13 +964,35 @@ Galapix::run(const Options& opts)
     {
       downscale(urls);
     }
-    else if (command == "prepare")
+    else if ((command == "prepare" || command == "thumbgen") &&
+             opts.processes > 1 && opts.num_shards == 0)
     {
-      thumbgen(opts, urls, true);
+      coordinate(opts, urls, command);
     }
-    else if (command == "thumbgen")
+    else if (command == "prepare" || command == "thumbgen")
     {
-      thumbgen(opts, urls, false);
+      if (opts.num_shards > 0)
+      {
+        Options shard_opts = opts;
+        shard_opts.database = get_shard_database(opts.database, opts.shard_index, opts.num_shards);
+
+        std::vector<URL> shard_urls;
+        for(std::vector<URL>::const_iterator i = urls.begin(); i != urls.end(); ++i)
+        {
+          if (get_shard(*i, opts.num_shards) == opts.shard_index)
+          {
+            shard_urls.push_back(*i);
+          }
+        }
+
+        std::cout << "Shard " << opts.shard_index << "/" << opts.num_shards << ": "
+                  << shard_urls.size() << " files, using database: " << shard_opts.database << std::endl;
+        thumbgen(shard_opts, shard_urls, command == "prepare");
+      }
+      else
+      {
+        thumbgen(opts, urls, command == "prepare");
+      }
     }
     else if (command == "filegen")
     {
@@ -668,6 +1045,90 @@ Galapix::parse_args(int argc, char** argv, Options& opts)
           throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
         }              
       }
+      else if (strcmp(argv[i], "-T") == 0 ||
+               strcmp(argv[i], "--io-threads") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          opts.io_threads = atoi(argv[i]);
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }              
+      }
+      else if (strcmp(argv[i], "-M") == 0 ||
+               strcmp(argv[i], "--memory-budget") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          opts.memory_budget = atoi(argv[i]);
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }
+      }
+      else if (strcmp(argv[i], "--shard") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          if (sscanf(argv[i], "%d/%d", &opts.shard_index, &opts.num_shards) != 2 ||
+              opts.num_shards < 1 || 
+              opts.shard_index < 0 || opts.shard_index >= opts.num_shards)
+          {
+            throw std::runtime_error(std::string(argv[i-1]) + " requires an argument of the form I/N with 0 <= I < N");
+          }
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }
+      }
+      else if (strcmp(argv[i], "-j") == 0 ||
+               strcmp(argv[i], "--processes") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          opts.processes = atoi(argv[i]);
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }
+      }
+      else if (strcmp(argv[i], "--exec-processes") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          opts.exec_processes = atoi(argv[i]);
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }
+      }
+      else if (strcmp(argv[i], "--exec-timeout") == 0)
+      {
+        ++i;
+        if (i < argc)
+        {
+          opts.exec_timeout = atoi(argv[i]);
+        }
+        else
+        {
+          throw std::runtime_error(std::string(argv[i-1]) + " requires an argument");
+        }
+      }
+      else if (strcmp(argv[i], "--lossless-tiles") == 0)
+      {
+        opts.lossless_tiles = true;
+      }
       else if (strcmp(argv[i], "-F") == 0 ||
                strcmp(argv[i], "--files-from") == 0)
       {
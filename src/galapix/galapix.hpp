@@ -52,10 +52,24 @@ public:
   void thumbgen(const Options& opts,
                 const std::vector<URL>& urls, 
                 bool generate_all_tiles);
+
+  /** Runs \a command for \a urls in opts.processes child processes,
+      each working on its own shard, and merges the shard databases
+      into opts.database afterwards */
+  void coordinate(const Options& opts,
+                  const std::vector<URL>& urls,
+                  const std::string& command);
   void filegen(const Options& opts,
                const std::vector<URL>& urls);
   void export_images(const std::string& database, const std::vector<URL>& urls);
   void view(const Options& opts, const std::vector<URL>& urls);
+
+  /** Returns the shard \a url belongs to, the result only depends on
+      the url itself, so it is the same for every process and machine */
+  static int get_shard(const URL& url, int num_shards);
+
+  /** Returns the directory of the database used by a shard */
+  static std::string get_shard_database(const std::string& database, int shard_index, int num_shards);
 };
 
 #endif
@@ -62,7 +62,7 @@ Image::Image(const URL& url, TileProviderPtr provider) :
   m_cache(),
   m_renderer(),
   m_file_entry_queue(),
-  m_tile_queue(),
+  m_tile_queue(16),
   m_tile_provider_queue(),
   m_jobs()
 {
@@ -259,7 +259,7 @@ Image::process_queues()
   {
     if (m_cache)
     {
-      m_cache->receive_tile(tile);
+      m_cache->add_tile(tile);
     }
   }
   
@@ -427,7 +427,10 @@ void
 
 Image::receive_tile(const FileEntry& file_entry, const Tile& tile)
 {
-  m_tile_queue.wait_and_push(tile);
+  // the main thread only empties the queue while the Image is
+  // visible, so waiting for it could stall the DatabaseThread, the
+  // Image only gets sent the few tiles of its thumbnail unasked
+  m_tile_queue.force_push(tile);
 }
 
 void
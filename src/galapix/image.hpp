@@ -28,6 +28,7 @@
 #include "galapix/tile_provider.hpp"
 #include "galapix/tile.hpp"
 #include "job/job_handle.hpp"
+#include "job/mpsc_queue.hpp"
 #include "job/thread_message_queue2.hpp"
 #include "math/rect.hpp"
 #include "math/vector2f.hpp"
@@ -70,7 +71,7 @@ private:
   std::unique_ptr<ImageRenderer>  m_renderer;
 
   ThreadMessageQueue2<FileEntry> m_file_entry_queue;
-  ThreadMessageQueue2<Tile> m_tile_queue;
+  MPSCQueue<Tile> m_tile_queue;
   ThreadMessageQueue2<TileProviderPtr> m_tile_provider_queue;
   typedef std::vector<JobHandle> Jobs;
   Jobs m_jobs;
@@ -42,7 +42,7 @@ ImageTileCache::set_weak_ptr(ImageTileCachePtr self)
 ImageTileCache::ImageTileCache(TileProviderPtr tile_provider) :
   m_self(),
   m_cache(),
-  m_tile_queue(),
+  m_tile_queue(16),
   m_tile_provider(tile_provider),
   m_max_scale(m_tile_provider->get_max_scale()),
   m_min_keep_scale(m_max_scale - 2)
@@ -168,24 +168,30 @@ ImageTileCache::process_queue()
   Tile tile;
   while (m_tile_queue.try_pop(tile))
   {
-    assert(tile.get_surface());
+    add_tile(tile);
+  }
+}
+
+void
+ImageTileCache::add_tile(const Tile& tile)
+{
+  assert(tile.get_surface());
 
-    TileCacheId tile_id(tile.get_pos(), tile.get_scale());
+  TileCacheId tile_id(tile.get_pos(), tile.get_scale());
   
-    Cache::iterator i = m_cache.find(tile_id);
+  Cache::iterator i = m_cache.find(tile_id);
 
-    if (i == m_cache.end())
-    {
-      // std::cout << "ImageTileCache::process_queue(): received unrequested tile" << std::endl;
-      m_cache[tile_id] = SurfaceStruct(JobHandle::create(),
-                                       SurfaceStruct::SURFACE_SUCCEEDED,
-                                       Surface::create(tile.get_surface()));
-    }
-    else
-    {
-      i->second.surface = Surface::create(tile.get_surface());
-      i->second.status  = SurfaceStruct::SURFACE_SUCCEEDED;
-    }
+  if (i == m_cache.end())
+  {
+    // std::cout << "ImageTileCache::process_queue(): received unrequested tile" << std::endl;
+    m_cache[tile_id] = SurfaceStruct(JobHandle::create(),
+                                     SurfaceStruct::SURFACE_SUCCEEDED,
+                                     Surface::create(tile.get_surface()));
+  }
+  else
+  {
+    i->second.surface = Surface::create(tile.get_surface());
+    i->second.status  = SurfaceStruct::SURFACE_SUCCEEDED;
   }
 }
 
@@ -221,7 +227,10 @@ ImageTileCache::cancel_jobs(const Rect& rect, int scale)
 void
 ImageTileCache::receive_tile(const Tile& tile)
 {
-  m_tile_queue.wait_and_push(tile);
+  // tiles can still arrive after the Image went out of view and
+  // process_queue() is no longer called, so never wait here, there
+  // are never more of them than tiles in m_cache were requested
+  m_tile_queue.force_push(tile);
 
   Viewer::current()->redraw();
 }
@@ -27,7 +27,7 @@
 #include "galapix/tile_cache_id.hpp"
 #include "galapix/tile_provider.hpp"
 #include "job/job_handle.hpp"
-#include "job/thread_message_queue2.hpp"
+#include "job/mpsc_queue.hpp"
 
 class ImageTileCache;
 
@@ -70,7 +70,7 @@ public:
   std::weak_ptr<ImageTileCache> m_self;
   Cache m_cache;
 
-  ThreadMessageQueue2<Tile> m_tile_queue;
+  MPSCQueue<Tile> m_tile_queue;
   
   TileProviderPtr m_tile_provider;
 
@@ -94,6 +94,10 @@ public:
 
   void process_queue();
 
+  /** Insert \a tile into the cache directly, must only be called from
+      the thread that calls process_queue() */
+  void add_tile(const Tile& tile);
+
   /** Clear the cache completly */
   void clear();
 
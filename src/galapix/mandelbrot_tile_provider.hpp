@@ -40,7 +40,7 @@ public:
   ~MandelbrotTileProvider();
   
   JobHandle request_tile(int tilescale, const Vector2i& pos, 
-                                 const std::function<void (Tile)>& callback);
+                                 std::function<void (Tile)> callback);
 
   int  get_max_scale() const;
   int  get_tilesize() const;
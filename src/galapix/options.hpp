@@ -25,12 +25,46 @@ public:
   std::string database;
   std::vector<std::string> patterns;
   int         threads;
+
+  /** Threads that read files, archives and URLs for the worker threads */
+  int         io_threads;
+
+  /** Memory in MB that jobs may use for decoded images, 0 for unlimited */
+  int         memory_budget;
+
+  /** Only handle the urls of shard \a shard_index out of \a
+      num_shards and use a database of its own, 0 shards for all urls */
+  int         shard_index;
+  int         num_shards;
+
+  /** Number of local processes "prepare" and "thumbgen" split their
+      work over, each one handles a shard */
+  int         processes;
+
+  /** Instances of each external loader program that may run at the
+      same time and the seconds after which they get killed, see
+      ExecLimiter */
+  int         exec_processes;
+  int         exec_timeout;
+
+  /** Cut the full size tiles out of JPEGs without decoding and
+      encoding them again, see JPEGCropper */
+  bool        lossless_tiles;
+
   std::vector<std::string> rest;
 
   Options() :
     database(),
     patterns(),
     threads(),
+    io_threads(),
+    memory_budget(),
+    shard_index(),
+    num_shards(),
+    processes(),
+    exec_processes(),
+    exec_timeout(),
+    lossless_tiles(),
     rest()
   {}
 };
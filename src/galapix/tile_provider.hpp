@@ -38,8 +38,10 @@ public:
   TileProvider() {}
   virtual ~TileProvider() {}
   
+  /** \a callback is taken by value, so providers can move it
+      along instead of copying it */
   virtual JobHandle request_tile(int tilescale, const Vector2i& pos, 
-                                 const std::function<void (Tile)>& callback) =0;
+                                 std::function<void (Tile)> callback) =0;
 
   virtual int  get_max_scale() const =0;
   virtual int  get_tilesize() const =0;
@@ -109,7 +109,7 @@ ZoomifyTileProvider::get_tile_group(int scale, const Vector2i& pos)
 
 JobHandle
 ZoomifyTileProvider::request_tile(int scale, const Vector2i& pos, 
-                                  const std::function<void (Tile)>& callback)
+                                  std::function<void (Tile)> callback)
 {
   int tile_group = get_tile_group(scale, pos);
 
@@ -64,7 +64,7 @@ public:
 
   int get_tile_group(int scale, const Vector2i& pos);
   JobHandle request_tile(int scale, const Vector2i& pos, 
-                         const std::function<void (Tile)>& callback);
+                         std::function<void (Tile)> callback);
 
   int  get_max_scale() const { return m_max_scale; }
   int  get_tilesize()  const { return m_tilesize; }
@@ -19,6 +19,8 @@
 #ifndef HEADER_GALAPIX_JOB_JOB_HPP
 #define HEADER_GALAPIX_JOB_JOB_HPP
 
+#include <memory>
+
 #include "job/job_handle.hpp"
 
 class Job
@@ -16,104 +16,346 @@
 **  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <condition_variable>
-#include <mutex>
+#include "job/job_handle.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
 #include <ostream>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
 
-#include "job/job_handle.hpp"
-
 class JobHandleImpl
 {
 public:
+  enum 
+  {
+    kAborted  = 1 << 0,
+    kFinished = 1 << 1,
+    kFailed   = 1 << 2,
+    /** Set by wait() before sleeping, so the other side only has to
+        make a syscall when somebody is actually waiting */
+    kWaiters  = 1 << 3,
+
+    kDone     = kAborted | kFinished
+  };
+
+  std::atomic<uint32_t> state;
+  std::atomic<int> refcount;
+
+  /** Next entry in the free list while the impl is unused */
+  JobHandleImpl* next_free;
+
   JobHandleImpl() :
-    aborted(false),
-    finished(false),
-    failed(false),
-    mutex(),
-    cond()
+    state(0),
+    refcount(1),
+    next_free(NULL)
   {}
 
-  bool aborted;
-  bool finished;
-  bool failed;
+  void set(uint32_t flags)
+  {
+    // release pairs with the acquire in get(), whatever the Job did
+    // before finishing is visible to the thread that sees it finished
+    uint32_t old_state = state.fetch_or(flags, std::memory_order_release);
+    if ((old_state & kWaiters) && !(old_state & kDone))
+    {
+      wake_all();
+    }
+  }
+
+  uint32_t get() const
+  {
+    return state.load(std::memory_order_acquire);
+  }
+
+  void wait()
+  {
+    uint32_t s = get();
+    while(!(s & kDone))
+    {
+      if (!(s & kWaiters))
+      {
+        if (!state.compare_exchange_weak(s, s | kWaiters, std::memory_order_acquire))
+        {
+          continue;
+        }
+        s |= kWaiters;
+      }
+
+      wait_for_change(s);
+      s = get();
+    }
+  }
+
+private:
+#ifdef __linux__
+  int* futex_word()
+  {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(int), "futex needs a 32bit word");
+    return reinterpret_cast<int*>(&state);
+  }
+
+  /** Sleep as long as the state is still \a expected */
+  void wait_for_change(uint32_t expected)
+  {
+    syscall(SYS_futex, futex_word(), FUTEX_WAIT_PRIVATE, static_cast<int>(expected), NULL, NULL, 0);
+  }
+
+  void wake_all()
+  {
+    syscall(SYS_futex, futex_word(), FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+  }
+#else
+  void wait_for_change(uint32_t expected)
+  {
+    while(state.load(std::memory_order_acquire) == expected)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  void wake_all()
+  {
+  }
+#endif
+
+private:
+  JobHandleImpl(const JobHandleImpl&);
+  JobHandleImpl& operator=(const JobHandleImpl&);
+};
+
+namespace {
+
+/** Unused JobHandleImpls. Handles are mostly created by the UI and
+    DatabaseThread and released by workers, so besides a small per
+    thread list there is one shared by all threads. Releasing pushes
+    to it with a CAS. Allocating never pops single impls, which would
+    suffer from ABA, but takes the whole shared list with one exchange
+    into the per thread list. The impls are never given back to the
+    heap, so there are never more of them than there were handles
+    alive at once. */
+class JobHandlePool
+{
+private:
+  static const int kMaxLocal = 64;
+
+  static std::atomic<JobHandleImpl*> s_shared;
+
+  /** Only used by this thread */
+  JobHandleImpl* m_local;
+  int m_num_local;
+
+public:
+  /** Set once the pool of the thread has been destroyed */
+  static thread_local bool s_destroyed;
+
+  JobHandlePool() :
+    m_local(NULL),
+    m_num_local(0)
+  {
+  }
+
+  ~JobHandlePool()
+  {
+    s_destroyed = true;
+
+    // leave what is left to the other threads
+    while(m_local)
+    {
+      JobHandleImpl* impl = m_local;
+      m_local = impl->next_free;
+      release_shared(impl);
+    }
+  }
+
+  JobHandleImpl* allocate()
+  {
+    if (!m_local)
+    {
+      // the count only limits what release() keeps, so it doesn't
+      // matter that the shared list can be longer
+      m_local = s_shared.exchange(NULL, std::memory_order_acquire);
+      m_num_local = 0;
+    }
+
+    if (!m_local)
+    {
+      return new JobHandleImpl;
+    }
+    else
+    {
+      JobHandleImpl* impl = m_local;
+      m_local = impl->next_free;
+      m_num_local = std::max(0, m_num_local - 1);
+      impl->state.store(0, std::memory_order_relaxed);
+      impl->refcount.store(1, std::memory_order_relaxed);
+      return impl;
+    }
+  }
+
+  void release(JobHandleImpl* impl)
+  {
+    if (m_num_local < kMaxLocal)
+    {
+      impl->next_free = m_local;
+      m_local = impl;
+      m_num_local += 1;
+    }
+    else
+    {
+      release_shared(impl);
+    }
+  }
+
+  static void release_shared(JobHandleImpl* impl)
+  {
+    // release pairs with the acquire in allocate(), so next_free and
+    // the last state changes are visible to the thread that takes it
+    JobHandleImpl* head = s_shared.load(std::memory_order_relaxed);
+    do
+    {
+      impl->next_free = head;
+    }
+    while(!s_shared.compare_exchange_weak(head, impl, std::memory_order_release, std::memory_order_relaxed));
+  }
 
-  std::mutex     mutex;
-  std::condition_variable cond;
+private:
+  JobHandlePool(const JobHandlePool&);
+  JobHandlePool& operator=(const JobHandlePool&);
 };
-
+
+std::atomic<JobHandleImpl*> JobHandlePool::s_shared(NULL);
+thread_local bool JobHandlePool::s_destroyed = false;
+thread_local JobHandlePool s_pool;
+
+} // namespace
+
 JobHandle 
 JobHandle::create() 
 {
   return JobHandle(); 
 }
 
-JobHandle::JobHandle()
-  : impl(new JobHandleImpl())
+JobHandle
+JobHandle::null()
 {
+  return JobHandle(NULL);
+}
+
+JobHandle::JobHandle() :
+  impl(JobHandlePool::s_destroyed ? new JobHandleImpl : s_pool.allocate())
+{
+}
+
+JobHandle::JobHandle(JobHandleImpl* impl_) :
+  impl(impl_)
+{
+}
+
+JobHandle::JobHandle(const JobHandle& other) :
+  impl(other.impl)
+{
+  if (impl)
+  {
+    impl->refcount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+JobHandle&
+JobHandle::operator=(const JobHandle& other)
+{
+  if (impl != other.impl)
+  {
+    JobHandle tmp(other);
+    std::swap(impl, tmp.impl);
+  }
+  return *this;
 }
 
 JobHandle::~JobHandle()
 {
+  if (impl && impl->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    if (JobHandlePool::s_destroyed)
+    {
+      // the thread is shutting down and its pool is already gone
+      JobHandlePool::release_shared(impl);
+    }
+    else
+    {
+      s_pool.release(impl);
+    }
+  }
 }
 
 void
 JobHandle::set_aborted()
 {
-  std::lock_guard<std::mutex> lock(impl->mutex);
-  impl->aborted = true;
-  impl->cond.notify_all();
+  assert(impl);
+  impl->set(JobHandleImpl::kAborted);
 }
 
 bool
 JobHandle::is_aborted() const
 {
-  return impl->aborted;
+  assert(impl);
+  return impl->get() & JobHandleImpl::kAborted;
 }
 
 void
 JobHandle::set_finished()
 {
-  std::lock_guard<std::mutex> lock(impl->mutex);
-  impl->finished = true;
-  impl->cond.notify_all();
+  assert(impl);
+  impl->set(JobHandleImpl::kFinished);
 }
 
 bool
 JobHandle::is_finished() const
 {
-  return impl->finished || impl->aborted;
+  assert(impl);
+  return impl->get() & JobHandleImpl::kDone;
 }
 
 void
 JobHandle::set_failed()
 {
-  std::lock_guard<std::mutex> lock(impl->mutex);
-  impl->finished = true;
-  impl->failed   = true;
-  impl->cond.notify_all();
+  assert(impl);
+  impl->set(JobHandleImpl::kFinished | JobHandleImpl::kFailed);
 }
 
 bool
 JobHandle::is_failed() const
 {
-  return impl->failed;
+  assert(impl);
+  return impl->get() & JobHandleImpl::kFailed;
 }
 
 void
 JobHandle::wait()
 {
-  std::unique_lock<std::mutex> lock(impl->mutex);
-  if (!impl->finished && !impl->aborted && !impl->failed)
-  {
-    impl->cond.wait(lock, [this]{ return is_finished(); });
-  }
+  assert(impl);
+  impl->wait();
 }
 
 std::ostream& operator<<(std::ostream& os, const JobHandle& job_handle)
 {
-  return os << "JobHandle(this=" << job_handle.impl.get() 
-            << ", aborted=" << job_handle.is_aborted()
-            << ", done=" << job_handle.is_finished() << ")";
+  if (!job_handle.impl)
+  {
+    return os << "JobHandle(null)";
+  }
+  else
+  {
+    return os << "JobHandle(this=" << job_handle.impl
+              << ", aborted=" << job_handle.is_aborted()
+              << ", done=" << job_handle.is_finished() << ")";
+  }
 }
-
+
 /* EOF */
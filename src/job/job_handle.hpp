@@ -19,24 +19,40 @@
 #ifndef HEADER_GALAPIX_JOB_JOB_HANDLE_HPP
 #define HEADER_GALAPIX_JOB_JOB_HANDLE_HPP
 
-#include <memory>
 #include <iosfwd>
-
+
 class JobHandleImpl;
-
+
 /** A JobHandle should be returend whenever one thread makes a request
     to another thread, the JobHandle allows the calling thread to
     cancel the job and the called thread to inform the calling one
-    that the Job is finished. (FIXME: Do we need that last thing for something?) */
+    that the Job is finished. (FIXME: Do we need that last thing for something?) 
+
+    The state is a single atomic word, so querying and changing it
+    never takes a lock, wait() sleeps on that word with a futex. The
+    shared state is reference counted and recycled through a free
+    list shared by all threads, as handles are created for every
+    tile. */
 class JobHandle
 {
 private:
   JobHandle();
+  JobHandle(JobHandleImpl* impl_);
 
 public:
   static JobHandle create();
+
+  /** A handle without a Job, for structs that need to be default
+      constructible, but always get a handle from create() assigned
+      before they are used. It doesn't allocate and none of its
+      functions may be called. */
+  static JobHandle null();
+
   ~JobHandle();
 
+  JobHandle(const JobHandle& other);
+  JobHandle& operator=(const JobHandle& other);
+
   /** Aborts a Job so that it gets removed from the JobManager without
       being called. */
   void set_aborted();
@@ -50,16 +66,17 @@ public:
   void set_failed();
   bool is_failed() const;
   
+  /** Blocks till the Job is finished, failed or aborted */
   void wait();
 
   friend std::ostream& operator<<(std::ostream& os, const JobHandle& job_handle);
 
 private:
-  std::shared_ptr<JobHandleImpl> impl;
+  JobHandleImpl* impl;
 };
 
 std::ostream& operator<<(std::ostream& os, const JobHandle& job_handle);
-
+
 #endif
 
 /* EOF */
@@ -23,9 +23,11 @@
 #include "job/job.hpp"
 #include "job/job_worker_thread.hpp"
 
-JobManager::JobManager(int num_threads) :
+JobManager::JobManager(int num_threads, const std::string& name_) :
+  name(name_),
   threads(),
   next_thread(0),
+  start_time(std::chrono::steady_clock::now()),
   mutex()
 {
   assert(num_threads > 0);
@@ -43,6 +45,8 @@ JobManager::start_thread()
 {
   std::unique_lock<std::mutex> lock(mutex);
 
+  start_time = std::chrono::steady_clock::now();
+
   for(Threads::iterator i = threads.begin(); i != threads.end(); ++i)
     (*i)->start_thread();
 }
@@ -90,4 +94,39 @@ JobManager::request(std::shared_ptr<Job> job,
   return handle;
 }
 
+float
+JobManager::get_utilization()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+  if (elapsed <= 0)
+  {
+    return 0.0f;
+  }
+  else
+  {
+    int64_t busy_time = 0;
+    for(Threads::iterator i = threads.begin(); i != threads.end(); ++i)
+      busy_time += (*i)->get_busy_time();
+
+    return static_cast<float>(static_cast<double>(busy_time) / static_cast<double>(elapsed * static_cast<int64_t>(threads.size())));
+  }
+}
+
+void
+JobManager::print_stats(std::ostream& out)
+{
+  int num_jobs = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for(Threads::iterator i = threads.begin(); i != threads.end(); ++i)
+      num_jobs += (*i)->get_num_jobs();
+  }
+
+  out << name << " pool: " << threads.size() << " threads, "
+      << num_jobs << " jobs, "
+      << static_cast<int>(get_utilization() * 100.0f) << "% utilization" << std::endl;
+}
+
 /* EOF */
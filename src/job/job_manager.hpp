@@ -19,8 +19,11 @@
 #ifndef HEADER_GALAPIX_JOB_JOB_MANAGER_HPP
 #define HEADER_GALAPIX_JOB_JOB_MANAGER_HPP
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <ostream>
+#include <string>
 #include <vector>
 #include <mutex>
 
@@ -33,13 +36,18 @@ class JobManager
 {
 private:
   typedef std::vector<std::shared_ptr<JobWorkerThread> > Threads;
+  std::string name;
   Threads threads;
   Threads::size_type next_thread;
 
+  /** Time of start_thread(), used for the utilization statistics */
+  std::chrono::steady_clock::time_point start_time;
+
   std::mutex mutex;
 
 public:
-  JobManager(int num_threads);
+  /** @param name_ used to identify the pool in the statistics */
+  JobManager(int num_threads, const std::string& name_ = "worker");
   ~JobManager();
 
   void start_thread();
@@ -52,6 +60,13 @@ public:
   JobHandle request(std::shared_ptr<Job> job,
                     const std::function<void (std::shared_ptr<Job>, bool)>& callback 
                     = std::function<void (std::shared_ptr<Job>, bool)>());
+
+  /** Fraction of time the threads spend running Jobs since
+      start_thread(), 0.0 to 1.0 */
+  float get_utilization();
+
+  /** Print the number of processed jobs and the utilization of the pool */
+  void print_stats(std::ostream& out);
 };
 
 #endif
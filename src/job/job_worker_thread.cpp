@@ -18,6 +18,7 @@
 
 #include "job/job_worker_thread.hpp"
 
+#include <chrono>
 #include <iostream>
 
 #include "job/job.hpp"
@@ -25,7 +26,9 @@
 JobWorkerThread::JobWorkerThread()
   : m_queue(),
     m_quit(false),
-    m_abort(false)
+    m_abort(false),
+    m_busy_time(0),
+    m_num_jobs(0)
 {
 }
 
@@ -39,7 +42,7 @@ JobWorkerThread::run()
 {
   while(!m_quit)
   {
-    m_queue.wait_for_pop([this]{ return m_abort; });
+    m_queue.wait_for_pop([this]{ return m_quit || m_abort; });
 
     Task task;
     while(!m_abort && m_queue.try_pop(task))
@@ -48,6 +51,7 @@ JobWorkerThread::run()
       if (!task.job->is_aborted())
       {
         //std::cout << "start job: " << task.job << std::endl;
+        auto start_time = std::chrono::steady_clock::now();
         try 
         {
           task.job->run();
@@ -56,6 +60,8 @@ JobWorkerThread::run()
         {
           std::cout << "JobWorkerThread:run: Job failed: " << err.what() << std::endl;
         }
+        m_busy_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+        m_num_jobs += 1;
 
         if (task.callback)
         {
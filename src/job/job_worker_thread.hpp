@@ -19,8 +19,10 @@
 #ifndef HEADER_GALAPIX_JOB_JOB_WORKER_THREAD_HPP
 #define HEADER_GALAPIX_JOB_JOB_WORKER_THREAD_HPP
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <stdint.h>
 
 #include "job/thread_message_queue2.hpp"
 #include "job/thread.hpp"
@@ -46,6 +48,10 @@ private:
   ThreadMessageQueue2<Task> m_queue;
   bool m_quit;
   bool m_abort;
+
+  /** Time spend in Job::run() in microseconds */
+  std::atomic<int64_t> m_busy_time;
+  std::atomic<int> m_num_jobs;
   
 public:
   JobWorkerThread();
@@ -59,6 +65,9 @@ public:
   void abort_thread();
 
   bool empty() { return m_queue.empty(); }
+
+  int64_t get_busy_time() const { return m_busy_time; }
+  int get_num_jobs() const { return m_num_jobs; }
   
 private:
   JobWorkerThread (const JobWorkerThread&);
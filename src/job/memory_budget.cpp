@@ -0,0 +1,112 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "job/memory_budget.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+
+MemoryBudget::MemoryBudget(size_t budget) :
+  m_budget(budget),
+  m_reserved(0),
+  m_peak(0),
+  m_num_reservations(0),
+  m_mutex(),
+  m_cond()
+{
+}
+
+MemoryBudget::~MemoryBudget()
+{
+  assert(m_num_reservations == 0);
+}
+
+size_t
+MemoryBudget::clamp(size_t bytes) const
+{
+  if (m_budget == 0)
+  {
+    return bytes;
+  }
+  else
+  {
+    return std::min(bytes, m_budget);
+  }
+}
+
+bool
+MemoryBudget::acquire(size_t bytes_in, const std::function<bool ()>& abort_condition)
+{
+  size_t bytes = clamp(bytes_in);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while(m_budget != 0 &&
+        m_num_reservations != 0 &&
+        m_reserved + bytes > m_budget)
+  {
+    // abort_condition() has no way to notify us, so we have to poll
+    m_cond.wait_for(lock, std::chrono::milliseconds(100));
+
+    if (abort_condition && abort_condition())
+    {
+      return false;
+    }
+  }
+
+  m_reserved += bytes;
+  m_num_reservations += 1;
+  m_peak = std::max(m_peak, m_reserved);
+
+  return true;
+}
+
+void
+MemoryBudget::release(size_t bytes_in)
+{
+  size_t bytes = clamp(bytes_in);
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    assert(m_num_reservations > 0);
+    assert(m_reserved >= bytes);
+
+    m_reserved -= bytes;
+    m_num_reservations -= 1;
+  }
+
+  m_cond.notify_all();
+}
+
+size_t
+MemoryBudget::get_reserved()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_reserved;
+}
+
+size_t
+MemoryBudget::get_peak()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_peak;
+}
+
+/* EOF */
@@ -0,0 +1,74 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOB_MEMORY_BUDGET_HPP
+#define HEADER_GALAPIX_JOB_MEMORY_BUDGET_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+
+#include "util/currenton.hpp"
+
+/** The MemoryBudget limits the amount of memory that Jobs can hold
+    in the form of decoded images at the same time. A Job has to
+    acquire() the estimated number of bytes before it starts
+    decoding, if the budget is exhausted it blocks till other Jobs
+    release() their share. */
+class MemoryBudget : public Currenton<MemoryBudget>
+{
+private:
+  size_t m_budget;
+  size_t m_reserved;
+  size_t m_peak;
+  int    m_num_reservations;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+
+public:
+  /** @param budget maximum number of bytes, 0 means unlimited */
+  MemoryBudget(size_t budget);
+  ~MemoryBudget();
+
+  /** Blocks till \a bytes are available, a request larger then the
+      whole budget is granted once no other reservation is active.
+
+      @return false if \a abort_condition became true while waiting,
+      nothing is reserved in that case */
+  bool acquire(size_t bytes, const std::function<bool ()>& abort_condition = std::function<bool ()>());
+
+  /** Gives back \a bytes previously reserved with acquire() */
+  void release(size_t bytes);
+
+  size_t get_budget() const { return m_budget; }
+  size_t get_reserved();
+  size_t get_peak();
+
+private:
+  size_t clamp(size_t bytes) const;
+
+private:
+  MemoryBudget(const MemoryBudget&);
+  MemoryBudget& operator=(const MemoryBudget&);
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,381 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOB_MPSC_QUEUE_HPP
+#define HEADER_GALAPIX_JOB_MPSC_QUEUE_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <utility>
+
+/** A bounded lock-free multi-producer/single-consumer queue, push
+    and pop don't touch a mutex as long as they don't have to wait.
+    The API mirrors ThreadMessageQueue2, but only a single thread may
+    pop from the queue. Based on Dmitry Vyukov's bounded MPMC queue,
+    each cell carries a sequence number that tells producers and the
+    consumer whose turn it is. */
+template<typename Data>
+class MPSCQueue
+{
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    Data data;
+
+    Cell() :
+      sequence(0),
+      data()
+    {}
+  };
+
+  /** Number of try_push()/try_pop() attempts before falling back to
+      waiting on the condition variable */
+  static const int kSpinCount = 64;
+
+  std::unique_ptr<Cell[]> m_cells;
+  size_t m_mask;
+
+  // keep the producer and the consumer position on separate cache lines
+  char m_pad0[64];
+  std::atomic<size_t> m_enqueue_pos;
+  char m_pad1[64];
+  std::atomic<size_t> m_dequeue_pos;
+  char m_pad2[64];
+
+  /** Number of threads blocked in a wait function, pushing and
+      popping only need to touch the mutex when they are non-zero */
+  std::atomic<int> m_push_waiters;
+  std::atomic<int> m_pop_waiters;
+
+  /** Data that didn't fit into the queue, see force_push() */
+  std::deque<Data> m_spilled;
+  std::atomic<int> m_num_spilled;
+
+  std::mutex m_mutex;
+  std::condition_variable m_queue_not_empty_cond;
+  std::condition_variable m_queue_not_full_cond;
+
+public:
+  /** @param max_size capacity of the queue, rounded up to the next power of two */
+  MPSCQueue(int max_size) :
+    m_cells(),
+    m_mask(0),
+    m_pad0(),
+    m_enqueue_pos(0),
+    m_pad1(),
+    m_dequeue_pos(0),
+    m_pad2(),
+    m_push_waiters(0),
+    m_pop_waiters(0),
+    m_spilled(),
+    m_num_spilled(0),
+    m_mutex(),
+    m_queue_not_empty_cond(),
+    m_queue_not_full_cond()
+  {
+    assert(max_size > 0);
+
+    size_t capacity = 2;
+    while(capacity < static_cast<size_t>(max_size))
+    {
+      capacity *= 2;
+    }
+
+    m_cells.reset(new Cell[capacity]);
+    m_mask = capacity - 1;
+
+    for(size_t i = 0; i < capacity; ++i)
+    {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MPSCQueue()
+  {
+  }
+
+  int capacity() const
+  {
+    return static_cast<int>(m_mask + 1);
+  }
+
+  /** The result is only a snapshot when other threads are pushing */
+  int size() const
+  {
+    size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_acquire);
+    size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_acquire);
+    return static_cast<int>(enqueue_pos - dequeue_pos) + m_num_spilled.load(std::memory_order_relaxed);
+  }
+
+  bool full() const
+  {
+    size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_acquire);
+    size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_acquire);
+    return static_cast<int>(enqueue_pos - dequeue_pos) >= capacity();
+  }
+
+  bool empty() const
+  {
+    return size() <= 0;
+  }
+
+  /** Try to push data on the queue, if the queue is full, fail and return false */
+  bool try_push(const Data& data)
+  {
+    return push_impl(data);
+  }
+
+  /** Like try_push(const Data&), but moves \a data into the queue,
+      \a data is left untouched when the queue is full */
+  bool try_push(Data&& data)
+  {
+    return push_impl(std::move(data));
+  }
+
+  /** Push data on the queue, if the queue is currently full, wait
+      till it is no longer full */
+  void wait_and_push(const Data& data)
+  {
+    for(int i = 0; i < kSpinCount; ++i)
+    {
+      if (try_push(data))
+      {
+        return;
+      }
+      std::this_thread::yield();
+    }
+
+    // try_push() might have to take the mutex itself to wake up the
+    // consumer, so it can't be called while holding the lock
+    while(!try_push(data))
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_push_waiters.fetch_add(1);
+      m_queue_not_full_cond.wait(lock, [this]{ return !full(); });
+      m_push_waiters.fetch_sub(1);
+    }
+  }
+
+  /** Push data on the queue without ever blocking, if the queue is
+      full the data goes into an overflow list that is protected by a
+      mutex. Once the list is non-empty, everything pushed with
+      force_push() goes there as well till the consumer drained it, so
+      the data of one producer stays in order. The list has no limit,
+      it is meant for producers that can't wait on the consumer, but
+      only send a bounded amount of data, like the tiles that were
+      requested. */
+  void force_push(const Data& data)
+  {
+    if (m_num_spilled.load(std::memory_order_acquire) != 0 ||
+        !try_push(data))
+    {
+      spill(Data(data));
+    }
+  }
+
+  void force_push(Data&& data)
+  {
+    if (m_num_spilled.load(std::memory_order_acquire) != 0 ||
+        !try_push(std::move(data)))
+    {
+      spill(std::move(data));
+    }
+  }
+
+  /** Waits till the queue is ready to accept a push */
+  void wait_for_push(std::function<bool ()> abort_condition)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_push_waiters.fetch_add(1);
+    m_queue_not_full_cond.wait(lock, [this, &abort_condition]{
+        return !full() || abort_condition();
+      });
+    m_push_waiters.fetch_sub(1);
+  }
+
+  /** Try pop data from the queue, if it's empty return false, must
+      only be called from the consumer thread */
+  bool try_pop(Data& data_out)
+  {
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    Cell& cell = m_cells[pos & m_mask];
+    size_t seq = cell.sequence.load(std::memory_order_acquire);
+    if (seq != pos + 1)
+    {
+      // the queue is empty or the producer hasn't finished writing the
+      // cell, check the overflow list before giving up, it only
+      // contains data that was pushed after what is in the queue
+      if (m_num_spilled.load(std::memory_order_acquire) == 0)
+      {
+        return false;
+      }
+      else
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        data_out = std::move(m_spilled.front());
+        m_spilled.pop_front();
+        m_num_spilled.fetch_sub(1);
+        return true;
+      }
+    }
+    else
+    {
+      data_out = std::move(cell.data);
+      // don't keep whatever the data references alive till the cell gets reused
+      cell.data = Data();
+
+      cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+      m_dequeue_pos.store(pos + 1, std::memory_order_release);
+
+      notify(m_push_waiters, m_queue_not_full_cond);
+
+      return true;
+    }
+  }
+
+  /** Pop data from the queue, if it's empty, wait till data is available */
+  void wait_and_pop(Data& data_out)
+  {
+    for(int i = 0; i < kSpinCount; ++i)
+    {
+      if (try_pop(data_out))
+      {
+        return;
+      }
+      std::this_thread::yield();
+    }
+
+    while(!try_pop(data_out))
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_pop_waiters.fetch_add(1);
+      m_queue_not_empty_cond.wait(lock, [this]{ return ready_to_pop(); });
+      m_pop_waiters.fetch_sub(1);
+    }
+  }
+
+  /** wait till the queue allows a pop */
+  void wait_for_pop(std::function<bool ()> abort_condition)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pop_waiters.fetch_add(1);
+    m_queue_not_empty_cond.wait(lock, [this, &abort_condition]{
+        return ready_to_pop() || abort_condition();
+      });
+    m_pop_waiters.fetch_sub(1);
+  }
+
+  void wakeup()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+    }
+    m_queue_not_full_cond.notify_all();
+    m_queue_not_empty_cond.notify_all();
+  }
+
+private:
+  void spill(Data&& data)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_spilled.push_back(std::move(data));
+      m_num_spilled.fetch_add(1);
+    }
+    m_queue_not_empty_cond.notify_all();
+  }
+
+  template<typename T>
+  bool push_impl(T&& data)
+  {
+    Cell* cell;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    for(;;)
+    {
+      cell = &m_cells[pos & m_mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+      if (diff == 0)
+      {
+        // the cell is free, try to claim it
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        // the consumer hasn't freed the cell yet, the queue is full
+        return false;
+      }
+      else
+      {
+        // another producer claimed the cell, retry with the new position
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = std::forward<T>(data);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    notify(m_pop_waiters, m_queue_not_empty_cond);
+
+    return true;
+  }
+
+  bool ready_to_pop() const
+  {
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    return
+      m_cells[pos & m_mask].sequence.load(std::memory_order_acquire) == pos + 1 ||
+      m_num_spilled.load(std::memory_order_relaxed) != 0;
+  }
+
+  /** Wakes up the other side if somebody is waiting, the fence pairs
+      with the fetch_add() in the wait functions, so either the waiter
+      sees the new state of the queue or we see the waiter */
+  void notify(std::atomic<int>& waiters, std::condition_variable& cond)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) != 0)
+    {
+      // taking the mutex makes sure the waiter is either not yet
+      // checking the queue or already blocked in wait()
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+      }
+      cond.notify_all();
+    }
+  }
+
+private:
+  MPSCQueue(const MPSCQueue&);
+  MPSCQueue& operator=(const MPSCQueue&);
+};
+
+#endif
+
+/* EOF */
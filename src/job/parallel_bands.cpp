@@ -0,0 +1,230 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "job/parallel_bands.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/** A parallel_bands() call, the bands [0, num_shared) are handed
+    out to whoever comes first, the helpers or the calling thread */
+struct BandCall
+{
+  const std::function<void (int, int)>& func;
+  int begin;
+  int count;
+  int num_bands;
+  int num_shared;
+
+  std::atomic<int> next;
+  int num_done;
+  std::vector<std::exception_ptr> errors;
+
+  BandCall(const std::function<void (int, int)>& func_, int begin_, int count_, int num_bands_) :
+    func(func_),
+    begin(begin_),
+    count(count_),
+    num_bands(num_bands_),
+    num_shared(num_bands_ - 1),
+    next(0),
+    num_done(0),
+    errors(static_cast<size_t>(num_bands_))
+  {}
+
+  /** Runs band \a i, errors are kept for the calling thread */
+  void run(int i)
+  {
+    try
+    {
+      func(begin + count * i / num_bands,
+           begin + count * (i + 1) / num_bands);
+    }
+    catch(...)
+    {
+      errors[static_cast<size_t>(i)] = std::current_exception();
+    }
+  }
+
+private:
+  BandCall(const BandCall&);
+  BandCall& operator=(const BandCall&);
+};
+
+typedef std::shared_ptr<BandCall> BandCallPtr;
+
+class BandThreadPool
+{
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_work_cond;
+  std::condition_variable m_done_cond;
+  std::deque<BandCallPtr> m_calls;
+  bool m_quit;
+  std::vector<std::thread> m_threads;
+
+public:
+  BandThreadPool() :
+    m_mutex(),
+    m_work_cond(),
+    m_done_cond(),
+    m_calls(),
+    m_quit(false),
+    m_threads()
+  {
+    const int num_threads = std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    for(int i = 0; i < num_threads; ++i)
+    {
+      m_threads.push_back(std::thread(&BandThreadPool::run, this));
+    }
+  }
+
+  ~BandThreadPool()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_work_cond.notify_all();
+
+    for(auto& thread: m_threads)
+    {
+      thread.join();
+    }
+  }
+
+  /** Runs all bands of \a call, returns once they are done */
+  void execute(const BandCallPtr& call)
+  {
+    if (!m_threads.empty())
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_calls.push_back(call);
+      }
+      m_work_cond.notify_all();
+    }
+
+    call->run(call->num_bands - 1);
+
+    int num_run = 0;
+    for(int i = call->next++; i < call->num_shared; i = call->next++)
+    {
+      call->run(i);
+      num_run += 1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    call->num_done += num_run;
+    m_done_cond.wait(lock, [&call]{ return call->num_done == call->num_shared; });
+
+    // the helpers drop the call once they find no more bands in it,
+    // but they might not have looked at it yet
+    m_calls.erase(std::remove(m_calls.begin(), m_calls.end(), call), m_calls.end());
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;)
+    {
+      m_work_cond.wait(lock, [this]{ return m_quit || !m_calls.empty(); });
+      if (m_quit)
+      {
+        return;
+      }
+
+      BandCallPtr call = m_calls.front();
+      int i = call->next++;
+      if (i >= call->num_shared)
+      {
+        if (!m_calls.empty() && m_calls.front() == call)
+        {
+          m_calls.pop_front();
+        }
+      }
+      else
+      {
+        lock.unlock();
+        call->run(i);
+        lock.lock();
+
+        call->num_done += 1;
+        if (call->num_done == call->num_shared)
+        {
+          m_done_cond.notify_all();
+        }
+      }
+    }
+  }
+
+private:
+  BandThreadPool(const BandThreadPool&);
+  BandThreadPool& operator=(const BandThreadPool&);
+};
+
+BandThreadPool& get_pool()
+{
+  static BandThreadPool pool;
+  return pool;
+}
+
+} // namespace
+
+void parallel_bands(int begin, int end, int num_bands,
+                    const std::function<void (int, int)>& func)
+{
+  int count = end - begin;
+  if (num_bands > count)
+  {
+    num_bands = count;
+  }
+
+  if (num_bands <= 1)
+  {
+    if (count > 0)
+    {
+      func(begin, end);
+    }
+  }
+  else
+  {
+    BandCallPtr call = std::make_shared<BandCall>(func, begin, count, num_bands);
+    get_pool().execute(call);
+
+    for(auto& error: call->errors)
+    {
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,38 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HEADER_GALAPIX_JOB_PARALLEL_BANDS_HPP
+#define HEADER_GALAPIX_JOB_PARALLEL_BANDS_HPP
+
+#include <functional>
+
+/** Splits the range [begin, end) into \a num_bands bands of roughly
+    equal size and calls \a func(band_begin, band_end) for each of
+    them. The last band always runs in the calling thread, the others
+    are shared with a pool of hardware_concurrency() - 1 helper
+    threads, which is started once and used by all callers, the
+    calling thread takes whatever bands the helpers didn't get to.
+    Returns when all bands are done, an exception thrown by \a func is
+    rethrown here. */
+void parallel_bands(int begin, int end, int num_bands,
+                    const std::function<void (int, int)>& func);
+
+#endif
+
+/* EOF */
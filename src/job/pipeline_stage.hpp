@@ -0,0 +1,224 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOB_PIPELINE_STAGE_HPP
+#define HEADER_GALAPIX_JOB_PIPELINE_STAGE_HPP
+
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job/thread_message_queue2.hpp"
+
+/** A PipelineStage is a queue with a number of threads that take
+    items from it and pass them to a process function, which normally
+    pushes its results into the next stage. A bounded queue makes
+    push() block when the stage can't keep up, so the slowest stage
+    throttles the ones before it. */
+template<typename Input>
+class PipelineStage
+{
+private:
+  std::string m_name;
+  int m_num_threads;
+  std::function<void (Input&)> m_process;
+
+  ThreadMessageQueue2<Input> m_queue;
+  int m_max_queue_size;
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_quit;
+
+  std::chrono::steady_clock::time_point m_start_time;
+  std::chrono::steady_clock::time_point m_end_time;
+
+  std::atomic<int> m_num_items;
+
+  /** Time spend in the process function in microseconds */
+  std::atomic<int64_t> m_busy_time;
+
+  /** Queue depth as seen by push(), for the statistics */
+  std::atomic<int64_t> m_queue_depth_sum;
+  std::atomic<int> m_queue_depth_max;
+  std::atomic<int> m_num_pushes;
+
+public:
+  /** @param max_queue_size number of items that can wait in the
+      stage, -1 for unlimited */
+  PipelineStage(const std::string& name, int num_threads, int max_queue_size,
+                const std::function<void (Input&)>& process) :
+    m_name(name),
+    m_num_threads(num_threads),
+    m_process(process),
+    m_queue(max_queue_size),
+    m_max_queue_size(max_queue_size),
+    m_threads(),
+    m_quit(false),
+    m_start_time(),
+    m_end_time(),
+    m_num_items(0),
+    m_busy_time(0),
+    m_queue_depth_sum(0),
+    m_queue_depth_max(0),
+    m_num_pushes(0)
+  {
+    assert(num_threads > 0);
+  }
+
+  ~PipelineStage()
+  {
+    assert(m_threads.empty());
+  }
+
+  void start()
+  {
+    m_start_time = std::chrono::steady_clock::now();
+    for(int i = 0; i < m_num_threads; ++i)
+    {
+      m_threads.push_back(std::thread([this]{ run(); }));
+    }
+  }
+
+  /** Processes the remaining items and waits till all threads are
+      done, the stages feeding into this one have to be finished
+      first */
+  void finish()
+  {
+    m_quit = true;
+    m_queue.wakeup();
+
+    for(auto& thread: m_threads)
+    {
+      thread.join();
+    }
+    m_threads.clear();
+
+    m_end_time = std::chrono::steady_clock::now();
+  }
+
+  /** Add \a item to the queue, blocks while the queue is full */
+  void push(const Input& item)
+  {
+    m_queue.wait_and_push(item);
+
+    int depth = m_queue.size();
+    m_queue_depth_sum += depth;
+    m_num_pushes += 1;
+
+    int max_depth = m_queue_depth_max;
+    while(depth > max_depth && !m_queue_depth_max.compare_exchange_weak(max_depth, depth)) {}
+  }
+
+  bool empty() const { return m_queue.empty(); }
+  int  size()  const { return m_queue.size(); }
+
+  int get_num_items() const { return m_num_items; }
+
+  /** Processed items per second */
+  float get_throughput() const
+  {
+    double sec = std::chrono::duration<double>(get_elapsed_time()).count();
+    return (sec > 0.0) ? static_cast<float>(m_num_items / sec) : 0.0f;
+  }
+
+  /** Fraction of time the threads spend in the process function */
+  float get_utilization() const
+  {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(get_elapsed_time()).count();
+    return (elapsed > 0) ? static_cast<float>(static_cast<double>(m_busy_time) / static_cast<double>(elapsed * m_num_threads)) : 0.0f;
+  }
+
+  float get_average_queue_depth() const
+  {
+    return (m_num_pushes > 0) ? static_cast<float>(static_cast<double>(m_queue_depth_sum) / m_num_pushes) : 0.0f;
+  }
+
+  int get_max_queue_depth() const { return m_queue_depth_max; }
+
+  void print_stats(std::ostream& out) const
+  {
+    out << std::setw(8) << std::left << m_name << std::right
+        << std::setw(3) << m_num_threads << " threads, "
+        << std::setw(7) << m_num_items << " items, "
+        << std::fixed << std::setprecision(1)
+        << std::setw(8) << get_throughput() << " items/sec, "
+        << std::setw(3) << static_cast<int>(get_utilization() * 100.0f) << "% busy, "
+        << "queue depth avg " << get_average_queue_depth() << " max " << get_max_queue_depth();
+    if (m_max_queue_size > 0)
+    {
+      out << "/" << m_max_queue_size;
+    }
+    out << std::endl;
+  }
+
+private:
+  std::chrono::steady_clock::duration get_elapsed_time() const
+  {
+    if (m_threads.empty())
+    {
+      return m_end_time - m_start_time;
+    }
+    else
+    {
+      return std::chrono::steady_clock::now() - m_start_time;
+    }
+  }
+
+  void run()
+  {
+    for(;;)
+    {
+      m_queue.wait_for_pop([this]{ return m_quit.load(); });
+
+      Input item;
+      if (m_queue.try_pop(item))
+      {
+        auto start_time = std::chrono::steady_clock::now();
+        try
+        {
+          m_process(item);
+        }
+        catch(const std::exception& err)
+        {
+          std::cout << "PipelineStage: " << m_name << ": " << err.what() << std::endl;
+        }
+        m_busy_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+        m_num_items += 1;
+      }
+      else if (m_quit)
+      {
+        break;
+      }
+    }
+  }
+
+private:
+  PipelineStage(const PipelineStage&);
+  PipelineStage& operator=(const PipelineStage&);
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,81 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOB_SEMAPHORE_HPP
+#define HEADER_GALAPIX_JOB_SEMAPHORE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+/** A simple counting semaphore */
+class Semaphore
+{
+private:
+  int m_count;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+
+public:
+  Semaphore(int count) :
+    m_count(count),
+    m_mutex(),
+    m_cond()
+  {}
+
+  /** Blocks till the count is larger then zero and decrements it
+
+      @return false if \a abort_condition became true while waiting,
+      the count is left untouched in that case */
+  bool acquire(const std::function<bool ()>& abort_condition = std::function<bool ()>())
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_count <= 0)
+    {
+      // abort_condition() has no way to notify us, so we have to poll
+      m_cond.wait_for(lock, std::chrono::milliseconds(100));
+
+      if (abort_condition && abort_condition())
+      {
+        return false;
+      }
+    }
+
+    m_count -= 1;
+    return true;
+  }
+
+  void release()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_count += 1;
+    }
+    m_cond.notify_one();
+  }
+
+private:
+  Semaphore(const Semaphore&);
+  Semaphore& operator=(const Semaphore&);
+};
+
+#endif
+
+/* EOF */
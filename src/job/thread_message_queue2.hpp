@@ -58,7 +58,7 @@ public:
   int size() const
   {
     std::unique_lock<std::mutex> lock(m_mutex);
-    return m_queue.size();
+    return static_cast<int>(m_queue.size());
   }
 
   bool empty() const
@@ -161,6 +161,11 @@ public:
 
   void wakeup()
   {
+    {
+      // make sure waiters are either blocked in wait() or haven't
+      // checked their condition yet, so the notification isn't lost
+      std::unique_lock<std::mutex> lock(m_mutex);
+    }
     m_queue_not_full_cond.notify_all();
     m_queue_not_empty_cond.notify_all();
   }
@@ -0,0 +1,116 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jobs/fetch_job.hpp"
+
+#include "job/job_manager.hpp"
+#include "job/semaphore.hpp"
+#include "plugins/jpeg.hpp"
+#include "util/log.hpp"
+#include "util/software_surface_factory.hpp"
+#include "util/software_surface_loader.hpp"
+
+FetchJob::FetchJob(std::shared_ptr<Job> job, const URL& url,
+                   const std::function<void (BlobPtr, const std::string&)>& blob_callback,
+                   JobManager& cpu_job_manager,
+                   const Callback& callback,
+                   Semaphore& slots) :
+  Job(job->get_handle()),
+  m_job(job),
+  m_url(url),
+  m_blob_callback(blob_callback),
+  m_cpu_job_manager(cpu_job_manager),
+  m_callback(callback),
+  m_slots(slots)
+{
+}
+
+void
+FetchJob::run()
+{
+  if (!m_slots.acquire([this]{ return is_aborted(); }))
+  {
+    if (m_callback)
+    {
+      m_callback(m_job, false);
+    }
+  }
+  else
+  {
+    try
+    {
+      std::string mime_type;
+      BlobPtr blob = m_url.get_blob(&mime_type);
+      m_blob_callback(blob, mime_type);
+    }
+    catch(const std::exception& err)
+    {
+      // the Job will try again on its own and report the error
+      log_warning << m_url << ": " << err.what() << std::endl;
+    }
+
+    Semaphore& slots = m_slots;
+    Callback callback = m_callback;
+    m_cpu_job_manager.request(m_job,
+                              [&slots, callback](std::shared_ptr<Job> job, bool success) {
+                                slots.release();
+                                if (callback)
+                                {
+                                  callback(job, success);
+                                }
+                              });
+  }
+}
+
+JobHandle
+FetchJob::request(JobManager& io_job_manager, std::shared_ptr<FetchJob> fetch_job)
+{
+  return io_job_manager.request(fetch_job,
+                                [](std::shared_ptr<Job> job, bool success) {
+                                  if (!success)
+                                  {
+                                    // the Job got aborted before it could be fetched
+                                    FetchJob& self = static_cast<FetchJob&>(*job);
+                                    if (self.m_callback)
+                                    {
+                                      self.m_callback(self.m_job, false);
+                                    }
+                                  }
+                                });
+}
+
+bool
+FetchJob::wants_prefetch(const URL& url)
+{
+  if (!url.has_stdio_name())
+  {
+    // archive members and remote files have to be fetched anyway
+    return true;
+  }
+  else if (JPEG::filename_is_jpeg(url.str()))
+  {
+    return true;
+  }
+  else
+  {
+    const SoftwareSurfaceLoader* loader = SoftwareSurfaceFactory::current().find_loader_by_filename(url.get_stdio_name());
+    return loader && loader->supports_from_mem();
+  }
+}
+
+/* EOF */
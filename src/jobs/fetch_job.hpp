@@ -0,0 +1,85 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOBS_FETCH_JOB_HPP
+#define HEADER_GALAPIX_JOBS_FETCH_JOB_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "job/job.hpp"
+#include "util/url.hpp"
+
+class JobManager;
+class Semaphore;
+
+/**
+ * FetchJob runs in the I/O JobManager, it reads the content of a URL
+ * into a Blob, hands it to the Job that needs it and then submits
+ * that Job to the CPU JobManager. This way slow disks, archive
+ * extraction and network transfers don't block the threads doing
+ * the decoding.
+ */
+class FetchJob : public Job
+{
+public:
+  typedef std::function<void (std::shared_ptr<Job>, bool)> Callback;
+
+private:
+  std::shared_ptr<Job> m_job;
+  URL m_url;
+  std::function<void (BlobPtr, const std::string&)> m_blob_callback;
+
+  JobManager& m_cpu_job_manager;
+  Callback m_callback;
+
+  /** Limits the number of Blobs that are fetched, but not yet
+      processed by the CPU JobManager */
+  Semaphore& m_slots;
+
+public:
+  /** @param job            the Job that will process the data
+      @param blob_callback  gets the fetched Blob and mime-type before \a job is submitted
+      @param callback       passed on to JobManager::request() along with \a job */
+  FetchJob(std::shared_ptr<Job> job, const URL& url,
+           const std::function<void (BlobPtr, const std::string&)>& blob_callback,
+           JobManager& cpu_job_manager,
+           const Callback& callback,
+           Semaphore& slots);
+
+  void run();
+
+  bool is_aborted() { return m_job->is_aborted(); }
+
+  /** Submit the FetchJob to \a io_job_manager, takes care that \a
+      callback gets called even when the FetchJob never runs */
+  static JobHandle request(JobManager& io_job_manager, std::shared_ptr<FetchJob> fetch_job);
+
+  /** Returns true if loading \a url will benefit from fetching its
+      content in advance, false if the loader needs the file itself */
+  static bool wants_prefetch(const URL& url);
+
+private:
+  FetchJob(const FetchJob&);
+  FetchJob& operator=(const FetchJob&);
+};
+
+#endif
+
+/* EOF */
@@ -18,6 +18,7 @@
 
 #include "jobs/file_entry_generation_job.hpp"
 
+#include "job/memory_budget.hpp"
 #include "jobs/tile_generator.hpp"
 #include "plugins/jpeg.hpp"
 #include "util/filesystem.hpp"
@@ -27,17 +28,34 @@
 FileEntryGenerationJob::FileEntryGenerationJob(const JobHandle& job_handle, const URL& url) :
   Job(job_handle),
   m_url(url),
+  m_blob(),
+  m_mime_type(),
   m_sig_file_callback(),
   m_sig_tile_callback()
 {
 }
 
+void
+FileEntryGenerationJob::set_blob(BlobPtr blob, const std::string& mime_type)
+{
+  m_blob = blob;
+  m_mime_type = mime_type;
+}
+
 void
 FileEntryGenerationJob::run()
 {
+  size_t reserved_bytes = 0;
+  bool   reserved = false;
+  bool   failed = false;
+
+  BlobPtr prefetched_blob;
+  prefetched_blob.swap(m_blob);
+
   try 
   {
     SoftwareSurfacePtr surface;
+    SoftwareSurface::Modifier orientation = SoftwareSurface::kRot0;
     Size size;
     int min_scale;
     int max_scale;
@@ -46,9 +64,13 @@ FileEntryGenerationJob::run()
     // FIXME: JPEG::filename_is_jpeg() is ugly
     if (!m_url.is_remote() && JPEG::filename_is_jpeg(m_url.str()))
     {
-      BlobPtr blob;
+      BlobPtr blob = prefetched_blob;
 
-      if (m_url.has_stdio_name())
+      if (blob)
+      {
+        size = JPEG::get_size(blob->get_data(), blob->size());
+      }
+      else if (m_url.has_stdio_name())
       {
         size = JPEG::get_size(m_url.get_stdio_name());
       }
@@ -71,25 +93,57 @@ FileEntryGenerationJob::run()
       // min_scale to that
       min_scale = Math::min(min_scale, 3);
 
+      reserved_bytes = TileGenerator::estimate_memory_usage(m_url, size, min_scale);
+      if (!MemoryBudget::current().acquire(reserved_bytes, [this]{ return is_aborted(); }))
+      {
+        return;
+      }
+      reserved = true;
+
       // FIXME: recalc min_scale from jpeg scale
       if (!blob)
       {
-        surface = JPEG::load_from_file(m_url.get_stdio_name(), Math::pow2(min_scale));
+        surface = JPEG::load_from_file(m_url.get_stdio_name(), Math::pow2(min_scale), NULL, &orientation);
       }
       else
       {
-        surface = JPEG::load_from_mem(blob->get_data(), blob->size(), Math::pow2(min_scale));
+        surface = JPEG::load_from_mem(blob->get_data(), blob->size(), Math::pow2(min_scale), NULL, &orientation);
       }
     }
     else
     {
+      // archive members and remote urls have no size of their own
+      // before they are read, from_url() would read them anyway
+      if (!prefetched_blob && !m_url.has_stdio_name())
+      {
+        prefetched_blob = m_url.get_blob(&m_mime_type);
+      }
+
+      // The image size isn't known before loading, so guess from the
+      // file size, assuming a compression ratio of about 1:8
+      reserved_bytes = 8 * static_cast<size_t>(prefetched_blob ? prefetched_blob->size() : m_url.get_size());
+      if (!MemoryBudget::current().acquire(reserved_bytes, [this]{ return is_aborted(); }))
+      {
+        return;
+      }
+      reserved = true;
+
       // FIXME: On http:// transfer mtime and size must be got from the transfer itself, not afterwards
-      surface = SoftwareSurfaceFactory::current().from_url(m_url);
+      if (prefetched_blob)
+      {
+        surface = SoftwareSurfaceFactory::current().from_blob(m_url, prefetched_blob, m_mime_type);
+        prefetched_blob.reset();
+      }
+      else
+      {
+        surface = SoftwareSurfaceFactory::current().from_url(m_url);
+      }
       size = surface->get_size();
       int format = FileEntry::UNKNOWN_FORMAT;
       switch(surface->get_format())
       {
         case SoftwareSurface::RGB_FORMAT:
+        case SoftwareSurface::L8_FORMAT:
           format = FileEntry::JPEG_FORMAT;
           break;
 
@@ -106,19 +160,37 @@ FileEntryGenerationJob::run()
     m_sig_file_callback(file_entry);
     
     TileGenerator::cut_into_tiles(surface, size, min_scale, max_scale, 
-                                  std::bind(&FileEntryGenerationJob::process_tile, this, file_entry, std::placeholders::_1));
+                                  std::bind(&FileEntryGenerationJob::process_tile, this, file_entry, std::placeholders::_1),
+                                  orientation);
   }
   catch(const std::exception& err)
   {
     log_error << "Error while processing " << m_url << std::endl;
     log_error << "  Exception: " << err.what() << std::endl;
+    failed = true;
+  }
+
+  if (reserved)
+  {
+    MemoryBudget::current().release(reserved_bytes);
+  }
+
+  if (failed)
+  {
+    get_handle().set_failed();
+  }
+  else
+  {
+    get_handle().set_finished();
   }
 }
 
 void
 FileEntryGenerationJob::process_tile(const FileEntry& file_entry, const Tile& tile)
 {
-  m_sig_tile_callback(file_entry, tile);
+  // a copy, so the tile doesn't keep the whole level alive, see
+  // TileGenerationJob::process_tile()
+  m_sig_tile_callback(file_entry, Tile(tile.get_scale(), tile.get_pos(), tile.get_surface()->clone()));
 }
 
 /* EOF */
@@ -32,6 +32,10 @@ class FileEntryGenerationJob : public Job
 private:
   URL m_url;
 
+  /** Content of m_url if it was already fetched by a FetchJob */
+  BlobPtr     m_blob;
+  std::string m_mime_type;
+
   boost::signals2::signal<void (FileEntry)>       m_sig_file_callback;
   boost::signals2::signal<void (FileEntry, Tile)> m_sig_tile_callback;
 
@@ -40,6 +44,10 @@ public:
 
   void run();
 
+  /** Hand over the already fetched content of the URL, must be called
+      before the Job is submitted to a JobManager */
+  void set_blob(BlobPtr blob, const std::string& mime_type);
+
   boost::signals2::signal<void (FileEntry)>& sig_file_callback() { return m_sig_file_callback; }
   boost::signals2::signal<void (FileEntry, Tile)>& sig_tile_callback() { return m_sig_tile_callback; }
 
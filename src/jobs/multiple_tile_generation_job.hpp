@@ -23,6 +23,7 @@
 
 #include "jobs/tile_generator.hpp"
 #include "job/job.hpp"
+#include "job/memory_budget.hpp"
 
 /**
  * Simple Job for generating a range of Tiles, it doesn't allow any
@@ -38,6 +39,10 @@ private:
   int m_max_scale;
   std::function<void (Tile)> m_callback;
 
+  /** Content of the URL if it was already fetched by a FetchJob */
+  BlobPtr     m_blob;
+  std::string m_mime_type;
+
 public:
   MultipleTileGenerationJob(const JobHandle& job_handle, 
                             const FileEntry& file_entry,
@@ -50,9 +55,19 @@ public:
     m_max_scale_in_db(max_scale_in_db),
     m_min_scale(min_scale),
     m_max_scale(max_scale),
-    m_callback(callback)
+    m_callback(callback),
+    m_blob(),
+    m_mime_type()
   {}
 
+  /** Hand over the already fetched content of the URL, must be called
+      before the Job is submitted to a JobManager */
+  void set_blob(BlobPtr blob, const std::string& mime_type)
+  {
+    m_blob = blob;
+    m_mime_type = mime_type;
+  }
+
   void run()
   {
     if (m_min_scale_in_db != -1 &&
@@ -64,9 +79,27 @@ public:
 
     if (m_min_scale_in_db == -1 || m_min_scale < m_min_scale_in_db) // range is non-empty
     {
-      TileGenerator::generate(m_file_entry.get_url(), 
-                              m_min_scale, m_max_scale,
-                              m_callback);
+      size_t reserved_bytes = TileGenerator::estimate_memory_usage(m_file_entry.get_url(),
+                                                                   m_file_entry.get_image_size(),
+                                                                   m_min_scale);
+      if (MemoryBudget::current().acquire(reserved_bytes, [this]{ return is_aborted(); }))
+      {
+        try
+        {
+          BlobPtr blob;
+          blob.swap(m_blob);
+          TileGenerator::generate(m_file_entry.get_url(), std::move(blob), m_mime_type,
+                                  m_min_scale, m_max_scale,
+                                  m_callback);
+        }
+        catch(...)
+        {
+          MemoryBudget::current().release(reserved_bytes);
+          throw;
+        }
+
+        MemoryBudget::current().release(reserved_bytes);
+      }
     }
 
     get_handle().set_finished();
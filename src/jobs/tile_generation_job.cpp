@@ -18,6 +18,9 @@
 
 #include "jobs/tile_generation_job.hpp"
 
+#include <algorithm>
+
+#include "job/memory_budget.hpp"
 #include "math/rect.hpp"
 #include "plugins/jpeg.hpp"
 #include "util/log.hpp"
@@ -31,15 +34,20 @@ TileGenerationJob::TileGenerationJob(const FileEntry& file_entry, int min_scale_
   m_state(kWaiting),
   m_url(file_entry.get_url()),
   m_file_entry(file_entry),
+  m_blob(),
+  m_mime_type(),
   m_min_scale(-1),
   m_max_scale(-1),
   m_min_scale_in_db(min_scale_in_db),
   m_max_scale_in_db(max_scale_in_db),
   m_tile_requests(),
   m_late_tile_requests(),
+  m_regions(),
   m_tiles(),
+  m_reserved_bytes(0),
   m_sig_file_callback(),
-  m_sig_tile_callback()
+  m_sig_tile_callback(),
+  m_sig_region_tile_callback()
 {
 }
 
@@ -48,6 +56,13 @@ TileGenerationJob::~TileGenerationJob()
   // FIXME: Verify that all JobHandles got finished
 }
 
+void
+TileGenerationJob::set_blob(BlobPtr blob, const std::string& mime_type)
+{
+  m_blob = blob;
+  m_mime_type = mime_type;
+}
+
 bool
 TileGenerationJob::request_tile(const JobHandle& job_handle, int scale, const Vector2i& pos,
                                 const std::function<void (Tile)>& callback)
@@ -65,7 +80,9 @@ TileGenerationJob::request_tile(const JobHandle& job_handle, int scale, const Ve
       return true;
 
     case kRunning:
-      if (m_min_scale <= scale && scale <= m_max_scale)
+      if ((m_min_scale <= scale && scale <= m_max_scale) ||
+          (m_regions.count(scale) &&
+           std::find(m_regions[scale].begin(), m_regions[scale].end(), pos) != m_regions[scale].end()))
       {
         m_late_tile_requests.push_back(TileRequest(job_handle, scale, pos, callback));
         return true;
@@ -79,33 +96,22 @@ TileGenerationJob::request_tile(const JobHandle& job_handle, int scale, const Ve
       return false;
 
     case kDone:
-      if (m_min_scale <= scale && scale <= m_max_scale)
+      // the tiles might not have reached the database yet, so they
+      // are served from here till the job gets removed
+      for(Tiles::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i)
       {
-        Tiles::iterator tile_it = m_tiles.end();
-        for(Tiles::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i)
+        if (i->get_scale() == scale && i->get_pos() == pos)
         {
-          if (scale == i->get_scale() &&
-              pos   == i->get_pos())
+          if (callback)
           {
-            tile_it = i;
-            break;
+            callback(*i);
           }
-        }
-
-        if (tile_it != m_tiles.end())
-        {
-          callback(*tile_it);
+          JobHandle handle = job_handle;
+          handle.set_finished();
           return true;
         }
-        else
-        {
-          return false;
-        }
-      }
-      else
-      {
-        return false;
       }
+      return false;
 
     default:
       assert(!"Never reached");
@@ -114,12 +120,48 @@ TileGenerationJob::request_tile(const JobHandle& job_handle, int scale, const Ve
 }
 
 void
-TileGenerationJob::process_tile(const Tile& tile)
+TileGenerationJob::release_tiles()
+{
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  Tiles().swap(m_tiles);
+
+  if (m_reserved_bytes)
+  {
+    MemoryBudget::current().release(m_reserved_bytes);
+    m_reserved_bytes = 0;
+  }
+}
+
+void
+TileGenerationJob::process_tile(const Tile& tile_view)
 {
+  // the tile is a view of a whole level, which the TileCache would
+  // keep alive long after release_tiles() gave back the reservation
+  Tile tile(tile_view.get_scale(), tile_view.get_pos(), tile_view.get_surface()->clone());
+
   m_tiles.push_back(tile);
 
   m_sig_tile_callback(m_file_entry, tile);
 
+  serve_tile(tile);
+}
+
+void
+TileGenerationJob::process_region_tile(const Tile& tile_view)
+{
+  // a view of the decoded region, see process_tile()
+  Tile tile(tile_view.get_scale(), tile_view.get_pos(), tile_view.get_surface()->clone());
+
+  m_tiles.push_back(tile);
+
+  m_sig_region_tile_callback(m_file_entry, tile);
+
+  serve_tile(tile);
+}
+
+void
+TileGenerationJob::serve_tile(const Tile& tile)
+{
   for(TileRequests::iterator i = m_tile_requests.begin(); i != m_tile_requests.end(); ++i)
   {
     if (!i->job_handle.is_aborted() &&
@@ -161,13 +203,69 @@ TileGenerationJob::is_aborted()
   }
 }
 
+TileGenerationJob::Regions
+TileGenerationJob::get_regions() const
+{
+  Regions regions;
+  for(TileRequests::const_iterator i = m_tile_requests.begin(); i != m_tile_requests.end(); ++i)
+  {
+    std::vector<Vector2i>& positions = regions[i->scale];
+    if (std::find(positions.begin(), positions.end(), i->pos) == positions.end())
+    {
+      positions.push_back(i->pos);
+    }
+  }
+
+  for(Regions::const_iterator i = regions.begin(); i != regions.end(); ++i)
+  {
+    if (!TileGenerator::wants_region(m_url, m_file_entry.get_image_size(), i->first, i->second))
+    {
+      return Regions();
+    }
+  }
+
+  return regions;
+}
+
+size_t
+TileGenerationJob::estimate_memory_usage()
+{
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+
+  int min_scale = m_file_entry.get_thumbnail_scale();
+  if (m_url.is_remote() || !JPEG::filename_is_jpeg(m_url.str()))
+  {
+    min_scale = 0;
+  }
+  else
+  {
+    for(TileRequests::iterator i = m_tile_requests.begin(); i != m_tile_requests.end(); ++i)
+    {
+      min_scale = std::min(min_scale, i->scale);
+    }
+  }
+
+  return TileGenerator::estimate_memory_usage(m_url, m_file_entry.get_image_size(), min_scale);
+}
+
 void
 TileGenerationJob::run()
 {
+  // Wait till there is enough memory to decode the image, the job
+  // stays in kWaiting state, so new requests can still be added
+  size_t reserved_bytes = estimate_memory_usage();
+  if (!MemoryBudget::current().acquire(reserved_bytes, [this]{ return is_aborted(); }))
+  {
+    return;
+  }
+
+  Regions regions;
+
   { // Calculate min/max_scale
     std::unique_lock<std::mutex> lock(m_state_mutex);
     assert(m_state == kWaiting);
     m_state = kRunning;
+    m_reserved_bytes = reserved_bytes;
 
     if (m_url.is_remote() || !JPEG::filename_is_jpeg(m_url.str()))
     { 
@@ -197,14 +295,39 @@ TileGenerationJob::run()
         m_min_scale = 0;
         m_max_scale = m_file_entry.get_thumbnail_scale();
       }
+      else
+      {
+        regions = get_regions();
+        if (!regions.empty())
+        {
+          // only late requests for the same tiles can be served from
+          // m_tiles, everything else needs a job of its own
+          m_regions = regions;
+          m_min_scale = 0;
+          m_max_scale = -1;
+        }
+      }
     }
   }
 
   try 
   {
     // Do the main work
-    TileGenerator::generate(m_url, m_min_scale, m_max_scale,
-                            std::bind(&TileGenerationJob::process_tile, this, std::placeholders::_1));
+    BlobPtr blob;
+    blob.swap(m_blob);
+    if (!regions.empty())
+    {
+      for(Regions::const_iterator i = regions.begin(); i != regions.end(); ++i)
+      {
+        TileGenerator::generate_region(m_url, blob, i->first, i->second,
+                                       std::bind(&TileGenerationJob::process_region_tile, this, std::placeholders::_1));
+      }
+    }
+    else
+    {
+      TileGenerator::generate(m_url, std::move(blob), m_mime_type, m_min_scale, m_max_scale,
+                              std::bind(&TileGenerationJob::process_tile, this, std::placeholders::_1));
+    }
   }
   catch(const std::exception& err)
   {
@@ -232,6 +355,8 @@ TileGenerationJob::run()
 
     m_late_tile_requests.clear();
   }
+
+  // the reservation is given back in release_tiles()
 }
 
 /* EOF */
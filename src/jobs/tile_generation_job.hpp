@@ -21,7 +21,9 @@
 
 #include <functional>
 #include <boost/signals2/signal.hpp>
+#include <map>
 #include <mutex>
+#include <vector>
 
 #include "database/file_entry.hpp"
 #include "galapix/tile.hpp"
@@ -49,6 +51,9 @@ private:
   };
 
   typedef std::vector<TileRequest> TileRequests;
+
+  /** Positions of the requested tiles by scale */
+  typedef std::map<int, std::vector<Vector2i> > Regions;
   
 private: 
   std::mutex m_state_mutex;
@@ -63,6 +68,10 @@ private:
   URL       m_url;
   FileEntry m_file_entry;
 
+  /** Content of m_url if it was already fetched by a FetchJob */
+  BlobPtr     m_blob;
+  std::string m_mime_type;
+
   /** Only valid if state is kRunning or kDone */
   int       m_min_scale;
   int       m_max_scale;
@@ -76,32 +85,69 @@ private:
   /** TileRequests that came in when the process was already running */
   TileRequests m_late_tile_requests;
   
+  /** The tiles that get decoded on their own instead of generating
+      the whole pyramid, see TileGenerator::generate_region() */
+  Regions m_regions;
+
+  /** Tiles generated so far, needed to serve late TileRequests and
+      the ones that arrive before the tiles are in the database,
+      cleared by release_tiles() */
   typedef std::vector<Tile> Tiles;
   Tiles m_tiles;
 
+  /** Bytes acquired from the MemoryBudget, held till release_tiles(),
+      as m_tiles and the tiles on their way to the database stay
+      around till then */
+  size_t m_reserved_bytes;
+
   boost::signals2::signal<void (FileEntry)> m_sig_file_callback;
   boost::signals2::signal<void (FileEntry, Tile)> m_sig_tile_callback;
 
+  /** Tiles from m_regions, they can't go into the database, as it
+      expects a scale to be complete once it has any of its tiles */
+  boost::signals2::signal<void (FileEntry, Tile)> m_sig_region_tile_callback;
+
 public:
   TileGenerationJob(const FileEntry& file_entry, int min_scale_in_db, int max_scale_in_db);
   ~TileGenerationJob();
 
   /** Request a tile to be generated, returns true if the request will
       be honored, false if the tile generation is already in progress
-      and the request has to be discarded */
+      and the request has to be discarded. Once the job is done, tiles
+      it generated are passed to \a callback right away. */
   bool request_tile(const JobHandle& job_handle, int scale, const Vector2i& pos,
                     const std::function<void (Tile)>& callback);
   void run();
 
+  /** Frees the generated tiles and gives their memory back to the
+      MemoryBudget, called once they are in the database and the job
+      is no longer asked for them */
+  void release_tiles();
+
+  /** Hand over the already fetched content of get_url(), must be
+      called before the Job is submitted to a JobManager */
+  void set_blob(BlobPtr blob, const std::string& mime_type);
+
   URL get_url() const { return m_url; }
 
   bool is_aborted();
 
   boost::signals2::signal<void (FileEntry)>& sig_file_callback() { return m_sig_file_callback; }
   boost::signals2::signal<void (FileEntry, Tile)>& sig_tile_callback() { return m_sig_tile_callback; }
+  boost::signals2::signal<void (FileEntry, Tile)>& sig_region_tile_callback() { return m_sig_region_tile_callback; }
 
 private:
   void process_tile(const Tile& tile);
+  void process_region_tile(const Tile& tile);
+
+  /** Passes \a tile to the requests for it */
+  void serve_tile(const Tile& tile);
+
+  /** The requested tiles, when all of them can be generated with
+      TileGenerator::generate_region(), empty otherwise */
+  Regions get_regions() const;
+
+  size_t estimate_memory_usage();
 };
 
 #endif
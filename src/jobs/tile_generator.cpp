@@ -18,16 +18,314 @@
 
 #include "jobs/tile_generator.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "galapix/tile.hpp"
+#include "job/parallel_bands.hpp"
 #include "math/rect.hpp"
 #include "math/vector2i.hpp"
+#include "plugins/exif.hpp"
+#include "plugins/file_jpeg_decompressor.hpp"
 #include "plugins/jpeg.hpp"
+#include "plugins/jpeg_cropper.hpp"
+#include "plugins/mem_jpeg_decompressor.hpp"
 #include "util/log.hpp"
+#include "util/raise_exception.hpp"
 #include "util/software_surface.hpp"
 
+namespace {
+
+/** Position in a surface of \a size of the pixel that ends up at
+    (\a x, \a y) after transform(\a mod) */
+Vector2i get_source_pos(SoftwareSurface::Modifier mod, const Size& size, int x, int y)
+{
+  const int w = size.width;
+  const int h = size.height;
+  switch(mod)
+  {
+    case SoftwareSurface::kRot90:      return Vector2i(y, h - 1 - x);
+    case SoftwareSurface::kRot180:     return Vector2i(w - 1 - x, h - 1 - y);
+    case SoftwareSurface::kRot270:     return Vector2i(w - 1 - y, x);
+    case SoftwareSurface::kRot0Flip:   return Vector2i(x, h - 1 - y);
+    case SoftwareSurface::kRot90Flip:  return Vector2i(w - 1 - y, h - 1 - x);
+    case SoftwareSurface::kRot180Flip: return Vector2i(w - 1 - x, y);
+    case SoftwareSurface::kRot270Flip: return Vector2i(y, x);
+    case SoftwareSurface::kRot0:
+    default:
+      return Vector2i(x, y);
+  }
+}
+
+/** The part of a surface of \a size that ends up in \a rect after
+    transform(\a mod) */
+Rect get_source_rect(SoftwareSurface::Modifier mod, const Size& size, const Rect& rect)
+{
+  Vector2i p = get_source_pos(mod, size, rect.left, rect.top);
+  Vector2i q = get_source_pos(mod, size, rect.right - 1, rect.bottom - 1);
+  return Rect(std::min(p.x, q.x), std::min(p.y, q.y),
+              std::max(p.x, q.x) + 1, std::max(p.y, q.y) + 1);
+}
+
+/** halve() drops the last column and row of odd sized surfaces, the
+    ones that would be last after transform(\a mod) may be the first
+    ones in \a surface, so those get cropped off instead */
+SoftwareSurfacePtr crop_for_halve(SoftwareSurfacePtr surface, SoftwareSurface::Modifier mod)
+{
+  const Size size = surface->get_size();
+  const Size transformed = SoftwareSurface::get_transformed_size(mod, size);
+  Vector2i corner = get_source_pos(mod, size, transformed.width - 1, transformed.height - 1);
+
+  int left = (size.width  % 2 == 1 && corner.x == 0) ? 1 : 0;
+  int top  = (size.height % 2 == 1 && corner.y == 0) ? 1 : 0;
+  if (left || top)
+  {
+    return surface->crop(Rect(left, top, size.width, size.height));
+  }
+  else
+  {
+    return surface;
+  }
+}
+
+/** A decompressor for the JPEG at \a url, reads it into \a blob
+    first when it isn't a local file, \a blob has to be kept till the
+    decompressor is done */
+std::unique_ptr<JPEGDecompressor> open_jpeg(const URL& url, BlobPtr& blob,
+                                            SoftwareSurface::Modifier* orientation)
+{
+  if (!blob && url.has_stdio_name())
+  {
+    *orientation = EXIF::get_orientation(url.get_stdio_name());
+    return std::unique_ptr<JPEGDecompressor>(new FileJPEGDecompressor(url.get_stdio_name()));
+  }
+  else
+  {
+    if (!blob)
+    {
+      blob = url.get_blob();
+    }
+    *orientation = EXIF::get_orientation(blob->get_data(), static_cast<int>(blob->size()));
+    return std::unique_ptr<JPEGDecompressor>(new MemJPEGDecompressor(blob->get_data(),
+                                                                     static_cast<int>(blob->size())));
+  }
+}
+
+/** The transform that undoes \a mod */
+SoftwareSurface::Modifier get_inverse(SoftwareSurface::Modifier mod)
+{
+  switch(mod)
+  {
+    case SoftwareSurface::kRot90:  return SoftwareSurface::kRot270;
+    case SoftwareSurface::kRot270: return SoftwareSurface::kRot90;
+    default:
+      return mod;
+  }
+}
+
+/** Builds the pyramid for TileGenerator::cut_bands_into_tiles(): each
+    level collects the rows that make up one row of tiles (a column
+    for orientations that transpose), cuts them into tiles and passes
+    them on halved to the next level. Only those rows are kept, so
+    memory depends on the width of the image, not its area. */
+class BandCutter
+{
+private:
+  struct Level
+  {
+    int scale;
+    Size size;
+
+    /** Rows collected so far, they start at row \a y of the level */
+    SoftwareSurfacePtr rows;
+    int fill;
+    int y;
+
+    /** Whether the tile boundaries are counted from the bottom,
+        i.e. the orientation flips the rows */
+    bool from_bottom;
+
+    /** What crop_for_halve() would crop off the whole level */
+    int skip_left;
+    int skip_top;
+
+    Level(int scale_, const Size& size_, SoftwareSurface::Modifier orientation) :
+      scale(scale_),
+      size(size_),
+      rows(),
+      fill(0),
+      y(0),
+      from_bottom(false),
+      skip_left(0),
+      skip_top(0)
+    {
+      const Size transformed = SoftwareSurface::get_transformed_size(orientation, size);
+      if (transformed.width > 0 && transformed.height > 0)
+      {
+        from_bottom = (get_source_pos(orientation, size, 0, 0).y != 0);
+
+        Vector2i corner = get_source_pos(orientation, size, transformed.width - 1, transformed.height - 1);
+        skip_left = (size.width  % 2 == 1 && corner.x == 0) ? 1 : 0;
+        skip_top  = (size.height % 2 == 1 && corner.y == 0) ? 1 : 0;
+      }
+    }
+
+    /** End of the row of tiles that starts at row \a y */
+    int get_band_end() const
+    {
+      if (from_bottom)
+      {
+        return size.height - 256 * ((size.height - y - 1) / 256);
+      }
+      else
+      {
+        return std::min(size.height, 256 * (y / 256 + 1));
+      }
+    }
+  };
+
+private:
+  std::vector<Level> m_levels;
+  SoftwareSurface::Modifier m_orientation;
+  const std::function<void (Tile)>& m_callback;
+
+public:
+  BandCutter(const Size& size, int min_scale, int max_scale,
+             SoftwareSurface::Modifier orientation,
+             const std::function<void (Tile)>& callback) :
+    m_levels(),
+    m_orientation(orientation),
+    m_callback(callback)
+  {
+    Size level_size = size;
+    int scale = min_scale;
+    do
+    {
+      m_levels.push_back(Level(scale, level_size, orientation));
+      level_size = level_size / 2;
+      scale += 1;
+    }
+    while (scale <= max_scale);
+  }
+
+  /** Adds the next rows of the first level */
+  void add(SoftwareSurfacePtr rows)
+  {
+    add(0, rows);
+  }
+
+  bool is_complete() const
+  {
+    return m_levels.front().y == m_levels.front().size.height;
+  }
+
+private:
+  void add(size_t idx, SoftwareSurfacePtr rows)
+  {
+    Level& level = m_levels[idx];
+    const int width = level.size.width;
+
+    int offset = 0;
+    while (offset < rows->get_height() && level.y < level.size.height)
+    {
+      const int band_height = level.get_band_end() - level.y;
+      const int count = std::min(band_height - level.fill, rows->get_height() - offset);
+
+      if (level.fill == 0 && count == band_height)
+      {
+        // the band is all there already, no need to copy it
+        flush(idx, rows->crop(Rect(0, offset, width, offset + count)));
+      }
+      else
+      {
+        if (!level.rows)
+        {
+          level.rows = SoftwareSurface::create(rows->get_format(), Size(width, band_height));
+        }
+
+        rows->crop(Rect(0, offset, width, offset + count))->blit(level.rows, Vector2i(0, level.fill));
+        level.fill += count;
+
+        if (level.fill == band_height)
+        {
+          SoftwareSurfacePtr band = level.rows;
+          level.rows.reset();
+          level.fill = 0;
+          flush(idx, band);
+        }
+      }
+
+      offset += count;
+    }
+  }
+
+  /** Cuts \a band, the next complete row of tiles of the level, into
+      tiles and passes it on to the next level */
+  void flush(size_t idx, SoftwareSurfacePtr band)
+  {
+    Level& level = m_levels[idx];
+    const int y = level.y;
+    const int height = band->get_height();
+    level.y += height;
+
+    const Size transformed = SoftwareSurface::get_transformed_size(m_orientation, level.size);
+    Rect target = get_source_rect(get_inverse(m_orientation), transformed,
+                                  Rect(0, y, level.size.width, y + height));
+    std::vector<Tile> tiles;
+    for(int ty = target.top / 256; 256 * ty < target.bottom; ++ty)
+      for(int tx = target.left / 256; 256 * tx < target.right; ++tx)
+      {
+        Rect rect(256 * tx, 256 * ty,
+                  std::min(256 * (tx + 1), transformed.width),
+                  std::min(256 * (ty + 1), transformed.height));
+
+        Rect source = get_source_rect(m_orientation, level.size, rect);
+        tiles.push_back(Tile(level.scale, Vector2i(tx, ty),
+                             band->crop(Rect(source.left, source.top - y, source.right, source.bottom - y))));
+      }
+
+    if (m_orientation != SoftwareSurface::kRot0)
+    {
+      // upright tiles stay views into the band, the others are copied
+      // by transform(), which is worth spreading over the helpers
+      parallel_bands(0, static_cast<int>(tiles.size()), static_cast<int>(tiles.size()),
+                     [&tiles, this](int begin, int end) {
+                       for(int i = begin; i < end; ++i)
+                       {
+                         Tile& tile = tiles[static_cast<size_t>(i)];
+                         tile = Tile(tile.get_scale(), tile.get_pos(), tile.get_surface()->transform(m_orientation));
+                       }
+                     });
+    }
+
+    for(std::vector<Tile>::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
+    {
+      m_callback(*i);
+    }
+
+    if (idx + 1 < m_levels.size())
+    {
+      // halve() combines rows starting at skip_top, so a band that
+      // starts in the middle of a pair leaves its first row out
+      const int skip = ((y - level.skip_top) % 2 != 0) ? 1 : 0;
+      if ((height - skip) / 2 > 0 && (level.size.width - level.skip_left) / 2 > 0)
+      {
+        add(idx + 1, TileGenerator::halve(band->crop(Rect(level.skip_left, skip, band->get_width(), height))));
+      }
+    }
+  }
+
+private:
+  BandCutter(const BandCutter&);
+  BandCutter& operator=(const BandCutter&);
+};
+
+} // namespace
+
 void
 TileGenerator::generate_old(const URL& url,
                             int m_min_scale_in_db, int m_max_scale_in_db,
@@ -64,50 +362,295 @@ void
 TileGenerator::generate(const URL& url, int min_scale, int max_scale,
                         const std::function<void(Tile)>& callback)
 {
+  generate(url, BlobPtr(), std::string(), min_scale, max_scale, callback);
+}
+
+void
+TileGenerator::generate(const URL& url, BlobPtr blob, const std::string& mime_type,
+                        int min_scale, int max_scale,
+                        const std::function<void(Tile)>& callback)
+{
+  if (JPEG::filename_is_jpeg(url.str()) && min_scale <= 3)
+  {
+    if (!blob && !url.has_stdio_name())
+    {
+      blob = url.get_blob();
+    }
+
+    Size image_size = blob ? JPEG::get_size(blob->get_data(), blob->size()) : JPEG::get_size(url.get_stdio_name());
+    if (wants_bands(url, image_size, min_scale))
+    {
+      generate_bands(url, blob, min_scale, max_scale, callback);
+      return;
+    }
+  }
+
   // Load the image, try to load an already downsized version if possible
   Size original_size;
-  SoftwareSurfacePtr surface = load_surface(url, min_scale, &original_size);
-  cut_into_tiles(surface, original_size, min_scale, max_scale, callback);
+  SoftwareSurface::Modifier orientation;
+  SoftwareSurfacePtr surface = load_surface(url, blob, mime_type, min_scale, &original_size, &orientation);
+  // the encoded data isn't needed anymore, so don't keep it around
+  // while cutting the tiles
+  blob.reset();
+  cut_into_tiles(surface, original_size, min_scale, max_scale, callback, orientation);
+}
+
+bool
+TileGenerator::wants_bands(const URL& url, const Size& image_size, int min_scale)
+{
+  // the bands come from the JPEG decoder, which can only scale down
+  // by up to 8 on its own
+  return (JPEG::filename_is_jpeg(url.str()) && min_scale <= 3 &&
+          static_cast<int64_t>(image_size.width  / Math::pow2(min_scale)) *
+          (image_size.height / Math::pow2(min_scale)) > kBandThreshold);
+}
+
+void
+TileGenerator::generate_bands(const URL& url, BlobPtr blob, int min_scale, int max_scale,
+                              const std::function<void(Tile)>& callback)
+{
+  assert(min_scale <= 3);
+
+  SoftwareSurface::Modifier orientation;
+  std::unique_ptr<JPEGDecompressor> decompressor = open_jpeg(url, blob, &orientation);
+
+  Size image_size;
+  Size size = decompressor->start(Math::pow2(min_scale), &image_size);
+  cut_bands_into_tiles(size, min_scale, max_scale,
+                       [&decompressor]{ return decompressor->read_band(kBandHeight); },
+                       callback, orientation);
+}
+
+bool
+TileGenerator::wants_region(const URL& url, const Size& image_size, int scale,
+                            const std::vector<Vector2i>& positions)
+{
+  const int64_t area = 
+    static_cast<int64_t>(image_size.width  / Math::pow2(scale)) *
+    (image_size.height / Math::pow2(scale));
+
+  if (!JPEG::filename_is_jpeg(url.str()) || scale > 3 ||
+      area <= kRegionThreshold || positions.empty())
+  {
+    return false;
+  }
+  else
+  {
+    // generate_region() decodes all the tiles in between too
+    Rect region(positions.front(), Size(1, 1));
+    for(std::vector<Vector2i>::const_iterator i = positions.begin(); i != positions.end(); ++i)
+    {
+      region.left   = std::min(region.left,   i->x);
+      region.top    = std::min(region.top,    i->y);
+      region.right  = std::max(region.right,  i->x + 1);
+      region.bottom = std::max(region.bottom, i->y + 1);
+    }
+
+    return 4 * static_cast<int64_t>(region.get_width()) * region.get_height() * 256 * 256 < area;
+  }
+}
+
+void
+TileGenerator::generate_region(const URL& url, BlobPtr blob, int scale,
+                               const std::vector<Vector2i>& positions,
+                               const std::function<void(Tile)>& callback)
+{
+  assert(scale <= 3);
+
+  SoftwareSurface::Modifier orientation;
+  std::unique_ptr<JPEGDecompressor> decompressor = open_jpeg(url, blob, &orientation);
+
+  Size image_size;
+  const Size size = decompressor->start(Math::pow2(scale), &image_size);
+  const Size transformed = SoftwareSurface::get_transformed_size(orientation, size);
+
+  // one region that covers all the tiles
+  std::vector<Rect> rects;
+  Rect region(transformed.width, transformed.height, 0, 0);
+  for(std::vector<Vector2i>::const_iterator i = positions.begin(); i != positions.end(); ++i)
+  {
+    Rect rect(256 * i->x, 256 * i->y,
+              std::min(256 * (i->x + 1), transformed.width),
+              std::min(256 * (i->y + 1), transformed.height));
+    if (i->x < 0 || i->y < 0 || rect.left >= rect.right || rect.top >= rect.bottom)
+    {
+      log_warning << url << ": tile " << *i << " is outside of " << transformed << std::endl;
+      rects.push_back(Rect());
+    }
+    else
+    {
+      region.left   = std::min(region.left,   rect.left);
+      region.top    = std::min(region.top,    rect.top);
+      region.right  = std::max(region.right,  rect.right);
+      region.bottom = std::max(region.bottom, rect.bottom);
+      rects.push_back(rect);
+    }
+  }
+
+  if (region.left < region.right && region.top < region.bottom)
+  {
+    const Rect source = get_source_rect(orientation, size, region);
+    SoftwareSurfacePtr surface = decompressor->read_region(source);
+
+    for(size_t i = 0; i < positions.size(); ++i)
+    {
+      if (rects[i].get_width() > 0)
+      {
+        Rect rect = get_source_rect(orientation, size, rects[i]);
+        rect = Rect(rect.left - source.left, rect.top - source.top,
+                    rect.right - source.left, rect.bottom - source.top);
+
+        SoftwareSurfacePtr tile = surface->crop(rect);
+        if (orientation != SoftwareSurface::kRot0)
+        {
+          tile = tile->transform(orientation);
+        }
+        callback(Tile(scale, positions[i], tile));
+      }
+    }
+  }
+}
+
+bool
+TileGenerator::generate_lossless(const URL& url, BlobPtr& blob,
+                                 const std::function<void (const Vector2i&, BlobPtr)>& callback)
+{
+  if (!JPEG::filename_is_jpeg(url.str()))
+  {
+    return false;
+  }
+  else
+  {
+    if (!blob)
+    {
+      blob = url.get_blob();
+    }
+
+    // the blocks could be transformed too, as "jpegtran -rotate"
+    // does, but only when the image is a multiple of the block size
+    if (EXIF::get_orientation(blob->get_data(), static_cast<int>(blob->size())) != SoftwareSurface::kRot0)
+    {
+      return false;
+    }
+
+    JPEGCropper cropper(blob->get_data(), static_cast<int>(blob->size()));
+    const Size size = cropper.get_size();
+    const Size imcu = cropper.get_imcu_size();
+    if (!cropper.is_supported() || 256 % imcu.width != 0 || 256 % imcu.height != 0)
+    {
+      return false;
+    }
+    else
+    {
+      // the tiles at the right and bottom are smaller, but still start
+      // at a block, their partial blocks are taken over as they are
+      for(int y = 0; 256 * y < size.height; ++y)
+      {
+        for(int x = 0; 256 * x < size.width; ++x)
+        {
+          Rect rect(256 * x, 256 * y,
+                    std::min(256 * (x + 1), size.width),
+                    std::min(256 * (y + 1), size.height));
+          callback(Vector2i(x, y), cropper.crop(rect));
+        }
+      }
+      return true;
+    }
+  }
+}
+
+SoftwareSurfacePtr
+TileGenerator::load_surface(const URL& url, int min_scale, Size* size,
+                            SoftwareSurface::Modifier* orientation)
+{
+  return load_surface(url, BlobPtr(), std::string(), min_scale, size, orientation);
 }
 
 SoftwareSurfacePtr
-TileGenerator::load_surface(const URL& url, int min_scale, Size* size)
+TileGenerator::load_surface(const URL& url, BlobPtr blob, const std::string& mime_type,
+                            int min_scale, Size* size,
+                            SoftwareSurface::Modifier* orientation)
 {
   // Load the image
   if (JPEG::filename_is_jpeg(url.str())) // FIXME: filename_is_jpeg() is ugly
   {
-    // The JPEG class can only scale down by factor 2,4,8, so we have to
-    // limit things (FIXME: is that true? if so, why?)
-    int jpeg_scale = Math::min(Math::pow2(min_scale), 8);
+    // the decoder gets as close to min_scale as it can, but doesn't
+    // go below 1/8, scale_to_min_scale() does the rest
+    int jpeg_scale = Math::pow2(min_scale);
               
-    if (url.has_stdio_name())
+    if (!blob && url.has_stdio_name())
     {
-      return JPEG::load_from_file(url.get_stdio_name(), jpeg_scale, size);
+      return JPEG::load_from_file(url.get_stdio_name(), jpeg_scale, size, orientation);
     }
     else
     {
-      BlobPtr blob = url.get_blob();
-      return JPEG::load_from_mem(blob->get_data(), blob->size(), jpeg_scale, size);
+      if (!blob)
+      {
+        blob = url.get_blob();
+      }
+      return JPEG::load_from_mem(blob->get_data(), blob->size(), jpeg_scale, size, orientation);
     }
   }
   else
   {
-    SoftwareSurfacePtr surface = SoftwareSurfaceFactory::current().from_url(url);
+    SoftwareSurfacePtr surface = blob ?
+      SoftwareSurfaceFactory::current().from_blob(url, blob, mime_type) :
+      SoftwareSurfaceFactory::current().from_url(url);
     *size = surface->get_size();
+    if (orientation)
+    {
+      *orientation = SoftwareSurface::kRot0;
+    }
     return surface;
   }
 }
 
-void
-TileGenerator::cut_into_tiles(SoftwareSurfacePtr surface,
-                              const Size& original_size,
-                              int min_scale, int max_scale,
-                              const std::function<void (Tile)>& callback)
+size_t
+TileGenerator::estimate_memory_usage(const URL& url, const Size& image_size, int min_scale)
+{
+  if (wants_bands(url, image_size, min_scale))
+  {
+    // the band being cut, the next one being decoded, the rows
+    // collected in each level and their halved copies add up to
+    // roughly five bands of the first level, the EXIF orientation
+    // might turn the image, so the larger side could be the width
+    int width = std::max(image_size.width, image_size.height) / Math::pow2(min_scale);
+    return 5 * 4 * static_cast<size_t>(width) * kBandHeight;
+  }
+
+  // JPEGs get downscaled while decoding, everything else is loaded
+  // at full size and scaled down afterwards
+  int decode_scale = 0;
+  if (JPEG::filename_is_jpeg(url.str()))
+  {
+    decode_scale = Math::min(min_scale, 3);
+  }
+
+  // assume the worst case of four bytes per pixel
+  size_t decoded = 
+    4 * static_cast<size_t>(image_size.width  / Math::pow2(decode_scale)) *
+    static_cast<size_t>(image_size.height / Math::pow2(decode_scale));
+
+  // the scaled surface plus all halved levels and the tiles cut from
+  // them add up to roughly twice the area of the first level
+  size_t tiles =
+    2 * 4 * static_cast<size_t>(image_size.width  / Math::pow2(min_scale)) *
+    static_cast<size_t>(image_size.height / Math::pow2(min_scale));
+
+  return decoded + tiles;
+}
+
+SoftwareSurfacePtr
+TileGenerator::scale_to_min_scale(SoftwareSurfacePtr surface,
+                                  const Size& original_size,
+                                  int min_scale,
+                                  SoftwareSurface::Modifier orientation)
 {
   // Scale the image if loading a downsized version was not possible
   // or the downscale wasn't enough
-  Size target_size(original_size.width  / Math::pow2(min_scale),
-                   original_size.height / Math::pow2(min_scale));
+  Size target_size = SoftwareSurface::get_transformed_size(orientation,
+                                                           Size(original_size.width  / Math::pow2(min_scale),
+                                                                original_size.height / Math::pow2(min_scale)));
 
   if (target_size != surface->get_size())
   {
@@ -126,10 +669,22 @@ TileGenerator::cut_into_tiles(SoftwareSurfacePtr surface,
     {
       log_debug << "image doesn't match target size, doing scaling: target=" 
                 << target_size << " vs surface=" << surface->get_size() << std::endl;
-      surface = surface->scale(target_size);
+      surface = scale(surface, target_size);
     }
   }
 
+  return surface;
+}
+
+void
+TileGenerator::cut_into_tiles(SoftwareSurfacePtr surface,
+                              const Size& original_size,
+                              int min_scale, int max_scale,
+                              const std::function<void (Tile)>& callback,
+                              SoftwareSurface::Modifier orientation)
+{
+  surface = scale_to_min_scale(surface, original_size, min_scale, orientation);
+
   // Cut the given image into tiles, give created tiles to callback(),
   // surface is expected to be pre-scaled and already at min_scale size
   int scale = min_scale;
@@ -137,16 +692,29 @@ TileGenerator::cut_into_tiles(SoftwareSurfacePtr surface,
   {
     if (scale != min_scale)
     {
-      surface = surface->halve();
+      surface = halve(crop_for_halve(surface, orientation));
     }
 
-    for(int y = 0; 256*y < surface->get_height(); ++y)
-      for(int x = 0; 256*x < surface->get_width(); ++x)
+    const Size size = SoftwareSurface::get_transformed_size(orientation, surface->get_size());
+    for(int y = 0; 256*y < size.height; ++y)
+      for(int x = 0; 256*x < size.width; ++x)
       {
-        SoftwareSurfacePtr croped_surface = surface->crop(Rect(Vector2i(x * 256, y * 256),
-                                                               Size(256, 256)));
+        Rect rect(256 * x, 256 * y,
+                  std::min(256 * (x + 1), size.width),
+                  std::min(256 * (y + 1), size.height));
+
+        // upright tiles are views into surface, so nothing gets copied
+        SoftwareSurfacePtr tile;
+        if (orientation == SoftwareSurface::kRot0)
+        {
+          tile = surface->crop(rect);
+        }
+        else
+        {
+          tile = surface->crop(get_source_rect(orientation, surface->get_size(), rect))->transform(orientation);
+        }
 
-        callback(Tile(scale, Vector2i(x, y), croped_surface));
+        callback(Tile(scale, Vector2i(x, y), tile));
       }
 
     scale += 1;
@@ -154,4 +722,114 @@ TileGenerator::cut_into_tiles(SoftwareSurfacePtr surface,
   while (scale <= max_scale);
 }
 
+void
+TileGenerator::cut_bands_into_tiles(const Size& size, int min_scale, int max_scale,
+                                    const std::function<SoftwareSurfacePtr ()>& next_band,
+                                    const std::function<void (Tile)>& callback,
+                                    SoftwareSurface::Modifier orientation)
+{
+  BandCutter cutter(size, min_scale, max_scale, orientation, callback);
+  SoftwareSurfacePtr band = next_band();
+  while(band)
+  {
+    if (band->get_width() != size.width)
+    {
+      raise_exception(std::runtime_error, "band has the wrong width: " << band->get_size() << " vs " << size);
+    }
+
+    // decode the next band while this one gets cut, the cutting is the
+    // last band, so the callback stays in the calling thread
+    SoftwareSurfacePtr next;
+    parallel_bands(0, 2, 2,
+                   [&](int i, int) {
+                     if (i == 0)
+                     {
+                       next = next_band();
+                     }
+                     else
+                     {
+                       cutter.add(band);
+                     }
+                   });
+    band = next;
+  }
+
+  if (!cutter.is_complete())
+  {
+    raise_exception(std::runtime_error, "image ended before all rows of " << size << " were read");
+  }
+}
+
+SoftwareSurfacePtr
+TileGenerator::halve(SoftwareSurfacePtr surface)
+{
+  Size size = surface->get_size() / 2;
+  int num_bands = get_num_bands(surface->get_size(), size.height);
+  if (num_bands <= 1)
+  {
+    return surface->halve();
+  }
+  else
+  {
+    SoftwareSurfacePtr result = SoftwareSurface::create(surface->get_format(), size);
+    parallel_bands(0, size.height, num_bands,
+                   [&surface, &result](int y_begin, int y_end) {
+                     surface->halve_rows(*result, y_begin, y_end);
+                   });
+    return result;
+  }
+}
+
+SoftwareSurfacePtr
+TileGenerator::scale(SoftwareSurfacePtr surface, const Size& size)
+{
+  // halving is much cheaper than filtering and as long as the filter
+  // still shrinks by 3 or more afterwards there is no visible
+  // difference, same as PIL's reducing_gap
+  while(size.width  > 0 && surface->get_width()  >= 6 * size.width &&
+        size.height > 0 && surface->get_height() >= 6 * size.height)
+  {
+    surface = halve(surface);
+  }
+
+  int num_bands = get_num_bands(surface->get_size(), surface->get_height());
+  if (num_bands <= 1 || size.width <= 0 || size.height <= 0)
+  {
+    return surface->scale(size);
+  }
+  else
+  {
+    Resampler resampler(surface->get_size(), size, Resampler::LANCZOS_FILTER);
+
+    // same as SoftwareSurface::scale(), with both passes split into bands
+    SoftwareSurfacePtr intermediate = SoftwareSurface::create(surface->get_format(),
+                                                              resampler.get_intermediate_size());
+    parallel_bands(0, intermediate->get_height(), num_bands,
+                   [&](int y_begin, int y_end) {
+                     resampler.first_pass(*surface, *intermediate, y_begin, y_end);
+                   });
+
+    SoftwareSurfacePtr result = SoftwareSurface::create(surface->get_format(), size);
+    parallel_bands(0, size.height, get_num_bands(size, size.height),
+                   [&](int y_begin, int y_end) {
+                     resampler.second_pass(*intermediate, *result, y_begin, y_end);
+                   });
+    return result;
+  }
+}
+
+int
+TileGenerator::get_num_bands(const Size& size, int num_rows)
+{
+  if (static_cast<int64_t>(size.width) * size.height <= kParallelThreshold)
+  {
+    return 1;
+  }
+  else
+  {
+    int num_threads = static_cast<int>(std::thread::hardware_concurrency());
+    return Math::clamp(1, num_threads, num_rows);
+  }
+}
+
 /* EOF */
@@ -20,6 +20,8 @@
 #define HEADER_GALAPIX_JOBS_TILE_GENERATOR_HPP
 
 #include <functional>
+#include <stddef.h>
+#include <vector>
 
 #include "util/software_surface_factory.hpp"
 #include "galapix/tile.hpp"
@@ -29,6 +31,20 @@ class FileEntry;
 class TileGenerator
 {
 private:
+  /** Surfaces with more pixels than this are halved and scaled by
+      multiple threads, each working on a band of rows, low enough
+      for the bands of generate_bands() to qualify */
+  static const int kParallelThreshold = 1024 * 1024;
+
+  /** JPEGs with more pixels than this at min_scale are decoded and
+      cut into tiles in bands of kBandHeight rows */
+  static const int kBandThreshold = 8192 * 8192;
+  static const int kBandHeight = 256;
+
+  /** JPEG levels with more pixels than this are decoded only in part
+      when just a few of their tiles are needed */
+  static const int kRegionThreshold = 2048 * 2048;
+
 public:
   static void generate_old(const URL& url,
                            int m_min_scale_in_db, int m_max_scale_in_db,
@@ -38,16 +54,108 @@ public:
   static void generate(const URL& url, int min_scale, int max_scale,
                        const std::function<void(Tile)>& callback);
 
-  static SoftwareSurfacePtr load_surface(const URL& url, int min_scale, Size* size);
+  /** Like generate(), but uses the already fetched \a blob instead
+      of reading \a url, \a blob can be empty */
+  static void generate(const URL& url, BlobPtr blob, const std::string& mime_type,
+                       int min_scale, int max_scale,
+                       const std::function<void(Tile)>& callback);
+
+  /** Whether generate() would decode the image at \a url in bands,
+      \a image_size is the size of the full image */
+  static bool wants_bands(const URL& url, const Size& image_size, int min_scale);
+
+  /** Like generate(), but for JPEGs only: the image is decoded in
+      bands and each band is cut into tiles as soon as it is
+      complete, so memory grows with the width of the image instead
+      of its area. \a min_scale must not be larger than 3. */
+  static void generate_bands(const URL& url, BlobPtr blob, int min_scale, int max_scale,
+                             const std::function<void(Tile)>& callback);
+
+  /** Whether generate_region() is worth it for the tiles at \a
+      positions of \a scale, i.e. the image is a JPEG and they cover
+      only a small part of a large level */
+  static bool wants_region(const URL& url, const Size& image_size, int scale,
+                           const std::vector<Vector2i>& positions);
+
+  /** Generates only the tiles at \a positions of \a scale. Only the
+      part of the JPEG at \a url that covers them gets decoded, they
+      are not the halved tiles of a lower scale, but decoded at this
+      scale directly. \a scale must not be larger than 3. */
+  static void generate_region(const URL& url, BlobPtr blob, int scale,
+                              const std::vector<Vector2i>& positions,
+                              const std::function<void(Tile)>& callback);
+
+  /** Cuts the scale 0 tiles out of the JPEG at \a url without
+      decoding it, see JPEGCropper. \a callback gets the position and
+      the encoded JPEG of each tile. Returns false and does nothing
+      when that isn't possible, i.e. for other formats, color spaces
+      that JPEGCropper doesn't handle or images with an EXIF
+      orientation. \a blob is read from \a url when it is empty and
+      can be used for decoding afterwards. */
+  static bool generate_lossless(const URL& url, BlobPtr& blob,
+                                const std::function<void (const Vector2i&, BlobPtr)>& callback);
+
+  /** Loads the image at \a url, \a size receives the size of the
+      full image with its orientation applied. When \a orientation
+      is given, the returned surface is left as it is stored in the
+      file and its EXIF orientation returned there, to be passed on to
+      scale_to_min_scale() and cut_into_tiles(). */
+  static SoftwareSurfacePtr load_surface(const URL& url, int min_scale, Size* size,
+                                         SoftwareSurface::Modifier* orientation = NULL);
+  static SoftwareSurfacePtr load_surface(const URL& url, BlobPtr blob, const std::string& mime_type,
+                                         int min_scale, Size* size,
+                                         SoftwareSurface::Modifier* orientation = NULL);
+
+  /** Rough estimate of the peak number of bytes generate() needs to
+      hold in memory for an image of \a image_size, used to reserve
+      space in the MemoryBudget before decoding */
+  static size_t estimate_memory_usage(const URL& url, const Size& image_size, int min_scale);
+
+  /** Scales \a surface to the size of \a min_scale, unless it
+      already is close enough to it. \a original_size has \a
+      orientation applied, \a surface and the result don't. */
+  static SoftwareSurfacePtr scale_to_min_scale(SoftwareSurfacePtr surface,
+                                               const Size& original_size,
+                                               int min_scale,
+                                               SoftwareSurface::Modifier orientation = SoftwareSurface::kRot0);
+
+  /** Like cut_into_tiles(), but the surface arrives in bands from
+      top to bottom, as it is stored before \a orientation. \a
+      next_band returns the next band or an empty pointer at the end,
+      \a size is the size of the whole surface. The tiles are the same
+      as cut_into_tiles() gives for the whole surface. */
+  static void cut_bands_into_tiles(const Size& size, int min_scale, int max_scale,
+                                   const std::function<SoftwareSurfacePtr ()>& next_band,
+                                   const std::function<void (Tile)>& callback,
+                                   SoftwareSurface::Modifier orientation = SoftwareSurface::kRot0);
+
+  /** Halves \a surface, large surfaces are split into bands that
+      are processed in parallel */
+  static SoftwareSurfacePtr halve(SoftwareSurfacePtr surface);
+
+  /** Scales \a surface to \a size with the Lanczos filter, large
+      reductions are halved first, large surfaces are split into bands
+      that are processed in parallel */
+  static SoftwareSurfacePtr scale(SoftwareSurfacePtr surface, const Size& size);
 
   /** Takes the given surface and cuts it into tiles which are then
       passed to callback. Surface can already be prescaled.
       min_scale/max_scale are the exact range for which tiles are
-      generated. */
+      generated. The tiles are views that share the pixels of the
+      scaled surface. When \a orientation is given, the levels stay as
+      \a surface is stored and only each tile gets transformed, so
+      the result is the same as for surface->transform(orientation)
+      without a second full size surface. */
   static void cut_into_tiles(SoftwareSurfacePtr surface,
                              const Size& original_size,
                              int min_scale, int max_scale,
-                             const std::function<void (Tile)>& callback);
+                             const std::function<void (Tile)>& callback,
+                             SoftwareSurface::Modifier orientation = SoftwareSurface::kRot0);
+
+private:
+  /** Number of bands a surface of \a size should be split into when
+      it consists of \a num_rows rows of work */
+  static int get_num_bands(const Size& size, int num_rows);
 
 private:
   TileGenerator(const TileGenerator&);
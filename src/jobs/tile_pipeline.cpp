@@ -0,0 +1,443 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jobs/tile_pipeline.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "galapix/database_thread.hpp"
+#include "job/memory_budget.hpp"
+#include "jobs/fetch_job.hpp"
+#include "jobs/tile_generator.hpp"
+#include "plugins/jpeg.hpp"
+#include "plugins/png.hpp"
+#include "util/log.hpp"
+#include "util/software_surface_factory.hpp"
+#include "util/software_surface_loader.hpp"
+
+namespace {
+
+bool needs_external_loader(const URL& url)
+{
+  const SoftwareSurfaceLoader* loader = SoftwareSurfaceFactory::current().find_loader_by_filename(url.str());
+  return loader && loader->is_external();
+}
+
+} // namespace
+
+struct TilePipeline::ImageWork
+{
+  JobHandle job_handle;
+  FileEntry file_entry;
+  int min_scale;
+  int max_scale;
+
+  BlobPtr blob;
+  std::string mime_type;
+  SoftwareSurfacePtr surface;
+  Size original_size;
+
+  /** EXIF orientation, applied to each tile instead of to surface */
+  SoftwareSurface::Modifier orientation;
+  size_t reserved_bytes;
+
+  /** Number of tiles not yet stored, plus one as long as the image
+      itself is still being processed */
+  std::atomic<int> num_pending;
+  std::atomic<bool> failed;
+
+  ImageWork(const JobHandle& job_handle_, const FileEntry& file_entry_,
+            int min_scale_, int max_scale_) :
+    job_handle(job_handle_),
+    file_entry(file_entry_),
+    min_scale(min_scale_),
+    max_scale(max_scale_),
+    blob(),
+    mime_type(),
+    surface(),
+    original_size(),
+    orientation(SoftwareSurface::kRot0),
+    reserved_bytes(0),
+    num_pending(1),
+    failed(false)
+  {}
+
+private:
+  ImageWork(const ImageWork&);
+  ImageWork& operator=(const ImageWork&);
+};
+
+TilePipeline::TilePipeline(DatabaseThread& database_thread, int num_threads, int num_io_threads,
+                           bool lossless_tiles) :
+  m_database_thread(database_thread),
+  m_lossless_tiles(lossless_tiles),
+  // the DatabaseThread must never block on request(), so the first queue is unbounded
+  m_fetch_stage("fetch", num_io_threads, -1, [this](ImageWorkPtr& image){ fetch(image); }),
+  m_decode_stage("decode", num_threads, 2 * num_threads, [this](ImageWorkPtr& image){ decode(image); }),
+  m_external_decode_stage("external", std::max(1, num_threads / 2), std::max(1, num_threads / 2),
+                          [this](ImageWorkPtr& image){ decode(image); }),
+  m_scale_stage("scale", num_threads, num_threads, [this](ImageWorkPtr& image){ scale(image); }),
+  m_cut_stage("cut", num_threads, num_threads, [this](ImageWorkPtr& image){ cut(image); }),
+  m_encode_stage("encode", num_threads, 256, [this](TileWork& tile){ encode(tile); }),
+  m_store_stage("store", 1, 256, [this](TileWork& tile){ store(tile); }),
+  m_batch()
+{
+}
+
+TilePipeline::~TilePipeline()
+{
+}
+
+void
+TilePipeline::start()
+{
+  m_fetch_stage.start();
+  m_decode_stage.start();
+  m_external_decode_stage.start();
+  m_scale_stage.start();
+  m_cut_stage.start();
+  m_encode_stage.start();
+  m_store_stage.start();
+}
+
+void
+TilePipeline::finish()
+{
+  // each stage can only finish once nothing feeds into it anymore
+  m_fetch_stage.finish();
+  m_decode_stage.finish();
+  m_external_decode_stage.finish();
+  m_scale_stage.finish();
+  m_cut_stage.finish();
+  m_encode_stage.finish();
+  m_store_stage.finish();
+}
+
+void
+TilePipeline::request(const JobHandle& job_handle_in, const FileEntry& file_entry,
+                      int min_scale_in_db, int max_scale_in_db,
+                      int min_scale, int max_scale)
+{
+  // same clipping as in MultipleTileGenerationJob
+  if (min_scale_in_db != -1 &&
+      max_scale_in_db != -1)
+  {
+    min_scale = std::min(min_scale, min_scale_in_db);
+    max_scale = std::min(max_scale, min_scale_in_db-1);
+  }
+
+  if (min_scale_in_db != -1 && min_scale >= min_scale_in_db)
+  {
+    // everything is already in the database
+    JobHandle job_handle = job_handle_in;
+    job_handle.set_finished();
+  }
+  else
+  {
+    m_fetch_stage.push(std::make_shared<ImageWork>(job_handle_in, file_entry, min_scale, max_scale));
+  }
+}
+
+void
+TilePipeline::fetch(ImageWorkPtr& image)
+{
+  if (image->job_handle.is_aborted())
+  {
+    finish_work(*image);
+  }
+  else
+  {
+    const URL& url = image->file_entry.get_url();
+    if (FetchJob::wants_prefetch(url))
+    {
+      try
+      {
+        image->blob = url.get_blob(&image->mime_type);
+      }
+      catch(const std::exception& err)
+      {
+        // decode() will try again on its own and report the error
+        log_warning << url << ": " << err.what() << std::endl;
+      }
+    }
+
+    if (needs_external_loader(url))
+    {
+      m_external_decode_stage.push(image);
+    }
+    else
+    {
+      m_decode_stage.push(image);
+    }
+  }
+}
+
+void
+TilePipeline::decode(ImageWorkPtr& image)
+{
+  if (image->job_handle.is_aborted())
+  {
+    image->blob.reset();
+    finish_work(*image);
+  }
+  else
+  {
+    const URL& url = image->file_entry.get_url();
+    size_t reserved_bytes = TileGenerator::estimate_memory_usage(url,
+                                                                 image->file_entry.get_image_size(),
+                                                                 image->min_scale);
+    JobHandle job_handle = image->job_handle;
+    if (!MemoryBudget::current().acquire(reserved_bytes, [job_handle]{ return job_handle.is_aborted(); }))
+    {
+      image->blob.reset();
+      finish_work(*image);
+    }
+    else
+    {
+      image->reserved_bytes = reserved_bytes;
+      try
+      {
+        BlobPtr blob;
+        blob.swap(image->blob);
+
+        bool done = false;
+        if (m_lossless_tiles && image->min_scale == 0 &&
+            TileGenerator::generate_lossless(url, blob,
+                                             [this, &image](const Vector2i& pos, BlobPtr data) {
+                                               push_entry(image, TileEntry(image->file_entry, 0, pos, data,
+                                                                           TileEntry::JPEG_FORMAT));
+                                             }))
+        {
+          // the remaining scales get decoded as usual, the decoder
+          // can scale them down on its own
+          image->min_scale = 1;
+          done = image->max_scale < 1;
+        }
+
+        if (done)
+        {
+          release_image(*image);
+          finish_work(*image);
+        }
+        else if (TileGenerator::wants_bands(url, image->file_entry.get_image_size(), image->min_scale))
+        {
+          // huge JPEGs skip the scale and cut stages, they are cut
+          // into tiles while they are decoded
+          TileGenerator::generate_bands(url, std::move(blob), image->min_scale, image->max_scale,
+                                        [this, &image](const Tile& tile) {
+                                          push_tile(image, tile);
+                                        });
+          release_image(*image);
+          finish_work(*image);
+        }
+        else
+        {
+          image->surface = TileGenerator::load_surface(url, std::move(blob), image->mime_type,
+                                                       image->min_scale, &image->original_size,
+                                                       &image->orientation);
+          m_scale_stage.push(image);
+        }
+      }
+      catch(const std::exception& err)
+      {
+        log_error << url << ": " << err.what() << std::endl;
+        image->failed = true;
+        release_image(*image);
+        finish_work(*image);
+      }
+    }
+  }
+}
+
+void
+TilePipeline::scale(ImageWorkPtr& image)
+{
+  if (image->job_handle.is_aborted())
+  {
+    release_image(*image);
+    finish_work(*image);
+  }
+  else
+  {
+    try
+    {
+      image->surface = TileGenerator::scale_to_min_scale(image->surface, image->original_size,
+                                                         image->min_scale, image->orientation);
+      m_cut_stage.push(image);
+    }
+    catch(const std::exception& err)
+    {
+      log_error << image->file_entry.get_url() << ": " << err.what() << std::endl;
+      image->failed = true;
+      release_image(*image);
+      finish_work(*image);
+    }
+  }
+}
+
+void
+TilePipeline::cut(ImageWorkPtr& image)
+{
+  if (!image->job_handle.is_aborted())
+  {
+    try
+    {
+      // surface is already at min_scale, so cut_into_tiles() won't scale it again
+      TileGenerator::cut_into_tiles(image->surface, image->original_size,
+                                    image->min_scale, image->max_scale,
+                                    [this, &image](const Tile& tile) {
+                                      push_tile(image, tile);
+                                    },
+                                    image->orientation);
+    }
+    catch(const std::exception& err)
+    {
+      log_error << image->file_entry.get_url() << ": " << err.what() << std::endl;
+      image->failed = true;
+    }
+  }
+
+  release_image(*image);
+  finish_work(*image);
+}
+
+void
+TilePipeline::push_tile(ImageWorkPtr& image, const Tile& tile)
+{
+  TileWork work;
+  work.image = image;
+  work.tile  = tile;
+  image->num_pending += 1;
+  m_encode_stage.push(work);
+}
+
+void
+TilePipeline::push_entry(ImageWorkPtr& image, const TileEntry& entry)
+{
+  TileWork work;
+  work.image = image;
+  work.entry = entry;
+  image->num_pending += 1;
+  m_store_stage.push(work);
+}
+
+void
+TilePipeline::encode(TileWork& work)
+{
+  const Tile& tile = work.tile;
+  SoftwareSurfacePtr surface = tile.get_surface();
+
+  switch(surface->get_format())
+  {
+    case SoftwareSurface::RGB_FORMAT:
+    case SoftwareSurface::L8_FORMAT:
+      work.entry = TileEntry(work.image->file_entry, tile.get_scale(), tile.get_pos(),
+                             JPEG::save(surface, 75), TileEntry::JPEG_FORMAT);
+      break;
+
+    case SoftwareSurface::RGBA_FORMAT:
+      work.entry = TileEntry(work.image->file_entry, tile.get_scale(), tile.get_pos(),
+                             PNG::save(surface), TileEntry::PNG_FORMAT);
+      break;
+
+    default:
+      assert(!"TilePipeline::encode: Unhandled format");
+      break;
+  }
+
+  // the surface isn't needed anymore
+  work.tile = Tile();
+
+  m_store_stage.push(work);
+}
+
+void
+TilePipeline::store(TileWork& work)
+{
+  m_batch.push_back(work);
+
+  // write in batches, but don't hold tiles back when nothing else is coming
+  if (m_batch.size() >= 64 || m_store_stage.empty())
+  {
+    std::vector<TileEntry> tiles;
+    std::vector<ImageWorkPtr> images;
+    tiles.reserve(m_batch.size());
+    images.reserve(m_batch.size());
+    for(std::vector<TileWork>::iterator i = m_batch.begin(); i != m_batch.end(); ++i)
+    {
+      tiles.push_back(i->entry);
+      images.push_back(i->image);
+    }
+    m_batch.clear();
+
+    m_database_thread.receive_tiles(tiles,
+                                    [images]{
+                                      for(std::vector<ImageWorkPtr>::const_iterator i = images.begin(); i != images.end(); ++i)
+                                      {
+                                        finish_work(**i);
+                                      }
+                                    });
+  }
+}
+
+void
+TilePipeline::release_image(ImageWork& image)
+{
+  image.blob.reset();
+  image.surface.reset();
+}
+
+void
+TilePipeline::finish_work(ImageWork& image)
+{
+  if (image.num_pending.fetch_sub(1) == 1)
+  {
+    // the tiles waiting to be encoded are views of the levels, so the
+    // memory is only free once all of them are done
+    if (image.reserved_bytes)
+    {
+      MemoryBudget::current().release(image.reserved_bytes);
+      image.reserved_bytes = 0;
+    }
+
+    if (image.failed)
+    {
+      image.job_handle.set_failed();
+    }
+    else
+    {
+      image.job_handle.set_finished();
+    }
+  }
+}
+
+void
+TilePipeline::print_stats(std::ostream& out) const
+{
+  out << "TilePipeline:" << std::endl;
+  m_fetch_stage.print_stats(out);
+  m_decode_stage.print_stats(out);
+  m_external_decode_stage.print_stats(out);
+  m_scale_stage.print_stats(out);
+  m_cut_stage.print_stats(out);
+  m_encode_stage.print_stats(out);
+  m_store_stage.print_stats(out);
+}
+
+/* EOF */
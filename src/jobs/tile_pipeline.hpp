@@ -0,0 +1,135 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_JOBS_TILE_PIPELINE_HPP
+#define HEADER_GALAPIX_JOBS_TILE_PIPELINE_HPP
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "database/file_entry.hpp"
+#include "database/tile_entry.hpp"
+#include "galapix/tile.hpp"
+#include "job/job_handle.hpp"
+#include "job/pipeline_stage.hpp"
+
+class DatabaseThread;
+
+/**
+ * TilePipeline generates the tiles for whole images in a chain of
+ * stages: fetch -> decode -> scale -> cut -> encode -> store. Each
+ * stage has its own threads and a bounded queue, so different images
+ * can be in different stages at the same time and the statistics
+ * show which stage is the bottleneck. Images that need an external
+ * program get decoded in a stage of their own, so slow formats can't
+ * hold up the JPEGs and PNGs. Huge JPEGs are cut into tiles band by
+ * band right in the decode stage. With \a lossless_tiles the scale 0
+ * tiles of JPEGs are cut out of the file without decoding them, see
+ * TileGenerator::generate_lossless(). Used by "galapix prepare" and
+ * "galapix thumbgen" instead of MultipleTileGenerationJob.
+ */
+class TilePipeline
+{
+private:
+  struct ImageWork;
+  typedef std::shared_ptr<ImageWork> ImageWorkPtr;
+
+  struct TileWork
+  {
+    ImageWorkPtr image;
+    Tile tile;
+    TileEntry entry;
+
+    TileWork() :
+      image(),
+      tile(),
+      entry()
+    {}
+  };
+
+private:
+  DatabaseThread& m_database_thread;
+  bool m_lossless_tiles;
+
+  PipelineStage<ImageWorkPtr> m_fetch_stage;
+  PipelineStage<ImageWorkPtr> m_decode_stage;
+  PipelineStage<ImageWorkPtr> m_external_decode_stage;
+  PipelineStage<ImageWorkPtr> m_scale_stage;
+  PipelineStage<ImageWorkPtr> m_cut_stage;
+  PipelineStage<TileWork> m_encode_stage;
+  PipelineStage<TileWork> m_store_stage;
+
+  /** Tiles waiting to be handed to the DatabaseThread, only touched
+      by the store stage */
+  std::vector<TileWork> m_batch;
+
+public:
+  TilePipeline(DatabaseThread& database_thread, int num_threads, int num_io_threads,
+               bool lossless_tiles = false);
+  ~TilePipeline();
+
+  void start();
+
+  /** Waits till all queued images are processed and stops the
+      threads, the DatabaseThread has to keep running till this
+      returns */
+  void finish();
+
+  /** Generate the tiles from \a min_scale to \a max_scale, the range
+      is clipped against the tiles that are already in the database
+      (\a min_scale_in_db, \a max_scale_in_db). \a job_handle is
+      finished once all tiles are stored. Never blocks, so it is safe
+      to call from the DatabaseThread. */
+  void request(const JobHandle& job_handle, const FileEntry& file_entry,
+               int min_scale_in_db, int max_scale_in_db,
+               int min_scale, int max_scale);
+
+  void print_stats(std::ostream& out) const;
+
+private:
+  void fetch(ImageWorkPtr& image);
+  void decode(ImageWorkPtr& image);
+  void scale(ImageWorkPtr& image);
+  void cut(ImageWorkPtr& image);
+  void encode(TileWork& tile);
+  void store(TileWork& tile);
+
+  /** Hands a tile of \a image on to the encode stage */
+  void push_tile(ImageWorkPtr& image, const Tile& tile);
+
+  /** Hands an already encoded tile of \a image on to the store stage */
+  void push_entry(ImageWorkPtr& image, const TileEntry& entry);
+
+  /** Drop the image data, the reservation in the MemoryBudget is
+      kept till finish_work() as the tiles still share it */
+  void release_image(ImageWork& image);
+
+  /** Called once the image and each of its tiles are done, finishes
+      the JobHandle and releases the reservation in the MemoryBudget
+      once all of them are */
+  static void finish_work(ImageWork& image);
+
+private:
+  TilePipeline(const TilePipeline&);
+  TilePipeline& operator=(const TilePipeline&);
+};
+
+#endif
+
+/* EOF */
@@ -31,25 +31,31 @@
 
 namespace {
 
-Size apply_orientation(SoftwareSurface::Modifier modifier, const Size& size)
+/** Creating the libjpeg state for every tile is a noticeable part of
+    the work for small images, so each thread keeps its own
+    decompressor and compressor for JPEGs in memory */
+MemJPEGDecompressor& get_mem_decompressor(const uint8_t* data, int len)
 {
-  switch(modifier)
-  {
-    case SoftwareSurface::kRot90:
-    case SoftwareSurface::kRot90Flip:
-    case SoftwareSurface::kRot270:
-    case SoftwareSurface::kRot270Flip:
-      return Size(size.height, size.width);
-
-    case SoftwareSurface::kRot0:
-    case SoftwareSurface::kRot0Flip:
-    case SoftwareSurface::kRot180:
-    case SoftwareSurface::kRot180Flip:
-    default:
-      return size;
-  }
+  thread_local MemJPEGDecompressor decompressor;
+  decompressor.set_data(data, len);
+  return decompressor;
 }
 
+struct MemJPEGSaver
+{
+  std::vector<uint8_t> data;
+  MemJPEGCompressor compressor;
+
+  MemJPEGSaver() :
+    data(),
+    compressor(data)
+  {}
+
+private:
+  MemJPEGSaver(const MemJPEGSaver&);
+  MemJPEGSaver& operator=(const MemJPEGSaver&);
+};
+
 } // namespace
 
 
@@ -68,21 +74,22 @@ JPEG::get_size(const std::string& filename)
 {
   FileJPEGDecompressor loader(filename);
   Size size = loader.read_size();
-  return apply_orientation(EXIF::get_orientation(filename), size);
+  return SoftwareSurface::get_transformed_size(EXIF::get_orientation(filename), size);
 }
 
 
 Size
 JPEG::get_size(const uint8_t* data, int len)
 {
-  MemJPEGDecompressor loader(data, len);
+  MemJPEGDecompressor& loader = get_mem_decompressor(data, len);
   Size size = loader.read_size();
-  return apply_orientation(EXIF::get_orientation(data, len), size);
+  return SoftwareSurface::get_transformed_size(EXIF::get_orientation(data, len), size);
 }
 
 
 SoftwareSurfacePtr
-JPEG::load_from_file(const std::string& filename, int scale, Size* image_size)
+JPEG::load_from_file(const std::string& filename, int scale, Size* image_size,
+                     SoftwareSurface::Modifier* orientation)
 {
   FileJPEGDecompressor loader(filename);
   SoftwareSurfacePtr surface = loader.read_image(scale, image_size);
@@ -90,9 +97,14 @@ JPEG::load_from_file(const std::string& filename, int scale, Size* image_size)
   SoftwareSurface::Modifier modifier = EXIF::get_orientation(filename);
 
   if (image_size)
-    *image_size = apply_orientation(modifier, *image_size);
+    *image_size = SoftwareSurface::get_transformed_size(modifier, *image_size);
 
-  if (modifier == SoftwareSurface::kRot0)
+  if (orientation)
+  {
+    *orientation = modifier;
+    return surface;
+  }
+  else if (modifier == SoftwareSurface::kRot0)
   {
     return surface;
   }
@@ -104,17 +116,23 @@ JPEG::load_from_file(const std::string& filename, int scale, Size* image_size)
 
 
 SoftwareSurfacePtr
-JPEG::load_from_mem(const uint8_t* data, int len, int scale, Size* image_size)
+JPEG::load_from_mem(const uint8_t* data, int len, int scale, Size* image_size,
+                    SoftwareSurface::Modifier* orientation)
 {
-  MemJPEGDecompressor loader(data, len);
+  MemJPEGDecompressor& loader = get_mem_decompressor(data, len);
   SoftwareSurfacePtr surface = loader.read_image(scale, image_size);
 
   SoftwareSurface::Modifier modifier = EXIF::get_orientation(data, len);
 
   if (image_size)
-    *image_size = apply_orientation(modifier, *image_size);
+    *image_size = SoftwareSurface::get_transformed_size(modifier, *image_size);
 
-  if (modifier == SoftwareSurface::kRot0)
+  if (orientation)
+  {
+    *orientation = modifier;
+    return surface;
+  }
+  else if (modifier == SoftwareSurface::kRot0)
   {
     return surface;
   }
@@ -136,11 +154,20 @@ JPEG::save(const SoftwareSurfacePtr& surface, int quality, const std::string& fi
 BlobPtr
 JPEG::save(const SoftwareSurfacePtr& surface, int quality)
 {
-  std::vector<uint8_t> data;
-  MemJPEGCompressor compressor(data);
-  compressor.save(surface, quality);
-  // FIXME: Unneeded copy of data
-  return Blob::copy(data);
+  thread_local MemJPEGSaver saver;
+  // clear() keeps the capacity from the previous tiles
+  saver.data.clear();
+  saver.compressor.save(surface, quality);
+  BlobPtr blob = Blob::copy(saver.data);
+
+  // don't hold on to the memory of an unusually large image
+  if (saver.data.capacity() > 4 * 1024 * 1024)
+  {
+    std::vector<uint8_t>().swap(saver.data);
+    saver.compressor.set_output(saver.data);
+  }
+
+  return blob;
 }
   
 /* EOF */
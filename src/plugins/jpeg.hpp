@@ -38,22 +38,27 @@ public:
   /** Load a SoftwareSurface from the filesystem
       
       @param[in]  filename Filename of the file to load
-      @param[in]  scale    Scale the image by 1/scale (only 1,2,4,8 allowed)
+      @param[in]  scale    Scale the image by about 1/scale, see JPEGDecompressor::read_image()
       @param[out] size     The size of the unscaled image
+      @param[out] orientation  If given, the EXIF orientation is not
+                               applied to the image, but returned here
 
       @return reference counted pointer to a SoftwareSurface object
    */
-  static SoftwareSurfacePtr load_from_file(const std::string& filename, int scale = 1, Size* size = NULL);
+  static SoftwareSurfacePtr load_from_file(const std::string& filename, int scale = 1, Size* size = NULL,
+                                           SoftwareSurface::Modifier* orientation = NULL);
 
   /** Load a JPEG from memory 
       
       @param[in]  data  Address of the JPEG data
       @param[in]  len   Length of the JPEG data
       @param[out] size  The size of the unscaled image
+      @param[out] orientation  See load_from_file()
 
       @return reference counted pointer to a SoftwareSurface object
    */
-  static SoftwareSurfacePtr load_from_mem(const uint8_t* data, int len, int scale = 1, Size* size = NULL);
+  static SoftwareSurfacePtr load_from_mem(const uint8_t* data, int len, int scale = 1, Size* size = NULL,
+                                          SoftwareSurface::Modifier* orientation = NULL);
 
   static void save(const SoftwareSurfacePtr& surface, int quality, const std::string& filename);
   static BlobPtr save(const SoftwareSurfacePtr& surface, int quality);
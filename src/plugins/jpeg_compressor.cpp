@@ -20,7 +20,8 @@
 
 JPEGCompressor::JPEGCompressor() :
   m_cinfo(),
-  m_jerr()
+  m_jerr(),
+  m_row_pointers()
 {
   jpeg_std_error(&m_jerr);
 
@@ -37,29 +38,41 @@ JPEGCompressor::~JPEGCompressor()
 void
 JPEGCompressor::save(SoftwareSurfacePtr surface_in, int quality)
 {
-  SoftwareSurfacePtr surface = surface_in->to_rgb();
+  // to_rgb() would copy the surface even when it is RGB already
+  SoftwareSurfacePtr surface = (surface_in->get_format() == SoftwareSurface::RGB_FORMAT ||
+                                surface_in->get_format() == SoftwareSurface::L8_FORMAT)
+    ? surface_in
+    : surface_in->to_rgb();
 
   m_cinfo.image_width  = surface->get_width();
   m_cinfo.image_height = surface->get_height();
 
-  m_cinfo.input_components = 3;         /* # of color components per pixel */
-  m_cinfo.in_color_space   = JCS_RGB;   /* colorspace of input image */
+  if (surface->get_format() == SoftwareSurface::L8_FORMAT)
+  {
+    m_cinfo.input_components = 1;
+    m_cinfo.in_color_space   = JCS_GRAYSCALE;
+  }
+  else
+  {
+    m_cinfo.input_components = 3;         /* # of color components per pixel */
+    m_cinfo.in_color_space   = JCS_RGB;   /* colorspace of input image */
+  }
 
   jpeg_set_defaults(&m_cinfo);
   jpeg_set_quality(&m_cinfo, quality, TRUE /* limit to baseline-JPEG values */);
  
   jpeg_start_compress(&m_cinfo, TRUE);
 
-  std::unique_ptr<JSAMPROW[]> row_pointer(new JSAMPROW[surface->get_height()]);
+  m_row_pointers.resize(static_cast<size_t>(surface->get_height()));
   
   for(int y = 0; y < surface->get_height(); ++y)
   {
-    row_pointer[y] = static_cast<JSAMPLE*>(surface->get_row_data(y));
+    m_row_pointers[static_cast<size_t>(y)] = static_cast<JSAMPLE*>(surface->get_row_data(y));
   }
 
   while(m_cinfo.next_scanline < m_cinfo.image_height)
   {
-    jpeg_write_scanlines(&m_cinfo, &row_pointer[m_cinfo.next_scanline], 
+    jpeg_write_scanlines(&m_cinfo, &m_row_pointers[m_cinfo.next_scanline], 
                          surface->get_height() - m_cinfo.next_scanline);
   }
 
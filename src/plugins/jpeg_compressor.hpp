@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <jpeglib.h>
+#include <vector>
 
 #include "util/software_surface.hpp"
 
@@ -30,6 +31,9 @@ protected:
   struct jpeg_compress_struct m_cinfo;
   struct jpeg_error_mgr m_jerr;
 
+  /** Scratch buffer, kept around for when the compressor gets reused */
+  std::vector<JSAMPROW> m_row_pointers;
+
 protected:
   JPEGCompressor();
 
@@ -0,0 +1,172 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "plugins/jpeg_cropper.hpp"
+
+#include <assert.h>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
+#include "math/rect.hpp"
+#include "plugins/jpeg_memory_dest.hpp"
+#include "plugins/jpeg_memory_src.hpp"
+#include "util/raise_exception.hpp"
+
+void
+JPEGCropper::fatal_error_handler(j_common_ptr cinfo)
+{
+  longjmp(reinterpret_cast<ErrorMgr*>(cinfo->err)->setjmp_buffer, 1);
+}
+
+JPEGCropper::JPEGCropper(const uint8_t* data, int len) :
+  m_src(),
+  m_dst(),
+  m_err(),
+  m_coefficients(),
+  m_output()
+{
+  jpeg_std_error(&m_err.pub);
+  m_err.pub.error_exit = &JPEGCropper::fatal_error_handler;
+
+  // both share the error manager, they are never used at the same time
+  m_src.err = &m_err.pub;
+  m_dst.err = &m_err.pub;
+
+  jpeg_create_decompress(&m_src);
+  jpeg_create_compress(&m_dst);
+
+  if (setjmp(m_err.setjmp_buffer))
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (m_err.pub.format_message)(reinterpret_cast<j_common_ptr>(&m_src), buffer);
+
+    // the destructor won't run
+    jpeg_destroy_compress(&m_dst);
+    jpeg_destroy_decompress(&m_src);
+    raise_exception(std::runtime_error, buffer);
+  }
+  else
+  {
+    jpeg_memory_src(&m_src, data, len);
+    jpeg_read_header(&m_src, TRUE);
+    m_coefficients = jpeg_read_coefficients(&m_src);
+  }
+}
+
+JPEGCropper::~JPEGCropper()
+{
+  jpeg_destroy_compress(&m_dst);
+  jpeg_destroy_decompress(&m_src);
+}
+
+Size
+JPEGCropper::get_size() const
+{
+  return Size(static_cast<int>(m_src.image_width),
+              static_cast<int>(m_src.image_height));
+}
+
+Size
+JPEGCropper::get_imcu_size() const
+{
+  return Size(m_src.max_h_samp_factor * DCTSIZE,
+              m_src.max_v_samp_factor * DCTSIZE);
+}
+
+bool
+JPEGCropper::is_supported() const
+{
+  return (m_src.data_precision == 8 &&
+          ((m_src.jpeg_color_space == JCS_YCbCr     && m_src.num_components == 3) ||
+           (m_src.jpeg_color_space == JCS_GRAYSCALE && m_src.num_components == 1)));
+}
+
+BlobPtr
+JPEGCropper::crop(const Rect& rect)
+{
+  const Size imcu = get_imcu_size();
+  assert(rect.left % imcu.width == 0 && rect.top % imcu.height == 0);
+  assert(rect.left >= 0 && rect.top >= 0 &&
+         rect.right  <= get_size().width &&
+         rect.bottom <= get_size().height);
+
+  if (setjmp(m_err.setjmp_buffer))
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (m_err.pub.format_message)(reinterpret_cast<j_common_ptr>(&m_dst), buffer);
+
+    jpeg_abort_compress(&m_dst);
+    raise_exception(std::runtime_error, buffer);
+  }
+  else
+  {
+    m_output.clear();
+    jpeg_memory_dest(&m_dst, &m_output);
+
+    // same quantization tables and sampling as the source, so the
+    // coefficients can be used as they are
+    jpeg_copy_critical_parameters(&m_src, &m_dst);
+    m_dst.image_width  = static_cast<JDIMENSION>(rect.get_width());
+    m_dst.image_height = static_cast<JDIMENSION>(rect.get_height());
+
+    const JDIMENSION width_in_imcus  = static_cast<JDIMENSION>((rect.get_width()  + imcu.width  - 1) / imcu.width);
+    const JDIMENSION height_in_imcus = static_cast<JDIMENSION>((rect.get_height() + imcu.height - 1) / imcu.height);
+
+    std::vector<jvirt_barray_ptr> coefficients(static_cast<size_t>(m_src.num_components));
+    for(int ci = 0; ci < m_src.num_components; ++ci)
+    {
+      const jpeg_component_info& comp = m_src.comp_info[ci];
+      coefficients[static_cast<size_t>(ci)] =
+        (*m_dst.mem->request_virt_barray)(reinterpret_cast<j_common_ptr>(&m_dst), JPOOL_IMAGE, FALSE,
+                                          width_in_imcus  * static_cast<JDIMENSION>(comp.h_samp_factor),
+                                          height_in_imcus * static_cast<JDIMENSION>(comp.v_samp_factor),
+                                          static_cast<JDIMENSION>(comp.v_samp_factor));
+    }
+
+    jpeg_write_coefficients(&m_dst, coefficients.data());
+
+    for(int ci = 0; ci < m_dst.num_components; ++ci)
+    {
+      const jpeg_component_info& comp = m_dst.comp_info[ci];
+      const JDIMENSION v_samp   = static_cast<JDIMENSION>(comp.v_samp_factor);
+      const JDIMENSION x_blocks = static_cast<JDIMENSION>(rect.left / imcu.width  * comp.h_samp_factor);
+      const JDIMENSION y_blocks = static_cast<JDIMENSION>(rect.top  / imcu.height * comp.v_samp_factor);
+
+      for(JDIMENSION y = 0; y < comp.height_in_blocks; y += v_samp)
+      {
+        JBLOCKARRAY dst = (*m_dst.mem->access_virt_barray)(reinterpret_cast<j_common_ptr>(&m_dst),
+                                                           coefficients[static_cast<size_t>(ci)],
+                                                           y, v_samp, TRUE);
+        JBLOCKARRAY src = (*m_src.mem->access_virt_barray)(reinterpret_cast<j_common_ptr>(&m_src),
+                                                           m_coefficients[ci],
+                                                           y + y_blocks, v_samp, FALSE);
+        for(JDIMENSION row = 0; row < v_samp; ++row)
+        {
+          memcpy(dst[row], src[row] + x_blocks, comp.width_in_blocks * sizeof(JBLOCK));
+        }
+      }
+    }
+
+    jpeg_finish_compress(&m_dst);
+
+    return Blob::copy(m_output);
+  }
+}
+
+/* EOF */
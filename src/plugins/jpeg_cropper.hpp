@@ -0,0 +1,87 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_PLUGINS_JPEG_CROPPER_HPP
+#define HEADER_GALAPIX_PLUGINS_JPEG_CROPPER_HPP
+
+#include <stdio.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#include <vector>
+
+#include "math/size.hpp"
+#include "util/blob.hpp"
+
+class Rect;
+
+/** Cuts pieces out of a JPEG without decoding and encoding them
+    again, the DCT coefficients of their blocks are copied as they
+    are, like "jpegtran -crop" does. Nothing gets lost and it is much
+    faster than decoding, but a piece has to start at a multiple of
+    get_imcu_size(). */
+class JPEGCropper
+{
+private:
+  struct ErrorMgr
+  {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+  };
+
+private:
+  struct jpeg_decompress_struct m_src;
+  struct jpeg_compress_struct m_dst;
+  struct ErrorMgr m_err;
+
+  /** The coefficients of the whole image, owned by m_src */
+  jvirt_barray_ptr* m_coefficients;
+
+  /** Output buffer, kept around for the next crop() */
+  std::vector<uint8_t> m_output;
+
+public:
+  /** Reads the coefficients of the JPEG in \a data, \a data has to
+      stay around as long as the JPEGCropper */
+  JPEGCropper(const uint8_t* data, int len);
+  ~JPEGCropper();
+
+  Size get_size() const;
+
+  /** Size of the blocks of all components together, a crop has to
+      start at a multiple of it */
+  Size get_imcu_size() const;
+
+  /** Whether crop() can handle the color space, only YCbCr and
+      grayscale JPEGs are supported */
+  bool is_supported() const;
+
+  /** Returns the part \a rect of the image as JPEG, the quality is
+      the one of the source */
+  BlobPtr crop(const Rect& rect);
+
+private:
+  static void fatal_error_handler(j_common_ptr cinfo);
+
+private:
+  JPEGCropper(const JPEGCropper&);
+  JPEGCropper& operator=(const JPEGCropper&);
+};
+
+#endif
+
+/* EOF */
@@ -18,13 +18,34 @@
 
 #include "plugins/jpeg_decompressor.hpp"
 
+#include <algorithm>
 #include <assert.h>
-#include <iostream>
 #include <sstream>
 #include <stdexcept>
 
+#include "math/rect.hpp"
 #include "util/raise_exception.hpp"
 
+// jpeg_crop_scanline() and jpeg_skip_scanlines() are libjpeg-turbo
+// extensions, plain libjpeg has to decode the whole width and all
+// rows above the region
+#ifdef LIBJPEG_TURBO_VERSION
+#  define GALAPIX_JPEG_CROP
+#endif
+
+// libjpeg-turbo and libjpeg 7 and later scale by any M/8, libjpeg 6b
+// only by 1/2, 1/4 and 1/8
+#if defined(LIBJPEG_TURBO_VERSION) || JPEG_LIB_VERSION >= 70
+#  define GALAPIX_JPEG_SCALE_M_8
+#endif
+
+namespace {
+
+/** Rows of CMYK data that are decoded and converted to RGB at a time */
+const size_t kCMYKChunkRows = 16;
+
+} // namespace
+
 void
 JPEGDecompressor::fatal_error_handler(j_common_ptr cinfo)
 {
@@ -33,7 +54,9 @@ JPEGDecompressor::fatal_error_handler(j_common_ptr cinfo)
 
 JPEGDecompressor::JPEGDecompressor() :
   m_cinfo(),
-  m_err()
+  m_err(),
+  m_scanlines(),
+  m_output_data()
 {
   jpeg_std_error(&m_err.pub);
 
@@ -73,115 +96,239 @@ JPEGDecompressor::read_size()
 SoftwareSurfacePtr
 JPEGDecompressor::read_image(int scale, Size* image_size)
 {
-  if (!(scale == 1 ||
-        scale == 2 ||
-        scale == 4 ||
-        scale == 8))
+  if (setjmp(m_err.setjmp_buffer))
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (m_cinfo.err->format_message)(reinterpret_cast<jpeg_common_struct*>(&m_cinfo), buffer);
+
+    std::ostringstream out;
+    out << "JPEG::read_image(): " /*<< filename << ": "*/ << buffer;
+    raise_exception(std::runtime_error, out.str());
+  }
+  else
   {
-    std::cout << "JPEGDecompressor::read_image: Invalid scale: " << scale << std::endl;
-    assert(0);
+    start_decompress(scale, image_size);
+
+    SoftwareSurfacePtr surface = SoftwareSurface::create(get_output_format(),
+                                                         Size(static_cast<int>(m_cinfo.output_width),
+                                                              static_cast<int>(m_cinfo.output_height)));
+    read_rows(*surface, surface->get_height());
+
+    return surface;
   }
+}
 
+Size
+JPEGDecompressor::start(int scale, Size* image_size)
+{
   if (setjmp(m_err.setjmp_buffer))
   {
     char buffer[JMSG_LENGTH_MAX];
     (m_cinfo.err->format_message)(reinterpret_cast<jpeg_common_struct*>(&m_cinfo), buffer);
 
     std::ostringstream out;
-    out << "JPEG::read_image(): " /*<< filename << ": "*/ << buffer;
+    out << "JPEG::start(): " << buffer;
     raise_exception(std::runtime_error, out.str());
   }
   else
   {
-    jpeg_read_header(&m_cinfo, /*require_image*/ FALSE);
+    start_decompress(scale, image_size);
+
+    return Size(static_cast<int>(m_cinfo.output_width),
+                static_cast<int>(m_cinfo.output_height));
+  }
+}
 
-    if (image_size)
+SoftwareSurfacePtr
+JPEGDecompressor::read_band(int band_height)
+{
+  assert(band_height > 0);
+
+  if (setjmp(m_err.setjmp_buffer))
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (m_cinfo.err->format_message)(reinterpret_cast<jpeg_common_struct*>(&m_cinfo), buffer);
+
+    std::ostringstream out;
+    out << "JPEG::read_band(): " << buffer;
+    raise_exception(std::runtime_error, out.str());
+  }
+  else
+  {
+    const int rows_left = static_cast<int>(m_cinfo.output_height - m_cinfo.output_scanline);
+    if (rows_left <= 0)
     {
-      image_size->width = static_cast<int>(m_cinfo.image_width);
-      image_size->height = static_cast<int>(m_cinfo.image_height);
+      return SoftwareSurfacePtr();
     }
-
-    if (scale != 1) // scale the image down by \a scale
+    else
     {
-      // by default all those values below are on 1
-      m_cinfo.scale_num = 1;
-      m_cinfo.scale_denom = static_cast<unsigned int>(scale);
-
-      m_cinfo.do_fancy_upsampling = FALSE; /* TRUE=apply fancy upsampling */
-      m_cinfo.do_block_smoothing  = FALSE; /* TRUE=apply interblock smoothing */
+      // each band is a surface of its own, so the caller can keep
+      // views into it
+      SoftwareSurfacePtr band = SoftwareSurface::create(get_output_format(),
+                                                        Size(static_cast<int>(m_cinfo.output_width),
+                                                             std::min(band_height, rows_left)));
+      read_rows(*band, band->get_height());
+      return band;
     }
+  }
+}
 
-    jpeg_start_decompress(&m_cinfo);
+SoftwareSurfacePtr
+JPEGDecompressor::read_region(const Rect& rect)
+{
+  assert(m_cinfo.output_scanline == 0);
+  assert(rect.left >= 0 && rect.top >= 0 &&
+         rect.right  <= static_cast<int>(m_cinfo.output_width) &&
+         rect.bottom <= static_cast<int>(m_cinfo.output_height));
 
-    SoftwareSurfacePtr surface = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT,
-                                                         Size(static_cast<int>(m_cinfo.output_width),
-                                                              static_cast<int>(m_cinfo.output_height)));
+  if (setjmp(m_err.setjmp_buffer))
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (m_cinfo.err->format_message)(reinterpret_cast<jpeg_common_struct*>(&m_cinfo), buffer);
 
-    if (m_cinfo.out_color_space == JCS_RGB &&
-        m_cinfo.output_components == 3)
+    std::ostringstream out;
+    out << "JPEG::read_region(): " << buffer;
+    raise_exception(std::runtime_error, out.str());
+  }
+  else
+  {
+#ifdef GALAPIX_JPEG_CROP
+    // upsampling the chroma at the edge of the crop uses the edge
+    // pixels instead of their neighbours, so an extra iMCU is decoded
+    // on both sides, the crop gets widened to whole iMCUs and
+    // output_width becomes its width
+    const int imcu_width = m_cinfo.max_h_samp_factor * m_cinfo.min_DCT_scaled_size;
+    const int crop_left  = std::max(0, rect.left - imcu_width);
+    const int crop_right = std::min(static_cast<int>(m_cinfo.output_width), rect.right + imcu_width);
+    JDIMENSION xoffset = static_cast<JDIMENSION>(crop_left);
+    JDIMENSION width   = static_cast<JDIMENSION>(crop_right - crop_left);
+    jpeg_crop_scanline(&m_cinfo, &xoffset, &width);
+    jpeg_skip_scanlines(&m_cinfo, static_cast<JDIMENSION>(rect.top));
+    const int left = rect.left - static_cast<int>(xoffset);
+#else
+    // without libjpeg-turbo the rows above have to be decoded anyway,
+    // but only the region is kept
+    if (rect.top > 0)
     {
-      std::vector<JSAMPLE*> scanlines(m_cinfo.output_height);
-
-      for(JDIMENSION y = 0; y < m_cinfo.output_height; ++y)
-        scanlines[y] = surface->get_row_data(static_cast<int>(y));
-
-      while (m_cinfo.output_scanline < m_cinfo.output_height)
+      SoftwareSurfacePtr skip = SoftwareSurface::create(get_output_format(),
+                                                        Size(static_cast<int>(m_cinfo.output_width),
+                                                             std::min(rect.top, 64)));
+      for(int y = 0; y < rect.top; y += skip->get_height())
       {
-        jpeg_read_scanlines(&m_cinfo, &scanlines[m_cinfo.output_scanline],
-                            m_cinfo.output_height - m_cinfo.output_scanline);
+        read_rows(*skip, std::min(skip->get_height(), rect.top - y));
       }
     }
-    else if (m_cinfo.out_color_space == JCS_GRAYSCALE &&
-             m_cinfo.output_components == 1)
-    {
-      std::vector<JSAMPLE*> scanlines(m_cinfo.output_height);
+    const int left = rect.left;
+#endif
+
+    SoftwareSurfacePtr rows = SoftwareSurface::create(get_output_format(),
+                                                      Size(static_cast<int>(m_cinfo.output_width),
+                                                           rect.get_height()));
+    read_rows(*rows, rows->get_height());
+    return rows->crop(Rect(Vector2i(left, 0), rect.get_size()));
+  }
+}
 
-      for(JDIMENSION y = 0; y < m_cinfo.output_height; ++y)
-        scanlines[y] = surface->get_row_data(static_cast<int>(y));
+void
+JPEGDecompressor::start_decompress(int scale, Size* image_size)
+{
+  if (scale < 1)
+  {
+    raise_exception(std::runtime_error, "invalid scale: " << scale);
+  }
 
-      while (m_cinfo.output_scanline < m_cinfo.output_height)
-      {
-        jpeg_read_scanlines(&m_cinfo, &scanlines[m_cinfo.output_scanline],
-                            m_cinfo.output_height - m_cinfo.output_scanline);
-      }
+  jpeg_read_header(&m_cinfo, /*require_image*/ FALSE);
 
-      // Expand the greyscale data to RGB
-      // FIXME: Could be made faster if SoftwareSurface would support
-      // other color formats
-      for(int y = 0; y < surface->get_height(); ++y)
-      {
-        uint8_t* rowptr = surface->get_row_data(y);
-        for(int x = surface->get_width()-1; x >= 0; --x)
-        {
-          rowptr[3*x+0] = rowptr[x];
-          rowptr[3*x+1] = rowptr[x];
-          rowptr[3*x+2] = rowptr[x];
-        }
-      }
+  if (image_size)
+  {
+    image_size->width = static_cast<int>(m_cinfo.image_width);
+    image_size->height = static_cast<int>(m_cinfo.image_height);
+  }
+
+  if (scale != 1) // scale the image down by \a scale
+  {
+#ifdef GALAPIX_JPEG_SCALE_M_8
+    // the smallest M/8 that still gives at least 1/scale of the size,
+    // 1/8 is as far as the decoder goes
+    m_cinfo.scale_num   = static_cast<unsigned int>((8 + scale - 1) / scale);
+    m_cinfo.scale_denom = 8;
+#else
+    // the largest power of two up to scale and 8
+    unsigned int denom = 1;
+    while(denom < 8 && 2 * denom <= static_cast<unsigned int>(scale))
+    {
+      denom *= 2;
     }
-    else if (m_cinfo.out_color_space == JCS_CMYK &&
-             m_cinfo.output_components == 4)
+    m_cinfo.scale_num   = 1;
+    m_cinfo.scale_denom = denom;
+#endif
+
+    m_cinfo.do_fancy_upsampling = FALSE; /* TRUE=apply fancy upsampling */
+    m_cinfo.do_block_smoothing  = FALSE; /* TRUE=apply interblock smoothing */
+  }
+
+  jpeg_start_decompress(&m_cinfo);
+}
+
+SoftwareSurface::Format
+JPEGDecompressor::get_output_format() const
+{
+  // grayscale images stay grayscale, that saves two thirds of the memory
+  return (m_cinfo.out_color_space == JCS_GRAYSCALE)
+    ? SoftwareSurface::L8_FORMAT
+    : SoftwareSurface::RGB_FORMAT;
+}
+
+void
+JPEGDecompressor::read_rows(SoftwareSurface& surface, int num_rows)
+{
+  const size_t rows = static_cast<size_t>(num_rows);
+
+  if ((m_cinfo.out_color_space == JCS_RGB &&
+       m_cinfo.output_components == 3) ||
+      (m_cinfo.out_color_space == JCS_GRAYSCALE &&
+       m_cinfo.output_components == 1))
+  {
+    m_scanlines.resize(rows);
+
+    for(size_t y = 0; y < rows; ++y)
+      m_scanlines[y] = surface.get_row_data(static_cast<int>(y));
+
+    for(JDIMENSION y = 0; y < rows; )
     {
-      std::vector<JSAMPLE> output_data(m_cinfo.output_width * m_cinfo.output_height *
-                                       m_cinfo.output_components);
-      std::vector<JSAMPLE*> scanlines(m_cinfo.output_height);
+      y += jpeg_read_scanlines(&m_cinfo, &m_scanlines[y], static_cast<JDIMENSION>(rows) - y);
+    }
+  }
+  else if (m_cinfo.out_color_space == JCS_CMYK &&
+           m_cinfo.output_components == 4)
+  {
+    const size_t pitch = m_cinfo.output_width * static_cast<size_t>(m_cinfo.output_components);
 
-      for(JDIMENSION y = 0; y < m_cinfo.output_height; ++y)
-      {
-        scanlines[y] = &output_data[y * m_cinfo.output_width * m_cinfo.output_components];
-      }
+    // converted a few rows at a time, as the decompressor lives as
+    // long as its thread and would otherwise keep a buffer for the
+    // largest image it ever read
+    const size_t chunk_rows = std::min(rows, kCMYKChunkRows);
+    m_output_data.resize(pitch * chunk_rows);
+    m_scanlines.resize(chunk_rows);
+
+    for(size_t y = 0; y < chunk_rows; ++y)
+    {
+      m_scanlines[y] = &m_output_data[y * pitch];
+    }
 
-      while (m_cinfo.output_scanline < m_cinfo.output_height)
+    for(size_t chunk_y = 0; chunk_y < rows; chunk_y += chunk_rows)
+    {
+      const size_t count = std::min(chunk_rows, rows - chunk_y);
+      for(JDIMENSION y = 0; y < count; )
       {
-        jpeg_read_scanlines(&m_cinfo, &scanlines[m_cinfo.output_scanline],
-                            m_cinfo.output_height - m_cinfo.output_scanline);
+        y += jpeg_read_scanlines(&m_cinfo, &m_scanlines[y], static_cast<JDIMENSION>(count) - y);
       }
 
-      for(int y = 0; y < surface->get_height(); ++y)
+      for(size_t y = 0; y < count; ++y)
       {
-        uint8_t* jpegptr = &output_data[y * m_cinfo.output_width * m_cinfo.output_components];
-        uint8_t* rowptr = surface->get_row_data(y);
-        for(int x = surface->get_width()-1; x >= 0; --x)
+        uint8_t* jpegptr = &m_output_data[y * pitch];
+        uint8_t* rowptr = surface.get_row_data(static_cast<int>(chunk_y + y));
+        for(int x = surface.get_width()-1; x >= 0; --x)
         {
           uint8_t const cmyk_c = jpegptr[4*x + 0];
           uint8_t const cmyk_m = jpegptr[4*x + 1];
@@ -194,15 +341,13 @@ JPEGDecompressor::read_image(int scale, Size* image_size)
         }
       }
     }
-    else
-    {
-      std::ostringstream str;
-      str << "JPEGDecompressor::read_image(): Unsupported colorspace: "
-          << m_cinfo.out_color_space << " components: " << m_cinfo.output_components;
-      raise_exception(std::runtime_error, str.str());
-    }
-
-    return surface;
+  }
+  else
+  {
+    std::ostringstream str;
+    str << "JPEGDecompressor::read_image(): Unsupported colorspace: "
+        << m_cinfo.out_color_space << " components: " << m_cinfo.output_components;
+    raise_exception(std::runtime_error, str.str());
   }
 }
 
@@ -22,10 +22,13 @@
 #include <stdio.h>
 #include <jpeglib.h>
 #include <setjmp.h>
+#include <vector>
 
 #include "math/size.hpp"
 #include "util/software_surface.hpp"
 
+class Rect;
+
 class JPEGDecompressor
 {
 protected:
@@ -39,6 +42,10 @@ protected:
   struct jpeg_decompress_struct  m_cinfo;
   struct ErrorMgr m_err;
 
+  /** Scratch buffers, kept around for when the decompressor gets reused */
+  std::vector<JSAMPLE*> m_scanlines;
+  std::vector<JSAMPLE> m_output_data;
+
 protected:
   JPEGDecompressor();
 
@@ -46,9 +53,36 @@ public:
   virtual ~JPEGDecompressor();
   
   Size read_size();
+
+  /** Decodes the image scaled down by \a scale, which can be any
+      integer. The decoder scales by M/8 (or 1/2^n with plain libjpeg
+      6b), so the result is the smallest such size that is still at
+      least 1/scale of the image, but never smaller than 1/8.
+      \a image_size receives the unscaled size. */
   SoftwareSurfacePtr read_image(int scale, Size* image_size);
 
+  /** Starts decoding the image for read_band() or read_region(),
+      returns the size of the decoded image, \a image_size receives
+      the unscaled one */
+  Size start(int scale, Size* image_size);
+
+  /** Decodes the next \a band_height rows, so the whole image never
+      has to be in memory at once. The last band can be smaller, once
+      all rows are read an empty pointer is returned. */
+  SoftwareSurfacePtr read_band(int band_height);
+
+  /** Decodes only \a rect of the image, has to be called right after
+      start(). With libjpeg-turbo only the iMCUs that cover \a rect
+      get decoded, the returned surface is a view of exactly \a rect. */
+  SoftwareSurfacePtr read_region(const Rect& rect);
+
 private:
+  void start_decompress(int scale, Size* image_size);
+  SoftwareSurface::Format get_output_format() const;
+
+  /** Reads the next \a num_rows scanlines into the first rows of \a surface */
+  void read_rows(SoftwareSurface& surface, int num_rows);
+
   static void fatal_error_handler(j_common_ptr cinfo);
   
 private:
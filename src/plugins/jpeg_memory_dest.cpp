@@ -42,10 +42,7 @@ boolean jpeg_memory_empty_output_buffer(j_compress_ptr cinfo)
   
   // This function always gets OUTPUT_BUF_SIZE bytes,
   // cinfo->dest->free_in_buffer *must* be ignored
-  for(size_t i = 0; i < OUTPUT_BUF_SIZE; ++i) 
-  { // FIXME: Little slow maybe?
-    mgr->data->push_back(mgr->buffer[i]);
-  }
+  mgr->data->insert(mgr->data->end(), mgr->buffer, mgr->buffer + OUTPUT_BUF_SIZE);
 
   cinfo->dest->next_output_byte = mgr->buffer;
   cinfo->dest->free_in_buffer   = OUTPUT_BUF_SIZE;
@@ -58,10 +55,7 @@ void jpeg_memory_term_destination(j_compress_ptr cinfo)
   struct jpeg_memory_destination_mgr* mgr = (struct jpeg_memory_destination_mgr*)cinfo->dest;
   size_t datacount = OUTPUT_BUF_SIZE - cinfo->dest->free_in_buffer;
 
-  for(size_t i = 0; i < datacount; ++i)
-  { // FIXME: Little slow maybe?
-    mgr->data->push_back(mgr->buffer[i]);
-  }
+  mgr->data->insert(mgr->data->end(), mgr->buffer, mgr->buffer + datacount);
 }
 
 void jpeg_memory_dest(j_compress_ptr cinfo, std::vector<uint8_t>* data)
@@ -48,8 +48,8 @@ KRA::load_from_file(const std::string& filename)
   koconverter.arg(filename).arg("/dev/stdout");
   koconverter.exec();
   
-  return PNG::load_from_mem(reinterpret_cast<const uint8_t*>(&*koconverter.get_stdout().begin()),
-                            koconverter.get_stdout().size());
+  BlobPtr png = koconverter.get_stdout();
+  return PNG::load_from_mem(png->get_data(), png->size());
 }
 
 // SoftwareSurface
@@ -29,4 +29,10 @@ MemJPEGCompressor::~MemJPEGCompressor()
 {
 }
 
+void
+MemJPEGCompressor::set_output(std::vector<uint8_t>& data)
+{
+  jpeg_memory_dest(&m_cinfo, &data);
+}
+
 /* EOF */
@@ -31,6 +31,8 @@ public:
   MemJPEGCompressor(std::vector<uint8_t>& data);
   ~MemJPEGCompressor();
 
+  /** Let the next save() append to \a data instead */
+  void set_output(std::vector<uint8_t>& data);
 
 private:
   MemJPEGCompressor(const MemJPEGCompressor&);
@@ -20,6 +20,10 @@
 
 #include "plugins/jpeg_memory_src.hpp"
 
+MemJPEGDecompressor::MemJPEGDecompressor()
+{
+}
+
 MemJPEGDecompressor::MemJPEGDecompressor(const uint8_t* data, int len)
 {
   jpeg_memory_src(&m_cinfo, data, len);
@@ -29,4 +33,12 @@ MemJPEGDecompressor::~MemJPEGDecompressor()
 {
 }
 
+void
+MemJPEGDecompressor::set_data(const uint8_t* data, int len)
+{
+  // keeps the source manager, it is allocated in the permanent pool
+  jpeg_abort_decompress(&m_cinfo);
+  jpeg_memory_src(&m_cinfo, data, len);
+}
+
 /* EOF */
@@ -25,9 +25,17 @@ class MemJPEGDecompressor : public JPEGDecompressor
 {
 private:
 public:
+  /** Creates a decompressor without data, set_data() must be called
+      before it can be used */
+  MemJPEGDecompressor();
   MemJPEGDecompressor(const uint8_t* data, int len);
   ~MemJPEGDecompressor();
 
+  /** Point the decompressor at a new JPEG, whatever the previous one
+      left behind is discarded, so the libjpeg state can be reused
+      even after an error */
+  void set_data(const uint8_t* data, int len);
+
 private:
   MemJPEGDecompressor(const MemJPEGDecompressor&);
   MemJPEGDecompressor& operator=(const MemJPEGDecompressor&);
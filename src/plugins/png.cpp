@@ -22,9 +22,40 @@
 #include <png.h>
 #include <stdexcept>
 #include <string.h>
+#include <vector>
 
 #include "util/log.hpp"
 
+namespace {
+
+/** Row pointers for png_read_image(), kept per thread so loading tiles
+    doesn't allocate them anew each time */
+png_bytepp get_row_pointers(const SoftwareSurfacePtr& surface)
+{
+  thread_local std::vector<png_bytep> row_pointers;
+  row_pointers.resize(static_cast<size_t>(surface->get_height()));
+  for (int y = 0; y < surface->get_height(); ++y)
+    row_pointers[static_cast<size_t>(y)] = surface->get_row_data(y);
+  return row_pointers.data();
+}
+
+int get_color_type(const SoftwareSurfacePtr& surface)
+{
+  switch(surface->get_format())
+  {
+    case SoftwareSurface::L8_FORMAT:
+      return PNG_COLOR_TYPE_GRAY;
+
+    case SoftwareSurface::RGB_FORMAT:
+      return PNG_COLOR_TYPE_RGB;
+
+    default:
+      return PNG_COLOR_TYPE_RGBA;
+  }
+}
+
+} // namespace
+
 struct PNGReadMemory
 {
   const png_byte* data;
@@ -142,14 +173,18 @@ PNG::load_from_file(const std::string& filename)
 
     png_read_info(png_ptr, info_ptr); 
       
-    // Convert all formats to either RGB or RGBA so we don't have to
-    // handle them all seperatly
+    // Convert all formats to either L8, RGB or RGBA so we don't have to
+    // handle them all seperatly, only gray with alpha needs to become RGBA
     png_set_strip_16(png_ptr);
     png_set_expand_gray_1_2_4_to_8(png_ptr);
     png_set_palette_to_rgb(png_ptr);
     png_set_expand(png_ptr); // FIXME: What does this do? what the other don't?
     png_set_tRNS_to_alpha(png_ptr);
-    png_set_gray_to_rgb(png_ptr);
+    if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY_ALPHA ||
+        png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+    {
+      png_set_gray_to_rgb(png_ptr);
+    }
 
     png_read_update_info(png_ptr, info_ptr);
 
@@ -165,23 +200,23 @@ PNG::load_from_file(const std::string& filename)
       {
         surface = SoftwareSurface::create(SoftwareSurface::RGBA_FORMAT, Size(width, height));
 
-        std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
-        for (int y = 0; y < height; ++y)
-          row_pointers[y] = surface->get_row_data(y);
-            
-        png_read_image(png_ptr, row_pointers.get());
+        png_read_image(png_ptr, get_row_pointers(surface));
       }
       break;           
 
+      case PNG_COLOR_TYPE_GRAY:
+      {
+        surface = SoftwareSurface::create(SoftwareSurface::L8_FORMAT, Size(width, height));
+
+        png_read_image(png_ptr, get_row_pointers(surface));
+      }
+      break;
+
       case PNG_COLOR_TYPE_RGB:
       {
         surface = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT, Size(width, height));
 
-        std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
-        for (int y = 0; y < height; ++y)
-          row_pointers[y] = surface->get_row_data(y);
-            
-        png_read_image(png_ptr, row_pointers.get());
+        png_read_image(png_ptr, get_row_pointers(surface));
       }
       break;
     }
@@ -216,14 +251,18 @@ PNG::load_from_mem(const uint8_t* data, int len)
 
   png_read_info(png_ptr, info_ptr); 
       
-  // Convert all formats to either RGB or RGBA so we don't have to
-  // handle them all seperatly
+  // Convert all formats to either L8, RGB or RGBA so we don't have to
+  // handle them all seperatly, only gray with alpha needs to become RGBA
   png_set_strip_16(png_ptr);
   png_set_expand_gray_1_2_4_to_8(png_ptr);
   png_set_palette_to_rgb(png_ptr);
   png_set_expand(png_ptr); // FIXME: What does this do? what the other don't?
   png_set_tRNS_to_alpha(png_ptr);
-  png_set_gray_to_rgb(png_ptr);
+  if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY_ALPHA ||
+      png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+  {
+    png_set_gray_to_rgb(png_ptr);
+  }
 
   png_read_update_info(png_ptr, info_ptr);
 
@@ -239,23 +278,23 @@ PNG::load_from_mem(const uint8_t* data, int len)
     {
       surface = SoftwareSurface::create(SoftwareSurface::RGBA_FORMAT, Size(width, height));
 
-      std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
-      for (int y = 0; y < height; ++y)
-        row_pointers[y] = surface->get_row_data(y);
-            
-      png_read_image(png_ptr, row_pointers.get());
+      png_read_image(png_ptr, get_row_pointers(surface));
     }
     break;           
 
+    case PNG_COLOR_TYPE_GRAY:
+    {
+      surface = SoftwareSurface::create(SoftwareSurface::L8_FORMAT, Size(width, height));
+
+      png_read_image(png_ptr, get_row_pointers(surface));
+    }
+    break;
+
     case PNG_COLOR_TYPE_RGB:
     {
       surface = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT, Size(width, height));
           
-      std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
-      for (int y = 0; y < height; ++y)
-        row_pointers[y] = surface->get_row_data(y);
-            
-      png_read_image(png_ptr, row_pointers.get());
+      png_read_image(png_ptr, get_row_pointers(surface));
     }
     break;
   }
@@ -292,7 +331,7 @@ PNG::save(const SoftwareSurfacePtr& surface, const std::string& filename)
 
     png_set_IHDR(png_ptr, info_ptr, 
                  surface->get_width(), surface->get_height(), 8,
-                 (surface->get_format() == SoftwareSurface::RGB_FORMAT) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA, 
+                 get_color_type(surface), 
                  PNG_INTERLACE_NONE, 
                  PNG_COMPRESSION_TYPE_DEFAULT,
                  PNG_FILTER_TYPE_DEFAULT);
@@ -310,20 +349,10 @@ PNG::save(const SoftwareSurfacePtr& surface, const std::string& filename)
   }
 }
 
-class PNGWriteMemory
-{
-public:
-  std::vector<uint8_t> data;
-
-  PNGWriteMemory() :
-    data()
-  {}
-};
-
 void writePNGMemory(png_structp png_ptr, png_bytep data, png_size_t length)
 {
-  PNGWriteMemory* mem = static_cast<PNGWriteMemory*>(png_get_io_ptr(png_ptr));
-  std::copy(data, data+length, std::back_inserter(mem->data));
+  std::vector<uint8_t>* mem = static_cast<std::vector<uint8_t>*>(png_get_io_ptr(png_ptr));
+  mem->insert(mem->end(), data, data + length);
 }
 
 BlobPtr
@@ -340,12 +369,15 @@ PNG::save(const SoftwareSurfacePtr& surface)
     throw std::runtime_error("PNG::save(): setjmp: Couldn't save to Blob");
   }
 
-  PNGWriteMemory mem;
+  // libpng can't reuse its write struct, but the output buffer can be
+  // kept per thread, clear() keeps the capacity from the previous tiles
+  thread_local std::vector<uint8_t> mem;
+  mem.clear();
   png_set_write_fn(png_ptr, &mem, &writePNGMemory, NULL);
 
   png_set_IHDR(png_ptr, info_ptr, 
                surface->get_width(), surface->get_height(), 8,
-               (surface->get_format() == SoftwareSurface::RGB_FORMAT) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA, 
+               get_color_type(surface), 
                PNG_INTERLACE_NONE, 
                PNG_COMPRESSION_TYPE_DEFAULT,
                PNG_FILTER_TYPE_DEFAULT);
@@ -359,7 +391,15 @@ PNG::save(const SoftwareSurfacePtr& surface)
 
   png_destroy_write_struct(&png_ptr, &info_ptr);
 
-  return Blob::copy(mem.data);
+  BlobPtr blob = Blob::copy(mem);
+
+  // don't hold on to the memory of an unusually large image
+  if (mem.capacity() > 4 * 1024 * 1024)
+  {
+    std::vector<uint8_t>().swap(mem);
+  }
+
+  return blob;
 }
 
 
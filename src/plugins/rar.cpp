@@ -30,9 +30,9 @@ Rar::get_filenames(const std::string& rar_filename)
   if (rar.exec() == 0)
   {
     std::vector<std::string> lst;
-    const std::vector<char>& stdout_lst = rar.get_stdout();
-    std::vector<char>::const_iterator start = stdout_lst.begin();
-    for(std::vector<char>::const_iterator i = stdout_lst.begin(); i != stdout_lst.end(); ++i)
+    const std::string stdout_lst = rar.get_stdout()->str();
+    std::string::const_iterator start = stdout_lst.begin();
+    for(std::string::const_iterator i = stdout_lst.begin(); i != stdout_lst.end(); ++i)
     {
       if (*i == '\n')
       {
@@ -56,8 +56,7 @@ Rar::get_file(const std::string& rar_filename, const std::string& filename)
   rar.arg("p").arg("-inul").arg("-p-").arg(rar_filename).arg(filename);
   if (rar.exec() == 0)
   {
-    // FIXME: Unneeded copy of data
-    return Blob::copy(&*rar.get_stdout().begin(), rar.get_stdout().size());
+    return rar.get_stdout();
   }
   else
   {
@@ -53,7 +53,7 @@ RSVG::load_from_file(const std::string& filename)
 
   if (rsvg.exec() == 0)
   {
-    BlobPtr blob = Blob::copy(&*rsvg.get_stdout().begin(), rsvg.get_stdout().size());
+    BlobPtr blob = rsvg.get_stdout();
     SoftwareSurfacePtr surface = PNG::load_from_mem(blob->get_data(), blob->size());
     return surface;
   }
@@ -20,19 +20,31 @@
 
 #include <stdexcept>
 
+#include "plugins/tar_reader.hpp"
 #include "util/exec.hpp"
+#include "util/log.hpp"
 
 std::vector<std::string>
 Tar::get_filenames(const std::string& tar_filename)
 {
+  try
+  {
+    return TarReader::get(tar_filename)->get_filenames();
+  }
+  catch(const std::exception& err)
+  {
+    // bzip2, xz and other compressions are left to tar
+    log_debug << err.what() << ", falling back to tar" << std::endl;
+  }
+
   Exec tar("tar");
   tar.arg("--list").arg("--file").arg(tar_filename);
   if (tar.exec() == 0)
   {
     std::vector<std::string> lst;
-    const std::vector<char>& stdout_lst = tar.get_stdout();
-    std::vector<char>::const_iterator start = stdout_lst.begin();
-    for(std::vector<char>::const_iterator i = stdout_lst.begin(); i != stdout_lst.end(); ++i)
+    const std::string stdout_lst = tar.get_stdout()->str();
+    std::string::const_iterator start = stdout_lst.begin();
+    for(std::string::const_iterator i = stdout_lst.begin(); i != stdout_lst.end(); ++i)
     {
       if (*i == '\n')
       {
@@ -52,12 +64,21 @@ Tar::get_filenames(const std::string& tar_filename)
 BlobPtr
 Tar::get_file(const std::string& tar_filename, const std::string& filename)
 {
+  try
+  {
+    return TarReader::get(tar_filename)->get_file(filename);
+  }
+  catch(const std::exception&)
+  {
+    // already reported by get_filenames(), tar gives a proper error
+    // message if it is something else
+  }
+
   Exec tar("tar");
   tar.arg("--extract").arg("--to-stdout").arg("--file").arg(tar_filename).arg(filename);
   if (tar.exec() == 0)
   {
-    // FIXME: Unneeded copy of data
-    return Blob::copy(&*tar.get_stdout().begin(), tar.get_stdout().size());
+    return tar.get_stdout();
   }
   else
   {
@@ -0,0 +1,730 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "plugins/tar_reader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <limits.h>
+#include <list>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const size_t kBlockSize = 512;
+
+/** Members of compressed archives that are kept around for later
+    requests, for all archives together */
+const size_t kMaxPendingBytes = 32 * 1024 * 1024;
+
+std::atomic<size_t> g_pending_bytes(0);
+
+/** Counts \a bytes against kMaxPendingBytes, false if they don't fit */
+bool reserve_pending(size_t bytes)
+{
+  size_t current = g_pending_bytes.load();
+  do
+  {
+    if (bytes > kMaxPendingBytes - current)
+    {
+      return false;
+    }
+  }
+  while(!g_pending_bytes.compare_exchange_weak(current, current + bytes));
+  return true;
+}
+
+/** Number of archives whose index is kept around */
+const size_t kMaxCachedReaders = 8;
+
+/** Sequential access to the uncompressed archive data */
+class TarStream
+{
+public:
+  virtual ~TarStream() {}
+
+  /** Returns the number of bytes read, less than \a len only at the
+      end of the archive */
+  virtual size_t read(void* buf, size_t len) = 0;
+  virtual void skip(uint64_t len) = 0;
+  virtual uint64_t tell() const = 0;
+
+  void read_exact(void* buf, size_t len)
+  {
+    if (read(buf, len) != len)
+    {
+      throw std::runtime_error("TarReader: unexpected end of archive");
+    }
+  }
+};
+
+class FileTarStream : public TarStream
+{
+private:
+  int m_fd;
+  uint64_t m_offset;
+
+public:
+  FileTarStream(int fd) :
+    m_fd(fd),
+    m_offset(0)
+  {}
+
+  size_t read(void* buf, size_t len)
+  {
+    uint8_t* ptr = static_cast<uint8_t*>(buf);
+    size_t total = 0;
+    while(total < len)
+    {
+      ssize_t ret = pread(m_fd, ptr + total, len - total, static_cast<off_t>(m_offset));
+      if (ret < 0)
+      {
+        if (errno != EINTR)
+        {
+          throw std::runtime_error(std::string("TarReader: ") + strerror(errno));
+        }
+      }
+      else if (ret == 0)
+      {
+        break;
+      }
+      else
+      {
+        total    += static_cast<size_t>(ret);
+        m_offset += static_cast<uint64_t>(ret);
+      }
+    }
+    return total;
+  }
+
+  void skip(uint64_t len)
+  {
+    m_offset += len;
+  }
+
+  uint64_t tell() const
+  {
+    return m_offset;
+  }
+
+private:
+  FileTarStream(const FileTarStream&);
+  FileTarStream& operator=(const FileTarStream&);
+};
+
+class GzipTarStream : public TarStream
+{
+private:
+  gzFile m_file;
+  uint64_t m_offset;
+
+public:
+  GzipTarStream(int fd) :
+    m_file(),
+    m_offset(0)
+  {
+    // gzclose() closes the fd, the reader still needs its own
+    int gz_fd = dup(fd);
+    if (gz_fd < 0 || lseek(gz_fd, 0, SEEK_SET) != 0)
+    {
+      if (gz_fd >= 0)
+      {
+        close(gz_fd);
+      }
+      throw std::runtime_error(std::string("TarReader: ") + strerror(errno));
+    }
+
+    m_file = gzdopen(gz_fd, "rb");
+    if (!m_file)
+    {
+      close(gz_fd);
+      throw std::runtime_error("TarReader: gzdopen() failed");
+    }
+    gzbuffer(m_file, 128 * 1024);
+  }
+
+  ~GzipTarStream()
+  {
+    gzclose(m_file);
+  }
+
+  size_t read(void* buf, size_t len)
+  {
+    uint8_t* ptr = static_cast<uint8_t*>(buf);
+    size_t total = 0;
+    while(total < len)
+    {
+      unsigned int chunk = static_cast<unsigned int>(std::min<size_t>(len - total, INT_MAX));
+      int ret = gzread(m_file, ptr + total, chunk);
+      if (ret < 0)
+      {
+        int errnum;
+        throw std::runtime_error(std::string("TarReader: ") + gzerror(m_file, &errnum));
+      }
+      else if (ret == 0)
+      {
+        break;
+      }
+      else
+      {
+        total += static_cast<size_t>(ret);
+      }
+    }
+    m_offset += total;
+    return total;
+  }
+
+  void skip(uint64_t len)
+  {
+    uint8_t buf[64 * 1024];
+    while(len > 0)
+    {
+      size_t chunk = static_cast<size_t>(std::min<uint64_t>(len, sizeof(buf)));
+      read_exact(buf, chunk);
+      len -= chunk;
+    }
+  }
+
+  uint64_t tell() const
+  {
+    return m_offset;
+  }
+
+private:
+  GzipTarStream(const GzipTarStream&);
+  GzipTarStream& operator=(const GzipTarStream&);
+};
+
+std::string get_field(const uint8_t* p, size_t len)
+{
+  const char* str = reinterpret_cast<const char*>(p);
+  return std::string(str, strnlen(str, len));
+}
+
+/** Numbers are octal text, large ones use GNU's base-256 encoding */
+uint64_t get_number(const uint8_t* p, size_t len)
+{
+  uint64_t value = 0;
+  if (p[0] & 0x80)
+  {
+    value = p[0] & 0x7f;
+    for(size_t i = 1; i < len; ++i)
+    {
+      value = (value << 8) | p[i];
+    }
+  }
+  else
+  {
+    size_t i = 0;
+    while(i < len && (p[i] == ' ' || p[i] == '\0'))
+    {
+      ++i;
+    }
+
+    for(; i < len && p[i] >= '0' && p[i] <= '7'; ++i)
+    {
+      value = (value << 3) | static_cast<uint64_t>(p[i] - '0');
+    }
+  }
+  return value;
+}
+
+bool is_zero_block(const uint8_t* block)
+{
+  for(size_t i = 0; i < kBlockSize; ++i)
+  {
+    if (block[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_valid_header(const uint8_t* block)
+{
+  // the checksum is calculated with the checksum field set to spaces,
+  // some old tars used signed chars for it
+  uint64_t expected = get_number(block + 148, 8);
+  uint64_t unsigned_sum = 8 * ' ';
+  int64_t  signed_sum   = 8 * ' ';
+  for(size_t i = 0; i < kBlockSize; ++i)
+  {
+    if (i < 148 || i >= 156)
+    {
+      unsigned_sum += block[i];
+      signed_sum   += static_cast<signed char>(block[i]);
+    }
+  }
+  return expected == unsigned_sum || static_cast<int64_t>(expected) == signed_sum;
+}
+
+/** Picks "path" and "size" from the records of a pax extended header */
+void parse_pax_header(const std::string& data, std::string& path, uint64_t& size, bool& has_size)
+{
+  size_t pos = 0;
+  while(pos < data.size())
+  {
+    // each record is "<length> <key>=<value>\n", length includes itself
+    size_t space = data.find(' ', pos);
+    if (space == std::string::npos)
+    {
+      return;
+    }
+
+    size_t len = static_cast<size_t>(strtoul(data.c_str() + pos, nullptr, 10));
+    if (len == 0 || pos + len > data.size())
+    {
+      return;
+    }
+
+    std::string record(data, space + 1, pos + len - space - 2);
+    size_t equal = record.find('=');
+    if (equal != std::string::npos)
+    {
+      std::string key = record.substr(0, equal);
+      if (key == "path")
+      {
+        path = record.substr(equal + 1);
+      }
+      else if (key == "size")
+      {
+        size = strtoull(record.c_str() + equal + 1, nullptr, 10);
+        has_size = true;
+      }
+    }
+
+    pos += len;
+  }
+}
+
+/** Walks over the headers in \a stream and calls \a func for each
+    regular file. \a func returns true if it has read the data of the
+    entry from the stream, false if it hasn't touched the stream, and
+    can set \a stop to end the scan early. */
+void scan_archive(TarStream& stream,
+                  const std::function<bool (const TarReader::Entry&, TarStream&, bool& stop)>& func)
+{
+  std::string long_name;
+  std::string pax_path;
+  uint64_t pax_size = 0;
+  bool has_pax_size = false;
+
+  uint8_t block[kBlockSize];
+  while(true)
+  {
+    size_t len = stream.read(block, kBlockSize);
+    if (len == 0 || is_zero_block(block))
+    {
+      // end of archive
+      return;
+    }
+    else if (len != kBlockSize || !is_valid_header(block))
+    {
+      throw std::runtime_error("TarReader: broken header");
+    }
+
+    uint64_t size = get_number(block + 124, 12);
+    char type = static_cast<char>(block[156]);
+
+    if (type == 'L' || type == 'x')
+    {
+      // GNU long name or pax extended header, both apply to the next entry
+      std::string data(static_cast<size_t>(size), '\0');
+      stream.read_exact(&data[0], data.size());
+      stream.skip((kBlockSize - size % kBlockSize) % kBlockSize);
+
+      if (type == 'L')
+      {
+        long_name = data.c_str();
+      }
+      else
+      {
+        parse_pax_header(data, pax_path, pax_size, has_pax_size);
+      }
+    }
+    else
+    {
+      if (type == '0' || type == '\0' || type == '7')
+      {
+        TarReader::Entry entry;
+        if (!pax_path.empty())
+        {
+          entry.filename = pax_path;
+        }
+        else if (!long_name.empty())
+        {
+          entry.filename = long_name;
+        }
+        else
+        {
+          entry.filename = get_field(block, 100);
+          // POSIX ustar splits long names, GNU uses the field for other things
+          if (memcmp(block + 257, "ustar\0", 6) == 0 && block[345])
+          {
+            entry.filename = get_field(block + 345, 155) + "/" + entry.filename;
+          }
+        }
+
+        if (has_pax_size)
+        {
+          size = pax_size;
+        }
+        entry.offset = stream.tell();
+        entry.size   = size;
+
+        bool stop = false;
+        if (!func(entry, stream, stop))
+        {
+          stream.skip(size);
+        }
+
+        if (stop)
+        {
+          return;
+        }
+      }
+      else
+      {
+        // directories, links, devices and the like have no data that
+        // is of interest, GNU's 'K' long link name has
+        stream.skip(size);
+      }
+      stream.skip((kBlockSize - size % kBlockSize) % kBlockSize);
+
+      long_name.clear();
+      pax_path.clear();
+      pax_size = 0;
+      has_pax_size = false;
+    }
+  }
+}
+
+struct CachedReader
+{
+  std::string filename;
+  TarReaderPtr reader;
+
+  CachedReader(const std::string& filename_, const TarReaderPtr& reader_) :
+    filename(filename_),
+    reader(reader_)
+  {}
+};
+
+std::mutex g_cache_mutex;
+std::list<CachedReader> g_cache;
+
+} // namespace
+
+TarReaderPtr
+TarReader::get(const std::string& filename)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+  {
+    throw std::runtime_error("TarReader::get(): " + filename + ": " + strerror(errno));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    for(std::list<CachedReader>::iterator i = g_cache.begin(); i != g_cache.end(); ++i)
+    {
+      if (i->filename == filename)
+      {
+        if (i->reader->is_current(st.st_size, st.st_mtime))
+        {
+          // move to the front, so the least recently used one goes first
+          g_cache.splice(g_cache.begin(), g_cache, i);
+          return g_cache.front().reader;
+        }
+        else
+        {
+          g_cache.erase(i);
+          break;
+        }
+      }
+    }
+  }
+
+  // scan outside the lock, so other archives don't have to wait
+  TarReaderPtr reader = std::make_shared<TarReader>(filename);
+
+  std::lock_guard<std::mutex> lock(g_cache_mutex);
+  g_cache.push_front(CachedReader(filename, reader));
+  if (g_cache.size() > kMaxCachedReaders)
+  {
+    g_cache.pop_back();
+  }
+  return reader;
+}
+
+TarReader::TarReader(const std::string& filename) :
+  m_filename(filename),
+  m_fd(-1),
+  m_file_size(0),
+  m_mtime(0),
+  m_gzip(false),
+  m_entries(),
+  m_index(),
+  m_mutex(),
+  m_pending(),
+  m_pending_bytes(0),
+  m_served(),
+  m_scanning(false),
+  m_scan_cond()
+{
+  m_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (m_fd < 0)
+  {
+    throw std::runtime_error("TarReader::TarReader(): " + filename + ": " + strerror(errno));
+  }
+
+  try
+  {
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+      throw std::runtime_error("TarReader::TarReader(): " + filename + ": " + strerror(errno));
+    }
+    m_file_size = st.st_size;
+    m_mtime     = st.st_mtime;
+
+    uint8_t block[kBlockSize];
+    FileTarStream file_stream(m_fd);
+    size_t len = file_stream.read(block, kBlockSize);
+    if (len >= 2 && block[0] == 0x1f && block[1] == 0x8b)
+    {
+      m_gzip = true;
+    }
+    else if (len != kBlockSize || !(is_zero_block(block) || is_valid_header(block)))
+    {
+      // bzip2, xz and friends end up here too
+      throw std::runtime_error("TarReader::TarReader(): " + filename + ": not a plain or gzip compressed tar archive");
+    }
+
+    // for compressed archives this is a full pass over the data, just
+    // like 'tar --list' would do
+    std::unique_ptr<TarStream> stream;
+    if (m_gzip)
+    {
+      stream.reset(new GzipTarStream(m_fd));
+    }
+    else
+    {
+      stream.reset(new FileTarStream(m_fd));
+    }
+
+    scan_archive(*stream, [this](const Entry& entry, TarStream&, bool&) {
+        // a later member of the same name replaces the earlier one
+        m_index[entry.filename] = m_entries.size();
+        m_entries.push_back(entry);
+        return false;
+      });
+  }
+  catch(const std::exception& err)
+  {
+    close(m_fd);
+    throw std::runtime_error(filename + ": " + err.what());
+  }
+}
+
+TarReader::~TarReader()
+{
+  g_pending_bytes -= m_pending_bytes;
+  close(m_fd);
+}
+
+bool
+TarReader::is_current(off_t file_size, time_t mtime) const
+{
+  return m_file_size == file_size && m_mtime == mtime;
+}
+
+std::vector<std::string>
+TarReader::get_filenames() const
+{
+  std::vector<std::string> lst;
+  lst.reserve(m_entries.size());
+  for(std::vector<Entry>::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+  {
+    lst.push_back(i->filename);
+  }
+  return lst;
+}
+
+const TarReader::Entry&
+TarReader::get_entry(const std::string& filename) const
+{
+  std::map<std::string, size_t>::const_iterator it = m_index.find(filename);
+  if (it == m_index.end())
+  {
+    throw std::runtime_error("TarReader: " + m_filename + ": " + filename + ": no such file in archive");
+  }
+  return m_entries[it->second];
+}
+
+BlobPtr
+TarReader::get_file(const std::string& filename) const
+{
+  const Entry& entry = get_entry(filename);
+  if (entry.size > INT_MAX)
+  {
+    throw std::runtime_error("TarReader: " + m_filename + ": " + filename + ": file too large");
+  }
+
+  if (m_gzip)
+  {
+    return get_file_gzip(filename);
+  }
+  else
+  {
+    BlobPtr blob = Blob::create(static_cast<int>(entry.size));
+    FileTarStream stream(m_fd);
+    stream.skip(entry.offset);
+    try
+    {
+      stream.read_exact(blob->get_data(), static_cast<size_t>(entry.size));
+    }
+    catch(const std::exception& err)
+    {
+      throw std::runtime_error(m_filename + ": " + filename + ": " + err.what());
+    }
+    return blob;
+  }
+}
+
+BlobPtr
+TarReader::get_file_gzip(const std::string& filename) const
+{
+  std::set<std::string> skip;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+      std::map<std::string, BlobPtr>::iterator it = m_pending.find(filename);
+      if (it != m_pending.end())
+      {
+        BlobPtr blob = it->second;
+        m_pending_bytes -= static_cast<size_t>(blob->size());
+        g_pending_bytes -= static_cast<size_t>(blob->size());
+        m_pending.erase(it);
+        m_served.insert(filename);
+        return blob;
+      }
+      else if (!m_scanning)
+      {
+        break;
+      }
+      else
+      {
+        // the pass running in another thread most likely brings this
+        // member along, so wait for it instead of starting a second one
+        m_scan_cond.wait(lock);
+      }
+    }
+
+    m_scanning = true;
+    skip = m_served;
+    for(std::map<std::string, BlobPtr>::const_iterator i = m_pending.begin(); i != m_pending.end(); ++i)
+    {
+      skip.insert(i->first);
+    }
+  }
+
+  // decompress without holding the lock, so requests for members that
+  // are already pending don't have to wait for the pass
+  const Entry& wanted = get_entry(filename);
+  BlobPtr result;
+  std::map<std::string, BlobPtr> found;
+  size_t found_bytes = 0;
+
+  try
+  {
+    GzipTarStream stream(m_fd);
+    scan_archive(stream, [this, &wanted, &result, &skip, &found, &found_bytes](const Entry& entry, TarStream& stream_, bool& stop) -> bool {
+        if (entry.offset == wanted.offset)
+        {
+          result = Blob::create(static_cast<int>(entry.size));
+          stream_.read_exact(result->get_data(), static_cast<size_t>(entry.size));
+          stop = (skip.size() + found.size() + 1 >= m_index.size());
+          return true;
+        }
+        else if (get_entry(entry.filename).offset == entry.offset &&
+                 !skip.count(entry.filename) &&
+                 !found.count(entry.filename) &&
+                 reserve_pending(static_cast<size_t>(entry.size)))
+        {
+          // keep it for the next request, so that one doesn't need
+          // another pass
+          found_bytes += static_cast<size_t>(entry.size);
+          BlobPtr blob = Blob::create(static_cast<int>(entry.size));
+          found[entry.filename] = blob;
+          stream_.read_exact(blob->get_data(), static_cast<size_t>(entry.size));
+          return true;
+        }
+        else
+        {
+          // once the wanted entry is found, stop where the cache is full
+          stop = static_cast<bool>(result) && !skip.count(entry.filename) && !found.count(entry.filename);
+          return false;
+        }
+      });
+  }
+  catch(const std::exception& err)
+  {
+    g_pending_bytes -= found_bytes;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_scanning = false;
+    }
+    m_scan_cond.notify_all();
+    throw std::runtime_error(m_filename + ": " + filename + ": " + err.what());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scanning = false;
+    if (result)
+    {
+      m_served.insert(filename);
+    }
+
+    for(std::map<std::string, BlobPtr>::iterator i = found.begin(); i != found.end(); ++i)
+    {
+      m_pending[i->first] = i->second;
+    }
+    m_pending_bytes += found_bytes;
+  }
+  m_scan_cond.notify_all();
+
+  if (!result)
+  {
+    throw std::runtime_error("TarReader: " + m_filename + ": " + filename + ": not found in archive");
+  }
+
+  return result;
+}
+
+/* EOF */
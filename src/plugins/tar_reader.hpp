@@ -0,0 +1,119 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_PLUGINS_TAR_READER_HPP
+#define HEADER_GALAPIX_PLUGINS_TAR_READER_HPP
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "util/blob.hpp"
+
+class TarReader;
+
+typedef std::shared_ptr<TarReader> TarReaderPtr;
+
+/** Reads members of a tar archive without running 'tar'. The headers
+    are scanned once in the constructor and kept as an index of
+    member offsets, so members of an uncompressed archive are read
+    with a single pread() each. Gzip compressed archives can't be
+    read at an offset, there a request decompresses the archive in a
+    single pass and keeps the other members it comes across for the
+    following requests, up to a memory limit shared by all readers. */
+class TarReader
+{
+public:
+  struct Entry
+  {
+    std::string filename;
+
+    /** Offset of the data in the uncompressed archive */
+    uint64_t offset;
+    uint64_t size;
+
+    Entry() :
+      filename(),
+      offset(0),
+      size(0)
+    {}
+  };
+
+private:
+  std::string m_filename;
+  int m_fd;
+  off_t m_file_size;
+  time_t m_mtime;
+  bool m_gzip;
+
+  std::vector<Entry> m_entries;
+  std::map<std::string, size_t> m_index;
+
+  /** Members of a compressed archive that were decompressed along the
+      way, but not asked for yet */
+  mutable std::mutex m_mutex;
+  mutable std::map<std::string, BlobPtr> m_pending;
+  mutable size_t m_pending_bytes;
+  mutable std::set<std::string> m_served;
+
+  /** True while a thread decompresses the archive, that happens
+      without holding m_mutex */
+  mutable bool m_scanning;
+  mutable std::condition_variable m_scan_cond;
+
+public:
+  /** Returns a TarReader for \a filename, readers are cached, so the
+      archive is only scanned again when the file changed */
+  static TarReaderPtr get(const std::string& filename);
+
+  /** Throws if \a filename can't be opened or isn't a plain or gzip
+      compressed tar archive */
+  TarReader(const std::string& filename);
+  ~TarReader();
+
+  const std::vector<Entry>& get_entries() const { return m_entries; }
+
+  /** Returns the names of the regular files in the archive */
+  std::vector<std::string> get_filenames() const;
+
+  BlobPtr get_file(const std::string& filename) const;
+
+  bool is_compressed() const { return m_gzip; }
+
+  /** True if the file on disk is still the one this reader was
+      created from */
+  bool is_current(off_t file_size, time_t mtime) const;
+
+private:
+  const Entry& get_entry(const std::string& filename) const;
+  BlobPtr get_file_gzip(const std::string& filename) const;
+
+private:
+  TarReader(const TarReader&);
+  TarReader& operator=(const TarReader&);
+};
+
+#endif
+
+/* EOF */
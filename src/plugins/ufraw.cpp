@@ -58,7 +58,8 @@ UFRaw::load_from_file(const std::string& filename)
   }
   else
   {
-    return PNM::load_from_mem(&*ufraw.get_stdout().begin(), ufraw.get_stdout().size());
+    BlobPtr pnm = ufraw.get_stdout();
+    return PNM::load_from_mem(reinterpret_cast<const char*>(pnm->get_data()), pnm->size());
   }
 }
 
@@ -56,8 +56,8 @@ VidThumb::load_from_file(const std::string& filename)
 
   if (vidthumb.exec() == 0)
   {
-    std::cout.write(vidthumb.get_stdout().data(),
-                    vidthumb.get_stdout().size());
+    std::cout.write(reinterpret_cast<const char*>(vidthumb.get_stdout()->get_data()),
+                    vidthumb.get_stdout()->size());
     SoftwareSurfacePtr surface = PNG::load_from_file(out.str());
     remove(out.str().c_str());
     return surface;
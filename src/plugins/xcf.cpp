@@ -45,13 +45,13 @@
 // - 800x800+0+0 Indexed-alpha Normal Pasted Layer
 
 std::vector<std::string>
-xcfinfo_get_layer(std::vector<char>::const_iterator start, std::vector<char>::const_iterator end)
+xcfinfo_get_layer(std::string::const_iterator start, std::string::const_iterator end)
 {
   std::vector<std::string> layer_names;
 
   while(start != end)
   {
-    std::vector<char>::const_iterator line_end = std::find(start, end, '\n');
+    std::string::const_iterator line_end = std::find(start, end, '\n');
     std::string line(&*start, line_end - start);
     start = line_end+1;
       
@@ -105,8 +105,8 @@ XCF::get_layers(const URL& url)
 
   if (xcfinfo.exec() == 0)
   {
-    const std::vector<char>& stdout_lst = xcfinfo.get_stdout();
-    std::vector<char>::const_iterator line_end = std::find(stdout_lst.begin(), stdout_lst.end(), '\n');
+    const std::string stdout_lst = xcfinfo.get_stdout()->str();
+    std::string::const_iterator line_end = std::find(stdout_lst.begin(), stdout_lst.end(), '\n');
     if (line_end == stdout_lst.end())
     {
       throw std::runtime_error("XCF::get_layers(): Couldn't parse output");
@@ -131,8 +131,8 @@ XCF::get_size(const std::string& filename, Size& size)
   xcfinfo.arg(filename);
   if (xcfinfo.exec() == 0)
   {
-    const std::vector<char>& stdout_lst = xcfinfo.get_stdout();
-    std::vector<char>::const_iterator line_end = std::find(stdout_lst.begin(), stdout_lst.end(), '\n');
+    const std::string stdout_lst = xcfinfo.get_stdout()->str();
+    std::string::const_iterator line_end = std::find(stdout_lst.begin(), stdout_lst.end(), '\n');
     if (line_end == stdout_lst.end())
     {
       std::cout << "Error: XCF: couldn't parse xcfinfo output" << std::endl;
@@ -173,8 +173,8 @@ XCF::load_from_file(const std::string& filename)
   }
   else
   {
-    return PNG::load_from_mem(reinterpret_cast<const uint8_t*>(&*xcf2png.get_stdout().begin()),
-                              xcf2png.get_stdout().size());
+    BlobPtr png = xcf2png.get_stdout();
+    return PNG::load_from_mem(png->get_data(), png->size());
   }
 }
 
@@ -190,8 +190,8 @@ XCF::load_from_mem(void* data, int len)
   }
   else
   {
-    return PNG::load_from_mem(reinterpret_cast<const uint8_t*>(&*xcf2png.get_stdout().begin()),
-                              xcf2png.get_stdout().size());
+    BlobPtr png = xcf2png.get_stdout();
+    return PNG::load_from_mem(png->get_data(), png->size());
   }
 }
 
@@ -21,7 +21,9 @@
 #include <stdexcept>
 #include <sstream>
 
+#include "plugins/zip_reader.hpp"
 #include "util/exec.hpp"
+#include "util/log.hpp"
 
 std::string zip_error_to_string(int err)
 {
@@ -99,7 +101,7 @@ std::string zip_error_to_string(int err)
   }
 }
 
-void unzip_parse_line(std::vector<char>::const_iterator start, std::vector<char>::const_iterator end,
+void unzip_parse_line(std::string::const_iterator start, std::string::const_iterator end,
                       std::vector<std::string>& lst)
 {
   
@@ -111,7 +113,7 @@ void unzip_parse_line(std::vector<char>::const_iterator start, std::vector<char>
   { // Figure out where the filename starts
     bool in_whitespace = true;
     int  column = 0;
-    for(std::vector<char>::const_iterator i = start; i != end; ++i)
+    for(std::string::const_iterator i = start; i != end; ++i)
     {
       if (in_whitespace)
       {
@@ -136,11 +138,11 @@ void unzip_parse_line(std::vector<char>::const_iterator start, std::vector<char>
   }
 }
 
-void unzip_parse_output(std::vector<char>::const_iterator start, std::vector<char>::const_iterator end,
+void unzip_parse_output(std::string::const_iterator start, std::string::const_iterator end,
                         std::vector<std::string>& lst)
 {
-  std::vector<char>::const_iterator line_start = start;
-  for(std::vector<char>::const_iterator i = start; i != end; ++i)
+  std::string::const_iterator line_start = start;
+  for(std::string::const_iterator i = start; i != end; ++i)
   {
     if (*i == '\n')
     {
@@ -153,13 +155,23 @@ void unzip_parse_output(std::vector<char>::const_iterator start, std::vector<cha
 std::vector<std::string>
 Zip::get_filenames(const std::string& zip_filename)
 {
+  try
+  {
+    return ZipReader::get(zip_filename)->get_filenames();
+  }
+  catch(const std::exception& err)
+  {
+    log_debug << err.what() << ", falling back to unzip" << std::endl;
+  }
+
   Exec unzip("unzip");
   unzip.arg("-lqq").arg(zip_filename);
   int zip_return_code = unzip.exec();
   if (zip_return_code == 0)
   {
     std::vector<std::string> lst;
-    unzip_parse_output(unzip.get_stdout().begin(), unzip.get_stdout().end(), lst);
+    const std::string output = unzip.get_stdout()->str();
+    unzip_parse_output(output.begin(), output.end(), lst);
     return lst;
   }
   else
@@ -175,6 +187,19 @@ Zip::get_filenames(const std::string& zip_filename)
 BlobPtr
 Zip::get_file(const std::string& zip_filename, const std::string& filename_in)
 {
+  try
+  {
+    ZipReaderPtr reader = ZipReader::get(zip_filename);
+    if (reader->is_supported(filename_in))
+    {
+      return reader->get_file(filename_in);
+    }
+  }
+  catch(const std::exception& err)
+  {
+    log_debug << err.what() << ", falling back to unzip" << std::endl;
+  }
+
   // unzip uses wildcard expressions, not raw filenames, thus we have
   // to escape a few special characters
   std::string filename;
@@ -199,8 +224,7 @@ Zip::get_file(const std::string& zip_filename, const std::string& filename_in)
   int zip_return_code = unzip.exec();
   if (zip_return_code == 0)
   {
-    // FIXME: Unneeded copy of data
-    return Blob::copy(&*unzip.get_stdout().begin(), unzip.get_stdout().size());
+    return unzip.get_stdout();
   }
   else
   {
@@ -0,0 +1,501 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "plugins/zip_reader.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+const uint32_t kEndOfCentralDirSignature   = 0x06054b50;
+const uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+const uint32_t kZip64LocatorSignature      = 0x07064b50;
+const uint32_t kCentralDirSignature        = 0x02014b50;
+const uint32_t kLocalHeaderSignature       = 0x04034b50;
+
+const size_t kEndOfCentralDirSize   = 22;
+const size_t kZip64LocatorSize      = 20;
+const size_t kZip64EndOfCentralDirSize = 56;
+const size_t kCentralDirHeaderSize  = 46;
+const size_t kLocalHeaderSize       = 30;
+
+/** The archive comment can be up to 64K, the end of central
+    directory record is somewhere in that range */
+const size_t kMaxEndOfCentralDirSearch = kEndOfCentralDirSize + 0xffff;
+
+const size_t kInflateChunkSize = 64 * 1024;
+
+/** Number of archives whose central directory is kept around */
+const size_t kMaxCachedReaders = 8;
+
+uint16_t get_u16(const uint8_t* p)
+{
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(p[0])       |
+          static_cast<uint32_t>(p[1]) << 8  |
+          static_cast<uint32_t>(p[2]) << 16 |
+          static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t get_u64(const uint8_t* p)
+{
+  return static_cast<uint64_t>(get_u32(p)) | static_cast<uint64_t>(get_u32(p + 4)) << 32;
+}
+
+/** Replace the 0xffffffff placeholders in \a entry with the values
+    from the Zip64 extended information extra field */
+void read_zip64_extra(const uint8_t* extra, size_t extra_len, ZipReader::Entry& entry,
+                      bool need_uncompressed, bool need_compressed, bool need_offset)
+{
+  size_t pos = 0;
+  while(pos + 4 <= extra_len)
+  {
+    uint16_t id   = get_u16(extra + pos);
+    uint16_t size = get_u16(extra + pos + 2);
+    const uint8_t* data = extra + pos + 4;
+    const uint8_t* data_end = data + std::min<size_t>(size, extra_len - pos - 4);
+
+    if (id == 0x0001)
+    {
+      if (need_uncompressed && data + 8 <= data_end)
+      {
+        entry.uncompressed_size = get_u64(data);
+        data += 8;
+      }
+
+      if (need_compressed && data + 8 <= data_end)
+      {
+        entry.compressed_size = get_u64(data);
+        data += 8;
+      }
+
+      if (need_offset && data + 8 <= data_end)
+      {
+        entry.local_header_offset = get_u64(data);
+      }
+      return;
+    }
+
+    pos += 4 + size;
+  }
+}
+
+struct CachedReader
+{
+  std::string filename;
+  ZipReaderPtr reader;
+
+  CachedReader(const std::string& filename_, const ZipReaderPtr& reader_) :
+    filename(filename_),
+    reader(reader_)
+  {}
+};
+
+std::mutex g_cache_mutex;
+std::list<CachedReader> g_cache;
+
+} // namespace
+
+ZipReaderPtr
+ZipReader::get(const std::string& filename)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+  {
+    throw std::runtime_error("ZipReader::get(): " + filename + ": " + strerror(errno));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    for(std::list<CachedReader>::iterator i = g_cache.begin(); i != g_cache.end(); ++i)
+    {
+      if (i->filename == filename)
+      {
+        if (i->reader->is_current(st.st_size, st.st_mtime))
+        {
+          // move to the front, so the least recently used one goes first
+          g_cache.splice(g_cache.begin(), g_cache, i);
+          return g_cache.front().reader;
+        }
+        else
+        {
+          g_cache.erase(i);
+          break;
+        }
+      }
+    }
+  }
+
+  // parse outside the lock, so other archives don't have to wait
+  ZipReaderPtr reader = std::make_shared<ZipReader>(filename);
+
+  std::lock_guard<std::mutex> lock(g_cache_mutex);
+  g_cache.push_front(CachedReader(filename, reader));
+  if (g_cache.size() > kMaxCachedReaders)
+  {
+    g_cache.pop_back();
+  }
+  return reader;
+}
+
+ZipReader::ZipReader(const std::string& filename) :
+  m_filename(filename),
+  m_fd(-1),
+  m_file_size(0),
+  m_mtime(0),
+  m_entries(),
+  m_index()
+{
+  m_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (m_fd < 0)
+  {
+    throw std::runtime_error("ZipReader::ZipReader(): " + filename + ": " + strerror(errno));
+  }
+
+  try
+  {
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+      throw std::runtime_error("ZipReader::ZipReader(): " + filename + ": " + strerror(errno));
+    }
+    m_file_size = st.st_size;
+    m_mtime     = st.st_mtime;
+
+    read_central_directory();
+  }
+  catch(...)
+  {
+    close(m_fd);
+    throw;
+  }
+}
+
+ZipReader::~ZipReader()
+{
+  close(m_fd);
+}
+
+bool
+ZipReader::is_current(off_t file_size, time_t mtime) const
+{
+  return m_file_size == file_size && m_mtime == mtime;
+}
+
+void
+ZipReader::pread_all(void* buf, size_t count, uint64_t offset) const
+{
+  uint8_t* ptr = static_cast<uint8_t*>(buf);
+  while(count > 0)
+  {
+    ssize_t len = pread(m_fd, ptr, count, static_cast<off_t>(offset));
+    if (len < 0)
+    {
+      if (errno != EINTR)
+      {
+        throw std::runtime_error("ZipReader: " + m_filename + ": " + strerror(errno));
+      }
+    }
+    else if (len == 0)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": unexpected end of file");
+    }
+    else
+    {
+      ptr    += len;
+      count  -= static_cast<size_t>(len);
+      offset += static_cast<uint64_t>(len);
+    }
+  }
+}
+
+void
+ZipReader::read_central_directory()
+{
+  uint64_t file_size = static_cast<uint64_t>(m_file_size);
+  if (file_size < kEndOfCentralDirSize)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": not a zip archive");
+  }
+
+  // find the end of central directory record, searching backwards
+  // over the archive comment
+  size_t tail_len = static_cast<size_t>(std::min<uint64_t>(file_size, kMaxEndOfCentralDirSearch));
+  uint64_t tail_offset = file_size - tail_len;
+  std::vector<uint8_t> tail(tail_len);
+  pread_all(tail.data(), tail_len, tail_offset);
+
+  size_t eocd = tail_len;
+  for(size_t i = tail_len - kEndOfCentralDirSize + 1; i > 0; --i)
+  {
+    if (get_u32(&tail[i - 1]) == kEndOfCentralDirSignature)
+    {
+      eocd = i - 1;
+      break;
+    }
+  }
+
+  if (eocd == tail_len)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": not a zip archive");
+  }
+
+  const uint8_t* p = &tail[eocd];
+  if (get_u16(p + 4) != 0 || get_u16(p + 6) != 0)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": multi-volume archives are not supported");
+  }
+
+  uint64_t num_entries = get_u16(p + 10);
+  uint64_t cd_size     = get_u32(p + 12);
+  uint64_t cd_offset   = get_u32(p + 16);
+
+  if (num_entries == 0xffff || cd_size == 0xffffffff || cd_offset == 0xffffffff)
+  {
+    // Zip64, the real values are in the Zip64 end of central directory record
+    uint64_t eocd_offset = tail_offset + eocd;
+    if (eocd_offset < kZip64LocatorSize)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": broken Zip64 archive");
+    }
+
+    uint8_t locator[kZip64LocatorSize];
+    pread_all(locator, sizeof(locator), eocd_offset - kZip64LocatorSize);
+    if (get_u32(locator) != kZip64LocatorSignature)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": broken Zip64 archive");
+    }
+
+    uint8_t eocd64[kZip64EndOfCentralDirSize];
+    pread_all(eocd64, sizeof(eocd64), get_u64(locator + 8));
+    if (get_u32(eocd64) != kZip64EndOfCentralDirSignature)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": broken Zip64 archive");
+    }
+
+    num_entries = get_u64(eocd64 + 32);
+    cd_size     = get_u64(eocd64 + 40);
+    cd_offset   = get_u64(eocd64 + 48);
+  }
+
+  if (cd_offset > file_size || cd_size > file_size - cd_offset)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": broken central directory");
+  }
+
+  std::vector<uint8_t> cd(static_cast<size_t>(cd_size));
+  pread_all(cd.data(), cd.size(), cd_offset);
+
+  m_entries.reserve(static_cast<size_t>(std::min<uint64_t>(num_entries, cd_size / kCentralDirHeaderSize)));
+
+  size_t pos = 0;
+  for(uint64_t n = 0; n < num_entries; ++n)
+  {
+    if (pos + kCentralDirHeaderSize > cd.size() ||
+        get_u32(&cd[pos]) != kCentralDirSignature)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": broken central directory");
+    }
+
+    const uint8_t* h = &cd[pos];
+    size_t name_len    = get_u16(h + 28);
+    size_t extra_len   = get_u16(h + 30);
+    size_t comment_len = get_u16(h + 32);
+
+    if (pos + kCentralDirHeaderSize + name_len + extra_len + comment_len > cd.size())
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": broken central directory");
+    }
+
+    Entry entry;
+    entry.flags               = get_u16(h + 8);
+    entry.method              = get_u16(h + 10);
+    entry.crc32               = get_u32(h + 16);
+    entry.compressed_size     = get_u32(h + 20);
+    entry.uncompressed_size   = get_u32(h + 24);
+    entry.local_header_offset = get_u32(h + 42);
+    entry.filename.assign(reinterpret_cast<const char*>(h + kCentralDirHeaderSize), name_len);
+
+    read_zip64_extra(h + kCentralDirHeaderSize + name_len, extra_len, entry,
+                     entry.uncompressed_size   == 0xffffffff,
+                     entry.compressed_size     == 0xffffffff,
+                     entry.local_header_offset == 0xffffffff);
+
+    pos += kCentralDirHeaderSize + name_len + extra_len + comment_len;
+
+    // directories are of no interest
+    if (!entry.filename.empty() && entry.filename[entry.filename.size() - 1] != '/')
+    {
+      m_index[entry.filename] = m_entries.size();
+      m_entries.push_back(entry);
+    }
+  }
+}
+
+std::vector<std::string>
+ZipReader::get_filenames() const
+{
+  std::vector<std::string> lst;
+  lst.reserve(m_entries.size());
+  for(std::vector<Entry>::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+  {
+    lst.push_back(i->filename);
+  }
+  return lst;
+}
+
+const ZipReader::Entry&
+ZipReader::get_entry(const std::string& filename) const
+{
+  std::map<std::string, size_t>::const_iterator it = m_index.find(filename);
+  if (it == m_index.end())
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": no such file in archive");
+  }
+  return m_entries[it->second];
+}
+
+bool
+ZipReader::is_supported(const std::string& filename) const
+{
+  const Entry& entry = get_entry(filename);
+  return (!(entry.flags & 0x0001) && // encrypted
+          (entry.method == 0 || entry.method == 8) &&
+          entry.uncompressed_size <= INT_MAX);
+}
+
+BlobPtr
+ZipReader::get_file(const std::string& filename) const
+{
+  const Entry& entry = get_entry(filename);
+  if (!is_supported(filename))
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": unsupported compression method");
+  }
+
+  // the local header can have a different extra field than the
+  // central directory, so it has to be read to find the data
+  uint8_t header[kLocalHeaderSize];
+  pread_all(header, sizeof(header), entry.local_header_offset);
+  if (get_u32(header) != kLocalHeaderSignature)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": broken local header");
+  }
+
+  uint64_t data_offset = (entry.local_header_offset + kLocalHeaderSize +
+                          get_u16(header + 26) + get_u16(header + 28));
+  if (data_offset > static_cast<uint64_t>(m_file_size) ||
+      entry.compressed_size > static_cast<uint64_t>(m_file_size) - data_offset)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": truncated archive");
+  }
+
+  int size = static_cast<int>(entry.uncompressed_size);
+  BlobPtr blob = Blob::create(size);
+
+  if (entry.method == 0)
+  {
+    if (entry.compressed_size != entry.uncompressed_size)
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": broken stored entry");
+    }
+    pread_all(blob->get_data(), static_cast<size_t>(size), data_offset);
+  }
+  else if (size > 0)
+  {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // negative window bits: raw deflate data without zlib header
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+    {
+      throw std::runtime_error("ZipReader: inflateInit2() failed");
+    }
+
+    std::vector<uint8_t> chunk(static_cast<size_t>(std::min<uint64_t>(kInflateChunkSize,
+                                                                      std::max<uint64_t>(entry.compressed_size, 1))));
+    uint64_t offset    = data_offset;
+    uint64_t remaining = entry.compressed_size;
+    strm.next_out  = blob->get_data();
+    strm.avail_out = static_cast<uInt>(size);
+
+    int ret = Z_OK;
+    while(ret != Z_STREAM_END)
+    {
+      if (strm.avail_in == 0)
+      {
+        if (remaining == 0)
+        {
+          break;
+        }
+
+        size_t len = static_cast<size_t>(std::min<uint64_t>(remaining, chunk.size()));
+        try
+        {
+          pread_all(chunk.data(), len, offset);
+        }
+        catch(...)
+        {
+          inflateEnd(&strm);
+          throw;
+        }
+        offset    += len;
+        remaining -= len;
+        strm.next_in  = chunk.data();
+        strm.avail_in = static_cast<uInt>(len);
+      }
+
+      ret = inflate(&strm, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END)
+      {
+        break;
+      }
+    }
+
+    uLong total_out = strm.total_out;
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END || total_out != static_cast<uLong>(size))
+    {
+      throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": broken deflate stream");
+    }
+  }
+
+  if (crc32(crc32(0L, Z_NULL, 0), blob->get_data(), static_cast<uInt>(size)) != entry.crc32)
+  {
+    throw std::runtime_error("ZipReader: " + m_filename + ": " + filename + ": CRC mismatch");
+  }
+
+  return blob;
+}
+
+/* EOF */
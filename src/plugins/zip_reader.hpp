@@ -0,0 +1,111 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_PLUGINS_ZIP_READER_HPP
+#define HEADER_GALAPIX_PLUGINS_ZIP_READER_HPP
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "util/blob.hpp"
+
+class ZipReader;
+
+typedef std::shared_ptr<ZipReader> ZipReaderPtr;
+
+/** Reads members of a zip archive without running 'unzip'. The
+    central directory is parsed once in the constructor, members are
+    then read straight from their offset with pread(), so a single
+    ZipReader can be used by multiple threads at once. Stored and
+    deflated members are supported, including Zip64. */
+class ZipReader
+{
+public:
+  struct Entry
+  {
+    std::string filename;
+    uint16_t flags;
+    uint16_t method;
+    uint32_t crc32;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t local_header_offset;
+
+    Entry() :
+      filename(),
+      flags(0),
+      method(0),
+      crc32(0),
+      compressed_size(0),
+      uncompressed_size(0),
+      local_header_offset(0)
+    {}
+  };
+
+private:
+  std::string m_filename;
+  int m_fd;
+  off_t m_file_size;
+  time_t m_mtime;
+
+  std::vector<Entry> m_entries;
+  std::map<std::string, size_t> m_index;
+
+public:
+  /** Returns a ZipReader for \a filename, readers are cached, so the
+      central directory is only parsed again when the file changed */
+  static ZipReaderPtr get(const std::string& filename);
+
+  /** Throws if \a filename can't be opened or isn't a zip archive */
+  ZipReader(const std::string& filename);
+  ~ZipReader();
+
+  const std::vector<Entry>& get_entries() const { return m_entries; }
+
+  /** Returns the names of all members that aren't directories */
+  std::vector<std::string> get_filenames() const;
+
+  /** False if the member uses an encryption or compression method
+      that ZipReader doesn't handle, use 'unzip' for those */
+  bool is_supported(const std::string& filename) const;
+
+  /** Returns the content of \a filename, stored members are read
+      directly into the Blob, deflated ones are inflated into it */
+  BlobPtr get_file(const std::string& filename) const;
+
+  /** True if the file on disk is still the one this reader was
+      created from */
+  bool is_current(off_t file_size, time_t mtime) const;
+
+private:
+  void read_central_directory();
+  const Entry& get_entry(const std::string& filename) const;
+  void pread_all(void* buf, size_t count, uint64_t offset) const;
+
+private:
+  ZipReader(const ZipReader&);
+  ZipReader& operator=(const ZipReader&);
+};
+
+#endif
+
+/* EOF */
@@ -0,0 +1,66 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_UTIL_ARCHIVE_LISTING_CACHE_HPP
+#define HEADER_GALAPIX_UTIL_ARCHIVE_LISTING_CACHE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "util/archive_loader.hpp"
+
+/** The content of an archive as seen by the loader named \a loader
+    when the archive had the given size and mtime */
+struct ArchiveListing
+{
+  std::string path;
+  int64_t size;
+  int64_t mtime;
+  std::string loader;
+  std::vector<ArchiveLoader::Entry> entries;
+
+  ArchiveListing() :
+    path(),
+    size(0),
+    mtime(0),
+    loader(),
+    entries()
+  {}
+};
+
+/** Keeps the listings of archives around, so that scanning a
+    directory doesn't have to open every archive again. Implemented
+    by ArchiveDatabase. */
+class ArchiveListingCache
+{
+public:
+  virtual ~ArchiveListingCache() {}
+
+  /** Returns false if there is no listing for \a path or if the
+      archive changed since it was stored */
+  virtual bool get_listing(const std::string& path, int64_t size, int64_t mtime,
+                           ArchiveListing& listing_out) = 0;
+
+  /** Stores \a listings, replacing older listings of the same path */
+  virtual void store_listings(const std::vector<ArchiveListing>& listings) = 0;
+};
+
+#endif
+
+/* EOF */
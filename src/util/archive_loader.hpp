@@ -19,6 +19,7 @@
 #ifndef HEADER_GALAPIX_UTIL_ARCHIVE_LOADER_HPP
 #define HEADER_GALAPIX_UTIL_ARCHIVE_LOADER_HPP
 
+#include <stdint.h>
 #include <vector>
 #include <string>
 
@@ -28,6 +29,23 @@ class ArchiveManager;
 
 class ArchiveLoader
 {
+public:
+  struct Entry
+  {
+    std::string filename;
+
+    /** Position of the member in the archive and its uncompressed
+        size, -1 when the loader doesn't know them */
+    int64_t offset;
+    int64_t size;
+
+    Entry(const std::string& filename_ = std::string(), int64_t offset_ = -1, int64_t size_ = -1) :
+      filename(filename_),
+      offset(offset_),
+      size(size_)
+    {}
+  };
+
 public:
   virtual ~ArchiveLoader() {}
 
@@ -36,6 +54,20 @@ public:
   virtual std::vector<std::string> get_filenames(const std::string& zip_filename) const = 0;
   virtual BlobPtr get_file(const std::string& zip_filename, const std::string& filename) const = 0;
 
+  /** Like get_filenames(), but with offset and size of the members
+      for loaders that can read the archive themselves */
+  virtual std::vector<Entry> get_entries(const std::string& zip_filename) const
+  {
+    std::vector<Entry> entries;
+    const std::vector<std::string> filenames = get_filenames(zip_filename);
+    entries.reserve(filenames.size());
+    for(std::vector<std::string>::const_iterator i = filenames.begin(); i != filenames.end(); ++i)
+    {
+      entries.push_back(Entry(*i));
+    }
+    return entries;
+  }
+
   virtual std::string str() const = 0;
 };
 
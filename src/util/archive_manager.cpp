@@ -108,9 +108,9 @@ ArchiveManager::find_loader_by_magic(const std::string& filename) const
   return nullptr;
 }
 
-std::vector<std::string>
-ArchiveManager::get_filenames(const std::string& zip_filename, 
-                              const ArchiveLoader** loader_out) const
+std::vector<ArchiveLoader::Entry>
+ArchiveManager::get_entries(const std::string& zip_filename,
+                            const ArchiveLoader** loader_out) const
 {
   auto loader = find_loader_by_filename(zip_filename);
   if (!loader)
@@ -122,7 +122,7 @@ ArchiveManager::get_filenames(const std::string& zip_filename,
     try
     {
       if (loader_out) { *loader_out = loader; }
-      return loader->get_filenames(zip_filename);
+      return loader->get_entries(zip_filename);
     }
     catch(const std::exception& err)
     {
@@ -131,7 +131,7 @@ ArchiveManager::get_filenames(const std::string& zip_filename,
       if (!new_loader || new_loader == loader)
       {
         throw;
-        return std::vector<std::string>();
+        return std::vector<ArchiveLoader::Entry>();
       }
       else
       {
@@ -144,13 +144,25 @@ ArchiveManager::get_filenames(const std::string& zip_filename,
         {
           log_warning << err.what() << std::endl;
           if (loader_out) { *loader_out = loader; }
-          return loader->get_filenames(zip_filename);
+          return loader->get_entries(zip_filename);
         }
       }
     }
   }
 }
 
+std::vector<std::string>
+ArchiveManager::get_filenames(const std::string& zip_filename, 
+                              const ArchiveLoader** loader_out) const
+{
+  std::vector<std::string> filenames;
+  for(const auto& entry: get_entries(zip_filename, loader_out))
+  {
+    filenames.push_back(entry.filename);
+  }
+  return filenames;
+}
+
 BlobPtr
 ArchiveManager::get_file(const std::string& zip_filename, const std::string& filename) const
 {
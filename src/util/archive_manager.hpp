@@ -24,11 +24,10 @@
 #include <string>
 #include <vector>
 
+#include "util/archive_loader.hpp"
 #include "util/blob.hpp"
 #include "util/currenton.hpp"
 
-class ArchiveLoader;
-
 class ArchiveManager : public Currenton<ArchiveManager>
 {
 private:
@@ -53,6 +52,12 @@ public:
       it */
   std::vector<std::string> get_filenames(const std::string& zip_filename, 
                                          const ArchiveLoader** loader_out = nullptr) const;
+
+  /** Like get_filenames(), but with the member offsets and sizes
+      where the loader knows them */
+  std::vector<ArchiveLoader::Entry> get_entries(const std::string& zip_filename,
+                                                const ArchiveLoader** loader_out = nullptr) const;
+
   BlobPtr get_file(const std::string& zip_filename, const std::string& filename) const;
 
 private:
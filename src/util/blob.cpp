@@ -18,6 +18,7 @@
 
 #include "util/blob.hpp"
 
+#include <algorithm>
 #include <assert.h>
 #include <stdexcept>
 #include <fstream>
@@ -25,21 +26,24 @@
 
 Blob::Blob(const std::vector<uint8_t>& data) :
   m_data(new uint8_t[data.size()]),
-  m_len(data.size())
+  m_len(data.size()),
+  m_capacity(m_len)
 {
   memcpy(m_data.get(), &*data.begin(), m_len);
 }
 
 Blob::Blob(const void* data, int len) :
   m_data(new uint8_t[len]),
-  m_len(len)
+  m_len(len),
+  m_capacity(len)
 {
   memcpy(m_data.get(), data, m_len);
 }
 
 Blob::Blob(int len) :
   m_data(new uint8_t[len]),
-  m_len(len)
+  m_len(len),
+  m_capacity(len)
 {  
 }
 
@@ -55,6 +59,23 @@ Blob::get_data() const
   return m_data.get();
 }
 
+void
+Blob::resize(int len)
+{
+  assert(len >= 0);
+
+  if (len > m_capacity)
+  {
+    int capacity = std::max(len, 2 * m_capacity);
+    std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+    memcpy(data.get(), m_data.get(), m_len);
+    m_data.swap(data);
+    m_capacity = capacity;
+  }
+
+  m_len = len;
+}
+
 std::string
 Blob::str() const
 {
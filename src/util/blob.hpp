@@ -35,6 +35,7 @@ class Blob
 private:
   std::unique_ptr<uint8_t[]> m_data;
   int m_len;
+  int m_capacity;
 
 private:
   Blob(const std::vector<uint8_t>& data); 
@@ -45,6 +46,14 @@ public:
   int size() const;
   uint8_t* get_data() const;
 
+  /** Number of bytes the Blob can grow to without reallocating */
+  int capacity() const { return m_capacity; }
+
+  /** Change the size of the Blob, when it has to grow the buffer is
+      at least doubled, so appending piece by piece stays cheap. The
+      content up to the old size is kept. */
+  void resize(int len);
+
   std::string str() const;
   
   void write_to_file(const std::string& filename);
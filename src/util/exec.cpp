@@ -18,25 +18,94 @@
 
 #include "util/exec.hpp"
 
+#include <algorithm>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sstream>
 #include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 
+#include "util/exec_limiter.hpp"
 #include "util/log.hpp"
 
+namespace {
+
+/** Output is read in chunks of at least this size straight into the
+    stdout Blob */
+const int kReadChunkSize = 64 * 1024;
+
+void close_fds(int fds[2])
+{
+  for(int i = 0; i < 2; ++i)
+  {
+    if (fds[i] >= 0)
+    {
+      close(fds[i]);
+    }
+  }
+}
+
+void close_fd(int& fd)
+{
+  if (fd >= 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+}
+
+/** write() that reports a closed pipe as EPIPE instead of killing the
+    process with SIGPIPE, the signal is blocked for this thread and a
+    pending one is discarded */
+ssize_t write_nosigpipe(int fd, const void* data, size_t size)
+{
+  sigset_t sigpipe_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+
+  sigset_t pending;
+  sigpending(&pending);
+  bool was_pending = sigismember(&pending, SIGPIPE);
+
+  sigset_t old_set;
+  pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+
+  ssize_t len = write(fd, data, size);
+  int errnum = errno;
+
+  if (len < 0 && errnum == EPIPE && !was_pending)
+  {
+    struct timespec zero = { 0, 0 };
+    while(sigtimedwait(&sigpipe_set, NULL, &zero) < 0 && errno == EINTR) {}
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+  errno = errnum;
+  return len;
+}
+
+} // namespace
+
 Exec::Exec(const std::string& program, bool absolute_path) :
   m_program(program),
   m_absolute_path(absolute_path),
   m_arguments(),
-  m_stdout_vec(),
+  m_stdout(Blob::create(0)),
   m_stderr_vec(),
-  m_stdin_data()
+  m_stdin_data(),
+  m_timeout(0.0),
+  m_timed_out(false)
 {}
 
 Exec&
@@ -52,207 +121,347 @@ Exec::set_stdin(const BlobPtr& blob)
   m_stdin_data = blob;
 }
 
+Exec&
+Exec::set_timeout(double seconds)
+{
+  m_timeout = seconds;
+  return *this;
+}
+
 int
 Exec::exec()
 {
-  int stdin_fd[2];
-  int stdout_fd[2];
-  int stderr_fd[2];
+  ExecLimiter* limiter = ExecLimiter::current();
+  if (!limiter)
+  {
+    return run(m_timeout);
+  }
+  else
+  {
+    double timeout = limiter->acquire(m_program);
+    if (m_timeout > 0.0)
+    {
+      timeout = m_timeout;
+    }
 
-  // FIXME: Bad, we potentially leak file descriptors
-  if (pipe(stdout_fd) < 0 || pipe(stderr_fd) < 0 || pipe(stdin_fd) < 0)
-    throw std::runtime_error("Exec:exec(): pipe failed");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try
+    {
+      int exit_code = run(timeout);
+      limiter->release(m_program,
+                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                       (exit_code == 0) ? ExecLimiter::SUCCESS : ExecLimiter::FAILURE);
+      return exit_code;
+    }
+    catch(...)
+    {
+      limiter->release(m_program,
+                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                       m_timed_out ? ExecLimiter::TIMEOUT : ExecLimiter::FAILURE);
+      throw;
+    }
+  }
+}
 
-  pid_t pid = fork();
-  if (pid < 0)
-  { // error
+int
+Exec::run(double timeout)
+{
+  m_timed_out = false;
+  m_stdout = Blob::create(0);
+  m_stderr_vec.clear();
+
+  // O_CLOEXEC, so other threads spawning processes at the same time
+  // don't pass our pipes on to their children
+  int stdin_fd[2]  = { -1, -1 };
+  int stdout_fd[2] = { -1, -1 };
+  int stderr_fd[2] = { -1, -1 };
+  if (pipe2(stdin_fd, O_CLOEXEC) < 0 ||
+      pipe2(stdout_fd, O_CLOEXEC) < 0 ||
+      pipe2(stderr_fd, O_CLOEXEC) < 0)
+  {
     int errnum = errno;
-
-    // Cleanup
-    close(stdout_fd[0]);
-    close(stdout_fd[1]);
-    close(stderr_fd[0]);
-    close(stderr_fd[1]);
-    close(stdin_fd[0]);
-    close(stdin_fd[1]);
+    close_fds(stdin_fd);
+    close_fds(stdout_fd);
+    close_fds(stderr_fd);
 
     std::ostringstream out;
-    out << "Exec::exec(): fork failed: " << strerror(errno);
+    out << "Exec::exec(): pipe failed: " << strerror(errnum);
     throw std::runtime_error(out.str());
   }
-  else if (pid == 0) 
-  { // child
-    close(stdin_fd[1]);
-    close(stdout_fd[0]);
-    close(stderr_fd[0]);
 
-    dup2(stdin_fd[0], STDIN_FILENO);
-    close(stdin_fd[0]);
+  // the dup2()ed descriptors lose O_CLOEXEC, everything else gets
+  // closed on exec
+  posix_spawn_file_actions_t file_actions;
+  posix_spawn_file_actions_init(&file_actions);
+  posix_spawn_file_actions_adddup2(&file_actions, stdin_fd[0],  STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&file_actions, stdout_fd[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&file_actions, stderr_fd[1], STDERR_FILENO);
+
+  // build the argument list up front, nothing gets allocated between
+  // spawning and exec
+  std::vector<char*> c_arguments;
+  c_arguments.reserve(m_arguments.size() + 2);
+  c_arguments.push_back(const_cast<char*>(m_program.c_str()));
+  for(std::vector<std::string>::const_iterator i = m_arguments.begin(); i != m_arguments.end(); ++i)
+  {
+    c_arguments.push_back(const_cast<char*>(i->c_str()));
+  }
+  c_arguments.push_back(NULL);
 
-    dup2(stdout_fd[1], STDOUT_FILENO);
-    close(stdout_fd[1]);
+  // posix_spawn() uses vfork() semantics, so unlike fork() it doesn't
+  // have to copy the page tables of our potentially huge heap
+  pid_t pid;
+  int errnum;
+  if (m_absolute_path)
+  {
+    errnum = posix_spawn(&pid, m_program.c_str(), &file_actions, NULL, c_arguments.data(), environ);
+  }
+  else
+  {
+    errnum = posix_spawnp(&pid, m_program.c_str(), &file_actions, NULL, c_arguments.data(), environ);
+  }
 
-    dup2(stderr_fd[1], STDERR_FILENO);
-    close(stderr_fd[1]);
+  posix_spawn_file_actions_destroy(&file_actions);
 
-    // Create C-style array for arguments 
-    std::unique_ptr<char*[]> c_arguments(new char*[m_arguments.size()+2]);
-    c_arguments[0] = strdup(m_program.c_str());
-    for(std::vector<std::string>::size_type i = 0; i < m_arguments.size(); ++i)
-      c_arguments[i+1] = strdup(m_arguments[i].c_str());
-    c_arguments[m_arguments.size()+1] = NULL;
-      
-    // Execute the program
-    if (m_absolute_path)
-    {
-      execv(c_arguments[0], c_arguments.get());
-    }
-    else
-    {
-      execvp(c_arguments[0], c_arguments.get());
-    }
-      
-    int error_code = errno;
+  close(stdin_fd[0]);
+  close(stdout_fd[1]);
+  close(stderr_fd[1]);
 
-    // FIXME: this ain't proper, need to exit(1) on failure and signal error to parent somehow
+  if (errnum != 0)
+  {
+    close(stdin_fd[1]);
+    close(stdout_fd[0]);
+    close(stderr_fd[0]);
 
-    // execvp() only returns on failure 
-    std::cout << "Exec::exec(): " << m_program << ": " << strerror(error_code) << std::endl;
-    _exit(EXIT_FAILURE);
+    std::ostringstream out;
+    out << "Exec::exec(): " << m_program << ": " << strerror(errnum);
+    throw std::runtime_error(out.str());
   }
-  else // if (pid > 0)
-  { // parent
-    close(stdin_fd[0]);
-    close(stdout_fd[1]);
-    close(stderr_fd[1]);
-
+  else
+  {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
     try 
     {
-      process_io(stdin_fd[1], stdout_fd[0], stderr_fd[0]);
+      process_io(stdin_fd[1], stdout_fd[0], stderr_fd[0], timeout, deadline);
+      return wait_for_exit(pid, timeout, deadline);
     }
     catch(std::exception& err)
     {
+      // the child might be hung, so don't wait for it to finish on its
+      // own, neither throws after the child has been reaped
+      kill(pid, SIGKILL);
       int child_status = 0;
       waitpid(pid, &child_status, 0);
       throw;
     }
-
-    int child_status = 0;
-    waitpid(pid, &child_status, 0);
-
-    return WEXITSTATUS(child_status);
   }
 }
 
 void
-Exec::process_io(int stdin_fd, int stdout_fd, int stderr_fd)
+Exec::process_io(int stdin_fd, int stdout_fd, int stderr_fd,
+                 double timeout, std::chrono::steady_clock::time_point deadline)
 {
   char buffer[4096];
-      
-  // write data to stdin
-  if (m_stdin_data)
-  {
-    if (write(stdin_fd, m_stdin_data->get_data(), m_stdin_data->size()) < 0)
-    {
-      close(stdin_fd);
-      close(stdout_fd);
-      close(stderr_fd);
 
-      std::ostringstream out;
-      out << "Exec::process_io(): stdin write failure: " << str() << ": " << strerror(errno);
-      throw std::runtime_error(out.str());
-    }
+  // stdin is fed from the select() loop, a child that doesn't read
+  // it must not block us past the deadline
+  size_t stdin_pos = 0;
+  size_t stdin_size = m_stdin_data ? static_cast<size_t>(m_stdin_data->size()) : 0;
+  if (stdin_size == 0 || fcntl(stdin_fd, F_SETFL, fcntl(stdin_fd, F_GETFL) | O_NONBLOCK) < 0)
+  {
+    close_fd(stdin_fd);
   }
-  close(stdin_fd);
 
-  // start reading from stdout/stderr
-  bool stdout_eof = false;
-  bool stderr_eof = false;
-  while(!(stdout_eof && stderr_eof))
+  try
   {
-    fd_set rfds;   
-    FD_ZERO(&rfds);
-
-    int nfds = 0;
-
-    if (!stdout_eof) 
+    while(stdout_fd >= 0 || stderr_fd >= 0)
     {
-      FD_SET(stdout_fd, &rfds);
-      nfds = std::max(nfds, stdout_fd);
-    }
+      fd_set rfds;
+      fd_set wfds;
+      FD_ZERO(&rfds);
+      FD_ZERO(&wfds);
 
-    if (!stderr_eof) 
-    {
-      FD_SET(stderr_fd, &rfds);
-      nfds = std::max(nfds, stderr_fd);
-    }
+      int nfds = 0;
 
-    int retval = select(nfds+1, &rfds, NULL, NULL, NULL);
+      if (stdin_fd >= 0)
+      {
+        FD_SET(stdin_fd, &wfds);
+        nfds = std::max(nfds, stdin_fd);
+      }
 
-    if (retval < 0)
-    {
-      close(stdout_fd);
-      close(stderr_fd);
+      if (stdout_fd >= 0)
+      {
+        FD_SET(stdout_fd, &rfds);
+        nfds = std::max(nfds, stdout_fd);
+      }
 
-      std::ostringstream out;
-      out << "Exec::process_io(): select() failure: " << str() << ": " << strerror(errno);
-      throw std::runtime_error(out.str());
-    }
-    else if (retval == 0)
-    {
-      log_error << "select() returned without results, this shouldn't happen" << std::endl;
-    }
-    else // retval > 0
-    {
-      if (!stdout_eof && FD_ISSET(stdout_fd, &rfds))
+      if (stderr_fd >= 0)
+      {
+        FD_SET(stderr_fd, &rfds);
+        nfds = std::max(nfds, stderr_fd);
+      }
+
+      struct timeval tv;
+      struct timeval* tv_ptr = NULL;
+      if (timeout > 0.0)
       {
-        ssize_t len = read(stdout_fd, buffer, sizeof(buffer));
-        
-        if (len < 0) // error
+        std::chrono::microseconds remaining =
+          std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
         {
-          close(stdout_fd);
-          close(stderr_fd);
+          m_timed_out = true;
 
           std::ostringstream out;
-          out << "Exec::process_io(): stdout read failure: " << str() << ": " << strerror(errno);
+          out << "Exec::process_io(): timeout after " << timeout << " seconds: " << str();
           throw std::runtime_error(out.str());
         }
-        else if (len > 0) // ok
-        {
-          m_stdout_vec.insert(m_stdout_vec.end(), buffer, buffer+len);
-        }
-        else if (len == 0) // eof
-        {
-          close(stdout_fd);
-          stdout_eof = true;
-        }
+
+        tv.tv_sec  = static_cast<time_t>(remaining.count() / 1000000);
+        tv.tv_usec = static_cast<suseconds_t>(remaining.count() % 1000000);
+        tv_ptr = &tv;
       }
 
-      if (!stderr_eof && FD_ISSET(stderr_fd, &rfds))
-      {
-        ssize_t len = read(stderr_fd, buffer, sizeof(buffer));
+      int retval = select(nfds+1, &rfds, &wfds, NULL, tv_ptr);
 
-        if (len < 0) // error
+      if (retval < 0)
+      {
+        if (errno == EINTR)
         {
-          close(stdout_fd);
-          close(stderr_fd);
+          continue;
+        }
 
-          std::ostringstream out;
-          out << "Exec::process_io(): stderr read failure: " << str() << ": " << strerror(errno);
-          throw std::runtime_error(out.str());
+        std::ostringstream out;
+        out << "Exec::process_io(): select() failure: " << str() << ": " << strerror(errno);
+        throw std::runtime_error(out.str());
+      }
+      else if (retval == 0)
+      {
+        // timeout, handled at the top of the loop
+      }
+      else // retval > 0
+      {
+        if (stdin_fd >= 0 && FD_ISSET(stdin_fd, &wfds))
+        {
+          ssize_t len = write_nosigpipe(stdin_fd, m_stdin_data->get_data() + stdin_pos, stdin_size - stdin_pos);
+
+          if (len < 0)
+          {
+            if (errno == EPIPE)
+            {
+              // the child doesn't want the rest, not an error on our side
+              close_fd(stdin_fd);
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+              std::ostringstream out;
+              out << "Exec::process_io(): stdin write failure: " << str() << ": " << strerror(errno);
+              throw std::runtime_error(out.str());
+            }
+          }
+          else
+          {
+            stdin_pos += static_cast<size_t>(len);
+            if (stdin_pos == stdin_size)
+            {
+              close_fd(stdin_fd);
+            }
+          }
         }
-        else if (len > 0) // ok
+
+        if (stdout_fd >= 0 && FD_ISSET(stdout_fd, &rfds))
         {
-          m_stderr_vec.insert(m_stderr_vec.end(), buffer, buffer+len);
+          // read straight into the Blob, so it can be handed out as is
+          int size = m_stdout->size();
+          int chunk_size = std::max(kReadChunkSize, m_stdout->capacity() - size);
+          m_stdout->resize(size + chunk_size);
+          ssize_t len = read(stdout_fd, m_stdout->get_data() + size, static_cast<size_t>(chunk_size));
+
+          if (len < 0) // error
+          {
+            int errnum = errno;
+            m_stdout->resize(size);
+
+            std::ostringstream out;
+            out << "Exec::process_io(): stdout read failure: " << str() << ": " << strerror(errnum);
+            throw std::runtime_error(out.str());
+          }
+          else if (len > 0) // ok
+          {
+            m_stdout->resize(size + static_cast<int>(len));
+          }
+          else if (len == 0) // eof
+          {
+            m_stdout->resize(size);
+            close_fd(stdout_fd);
+          }
         }
-        else if (len == 0) // eof
+
+        if (stderr_fd >= 0 && FD_ISSET(stderr_fd, &rfds))
         {
-          close(stderr_fd);
-          stderr_eof = true;
+          ssize_t len = read(stderr_fd, buffer, sizeof(buffer));
+
+          if (len < 0) // error
+          {
+            std::ostringstream out;
+            out << "Exec::process_io(): stderr read failure: " << str() << ": " << strerror(errno);
+            throw std::runtime_error(out.str());
+          }
+          else if (len > 0) // ok
+          {
+            m_stderr_vec.insert(m_stderr_vec.end(), buffer, buffer+len);
+          }
+          else if (len == 0) // eof
+          {
+            close_fd(stderr_fd);
+          }
         }
       }
     }
   }
+  catch(...)
+  {
+    close_fd(stdin_fd);
+    close_fd(stdout_fd);
+    close_fd(stderr_fd);
+    throw;
+  }
+
+  // the child closed its output, but might still be waiting for
+  // input, closing stdin gives it EOF
+  close_fd(stdin_fd);
+}
+
+int
+Exec::wait_for_exit(pid_t pid, double timeout, std::chrono::steady_clock::time_point deadline)
+{
+  int child_status = 0;
+  if (timeout > 0.0)
+  {
+    // a child can close stdout/stderr and keep running, so the
+    // deadline covers reaping as well
+    std::chrono::milliseconds interval(1);
+    while(waitpid(pid, &child_status, WNOHANG) == 0)
+    {
+      if (std::chrono::steady_clock::now() >= deadline)
+      {
+        m_timed_out = true;
+
+        std::ostringstream out;
+        out << "Exec::wait_for_exit(): timeout after " << timeout << " seconds: " << str();
+        throw std::runtime_error(out.str());
+      }
+
+      std::this_thread::sleep_for(interval);
+      interval = std::min(interval * 2, std::chrono::milliseconds(50));
+    }
+  }
+  else
+  {
+    waitpid(pid, &child_status, 0);
+  }
+
+  return WEXITSTATUS(child_status);
 }
 
 std::string
@@ -19,13 +19,16 @@
 #ifndef HEADER_GALAPIX_UTIL_EXEC_HPP
 #define HEADER_GALAPIX_UTIL_EXEC_HPP
 
+#include <chrono>
+#include <sys/types.h>
 #include <vector>
 #include <string>
 
 #include "util/blob.hpp"
 
 /** The Exec class allows to call external applications in a
-    conventient vasion. */
+    conventient vasion. The program is started with posix_spawn(), so
+    a large heap in the calling process doesn't slow it down. */
 class Exec
 {
 private:
@@ -33,11 +36,14 @@ private:
   bool m_absolute_path;
   std::vector<std::string> m_arguments;
 
-  std::vector<char> m_stdout_vec;
+  BlobPtr m_stdout;
   std::vector<char> m_stderr_vec;
 
   BlobPtr m_stdin_data;
 
+  double m_timeout;
+  bool m_timed_out;
+
 public:
   static const bool ABSOLUTE_PATH = true;
 
@@ -64,14 +70,24 @@ public:
    */
   void set_stdin(const BlobPtr& blob);
 
-  /** Start the external program 
+  /** Kill the program when it is still running after \a seconds and
+      throw an exception from exec(), 0 means no timeout. Without it
+      the timeout set in the ExecLimiter is used. */
+  Exec& set_timeout(double seconds);
+
+  /** Start the external program, if there is an ExecLimiter it
+      decides how many of them can run at once
       
       @return Returns the exit code of the external program 
   */
   int exec();
 
-  /** Access the stdout output of the program */
-  const std::vector<char>& get_stdout() const { return m_stdout_vec; }
+  /** True if the last exec() was killed because of the timeout */
+  bool timed_out() const { return m_timed_out; }
+
+  /** Access the stdout output of the program, the Blob isn't touched
+      by a later exec(), so it can be kept without copying it */
+  BlobPtr get_stdout() const { return m_stdout; }
 
   /** Access the stderr output of the program */
   const std::vector<char>& get_stderr() const { return m_stderr_vec; }
@@ -82,7 +98,16 @@ public:
   std::string str() const;
 
 private:
-  void process_io(int stdin_fd, int stdout_fd, int stderr_fd);
+  int run(double timeout);
+
+  /** Feeds stdin and collects stdout/stderr without blocking, throws
+      when the \a deadline passes, unless \a timeout is 0 */
+  void process_io(int stdin_fd, int stdout_fd, int stderr_fd,
+                  double timeout, std::chrono::steady_clock::time_point deadline);
+
+  /** Reaps the child, throws when the \a deadline passes, unless
+      \a timeout is 0 */
+  int wait_for_exit(pid_t pid, double timeout, std::chrono::steady_clock::time_point deadline);
 
 private:
   Exec (const Exec&);
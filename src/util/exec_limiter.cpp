@@ -0,0 +1,131 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/exec_limiter.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <iomanip>
+
+ExecLimiter* ExecLimiter::current_ = 0;
+
+ExecLimiter::ExecLimiter() :
+  m_programs(),
+  m_mutex(),
+  m_cond()
+{
+  assert(current_ == 0);
+  current_ = this;
+}
+
+ExecLimiter::~ExecLimiter()
+{
+  current_ = 0;
+}
+
+void
+ExecLimiter::set_limit(const std::string& program, int max_processes, double timeout)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Program& entry = m_programs[program];
+    entry.max_processes = max_processes;
+    entry.timeout = timeout;
+  }
+  // a raised limit might let a waiting thread through
+  m_cond.notify_all();
+}
+
+double
+ExecLimiter::acquire(const std::string& program)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Program& entry = m_programs[program];
+
+  entry.num_waiting += 1;
+  m_cond.wait(lock, [&entry]{
+      return entry.max_processes <= 0 || entry.num_running < entry.max_processes;
+    });
+  entry.num_waiting -= 1;
+
+  entry.num_running += 1;
+  return entry.timeout;
+}
+
+void
+ExecLimiter::release(const std::string& program, double seconds, Result result)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Program& entry = m_programs[program];
+
+    assert(entry.num_running > 0);
+    entry.num_running -= 1;
+
+    entry.count += 1;
+    entry.total_seconds += seconds;
+    entry.max_seconds = std::max(entry.max_seconds, seconds);
+
+    switch(result)
+    {
+      case SUCCESS:
+        break;
+
+      case FAILURE:
+        entry.failures += 1;
+        break;
+
+      case TIMEOUT:
+        entry.failures += 1;
+        entry.timeouts += 1;
+        break;
+    }
+  }
+  m_cond.notify_all();
+}
+
+void
+ExecLimiter::print_stats(std::ostream& out)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  bool header = false;
+  for(Programs::const_iterator i = m_programs.begin(); i != m_programs.end(); ++i)
+  {
+    const Program& entry = i->second;
+    if (entry.count > 0)
+    {
+      if (!header)
+      {
+        out << "ExecLimiter:" << std::endl;
+        header = true;
+      }
+
+      out << "  " << std::setw(12) << std::left << i->first << std::right
+          << std::setw(6) << entry.count << " runs, "
+          << std::setw(4) << entry.failures << " failures, "
+          << std::setw(4) << entry.timeouts << " timeouts, "
+          << std::fixed << std::setprecision(2)
+          << "avg " << (entry.total_seconds / entry.count) << "s "
+          << "max " << entry.max_seconds << "s"
+          << std::endl;
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,106 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_UTIL_EXEC_LIMITER_HPP
+#define HEADER_GALAPIX_UTIL_EXEC_LIMITER_HPP
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+/** The ExecLimiter is consulted by Exec::exec() for every external
+    program that gets run. It limits how many instances of a program
+    can run at the same time and how long they may take, so a hung
+    'ufraw-batch' or a dozen '7zr' fighting over the disk can't tie
+    up all the worker threads. It also keeps statistics per
+    program. Programs without a limit run without restrictions, but
+    are still counted. */
+class ExecLimiter
+{
+private:
+  static ExecLimiter* current_;
+public:
+  static ExecLimiter* current() { return current_; }
+
+private:
+  struct Program
+  {
+    int max_processes;
+    double timeout;
+
+    int num_running;
+    int num_waiting;
+
+    int count;
+    int failures;
+    int timeouts;
+    double total_seconds;
+    double max_seconds;
+
+    Program() :
+      max_processes(0),
+      timeout(0.0),
+      num_running(0),
+      num_waiting(0),
+      count(0),
+      failures(0),
+      timeouts(0),
+      total_seconds(0.0),
+      max_seconds(0.0)
+    {}
+  };
+
+  typedef std::map<std::string, Program> Programs;
+  Programs m_programs;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+
+public:
+  enum Result { SUCCESS, FAILURE, TIMEOUT };
+
+  ExecLimiter();
+  ~ExecLimiter();
+
+  /** @param max_processes number of instances of \a program that can
+      run at the same time, 0 for unlimited
+      @param timeout seconds after which \a program gets killed, 0
+      for no timeout */
+  void set_limit(const std::string& program, int max_processes, double timeout);
+
+  /** Blocks till another instance of \a program is allowed to run
+
+      @return the timeout for \a program in seconds, 0 for none */
+  double acquire(const std::string& program);
+
+  /** Gives back the slot taken by acquire() and records how long
+      \a program took and how it ended */
+  void release(const std::string& program, double seconds, Result result);
+
+  void print_stats(std::ostream& out);
+
+private:
+  ExecLimiter(const ExecLimiter&);
+  ExecLimiter& operator=(const ExecLimiter&);
+};
+
+#endif
+
+/* EOF */
@@ -35,6 +35,7 @@
 #include "plugins/tar.hpp"
 #include "plugins/zip.hpp"
 #include "util/archive_manager.hpp"
+#include "util/archive_listing_cache.hpp"
 #include "util/archive_loader.hpp"
 #include "util/filesystem.hpp"
 #include "util/log.hpp"
@@ -42,6 +43,23 @@
 #include "util/software_surface.hpp"
 #include "util/software_surface_factory.hpp"
 
+namespace {
+
+void add_archive_urls(const ArchiveListing& listing, std::vector<URL>& file_list)
+{
+  const std::string prefix = URL::from_filename(listing.path).str() + "//" + listing.loader + ":";
+  for(const auto& entry: listing.entries)
+  {
+    URL archive_url = URL::from_string(prefix + entry.filename);
+    if (SoftwareSurfaceFactory::current().has_supported_extension(archive_url))
+    {
+      file_list.push_back(archive_url);
+    }
+  }
+}
+
+} // namespace
+
 std::string Filesystem::home_directory;
 
 std::string
@@ -305,7 +323,8 @@ Filesystem::get_mtime(const std::string& filename)
 // }
 
 void
-Filesystem::generate_image_file_list(const std::string& pathname, std::vector<URL>& file_list)
+Filesystem::generate_image_file_list(const std::string& pathname, std::vector<URL>& file_list,
+                                     ArchiveListingCache* archive_cache)
 {
   if (!exist(pathname))
   {
@@ -327,7 +346,8 @@ Filesystem::generate_image_file_list(const std::string& pathname, std::vector<UR
   
     // check the file list for valid entries, if entries are archives,
     // get a file list from them
-    std::vector<std::future<std::vector<URL>>> archive_tasks;
+    std::vector<ArchiveListing> cached_listings;
+    std::vector<std::future<ArchiveListing>> archive_tasks;
     for(std::vector<std::string>::iterator i = lst.begin(); i != lst.end(); ++i)
     {
       URL url = URL::from_filename(*i);
@@ -336,22 +356,24 @@ Filesystem::generate_image_file_list(const std::string& pathname, std::vector<UR
       {
         if (ArchiveManager::current().is_archive(*i))
         {
-          archive_tasks.push_back(std::async([i, url]() -> std::vector<URL> {
-                std::vector<URL> sub_file_list;
-
-                const ArchiveLoader* loader;
-                const auto& files = ArchiveManager::current().get_filenames(*i, &loader);
-                for(const auto& file: files)
-                {
-                  URL archive_url = URL::from_string(url.str() + "//" + loader->str() + ":" + file);
-                  if (SoftwareSurfaceFactory::current().has_supported_extension(archive_url))
-                  {
-                    sub_file_list.push_back(archive_url);
-                  }
-                }
-
-                return sub_file_list;
-              }));
+          ArchiveListing listing;
+          listing.path  = *i;
+          listing.size  = get_size(*i);
+          listing.mtime = get_mtime(*i);
+
+          if (archive_cache && archive_cache->get_listing(listing.path, listing.size, listing.mtime, listing))
+          {
+            cached_listings.push_back(listing);
+          }
+          else
+          {
+            archive_tasks.push_back(std::async([listing]() mutable -> ArchiveListing {
+                  const ArchiveLoader* loader;
+                  listing.entries = ArchiveManager::current().get_entries(listing.path, &loader);
+                  listing.loader  = loader->str();
+                  return listing;
+                }));
+          }
         }
         else if (has_extension(*i, ".galapix"))
         {
@@ -380,18 +402,29 @@ Filesystem::generate_image_file_list(const std::string& pathname, std::vector<UR
       }
     }
 
+    for(const auto& listing: cached_listings)
+    {
+      add_archive_urls(listing, file_list);
+    }
+
+    std::vector<ArchiveListing> new_listings;
     for(auto& task: archive_tasks)
     {
       try 
       {
-        const auto& sub_lst = task.get();
-        file_list.insert(file_list.end(), sub_lst.begin(), sub_lst.end());
+        new_listings.push_back(task.get());
+        add_archive_urls(new_listings.back(), file_list);
       }
       catch(const std::exception& err)
       {
         log_warning << "Warning: " << err.what() << std::endl;
       }
     }
+
+    if (archive_cache && !new_listings.empty())
+    {
+      archive_cache->store_listings(new_listings);
+    }
   }
 }
 
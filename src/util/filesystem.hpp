@@ -20,6 +20,8 @@
 #define HEADER_GALAPIX_UTIL_FILESYSTEM_HPP
 
 #include "util/url.hpp"
+
+class ArchiveListingCache;
 
 class Filesystem
 {
@@ -56,8 +58,11 @@ public:
   static unsigned int get_mtime(const std::string& filename);
   static unsigned int get_size(const std::string& filename);
   
-  /** Generate a recursive list of all images in pathname */
-  static void generate_image_file_list(const std::string& pathname, std::vector<URL>& file_list);
+  /** Generate a recursive list of all images in pathname, archives
+      that are unchanged since they were put into \a archive_cache
+      aren't opened again */
+  static void generate_image_file_list(const std::string& pathname, std::vector<URL>& file_list,
+                                       ArchiveListingCache* archive_cache = nullptr);
 
   static void init();
   static void deinit();
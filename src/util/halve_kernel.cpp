@@ -0,0 +1,320 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/halve_kernel.hpp"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define GALAPIX_HALVE_X86
+#  include <immintrin.h>
+#endif
+
+namespace {
+
+void halve_row_gray_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  for(int x = 0; x < dst_width; ++x)
+  {
+    dst[x] = static_cast<uint8_t>((row0[2*x] + row0[2*x+1] + row1[2*x] + row1[2*x+1])/4);
+  }
+}
+
+void halve_row_rgb_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  for(int x = 0; x < dst_width; ++x)
+  {
+    const uint8_t* s0 = row0 + 6*x;
+    const uint8_t* s1 = row1 + 6*x;
+    uint8_t* d = dst + 3*x;
+
+    d[0] = static_cast<uint8_t>((s0[0] + s0[0+3] + s1[0] + s1[0+3])/4);
+    d[1] = static_cast<uint8_t>((s0[1] + s0[1+3] + s1[1] + s1[1+3])/4);
+    d[2] = static_cast<uint8_t>((s0[2] + s0[2+3] + s1[2] + s1[2+3])/4);
+  }
+}
+
+void halve_row_rgba_scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  for(int x = 0; x < dst_width; ++x)
+  {
+    const uint8_t* s0 = row0 + 8*x;
+    const uint8_t* s1 = row1 + 8*x;
+    uint8_t* d = dst + 4*x;
+
+    d[0] = static_cast<uint8_t>((s0[0] + s0[0+4] + s1[0] + s1[0+4])/4);
+    d[1] = static_cast<uint8_t>((s0[1] + s0[1+4] + s1[1] + s1[1+4])/4);
+    d[2] = static_cast<uint8_t>((s0[2] + s0[2+4] + s1[2] + s1[2+4])/4);
+    d[3] = static_cast<uint8_t>((s0[3] + s0[3+4] + s1[3] + s1[3+4])/4);
+  }
+}
+
+#ifdef GALAPIX_HALVE_X86
+
+// The SIMD kernels widen the bytes to 16 bit, add the two rows, add
+// neighbouring pixels and shift the sum down by two, which is what
+// the scalar code does one byte at a time. Loads never go past the
+// 2 * dst_width pixels of a row and stores never past dst_width
+// pixels, as other threads might be working on the next row. The
+// rest of a row is left to the scalar kernel. A NEON version would
+// follow the same steps with vaddl_u8/vpadd.
+
+__attribute__((target("sse2")))
+void halve_row_gray_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m128i low_bytes = _mm_set1_epi16(0xff);
+
+  int x = 0;
+  for(; x + 16 <= dst_width; x += 16)
+  {
+    __m128i sum[2];
+    for(int i = 0; i < 2; ++i)
+    {
+      // the even pixels end up in the low byte of each 16 bit lane,
+      // the odd ones in the high byte
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2*x + 16*i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2*x + 16*i));
+
+      sum[i] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8)),
+                                            _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8))), 2);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum[0], sum[1]));
+  }
+
+  halve_row_gray_scalar(row0 + 2*x, row1 + 2*x, dst + x, dst_width - x);
+}
+
+__attribute__((target("sse2")))
+void halve_row_rgba_sse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  int x = 0;
+  for(; x + 4 <= dst_width; x += 4)
+  {
+    __m128i sum[2];
+    for(int i = 0; i < 2; ++i)
+    {
+      // two pixels of each row give one output pixel
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8*x + 16*i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8*x + 16*i));
+
+      __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+      __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+      sum[i] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                                            _mm_unpackhi_epi64(lo, hi)), 2);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4*x), _mm_packus_epi16(sum[0], sum[1]));
+  }
+
+  halve_row_rgba_scalar(row0 + 8*x, row1 + 8*x, dst + 4*x, dst_width - x);
+}
+
+/** Shuffles the even resp. odd pixels of four RGB pixels into 16 bit
+    lanes, the upper two lanes stay zero */
+#define HALVE_RGB_EVEN_MASK  -1, -1, -1, -1, -1, 8, -1, 7, -1, 6, -1, 2, -1, 1, -1, 0
+#define HALVE_RGB_ODD_MASK   -1, -1, -1, -1, -1, 11, -1, 10, -1, 9, -1, 5, -1, 4, -1, 3
+#define HALVE_RGB_PACK_MASK  -1, -1, -1, -1, 13, 12, 11, 10, 9, 8, 5, 4, 3, 2, 1, 0
+
+__attribute__((target("ssse3")))
+inline __m128i halve_rgb_ssse3(const uint8_t* row0, const uint8_t* row1,
+                               __m128i even, __m128i odd)
+{
+  __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0));
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1));
+  __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_shuffle_epi8(a, even), _mm_shuffle_epi8(a, odd)),
+                              _mm_add_epi16(_mm_shuffle_epi8(b, even), _mm_shuffle_epi8(b, odd)));
+  return _mm_srli_epi16(sum, 2);
+}
+
+__attribute__((target("ssse3")))
+void halve_row_rgb_ssse3(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m128i even = _mm_set_epi8(HALVE_RGB_EVEN_MASK);
+  const __m128i odd  = _mm_set_epi8(HALVE_RGB_ODD_MASK);
+  const __m128i pack = _mm_set_epi8(HALVE_RGB_PACK_MASK);
+
+  int x = 0;
+  // each step reads 24 bytes of a row with 16 byte loads at offset 0
+  // and 12, the second load goes 4 bytes further than needed
+  for(; x + 5 <= dst_width; x += 4)
+  {
+    __m128i lo = halve_rgb_ssse3(row0 + 6*x,      row1 + 6*x,      even, odd);
+    __m128i hi = halve_rgb_ssse3(row0 + 6*x + 12, row1 + 6*x + 12, even, odd);
+    __m128i result = _mm_shuffle_epi8(_mm_packus_epi16(lo, hi), pack);
+
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 3*x), result);
+    uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(result, 8)));
+    memcpy(dst + 3*x + 8, &tail, 4);
+  }
+
+  halve_row_rgb_scalar(row0 + 6*x, row1 + 6*x, dst + 3*x, dst_width - x);
+}
+
+__attribute__((target("avx2")))
+void halve_row_gray_avx2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+
+  int x = 0;
+  for(; x + 32 <= dst_width; x += 32)
+  {
+    __m256i sum[2];
+    for(int i = 0; i < 2; ++i)
+    {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 2*x + 32*i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 2*x + 32*i));
+
+      sum[i] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a, low_bytes),
+                                                                   _mm256_srli_epi16(a, 8)),
+                                                  _mm256_add_epi16(_mm256_and_si256(b, low_bytes),
+                                                                   _mm256_srli_epi16(b, 8))), 2);
+    }
+    __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum[0], sum[1]), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), result);
+  }
+
+  halve_row_gray_sse2(row0 + 2*x, row1 + 2*x, dst + x, dst_width - x);
+}
+
+__attribute__((target("avx2")))
+void halve_row_rgba_avx2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  int x = 0;
+  for(; x + 8 <= dst_width; x += 8)
+  {
+    __m256i sum[2];
+    for(int i = 0; i < 2; ++i)
+    {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 8*x + 32*i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 8*x + 32*i));
+
+      __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+      __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+      sum[i] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi),
+                                                  _mm256_unpackhi_epi64(lo, hi)), 2);
+    }
+    // packing works within the 128 bit lanes, so the pixels come out
+    // as 0 1 4 5 2 3 6 7 and have to be put back in order
+    __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum[0], sum[1]), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4*x), result);
+  }
+
+  halve_row_rgba_sse2(row0 + 8*x, row1 + 8*x, dst + 4*x, dst_width - x);
+}
+
+__attribute__((target("avx2")))
+inline __m256i halve_rgb_avx2(const uint8_t* row0, const uint8_t* row1,
+                              __m256i even, __m256i odd)
+{
+  // lane 0 gets the pixels 0-3, lane 1 the pixels 8-11
+  __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0))),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 24)), 1);
+  __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1))),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 24)), 1);
+  __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_shuffle_epi8(a, even), _mm256_shuffle_epi8(a, odd)),
+                                 _mm256_add_epi16(_mm256_shuffle_epi8(b, even), _mm256_shuffle_epi8(b, odd)));
+  return _mm256_srli_epi16(sum, 2);
+}
+
+__attribute__((target("avx2")))
+void halve_row_rgb_avx2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width)
+{
+  const __m256i even = _mm256_set_epi8(HALVE_RGB_EVEN_MASK, HALVE_RGB_EVEN_MASK);
+  const __m256i odd  = _mm256_set_epi8(HALVE_RGB_ODD_MASK,  HALVE_RGB_ODD_MASK);
+  const __m256i pack = _mm256_set_epi8(HALVE_RGB_PACK_MASK, HALVE_RGB_PACK_MASK);
+
+  int x = 0;
+  // each step reads 48 bytes of a row, the last load at offset 36
+  // goes 4 bytes further than needed
+  for(; x + 9 <= dst_width; x += 8)
+  {
+    // output pixels 0 1 | 4 5 and 2 3 | 6 7, so that packing gives
+    // 0 1 2 3 | 4 5 6 7
+    __m256i lo = halve_rgb_avx2(row0 + 6*x,      row1 + 6*x,      even, odd);
+    __m256i hi = halve_rgb_avx2(row0 + 6*x + 12, row1 + 6*x + 12, even, odd);
+    __m256i result = _mm256_shuffle_epi8(_mm256_packus_epi16(lo, hi), pack);
+
+    __m128i first  = _mm256_castsi256_si128(result);
+    __m128i second = _mm256_extracti128_si256(result, 1);
+    uint32_t tail;
+
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 3*x), first);
+    tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(first, 8)));
+    memcpy(dst + 3*x + 8, &tail, 4);
+
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 3*x + 12), second);
+    tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(second, 8)));
+    memcpy(dst + 3*x + 20, &tail, 4);
+  }
+
+  halve_row_rgb_ssse3(row0 + 6*x, row1 + 6*x, dst + 3*x, dst_width - x);
+}
+
+#endif
+
+HalveKernel::Kernel scalar_kernel()
+{
+  HalveKernel::Kernel kernel = { "scalar", &halve_row_gray_scalar, &halve_row_rgb_scalar, &halve_row_rgba_scalar };
+  return kernel;
+}
+
+} // namespace
+
+std::vector<HalveKernel::Kernel>
+HalveKernel::available()
+{
+  std::vector<Kernel> kernels;
+  kernels.push_back(scalar_kernel());
+
+#ifdef GALAPIX_HALVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+  {
+    Kernel kernel = { "sse2", &halve_row_gray_sse2, &halve_row_rgb_scalar, &halve_row_rgba_sse2 };
+    kernels.push_back(kernel);
+  }
+
+  if (__builtin_cpu_supports("ssse3"))
+  {
+    Kernel kernel = { "ssse3", &halve_row_gray_sse2, &halve_row_rgb_ssse3, &halve_row_rgba_sse2 };
+    kernels.push_back(kernel);
+  }
+
+  if (__builtin_cpu_supports("avx2"))
+  {
+    Kernel kernel = { "avx2", &halve_row_gray_avx2, &halve_row_rgb_avx2, &halve_row_rgba_avx2 };
+    kernels.push_back(kernel);
+  }
+#endif
+
+  return kernels;
+}
+
+const HalveKernel::Kernel&
+HalveKernel::best()
+{
+  static const Kernel kernel = available().back();
+  return kernel;
+}
+
+/* EOF */
@@ -0,0 +1,53 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_UTIL_HALVE_KERNEL_HPP
+#define HEADER_GALAPIX_UTIL_HALVE_KERNEL_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/** Row functions for SoftwareSurface::halve(), each output byte is
+    the average of a 2x2 block of input bytes, rounded down. All
+    kernels give exactly the same result, the SIMD ones are picked at
+    runtime depending on what the CPU supports. */
+class HalveKernel
+{
+public:
+  /** Halves the two source rows \a row0 and \a row1 into \a dst,
+      reads 2 * \a dst_width pixels from each row */
+  typedef void (*RowFunc)(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width);
+
+  struct Kernel
+  {
+    const char* name;
+    RowFunc gray;
+    RowFunc rgb;
+    RowFunc rgba;
+  };
+
+  /** The fastest kernel the CPU supports */
+  static const Kernel& best();
+
+  /** All kernels the CPU supports, the scalar one first */
+  static std::vector<Kernel> available();
+};
+
+#endif
+
+/* EOF */
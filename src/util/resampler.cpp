@@ -0,0 +1,493 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/resampler.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "util/software_surface.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define GALAPIX_RESAMPLER_X86
+#  include <immintrin.h>
+#endif
+
+namespace {
+
+/** Fixed point precision of the weights, they are 16 bit, so that
+    SIMD code can multiply and add pairs of them in one go */
+const int kPrecisionBits = 14;
+
+double box_filter(double x)
+{
+  if (x > -0.5 && x <= 0.5)
+  {
+    return 1.0;
+  }
+  else
+  {
+    return 0.0;
+  }
+}
+
+double triangle_filter(double x)
+{
+  x = fabs(x);
+  if (x < 1.0)
+  {
+    return 1.0 - x;
+  }
+  else
+  {
+    return 0.0;
+  }
+}
+
+double sinc(double x)
+{
+  if (x == 0.0)
+  {
+    return 1.0;
+  }
+  else
+  {
+    x *= M_PI;
+    return sin(x) / x;
+  }
+}
+
+double lanczos_filter(double x)
+{
+  if (-3.0 <= x && x < 3.0)
+  {
+    return sinc(x) * sinc(x / 3.0);
+  }
+  else
+  {
+    return 0.0;
+  }
+}
+
+inline uint8_t clip8(int32_t value)
+{
+  value >>= kPrecisionBits;
+  return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+template<int BPP>
+void resample_horizontal_scalar(const uint8_t* src, int /*src_width*/, uint8_t* dst, int dst_width,
+                                const int* first, const int* count, const int16_t* weights, int size)
+{
+  for(int x = 0; x < dst_width; ++x)
+  {
+    const uint8_t* s = src + BPP * first[x];
+    const int16_t* k = weights + x * size;
+
+    int32_t sum[BPP];
+    for(int c = 0; c < BPP; ++c)
+    {
+      sum[c] = 1 << (kPrecisionBits - 1);
+    }
+
+    for(int i = 0; i < count[x]; ++i)
+    {
+      for(int c = 0; c < BPP; ++c)
+      {
+        sum[c] += s[BPP * i + c] * k[i];
+      }
+    }
+
+    for(int c = 0; c < BPP; ++c)
+    {
+      dst[BPP * x + c] = clip8(sum[c]);
+    }
+  }
+}
+
+void resample_vertical_scalar(const uint8_t* const* rows, int count, const int16_t* weights,
+                              uint8_t* dst, int len)
+{
+  for(int x = 0; x < len; ++x)
+  {
+    int32_t sum = 1 << (kPrecisionBits - 1);
+    for(int i = 0; i < count; ++i)
+    {
+      sum += rows[i][x] * weights[i];
+    }
+    dst[x] = clip8(sum);
+  }
+}
+
+#ifdef GALAPIX_RESAMPLER_X86
+
+// The SIMD code does the same integer math as the scalar code, so the
+// results are identical. pmaddwd multiplies 16 bit pixel values with
+// 16 bit weights and adds neighbouring products, so the pixels of two
+// taps are interleaved and handled in one instruction.
+
+/** Pairs the channels of two RGB resp. RGBA pixels as 16 bit values:
+    r0 r1 g0 g1 b0 b1 (a0 a1), the _HI masks do the same for the 3rd
+    and 4th pixel */
+#define RESAMPLER_RGB_MASK      -1, -1, -1, -1, -1,  5, -1,  2, -1,  4, -1, 1, -1,  3, -1, 0
+#define RESAMPLER_RGB_MASK_HI   -1, -1, -1, -1, -1, 11, -1,  8, -1, 10, -1, 7, -1,  9, -1, 6
+#define RESAMPLER_RGBA_MASK     -1,  7, -1,  3, -1,  6, -1,  2, -1,  5, -1, 1, -1,  4, -1, 0
+#define RESAMPLER_RGBA_MASK_HI  -1, 15, -1, 11, -1, 14, -1, 10, -1, 13, -1, 9, -1, 12, -1, 8
+
+/** Both weights of a pair of taps, as needed by pmaddwd */
+inline int32_t load_weight_pair(const int16_t* k)
+{
+  int32_t w;
+  memcpy(&w, k, sizeof(w));
+  return w;
+}
+
+template<int BPP>
+__attribute__((target("ssse3")))
+void resample_horizontal_ssse3(const uint8_t* src, int src_width, uint8_t* dst, int dst_width,
+                               const int* first, const int* count, const int16_t* weights, int size)
+{
+  const __m128i mask_lo = (BPP == 3) ? _mm_set_epi8(RESAMPLER_RGB_MASK) : _mm_set_epi8(RESAMPLER_RGBA_MASK);
+  const __m128i mask_hi = (BPP == 3) ? _mm_set_epi8(RESAMPLER_RGB_MASK_HI) : _mm_set_epi8(RESAMPLER_RGBA_MASK_HI);
+  const __m128i offset = _mm_set1_epi32(1 << (kPrecisionBits - 1));
+
+  for(int x = 0; x < dst_width; ++x)
+  {
+    const uint8_t* s = src + BPP * first[x];
+    const int16_t* k = weights + x * size;
+    const int n = count[x];
+
+    // the 16 byte loads may read past the last tap, which is only fine
+    // as long as that is still in the row
+    const int safe_taps = std::min(n, src_width - first[x] - 16 / BPP + 1);
+
+    __m128i sum = offset;
+    int i = 0;
+    for(; i + 4 <= safe_taps; i += 4)
+    {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + BPP * i));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_shuffle_epi8(pixels, mask_lo),
+                                              _mm_set1_epi32(load_weight_pair(k + i))));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_shuffle_epi8(pixels, mask_hi),
+                                              _mm_set1_epi32(load_weight_pair(k + i + 2))));
+    }
+
+    // the remaining taps one pair at a time, a pixel after the last
+    // tap gets a zero weight
+    for(; i < n; i += 2)
+    {
+      __m128i pixels;
+      if (BPP * (first[x] + i) + 8 <= BPP * src_width)
+      {
+        pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + BPP * i));
+      }
+      else
+      {
+        uint8_t tmp[8] = { 0 };
+        memcpy(tmp, s + BPP * i, static_cast<size_t>(BPP * std::min(2, n - i)));
+        pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(tmp));
+      }
+      int32_t w = (i + 1 < n) ? load_weight_pair(k + i) : static_cast<uint16_t>(k[i]);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_shuffle_epi8(pixels, mask_lo), _mm_set1_epi32(w)));
+    }
+
+    sum = _mm_srai_epi32(sum, kPrecisionBits);
+    sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), sum);
+    uint32_t result = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+    memcpy(dst + BPP * x, &result, BPP);
+  }
+}
+
+__attribute__((target("sse2")))
+void resample_vertical_sse2(const uint8_t* const* rows, int count, const int16_t* weights,
+                            uint8_t* dst, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi32(1 << (kPrecisionBits - 1));
+
+  int x = 0;
+  for(; x + 16 <= len; x += 16)
+  {
+    __m128i sum0 = offset;
+    __m128i sum1 = offset;
+    __m128i sum2 = offset;
+    __m128i sum3 = offset;
+
+    for(int i = 0; i < count; i += 2)
+    {
+      // an odd number of taps gets a zero weight for the last pair
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[i] + x));
+      __m128i b = zero;
+      int16_t k1 = 0;
+      if (i + 1 < count)
+      {
+        b  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[i+1] + x));
+        k1 = weights[i+1];
+      }
+
+      __m128i w = _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(weights[i]) |
+                                                  (static_cast<uint32_t>(static_cast<uint16_t>(k1)) << 16)));
+
+      // pixels of both rows interleaved as 16 bit values: a0 b0 a1 b1 ...
+      __m128i ab_lo = _mm_unpacklo_epi8(a, b);
+      __m128i ab_hi = _mm_unpackhi_epi8(a, b);
+      sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(ab_lo, zero), w));
+      sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(ab_lo, zero), w));
+      sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(ab_hi, zero), w));
+      sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(ab_hi, zero), w));
+    }
+
+    __m128i lo = _mm_packs_epi32(_mm_srai_epi32(sum0, kPrecisionBits), _mm_srai_epi32(sum1, kPrecisionBits));
+    __m128i hi = _mm_packs_epi32(_mm_srai_epi32(sum2, kPrecisionBits), _mm_srai_epi32(sum3, kPrecisionBits));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+  }
+
+  for(; x < len; ++x)
+  {
+    int32_t sum = 1 << (kPrecisionBits - 1);
+    for(int i = 0; i < count; ++i)
+    {
+      sum += rows[i][x] * weights[i];
+    }
+    dst[x] = clip8(sum);
+  }
+}
+
+#endif
+
+} // namespace
+
+Resampler::Coefficients
+Resampler::calc_coefficients(int src_size, int dst_size, Filter filter)
+{
+  double (*func)(double) = nullptr;
+  double support = 0.0;
+  switch(filter)
+  {
+    case BOX_FILTER:
+      func = &box_filter;
+      support = 0.5;
+      break;
+
+    case TRIANGLE_FILTER:
+      func = &triangle_filter;
+      support = 1.0;
+      break;
+
+    case LANCZOS_FILTER:
+      func = &lanczos_filter;
+      support = 3.0;
+      break;
+  }
+
+  // when shrinking the filter gets stretched over the source pixels
+  // that make up one output pixel
+  double scale = static_cast<double>(src_size) / dst_size;
+  double filter_scale = std::max(1.0, scale);
+  support *= filter_scale;
+
+  Coefficients coeffs;
+  coeffs.size = static_cast<int>(ceil(support)) * 2 + 1;
+  coeffs.first.resize(static_cast<size_t>(dst_size));
+  coeffs.count.resize(static_cast<size_t>(dst_size));
+  coeffs.weights.resize(static_cast<size_t>(dst_size) * static_cast<size_t>(coeffs.size));
+
+  std::vector<double> k(static_cast<size_t>(coeffs.size));
+  for(int i = 0; i < dst_size; ++i)
+  {
+    double center = (i + 0.5) * scale;
+    int first = std::max(0, static_cast<int>(center - support + 0.5));
+    int last  = std::min(src_size, static_cast<int>(center + support + 0.5));
+    int count = std::min(last - first, coeffs.size);
+
+    double total = 0.0;
+    for(int j = 0; j < count; ++j)
+    {
+      k[static_cast<size_t>(j)] = func((first + j - center + 0.5) / filter_scale);
+      total += k[static_cast<size_t>(j)];
+    }
+
+    int16_t* weights = &coeffs.weights[static_cast<size_t>(i) * static_cast<size_t>(coeffs.size)];
+    for(int j = 0; j < count; ++j)
+    {
+      double w = (total != 0.0) ? k[static_cast<size_t>(j)] / total : 0.0;
+      w *= (1 << kPrecisionBits);
+      weights[j] = static_cast<int16_t>(w < 0.0 ? w - 0.5 : w + 0.5);
+    }
+
+    coeffs.first[static_cast<size_t>(i)] = first;
+    coeffs.count[static_cast<size_t>(i)] = count;
+  }
+
+  return coeffs;
+}
+
+Resampler::Resampler(const Size& src_size, const Size& dst_size, Filter filter, bool use_simd) :
+  m_src_size(src_size),
+  m_dst_size(dst_size),
+  m_horizontal(calc_coefficients(src_size.width,  dst_size.width,  filter)),
+  m_vertical  (calc_coefficients(src_size.height, dst_size.height, filter)),
+  m_vertical_first(dst_size.height < src_size.height),
+  m_use_simd(use_simd)
+{
+}
+
+Size
+Resampler::get_intermediate_size() const
+{
+  if (m_vertical_first)
+  {
+    return Size(m_src_size.width, m_dst_size.height);
+  }
+  else
+  {
+    return Size(m_dst_size.width, m_src_size.height);
+  }
+}
+
+void
+Resampler::first_pass(const SoftwareSurface& src, SoftwareSurface& dst,
+                      int y_begin, int y_end) const
+{
+  assert(src.get_size() == m_src_size);
+  assert(dst.get_size() == get_intermediate_size());
+
+  if (m_vertical_first)
+  {
+    resample_vertical(src, dst, y_begin, y_end);
+  }
+  else
+  {
+    resample_horizontal(src, dst, y_begin, y_end);
+  }
+}
+
+void
+Resampler::second_pass(const SoftwareSurface& src, SoftwareSurface& dst,
+                       int y_begin, int y_end) const
+{
+  assert(src.get_size() == get_intermediate_size());
+  assert(dst.get_size() == m_dst_size);
+
+  if (m_vertical_first)
+  {
+    resample_horizontal(src, dst, y_begin, y_end);
+  }
+  else
+  {
+    resample_vertical(src, dst, y_begin, y_end);
+  }
+}
+
+Resampler::HorizontalFunc
+Resampler::get_horizontal_func(int bpp) const
+{
+  if (bpp == 1)
+  {
+    // a single channel has nothing to interleave for pmaddwd
+    return &resample_horizontal_scalar<1>;
+  }
+
+#ifdef GALAPIX_RESAMPLER_X86
+  if (m_use_simd && __builtin_cpu_supports("ssse3"))
+  {
+    return (bpp == 3) ? &resample_horizontal_ssse3<3> : &resample_horizontal_ssse3<4>;
+  }
+#endif
+
+  return (bpp == 3) ? &resample_horizontal_scalar<3> : &resample_horizontal_scalar<4>;
+}
+
+Resampler::VerticalFunc
+Resampler::get_vertical_func() const
+{
+#ifdef GALAPIX_RESAMPLER_X86
+  if (m_use_simd && __builtin_cpu_supports("sse2"))
+  {
+    return &resample_vertical_sse2;
+  }
+#endif
+
+  return &resample_vertical_scalar;
+}
+
+void
+Resampler::resample_horizontal(const SoftwareSurface& src, SoftwareSurface& dst,
+                               int y_begin, int y_end) const
+{
+  assert(src.get_format() == dst.get_format());
+  assert(src.get_height() == dst.get_height());
+
+  if (src.get_width() == dst.get_width())
+  {
+    for(int y = y_begin; y < y_end; ++y)
+    {
+      memcpy(dst.get_row_data(y), src.get_row_data(y),
+             static_cast<size_t>(src.get_width() * src.get_bytes_per_pixel()));
+    }
+  }
+  else
+  {
+    HorizontalFunc func = get_horizontal_func(src.get_bytes_per_pixel());
+    for(int y = y_begin; y < y_end; ++y)
+    {
+      func(src.get_row_data(y), src.get_width(), dst.get_row_data(y), dst.get_width(),
+           m_horizontal.first.data(), m_horizontal.count.data(),
+           m_horizontal.weights.data(), m_horizontal.size);
+    }
+  }
+}
+
+void
+Resampler::resample_vertical(const SoftwareSurface& src, SoftwareSurface& dst,
+                             int y_begin, int y_end) const
+{
+  assert(src.get_format() == dst.get_format());
+  assert(src.get_width() == dst.get_width());
+
+  const int len = dst.get_width() * dst.get_bytes_per_pixel();
+  if (src.get_height() == dst.get_height())
+  {
+    for(int y = y_begin; y < y_end; ++y)
+    {
+      memcpy(dst.get_row_data(y), src.get_row_data(y), static_cast<size_t>(len));
+    }
+    return;
+  }
+
+  VerticalFunc func = get_vertical_func();
+  std::vector<const uint8_t*> rows(static_cast<size_t>(m_vertical.size));
+
+  for(int y = y_begin; y < y_end; ++y)
+  {
+    const int first = m_vertical.first[static_cast<size_t>(y)];
+    const int count = m_vertical.count[static_cast<size_t>(y)];
+    for(int i = 0; i < count; ++i)
+    {
+      rows[static_cast<size_t>(i)] = src.get_row_data(first + i);
+    }
+
+    func(rows.data(), count,
+         &m_vertical.weights[static_cast<size_t>(y) * static_cast<size_t>(m_vertical.size)],
+         dst.get_row_data(y), len);
+  }
+}
+
+/* EOF */
@@ -0,0 +1,115 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEADER_GALAPIX_UTIL_RESAMPLER_HPP
+#define HEADER_GALAPIX_UTIL_RESAMPLER_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "math/size.hpp"
+
+class SoftwareSurface;
+
+/** Separable filtered scaling of a SoftwareSurface, one pass scales
+    along the columns, the other along the rows, with an intermediate
+    surface in between. When shrinking vertically the columns are done
+    first, as that pass is cheaper per source pixel. The filter weights
+    are computed once, the same way PIL does it, so the result is
+    close to what common image tools produce. Both passes work on
+    independent rows, so they can be split into bands for multiple
+    threads. */
+class Resampler
+{
+public:
+  enum Filter
+  {
+    BOX_FILTER,      // average of the covered pixels
+    TRIANGLE_FILTER, // bilinear
+    LANCZOS_FILTER   // Lanczos with three lobes, sharpest
+  };
+
+private:
+  /** Filter weights for each output pixel along one axis */
+  struct Coefficients
+  {
+    /** Maximum number of taps, the weights of output pixel i start
+        at i * size */
+    int size;
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<int16_t> weights;
+
+    Coefficients() :
+      size(0),
+      first(),
+      count(),
+      weights()
+    {}
+  };
+
+private:
+  typedef void (*HorizontalFunc)(const uint8_t* src, int src_width, uint8_t* dst, int dst_width,
+                                 const int* first, const int* count, const int16_t* weights, int size);
+  typedef void (*VerticalFunc)(const uint8_t* const* rows, int count, const int16_t* weights,
+                               uint8_t* dst, int len);
+
+  Size m_src_size;
+  Size m_dst_size;
+  Coefficients m_horizontal;
+  Coefficients m_vertical;
+  bool m_vertical_first;
+  bool m_use_simd;
+
+public:
+  /** \a use_simd = false forces the plain C++ code, which gives the
+      same result and is only of interest for testing */
+  Resampler(const Size& src_size, const Size& dst_size, Filter filter, bool use_simd = true);
+
+  /** Size of the surface between the two passes */
+  Size get_intermediate_size() const;
+
+  /** Writes the rows [y_begin, y_end) of the intermediate surface
+      \a dst, \a src must be the size given in the constructor */
+  void first_pass(const SoftwareSurface& src, SoftwareSurface& dst,
+                  int y_begin, int y_end) const;
+
+  /** Writes the rows [y_begin, y_end) of \a dst from the result of
+      first_pass() */
+  void second_pass(const SoftwareSurface& src, SoftwareSurface& dst,
+                   int y_begin, int y_end) const;
+
+private:
+  HorizontalFunc get_horizontal_func(int bpp) const;
+  VerticalFunc get_vertical_func() const;
+
+  void resample_horizontal(const SoftwareSurface& src, SoftwareSurface& dst,
+                           int y_begin, int y_end) const;
+  void resample_vertical(const SoftwareSurface& src, SoftwareSurface& dst,
+                         int y_begin, int y_end) const;
+
+  static Coefficients calc_coefficients(int src_size, int dst_size, Filter filter);
+
+private:
+  Resampler(const Resampler&);
+  Resampler& operator=(const Resampler&);
+};
+
+#endif
+
+/* EOF */
@@ -18,39 +18,195 @@
 
 #include "util/software_surface.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <string.h>
 #include <boost/scoped_array.hpp>
 
+#if defined(__x86_64__) || defined(__i386__)
+#  include <tmmintrin.h>
+#endif
+
 #include "math/rect.hpp"
 #include "math/rgb.hpp"
 #include "math/rgba.hpp"
+#include "util/halve_kernel.hpp"
+#include "util/resampler.hpp"
 
 // FIXME: Stuff in this file is currently written to just work, not to
 // be fast
 
 namespace {
 
-inline
-void copy_pixel_rgb(SoftwareSurface& dst, int dst_x, int dst_y,
-                    SoftwareSurface& src, int src_x, int src_y)
+int bytes_per_pixel(SoftwareSurface::Format format)
+{
+  switch(format)
+  {
+    case SoftwareSurface::L8_FORMAT:
+      return 1;
+
+    case SoftwareSurface::RGB_FORMAT:
+      return 3;
+
+    case SoftwareSurface::RGBA_FORMAT:
+      return 4;
+
+    default:
+      assert(!"SoftwareSurface: Unknown color format");
+      return 0;
+  }
+}
+
+/** Rotations read the source along its columns, so they work on
+    square blocks of this size, small enough that the source rows of
+    a block stay in the cache */
+const int kTransformBlockSize = 64;
+
+/** Fills the rectangle [x_begin, x_end) x [y_begin, y_end) of \a
+    dst, the source of dst pixel (x, y) is at base + x * step_x + y *
+    step_y */
+template<int BPP>
+void transform_pixels(const uint8_t* base, ptrdiff_t step_x, ptrdiff_t step_y, SoftwareSurface& dst,
+                      int x_begin, int x_end, int y_begin, int y_end)
+{
+  for(int y = y_begin; y < y_end; ++y)
+  {
+    uint8_t* d = dst.get_row_data(y) + BPP * x_begin;
+    const uint8_t* s = base + x_begin * step_x + y * step_y;
+    for(int x = x_begin; x < x_end; ++x)
+    {
+      memcpy(d, s, BPP);
+      d += BPP;
+      s += step_x;
+    }
+  }
+}
+
+/** Transforms that keep source rows as destination rows, flipped
+    or not */
+template<int BPP>
+void transform_rows(const uint8_t* base, ptrdiff_t step_x, ptrdiff_t step_y, SoftwareSurface& dst)
+{
+  if (step_x == BPP)
+  {
+    for(int y = 0; y < dst.get_height(); ++y)
+    {
+      memcpy(dst.get_row_data(y), base + y * step_y, static_cast<size_t>(BPP * dst.get_width()));
+    }
+  }
+  else
+  {
+    transform_pixels<BPP>(base, step_x, step_y, dst, 0, dst.get_width(), 0, dst.get_height());
+  }
+}
+
+/** Transforms that turn source columns into destination rows */
+template<int BPP>
+void transform_blocks(const uint8_t* base, ptrdiff_t step_x, ptrdiff_t step_y, SoftwareSurface& dst)
+{
+  for(int y = 0; y < dst.get_height(); y += kTransformBlockSize)
+    for(int x = 0; x < dst.get_width(); x += kTransformBlockSize)
+    {
+      transform_pixels<BPP>(base, step_x, step_y, dst,
+                            x, std::min(x + kTransformBlockSize, dst.get_width()),
+                            y, std::min(y + kTransformBlockSize, dst.get_height()));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define GALAPIX_TRANSFORM_SSSE3
+
+/** Loads the four pixels that go into one destination column as 32
+    bit values, in destination order, RGB pixels get padded */
+template<int BPP>
+__attribute__((target("ssse3")))
+inline __m128i load_column(const uint8_t* s, bool reverse)
+{
+  __m128i v;
+  if (BPP == 4)
+  {
+    v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    return reverse ? _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)) : v;
+  }
+  else
+  {
+    // exactly 12 bytes, as the pixels might be the last ones in memory
+    int32_t tail;
+    memcpy(&tail, s + 8, sizeof(tail));
+    v = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s)), _mm_cvtsi32_si128(tail));
+    return reverse
+      ? _mm_shuffle_epi8(v, _mm_setr_epi8(9, 10, 11, -1, 6, 7, 8, -1, 3, 4, 5, -1, 0, 1, 2, -1))
+      : _mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+  }
+}
+
+template<int BPP>
+__attribute__((target("ssse3")))
+inline void store_row(uint8_t* d, __m128i v)
 {
-  uint8_t* const d = dst.get_row_data(dst_y) + 3*dst_x;
-  uint8_t* const s = src.get_row_data(src_y) + 3*src_x;
-  d[0] = s[0];
-  d[1] = s[1];
-  d[2] = s[2];
+  if (BPP == 4)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d), v);
+  }
+  else
+  {
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(d), v);
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+    memcpy(d + 8, &tail, sizeof(tail));
+  }
 }
 
-inline
-void copy_pixel_rgba(SoftwareSurface& dst, int dst_x, int dst_y,
-                     SoftwareSurface& src, int src_x, int src_y)
+/** transform_blocks() that transposes 4x4 pixels at a time in SSE
+    registers. Here step_y is +BPP or -BPP, so the four pixels that go
+    into one destination column are next to each other in the
+    source. */
+template<int BPP>
+__attribute__((target("ssse3")))
+void transform_blocks_ssse3(const uint8_t* base, ptrdiff_t step_x, ptrdiff_t step_y, SoftwareSurface& dst)
 {
-  uint32_t* const d = reinterpret_cast<uint32_t*>(dst.get_row_data(dst_y) + 4*dst_x);
-  uint32_t* const s = reinterpret_cast<uint32_t*>(src.get_row_data(src_y) + 4*src_x);
-  *d = *s;
+  // a column of four pixels starts at its lowest address
+  const bool reverse = (step_y < 0);
+  const ptrdiff_t load_offset = reverse ? 3 * step_y : 0;
+
+  for(int by = 0; by < dst.get_height(); by += kTransformBlockSize)
+    for(int bx = 0; bx < dst.get_width(); bx += kTransformBlockSize)
+    {
+      const int x_end = std::min(bx + kTransformBlockSize, dst.get_width());
+      const int y_end = std::min(by + kTransformBlockSize, dst.get_height());
+      const int x_end4 = bx + (x_end - bx) / 4 * 4;
+      const int y_end4 = by + (y_end - by) / 4 * 4;
+
+      for(int y = by; y < y_end4; y += 4)
+      {
+        for(int x = bx; x < x_end4; x += 4)
+        {
+          const uint8_t* s = base + x * step_x + y * step_y + load_offset;
+          __m128i v0 = load_column<BPP>(s, reverse);
+          __m128i v1 = load_column<BPP>(s + step_x, reverse);
+          __m128i v2 = load_column<BPP>(s + 2 * step_x, reverse);
+          __m128i v3 = load_column<BPP>(s + 3 * step_x, reverse);
+
+          __m128i t0 = _mm_unpacklo_epi32(v0, v1);
+          __m128i t1 = _mm_unpacklo_epi32(v2, v3);
+          __m128i t2 = _mm_unpackhi_epi32(v0, v1);
+          __m128i t3 = _mm_unpackhi_epi32(v2, v3);
+
+          store_row<BPP>(dst.get_row_data(y + 0) + BPP * x, _mm_unpacklo_epi64(t0, t1));
+          store_row<BPP>(dst.get_row_data(y + 1) + BPP * x, _mm_unpackhi_epi64(t0, t1));
+          store_row<BPP>(dst.get_row_data(y + 2) + BPP * x, _mm_unpacklo_epi64(t2, t3));
+          store_row<BPP>(dst.get_row_data(y + 3) + BPP * x, _mm_unpackhi_epi64(t2, t3));
+        }
+      }
+
+      // the edges that don't fill four pixels
+      transform_pixels<BPP>(base, step_x, step_y, dst, x_end4, x_end, by, y_end4);
+      transform_pixels<BPP>(base, step_x, step_y, dst, bx, x_end, y_end4, y_end);
+    }
 }
 
+#endif
+
 } // namespace
 
 class SoftwareSurfaceImpl
@@ -59,43 +215,55 @@ public:
   SoftwareSurface::Format format;
   Size     size;
   int      pitch;
-  std::unique_ptr<uint8_t[]> pixels;
+
+  /** Owns the pixel data, shared between a surface and the views
+      that crop() created from it */
+  std::shared_ptr<uint8_t> buffer;
+
+  /** First pixel of this surface within \a buffer */
+  uint8_t* pixels;
   
   SoftwareSurfaceImpl(SoftwareSurface::Format format_, const Size& size_) :
     format(format_),
     size(size_),
-    pitch(),
+    pitch(size.width * bytes_per_pixel(format)),
+    buffer(),
     pixels()
   {
-    switch(format)
-    {
-      case SoftwareSurface::RGB_FORMAT:
-        pitch  = size.width * 3;
-        pixels.reset(new uint8_t[pitch * size.height]);
-        break;
-          
-      case SoftwareSurface::RGBA_FORMAT:
-        pitch  = size.width * 4;
-        pixels.reset(new uint8_t[pitch * size.height]);
-        break;
+    buffer.reset(new uint8_t[pitch * size.height], std::default_delete<uint8_t[]>());
+    pixels = buffer.get();
+  }
 
-      default:
-        assert(!"SoftwareSurfaceImpl: Unknown color format");
-    }
+  SoftwareSurfaceImpl(const SoftwareSurfaceImpl& parent, const Rect& rect) :
+    format(parent.format),
+    size(rect.get_size()),
+    pitch(parent.pitch),
+    buffer(parent.buffer),
+    pixels(parent.pixels + rect.top * parent.pitch + rect.left * bytes_per_pixel(parent.format))
+  {
   }
+
+private:
+  SoftwareSurfaceImpl(const SoftwareSurfaceImpl&);
+  SoftwareSurfaceImpl& operator=(const SoftwareSurfaceImpl&);
 };
-
+
 SoftwareSurfacePtr
 SoftwareSurface::create(Format format, const Size& size)
 {
   return SoftwareSurfacePtr(new SoftwareSurface(format, size));
 }
-
+
 SoftwareSurface::SoftwareSurface(Format format_, const Size& size_) :
   impl(new SoftwareSurfaceImpl(format_, size_))
 {
 }
 
+SoftwareSurface::SoftwareSurface(SoftwareSurfaceImpl* impl_) :
+  impl(impl_)
+{
+}
+
 void
 SoftwareSurface::put_pixel(int x, int y, const RGBA& rgba)
 {
@@ -137,10 +305,16 @@ SoftwareSurface::put_pixel(int x, int y, const RGB& rgb)
 void
 SoftwareSurface::get_pixel(int x, int y, RGB& rgb) const
 {
-  assert(impl->format == RGB_FORMAT);
+  assert(impl->format == RGB_FORMAT || impl->format == L8_FORMAT);
   assert(x >= 0 && x < impl->size.width &&
          y >= 0 && y < impl->size.height);
 
+  if (impl->format == L8_FORMAT)
+  {
+    rgb.r = rgb.g = rgb.b = impl->pixels[y * impl->pitch + x];
+    return;
+  }
+
   rgb.r = impl->pixels[y * impl->pitch + x*3 + 0];
   rgb.g = impl->pixels[y * impl->pitch + x*3 + 1];
   rgb.b = impl->pixels[y * impl->pitch + x*3 + 2];
@@ -150,103 +324,63 @@ SoftwareSurfacePtr
 SoftwareSurface::halve()
 {
   SoftwareSurfacePtr dstsrc = SoftwareSurface::create(impl->format, impl->size/2);
-  
-  uint8_t* dst = dstsrc->get_data();
-  uint8_t* src = get_data();
-
-  //int src_w = get_width();
-  //int src_h = get_height();
-  int src_p = get_pitch();
+  halve_rows(*dstsrc, 0, dstsrc->get_height());
+  return dstsrc;
+}
 
-  int dst_w = dstsrc->get_width();
-  int dst_h = dstsrc->get_height();
-  int dst_p = dstsrc->get_pitch();
+void
+SoftwareSurface::halve_rows(SoftwareSurface& dstsrc, int y_begin, int y_end) const
+{
+  assert(dstsrc.get_format() == impl->format);
+  assert(dstsrc.get_size() == impl->size/2);
 
+  const HalveKernel::Kernel& kernel = HalveKernel::best();
+  HalveKernel::RowFunc halve_row = kernel.rgba;
   switch(impl->format)
   {
-    case RGB_FORMAT:
-      for(int y = 0; y < dst_h; ++y)
-        for(int x = 0; x < dst_w; ++x)
-        {
-          uint8_t* d = dst + (y*dst_p + 3*x);
-          uint8_t* s = src + (y*src_p + 3*x)*2;
+    case L8_FORMAT:
+      halve_row = kernel.gray;
+      break;
 
-          d[0] = static_cast<uint8_t>((s[0] + s[0+3] + s[0+src_p] + s[0+src_p+3])/4);
-          d[1] = static_cast<uint8_t>((s[1] + s[1+3] + s[1+src_p] + s[1+src_p+3])/4);
-          d[2] = static_cast<uint8_t>((s[2] + s[2+3] + s[2+src_p] + s[2+src_p+3])/4);
-        }
+    case RGB_FORMAT:
+      halve_row = kernel.rgb;
       break;
 
     case RGBA_FORMAT:
-      for(int y = 0; y < dst_h; ++y)
-        for(int x = 0; x < dst_w; ++x)
-        {
-          uint8_t* d = dst + (y*dst_p + 4*x);
-          uint8_t* s = src + (y*src_p + 4*x)*2;
-
-          d[0] = static_cast<uint8_t>((s[0] + s[0+4] + s[0+src_p] + s[0+src_p+4])/4);
-          d[1] = static_cast<uint8_t>((s[1] + s[1+4] + s[1+src_p] + s[1+src_p+4])/4);
-          d[2] = static_cast<uint8_t>((s[2] + s[2+4] + s[2+src_p] + s[2+src_p+4])/4);
-          d[3] = static_cast<uint8_t>((s[3] + s[3+4] + s[3+src_p] + s[3+src_p+4])/4);
-        }
-      break;
-        
-    default:
-      assert(!"Not reachable");
+      halve_row = kernel.rgba;
       break;
   }
 
-  return dstsrc;
+  int src_p = get_pitch();
+  int dst_w = dstsrc.get_width();
+
+  for(int y = y_begin; y < y_end; ++y)
+  {
+    const uint8_t* src = get_row_data(2*y);
+    halve_row(src, src + src_p, dstsrc.get_row_data(y), dst_w);
+  }
 }
 
 SoftwareSurfacePtr
-SoftwareSurface::scale(const Size& size)
+SoftwareSurface::scale(const Size& size, Resampler::Filter filter)
 {
   if (size == impl->size)
   {
     return clone();
   }
+  else if (size.width <= 0 || size.height <= 0)
+  {
+    return SoftwareSurface::create(impl->format, size);
+  }
   else
   {
-    SoftwareSurfacePtr surface = SoftwareSurface::create(impl->format, size);
-    // FIXME: very much non-fast
-    switch(impl->format)
-    {
-      case RGB_FORMAT:
-      {
-        RGB rgb;
-        for(int y = 0; y < surface->get_height(); ++y)
-          for(int x = 0; x < surface->get_width(); ++x)
-          {
-            get_pixel(x * impl->size.width  / surface->impl->size.width,
-                      y * impl->size.height / surface->impl->size.height,
-                      rgb);
-                
-            surface->put_pixel(x, y, rgb);
-          }
-      }
-      break;
+    Resampler resampler(impl->size, size, filter);
 
-      case RGBA_FORMAT:
-      {
-        RGBA rgba;
-        for(int y = 0; y < surface->get_height(); ++y)
-          for(int x = 0; x < surface->get_width(); ++x)
-          {
-            get_pixel(x * impl->size.width  / surface->impl->size.width,
-                      y * impl->size.height / surface->impl->size.height,
-                      rgba);
-                
-            surface->put_pixel(x, y, rgba);
-          }
-      }
-      break;
-
-      default:
-        assert(!"SoftwareSurface::scale: Unknown format");
-        break;
-    }
+    SoftwareSurfacePtr intermediate = SoftwareSurface::create(impl->format, resampler.get_intermediate_size());
+    resampler.first_pass(*this, *intermediate, 0, intermediate->get_height());
 
+    SoftwareSurfacePtr surface = SoftwareSurface::create(impl->format, size);
+    resampler.second_pass(*intermediate, *surface, 0, size.height);
     return surface;
   }
 }
@@ -255,190 +389,202 @@ SoftwareSurfacePtr
 SoftwareSurface::clone()
 {
   SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, impl->size);
-  memcpy(out->impl->pixels.get(), impl->pixels.get(), impl->pitch * impl->size.height);
+  if (is_contiguous())
+  {
+    memcpy(out->impl->pixels, impl->pixels, impl->pitch * impl->size.height);
+  }
+  else
+  {
+    for(int y = 0; y < impl->size.height; ++y)
+    {
+      memcpy(out->get_row_data(y), get_row_data(y), out->impl->pitch);
+    }
+  }
   return out;
 }
 
 SoftwareSurfacePtr
 SoftwareSurface::transform(Modifier mod)
 {
-  switch(mod)
+  if (mod == kRot0)
   {
-    case kRot0:
-      return clone();
+    return clone();
+  }
 
+  const int w = impl->size.width;
+  const int h = impl->size.height;
+  const ptrdiff_t bpp   = get_bytes_per_pixel();
+  const ptrdiff_t pitch = impl->pitch;
+
+  // every transform is done in a single pass, all that differs is
+  // where the source of destination pixel (0, 0) is and how far to
+  // step in the source for one pixel to the right and one down
+  int src_x = 0;
+  int src_y = 0;
+  ptrdiff_t step_x = bpp;
+  ptrdiff_t step_y = pitch;
+  switch(mod)
+  {
     case kRot90:
-      return rotate90();
+      src_y  = h - 1;
+      step_x = -pitch;
+      step_y = bpp;
+      break;
 
     case kRot180:
-      return rotate180();
+      src_x  = w - 1;
+      src_y  = h - 1;
+      step_x = -bpp;
+      step_y = -pitch;
+      break;
 
     case kRot270:
-      return rotate270();
+      src_x  = w - 1;
+      step_x = pitch;
+      step_y = -bpp;
+      break;
 
     case kRot0Flip:
-      return vflip();
+      src_y  = h - 1;
+      step_x = bpp;
+      step_y = -pitch;
+      break;
 
     case kRot90Flip:
-      // FIXME: Could be made faster
-      return rotate90()->vflip();
+      src_x  = w - 1;
+      src_y  = h - 1;
+      step_x = -pitch;
+      step_y = -bpp;
+      break;
 
     case kRot180Flip:
-      return hflip();
+      src_x  = w - 1;
+      step_x = -bpp;
+      step_y = pitch;
+      break;
 
     case kRot270Flip:
-      // FIXME: Could be made faster
-      return rotate270()->vflip();
+      step_x = pitch;
+      step_y = bpp;
+      break;
 
     default:
       assert(!"never reached");
       return clone();
   }
-}
 
-SoftwareSurfacePtr
-SoftwareSurface::rotate90()
-{
-  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, Size(impl->size.height, impl->size.width));
-
-  switch(impl->format)
+  const bool transposed = (step_x != bpp && step_x != -bpp);
+  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, get_transformed_size(mod, impl->size));
+  if (w == 0 || h == 0)
   {
-    case SoftwareSurface::RGB_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgb(*out, impl->size.height - y - 1, x,
-                         *this, x, y);
-        }
-      break;
+    return out;
+  }
 
-    case SoftwareSurface::RGBA_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
+  const uint8_t* base = get_row_data(src_y) + src_x * bpp;
+  if (bpp == 1)
+  {
+    if (!transposed)
+    {
+      transform_rows<1>(base, step_x, step_y, *out);
+    }
+    else
+    {
+      transform_blocks<1>(base, step_x, step_y, *out);
+    }
+  }
+  else if (!transposed)
+  {
+    if (bpp == 3)
+    {
+      transform_rows<3>(base, step_x, step_y, *out);
+    }
+    else
+    {
+      transform_rows<4>(base, step_x, step_y, *out);
+    }
+  }
+  else
+  {
+#ifdef GALAPIX_TRANSFORM_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+    {
+      if (bpp == 3)
       {
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgba(*out, impl->size.height - y - 1, x,
-                          *this, x, y);
-        }
+        transform_blocks_ssse3<3>(base, step_x, step_y, *out);
       }
-      break;
+      else
+      {
+        transform_blocks_ssse3<4>(base, step_x, step_y, *out);
+      }
+    }
+    else
+#endif
+    if (bpp == 3)
+    {
+      transform_blocks<3>(base, step_x, step_y, *out);
+    }
+    else
+    {
+      transform_blocks<4>(base, step_x, step_y, *out);
+    }
   }
 
   return out;
 }
 
-SoftwareSurfacePtr
-SoftwareSurface::rotate180()
+Size
+SoftwareSurface::get_transformed_size(Modifier mod, const Size& size)
 {
-  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, impl->size);
-
-  switch(impl->format)
+  switch(mod)
   {
-    case SoftwareSurface::RGB_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgb(*out, impl->size.width - x - 1, impl->size.height - 1 - y,
-                         *this, x, y);
-        }
-      break;
+    case kRot90:
+    case kRot90Flip:
+    case kRot270:
+    case kRot270Flip:
+      return Size(size.height, size.width);
 
-    case SoftwareSurface::RGBA_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-      {
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgba(*out, impl->size.width - x - 1, impl->size.height - 1 - y,
-                          *this, x, y);
-        }
-      }
-      break;
+    case kRot0:
+    case kRot0Flip:
+    case kRot180:
+    case kRot180Flip:
+    default:
+      return size;
   }
-
-  return out; 
 }
 
 SoftwareSurfacePtr
-SoftwareSurface::rotate270()
+SoftwareSurface::rotate90()
 {
-  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, Size(impl->size.height, impl->size.width));
-
-  switch(impl->format)
-  {
-    case SoftwareSurface::RGB_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgb(*out, y, impl->size.width - 1 - x,
-                         *this, x, y);
-        }
-      break;
+  return transform(kRot90);
+}
 
-    case SoftwareSurface::RGBA_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-      {
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgba(*out, y, impl->size.width - 1 - x,
-                          *this, x, y);
-        }
-      }
-      break;
-  }
+SoftwareSurfacePtr
+SoftwareSurface::rotate180()
+{
+  return transform(kRot180);
+}
 
-  return out; 
+SoftwareSurfacePtr
+SoftwareSurface::rotate270()
+{
+  return transform(kRot270);
 }
 
 SoftwareSurfacePtr
 SoftwareSurface::hflip()
 {
-  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, impl->size);
-
-  switch(impl->format)
-  {
-    case SoftwareSurface::RGB_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgb(*out, impl->size.width - 1 - x, y,
-                         *this, x, y);
-        }
-      break;
-
-    case SoftwareSurface::RGBA_FORMAT:
-      for(int y = 0; y < impl->size.height; ++y)
-      {
-        for(int x = 0; x < impl->size.width; ++x)
-        {
-          copy_pixel_rgba(*out, impl->size.width - 1 - x, y,
-                          *this, x, y);
-        }
-      }
-      break;
-  }
-
-  return out; 
+  return transform(kRot180Flip);
 }
 
 SoftwareSurfacePtr
 SoftwareSurface::vflip()
 {
-  SoftwareSurfacePtr out = SoftwareSurface::create(impl->format, impl->size);
-
-  for(int y = 0; y < impl->size.height; ++y)
-  {
-    memcpy(out->get_row_data(impl->size.height - y - 1), get_row_data(y), impl->pitch);
-  }
-
-  return out;
+  return transform(kRot0Flip);
 }
 
 SoftwareSurfacePtr
 SoftwareSurface::crop(const Rect& rect_in)
 {
-  // FIXME: We could do a crop without copying contain, simply
-  // reference the old SoftwareSurfaceImpl and have a different pitch
-  // and pixel offset
   assert(rect_in.is_normal());
  
   // Clip the rectangle to the image
@@ -447,16 +593,7 @@ SoftwareSurface::crop(const Rect& rect_in)
             Math::clamp(0, rect_in.right,  get_width()), 
             Math::clamp(0, rect_in.bottom, get_height()));
 
-  SoftwareSurfacePtr surface = SoftwareSurface::create(impl->format, rect.get_size());
-
-  for(int y = rect.top; y < rect.bottom; ++y)
-  {
-    memcpy(surface->get_row_data(y - rect.top), 
-           get_row_data(y) + rect.left * get_bytes_per_pixel(),
-           rect.get_width() * get_bytes_per_pixel());
-  }
-
-  return surface;
+  return SoftwareSurfacePtr(new SoftwareSurface(new SoftwareSurfaceImpl(*impl, rect)));
 }
 
 Size
@@ -483,23 +620,34 @@ SoftwareSurface::get_pitch()  const
   return impl->pitch;
 }
 
+bool
+SoftwareSurface::is_contiguous() const
+{
+  return impl->pitch == impl->size.width * get_bytes_per_pixel();
+}
+
 BlobPtr
 SoftwareSurface::get_raw_data() const
 {
-  assert(impl->pitch != impl->size.width*3);
-  return Blob::copy(impl->pixels.get(), impl->size.height * impl->pitch);
+  const int row_len = impl->size.width * get_bytes_per_pixel();
+  BlobPtr blob = Blob::create(row_len * impl->size.height);
+  for(int y = 0; y < impl->size.height; ++y)
+  {
+    memcpy(blob->get_data() + y * row_len, get_row_data(y), row_len);
+  }
+  return blob;
 }
 
 uint8_t*
 SoftwareSurface::get_data() const
 {
-  return impl->pixels.get();
+  return impl->pixels;
 }
 
 uint8_t*
 SoftwareSurface::get_row_data(int y) const
 {
-  return impl->pixels.get() + (y * impl->pitch);
+  return impl->pixels + (y * impl->pitch);
 }
 
 SoftwareSurface::Format
@@ -511,7 +659,7 @@ SoftwareSurface::get_format() const
 RGB
 SoftwareSurface::get_average_color() const
 {
-  assert(impl->format == RGB_FORMAT);
+  assert(impl->format == RGB_FORMAT || impl->format == L8_FORMAT);
   // Only works for smaller surfaces, else we would run into integer overflows
   assert(get_width() > 256 || get_height() > 256); // random limit, but should be enough for galapix
 
@@ -543,20 +691,29 @@ SoftwareSurface::to_rgb()
   {
     case RGB_FORMAT:
       return clone();
+
+    case L8_FORMAT:
+    {
+      SoftwareSurfacePtr surface = SoftwareSurface::create(RGB_FORMAT, impl->size);
+      blit(surface, Vector2i(0, 0));
+      return surface;
+    }
         
     case RGBA_FORMAT:
     {
       SoftwareSurfacePtr surface = SoftwareSurface::create(RGB_FORMAT, impl->size);
 
-      int num_pixels      = get_width() * get_height();
-      uint8_t* src_pixels = get_data();
-      uint8_t* dst_pixels = surface->get_data();
-
-      for(int i = 0; i < num_pixels; ++i)
+      for(int y = 0; y < get_height(); ++y)
       {
-        dst_pixels[3*i+0] = src_pixels[4*i+0];
-        dst_pixels[3*i+1] = src_pixels[4*i+1];
-        dst_pixels[3*i+2] = src_pixels[4*i+2];
+        uint8_t* src_pixels = get_row_data(y);
+        uint8_t* dst_pixels = surface->get_row_data(y);
+
+        for(int x = 0; x < get_width(); ++x)
+        {
+          dst_pixels[3*x+0] = src_pixels[4*x+0];
+          dst_pixels[3*x+1] = src_pixels[4*x+1];
+          dst_pixels[3*x+2] = src_pixels[4*x+2];
+        }
       }
 
       return surface;
@@ -571,18 +728,7 @@ SoftwareSurface::to_rgb()
 int
 SoftwareSurface::get_bytes_per_pixel() const
 {
-  switch(impl->format) 
-  {
-    case RGB_FORMAT:
-      return 3;
-
-    case RGBA_FORMAT:
-      return 4;
-
-    default:
-      assert(!"SoftwareSurface::get_bytes_per_pixel(): Unknown format");
-      return 0;
-  }
+  return bytes_per_pixel(impl->format);
 }
 
 void
@@ -594,19 +740,32 @@ SoftwareSurface::blit(SoftwareSurfacePtr& dst, const Vector2i& pos)
   int end_x = std::min(impl->size.width,  dst->impl->size.width  - pos.x);
   int end_y = std::min(impl->size.height, dst->impl->size.height - pos.y);
 
-  if (dst->impl->format == RGB_FORMAT && impl->format == RGB_FORMAT)
+  if (dst->impl->format == impl->format)
   {
+    const int bpp = get_bytes_per_pixel();
     for(int y = start_y; y < end_y; ++y)
-      memcpy(dst->get_row_data(y + pos.y) + (pos.x+start_x)*3, 
-             get_row_data(y) + start_x*3,
-             (end_x - start_x)*3);
+      memcpy(dst->get_row_data(y + pos.y) + (pos.x+start_x)*bpp, 
+             get_row_data(y) + start_x*bpp,
+             (end_x - start_x)*bpp);
   }
-  else if (dst->impl->format == RGBA_FORMAT && impl->format == RGBA_FORMAT)
+  else if (impl->format == L8_FORMAT)
   {
+    // gray to RGB or RGBA, alpha is opaque
+    const int dst_bpp = dst->get_bytes_per_pixel();
     for(int y = start_y; y < end_y; ++y)
-      memcpy(dst->get_row_data(y + pos.y) + (pos.x+start_x)*4, 
-             get_row_data(y) + start_x*4,
-             (end_x - start_x)*4);
+    {
+      uint8_t* dstpx = dst->get_row_data(y + pos.y) + (pos.x+start_x)*dst_bpp;
+      uint8_t* srcpx = get_row_data(y) + start_x;
+
+      for(int x = 0; x < (end_x - start_x); ++x)
+      {
+        memset(dstpx + dst_bpp*x, srcpx[x], 3);
+        if (dst_bpp == 4)
+        {
+          dstpx[4*x+3] = 255;
+        }
+      }
+    }
   }
   else if (dst->impl->format == RGBA_FORMAT && impl->format == RGB_FORMAT)
   {
@@ -23,6 +23,7 @@
 #include <memory>
 
 #include "util/blob.hpp"
+#include "util/resampler.hpp"
 
 class Vector2i;
 class RGB;
@@ -40,7 +41,8 @@ public:
   enum Format 
   { 
     RGB_FORMAT, 
-    RGBA_FORMAT 
+    RGBA_FORMAT,
+    L8_FORMAT    // 8 bit grayscale
   };
 
   enum Modifier 
@@ -57,6 +59,7 @@ public:
 
 private:
   SoftwareSurface(Format format, const Size& size);
+  SoftwareSurface(SoftwareSurfaceImpl* impl);
 
 public:
   static SoftwareSurfacePtr create(Format format, const Size& size);
@@ -66,12 +69,33 @@ public:
   int  get_height() const;
   int  get_pitch()  const;
 
+  /** False for views from crop(), where rows are further apart than
+      their length */
+  bool is_contiguous() const;
+
   SoftwareSurfacePtr clone();
   SoftwareSurfacePtr halve();
-  SoftwareSurfacePtr scale(const Size& size);
+
+  /** Writes the rows [y_begin, y_end) of the halved surface into \a
+      dst, which must be half the size of this surface. Allows
+      halving a large surface in multiple threads. */
+  void halve_rows(SoftwareSurface& dst, int y_begin, int y_end) const;
+
+  /** Scales the surface to \a size with a filter, large surfaces can
+      be scaled in multiple threads with Resampler directly */
+  SoftwareSurfacePtr scale(const Size& size, Resampler::Filter filter = Resampler::LANCZOS_FILTER);
+
+  /** Returns a view of \a rect that shares the pixels with this
+      surface, so changes to one show up in the other. Use clone() on
+      the result when an independent copy is needed. */
   SoftwareSurfacePtr crop(const Rect& rect);
 
+  /** Returns a rotated and/or flipped copy, each Modifier is done in
+      a single pass */
   SoftwareSurfacePtr transform(Modifier mod);
+
+  /** The size transform(\a mod) gives for a surface of \a size */
+  static Size get_transformed_size(Modifier mod, const Size& size);
   SoftwareSurfacePtr rotate90();
   SoftwareSurfacePtr rotate180();
   SoftwareSurfacePtr rotate270();
@@ -242,49 +242,73 @@ SoftwareSurfaceFactory::from_url(const URL& url) const
   {
     std::string mime_type;
     BlobPtr blob = url.get_blob(&mime_type);
+    return from_blob(url, blob, mime_type);
+  }
+}
 
-    const SoftwareSurfaceLoader* loader = nullptr;
+SoftwareSurfacePtr
+SoftwareSurfaceFactory::from_blob(const URL& url, BlobPtr blob, const std::string& mime_type) const
+{
+  log_debug << url << std::endl;
 
-    // try to find a loader by mime-type
-    if (!mime_type.empty())
+  const SoftwareSurfaceLoader* loader = nullptr;
+
+  // try to find a loader by mime-type
+  if (!mime_type.empty())
+  {
+    MimeTypeMap::const_iterator i = m_mime_type_map.find(mime_type);
+    if (i != m_mime_type_map.end())
     {
-      MimeTypeMap::const_iterator i = m_mime_type_map.find(mime_type);
-      if (i != m_mime_type_map.end())
-      {
-        loader = i->second;
-      }
+      loader = i->second;
     }
+  }
+
+  // try to find a loader by file extension
+  if (!loader)
+  {
+    std::string extension = Filesystem::get_extension(url.str());
+    ExtensionMap::const_iterator i = m_extension_map.find(extension);
+    if (i != m_extension_map.end())
+    {
+      loader = i->second;
+    }
+  }
 
-    // try to find a loader by file extension
-    if (!loader)
+  if (url.has_stdio_name())
+  {
+    if (loader && loader->supports_from_mem())
     {
-      std::string extension = Filesystem::get_extension(url.str());
-      ExtensionMap::const_iterator i = m_extension_map.find(extension);
-      if (i != m_extension_map.end())
+      try
+      {
+        return loader->from_mem(blob->get_data(), blob->size());
+      }
+      catch(const std::exception&)
       {
-        loader = i->second;
+        // the file extension might be wrong, from_file() retries with
+        // the loader found by magic
       }
     }
 
-    // load the image or fail if no loader is present
-    if (!loader)
+    return from_file(url.get_stdio_name());
+  }
+  // load the image or fail if no loader is present
+  else if (!loader)
+  {
+    std::ostringstream out;
+    out << "SoftwareSurfaceFactory::from_url(): " << url.str() << ": unknown file type";
+    throw std::runtime_error(out.str());      
+  }
+  else
+  {
+    if (loader->supports_from_mem())
     {
-      std::ostringstream out;
-      out << "SoftwareSurfaceFactory::from_url(): " << url.str() << ": unknown file type";
-      throw std::runtime_error(out.str());      
+      return loader->from_mem(blob->get_data(), blob->size()); 
     }
     else
     {
-      if (loader->supports_from_mem())
-      {
-        return loader->from_mem(blob->get_data(), blob->size()); 
-      }
-      else
-      {
-        std::ostringstream out;
-        out << "SoftwareSurfaceFactory::from_url(): " << url.str() << ": loader doesn't support from_mem(), workaround not implemented";
-        throw std::runtime_error(out.str());        
-      }
+      std::ostringstream out;
+      out << "SoftwareSurfaceFactory::from_url(): " << url.str() << ": loader doesn't support from_mem(), workaround not implemented";
+      throw std::runtime_error(out.str());        
     }
   }
 }
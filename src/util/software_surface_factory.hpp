@@ -22,6 +22,7 @@
 #include <map>
 #include <string>
 
+#include "util/blob.hpp"
 #include "util/currenton.hpp"
 #include "util/software_surface.hpp"
 
@@ -60,6 +61,11 @@ public:
   const SoftwareSurfaceLoader* find_loader_by_magic(const std::string& filename) const;
 
   SoftwareSurfacePtr from_url(const URL& url) const;
+
+  /** Load \a url from \a blob, which has to contain the data that
+      url.get_blob() would return, so the loading doesn't need to do
+      any I/O in most cases */
+  SoftwareSurfacePtr from_blob(const URL& url, BlobPtr blob, const std::string& mime_type) const;
   SoftwareSurfacePtr from_file(const std::string& filename) const;
   SoftwareSurfacePtr from_file(const std::string& filename, const SoftwareSurfaceLoader* loader) const;
 
@@ -39,6 +39,10 @@ public:
   virtual bool supports_from_mem() const =0;
   virtual SoftwareSurfacePtr from_mem(uint8_t* data, int len) const =0;
 
+  /** True if the loader runs an external program, those can be slow
+      and get their own threads in the TilePipeline */
+  virtual bool is_external() const { return false; }
+
 private:
   SoftwareSurfaceLoader(const SoftwareSurfaceLoader&);
   SoftwareSurfaceLoader& operator=(const SoftwareSurfaceLoader&);
@@ -21,6 +21,7 @@
 #include "util/archive_manager.hpp"
 
 #include "plugins/tar.hpp"
+#include "plugins/tar_reader.hpp"
 
 TarArchiveLoader::TarArchiveLoader()
 {
@@ -59,4 +60,29 @@ TarArchiveLoader::get_file(const std::string& zip_filename, const std::string& f
   return Tar::get_file(zip_filename, filename);
 }
 
+std::vector<ArchiveLoader::Entry>
+TarArchiveLoader::get_entries(const std::string& zip_filename) const
+{
+  TarReaderPtr reader;
+  try
+  {
+    reader = TarReader::get(zip_filename);
+  }
+  catch(const std::exception&)
+  {
+    // leave it to get_filenames() and its fallback
+    return ArchiveLoader::get_entries(zip_filename);
+  }
+
+  std::vector<Entry> entries;
+  entries.reserve(reader->get_entries().size());
+  for(const auto& entry: reader->get_entries())
+  {
+    entries.push_back(Entry(entry.filename,
+                            static_cast<int64_t>(entry.offset),
+                            static_cast<int64_t>(entry.size)));
+  }
+  return entries;
+}
+
 /* EOF */
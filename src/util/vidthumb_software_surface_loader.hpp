@@ -46,6 +46,7 @@ public:
 
   bool supports_from_file() const { return true;  }
   bool supports_from_mem()  const { return false; }
+  bool is_external()        const { return true; }
 
   SoftwareSurfacePtr from_file(const std::string& filename) const
   {
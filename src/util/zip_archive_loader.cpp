@@ -20,6 +20,7 @@
 
 #include "util/archive_manager.hpp"
 #include "plugins/zip.hpp"
+#include "plugins/zip_reader.hpp"
 
 ZipArchiveLoader::ZipArchiveLoader()
 {
@@ -48,4 +49,29 @@ ZipArchiveLoader::get_file(const std::string& zip_filename, const std::string& f
   return Zip::get_file(zip_filename, filename);
 }
 
+std::vector<ArchiveLoader::Entry>
+ZipArchiveLoader::get_entries(const std::string& zip_filename) const
+{
+  ZipReaderPtr reader;
+  try
+  {
+    reader = ZipReader::get(zip_filename);
+  }
+  catch(const std::exception&)
+  {
+    // leave it to get_filenames() and its fallback
+    return ArchiveLoader::get_entries(zip_filename);
+  }
+
+  std::vector<Entry> entries;
+  entries.reserve(reader->get_entries().size());
+  for(const auto& entry: reader->get_entries())
+  {
+    entries.push_back(Entry(entry.filename,
+                            static_cast<int64_t>(entry.local_header_offset),
+                            static_cast<int64_t>(entry.uncompressed_size)));
+  }
+  return entries;
+}
+
 /* EOF */
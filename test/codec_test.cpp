@@ -0,0 +1,129 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+
+#include "math/size.hpp"
+#include "plugins/jpeg.hpp"
+#include "plugins/mem_jpeg_compressor.hpp"
+#include "plugins/mem_jpeg_decompressor.hpp"
+#include "plugins/png.hpp"
+#include "util/software_surface.hpp"
+
+/** Reports the best of a few rounds, as the timing is noisy */
+template<typename Func>
+void benchmark(const char* name, int num_tiles, Func func)
+{
+  double best = 0.0;
+  for(int round = 0; round < 5; ++round)
+  {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::max(best, num_tiles / sec);
+  }
+  std::cout << name << ": " << static_cast<int>(best) << " tiles/sec" << std::endl;
+}
+
+SoftwareSurfacePtr create_tile(SoftwareSurface::Format format)
+{
+  SoftwareSurfacePtr surface = SoftwareSurface::create(format, Size(256, 256));
+  int pitch = surface->get_width() * surface->get_bytes_per_pixel();
+  for(int y = 0; y < surface->get_height(); ++y)
+  {
+    uint8_t* row = surface->get_row_data(y);
+    for(int x = 0; x < pitch; ++x)
+    {
+      row[x] = static_cast<uint8_t>((x * x + y * 3) / 7);
+    }
+  }
+  return surface;
+}
+
+int main(int argc, char** argv)
+{
+  int num_tiles = (argc > 1) ? atoi(argv[1]) : 1000;
+
+  SoftwareSurfacePtr rgb  = create_tile(SoftwareSurface::RGB_FORMAT);
+  SoftwareSurfacePtr rgba = create_tile(SoftwareSurface::RGBA_FORMAT);
+
+  BlobPtr jpeg = JPEG::save(rgb, 75);
+  BlobPtr png  = PNG::save(rgba);
+
+  benchmark("JPEG::save         ", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+        JPEG::save(rgb, 75);
+    });
+
+  benchmark("JPEG::load_from_mem", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+        JPEG::load_from_mem(jpeg->get_data(), jpeg->size());
+    });
+
+  // what JPEG::save() and JPEG::load_from_mem() did before they kept
+  // their libjpeg state per thread, for comparison
+  benchmark("JPEG save, fresh   ", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+      {
+        std::vector<uint8_t> data;
+        MemJPEGCompressor compressor(data);
+        compressor.save(rgb, 75);
+        Blob::copy(data);
+      }
+    });
+
+  benchmark("JPEG load, fresh   ", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+      {
+        MemJPEGDecompressor loader(jpeg->get_data(), jpeg->size());
+        loader.read_image(1, NULL);
+      }
+    });
+
+  benchmark("PNG::save          ", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+        PNG::save(rgba);
+    });
+
+  benchmark("PNG::load_from_mem ", num_tiles, [&]{
+      for(int i = 0; i < num_tiles; ++i)
+        PNG::load_from_mem(png->get_data(), png->size());
+    });
+
+  // a broken JPEG must not leave the reused decoder in a bad state
+  try
+  {
+    JPEG::load_from_mem(jpeg->get_data(), jpeg->size() / 2);
+  }
+  catch(const std::exception& err)
+  {
+    std::cout << "truncated JPEG: " << err.what() << std::endl;
+  }
+
+  SoftwareSurfacePtr result = JPEG::load_from_mem(jpeg->get_data(), jpeg->size());
+  std::cout << "reload after error: "
+            << ((result->get_size() == rgb->get_size()) ? "ok" : "ERROR: wrong size") << std::endl;
+
+  return 0;
+}
+
+/* EOF */
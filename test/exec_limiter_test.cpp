@@ -0,0 +1,127 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <string.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "util/exec.hpp"
+#include "util/exec_limiter.hpp"
+
+int main(int argc, char** argv)
+{
+  ExecLimiter limiter;
+  limiter.set_limit("sleep", 2, 0.5);
+
+  // a hung program gets killed
+  {
+    auto start = std::chrono::steady_clock::now();
+    Exec sleep("sleep");
+    sleep.arg("10");
+    try
+    {
+      sleep.exec();
+      std::cout << "timeout: ERROR: no exception" << std::endl;
+    }
+    catch(const std::exception& err)
+    {
+      std::cout << "timeout: " << (sleep.timed_out() ? "ok" : "ERROR: not flagged") << ": " << err.what() << std::endl;
+    }
+    std::cout << "killed after "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+              << " sec" << std::endl;
+  }
+
+  // a child that doesn't read its stdin, or that closes its output
+  // and keeps running, gets killed as well
+  {
+    const char* scripts[] = { "sleep 10", "exec >&- 2>&-; sleep 10" };
+    for(int i = 0; i < 2; ++i)
+    {
+      auto start = std::chrono::steady_clock::now();
+      Exec sh("sh");
+      sh.arg("-c").arg(scripts[i]).set_timeout(0.5);
+      sh.set_stdin(Blob::create(4 * 1024 * 1024));
+      try
+      {
+        sh.exec();
+        std::cout << scripts[i] << ": ERROR: no exception" << std::endl;
+      }
+      catch(const std::exception& err)
+      {
+        std::cout << scripts[i] << ": " << (sh.timed_out() ? "ok" : "ERROR: not flagged") << ": " << err.what() << std::endl;
+      }
+      std::cout << "killed after "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                << " sec" << std::endl;
+    }
+  }
+
+  // stdin larger than the pipe buffer arrives in full
+  {
+    BlobPtr data = Blob::create(4 * 1024 * 1024);
+    for(int i = 0; i < data->size(); ++i)
+    {
+      data->get_data()[i] = static_cast<uint8_t>(i * 7);
+    }
+    Exec cat("cat");
+    cat.set_stdin(data);
+    cat.exec();
+    BlobPtr out = cat.get_stdout();
+    std::cout << "cat 4 MiB: "
+              << ((out->size() == data->size() && memcmp(out->get_data(), data->get_data(), static_cast<size_t>(data->size())) == 0) ? "ok" : "ERROR: mismatch")
+              << std::endl;
+  }
+
+  // a child closing stdin early isn't an error
+  {
+    Exec head("head");
+    head.arg("-c").arg("10");
+    head.set_stdin(Blob::create(4 * 1024 * 1024));
+    std::cout << "head -c 10: exit " << head.exec() << ", " << head.get_stdout()->size() << " bytes" << std::endl;
+  }
+
+  // only two run at the same time, so six take three rounds
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 6; ++i)
+    {
+      threads.push_back(std::thread([]{
+            Exec sleep("sleep");
+            sleep.arg("0.2");
+            sleep.exec();
+          }));
+    }
+    for(auto& thread: threads)
+    {
+      thread.join();
+    }
+    std::cout << "6 x 'sleep 0.2' with 2 at once: "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+              << " sec (expected ~0.6)" << std::endl;
+  }
+
+  limiter.print_stats(std::cout);
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,95 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "util/blob.hpp"
+#include "util/exec.hpp"
+
+int main(int argc, char** argv)
+{
+  int num_extractions = (argc > 1) ? atoi(argv[1]) : 10000;
+  int heap_mb         = (argc > 2) ? atoi(argv[2]) : 512;
+
+  // a big heap like the one of the viewer, that is what makes fork() slow
+  std::vector<char> heap(static_cast<size_t>(heap_mb) * 1024 * 1024);
+  memset(heap.data(), 1, heap.size());
+
+  std::vector<uint8_t> content(256 * 1024);
+  for(size_t i = 0; i < content.size(); ++i)
+  {
+    content[i] = static_cast<uint8_t>(i * 7);
+  }
+  Blob::copy(content)->write_to_file("/tmp/exec_spawn_test.dat");
+
+  Exec tar_create("tar");
+  tar_create.arg("--create").arg("--file").arg("/tmp/exec_spawn_test.tar")
+    .arg("--directory").arg("/tmp").arg("exec_spawn_test.dat");
+  if (tar_create.exec() != 0)
+  {
+    throw std::runtime_error("couldn't create /tmp/exec_spawn_test.tar");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < num_extractions; ++i)
+  {
+    // Tar::get_file() reads the archive without a program by now, so
+    // run tar directly, this is about the cost of spawning a process
+    Exec tar_extract("tar");
+    tar_extract.arg("--extract").arg("--to-stdout")
+      .arg("--file").arg("/tmp/exec_spawn_test.tar").arg("exec_spawn_test.dat");
+    if (tar_extract.exec() != 0)
+    {
+      std::cout << "ERROR: tar failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    BlobPtr blob = tar_extract.get_stdout();
+    if (blob->size() != static_cast<int>(content.size()) ||
+        memcmp(blob->get_data(), content.data(), content.size()) != 0)
+    {
+      std::cout << "ERROR: extracted data differs" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << num_extractions << " extractions with a " << heap_mb << "MB heap: "
+            << sec << " sec, " << static_cast<int>(num_extractions / sec) << " extractions/sec" << std::endl;
+
+  // a program that doesn't exist must give an error, not a silent child
+  try
+  {
+    Exec missing("galapix-no-such-program");
+    missing.exec();
+    std::cout << "missing program: exec() returned" << std::endl;
+  }
+  catch(const std::exception& err)
+  {
+    std::cout << "missing program: " << err.what() << std::endl;
+  }
+
+  return 0;
+}
+
+/* EOF */
@@ -38,14 +38,14 @@ int main(int argc, char** argv)
       std::cout << "ExitCode: " << prgn.exec() << std::endl;
 
       std::cout << "### STDOUT BEGIN" << std::endl;
-      std::cout.write(&*prgn.get_stdout().begin(), prgn.get_stdout().size());
+      std::cout.write(reinterpret_cast<const char*>(prgn.get_stdout()->get_data()), prgn.get_stdout()->size());
       std::cout << "### STDOUT END" << std::endl;
       std::cout << std::endl;
       std::cout << "### STERR BEGIN: " << std::endl;
       std::cout.write(&*prgn.get_stderr().begin(), prgn.get_stderr().size());
       std::cout << "### STDERR END" << std::endl;
 
-      std::cout << "stdout size: " << prgn.get_stdout().size() << std::endl;
+      std::cout << "stdout size: " << prgn.get_stdout()->size() << std::endl;
       std::cout << "stderr size: " << prgn.get_stderr().size() << std::endl;
     }
   }
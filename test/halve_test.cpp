@@ -0,0 +1,130 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "util/halve_kernel.hpp"
+
+namespace {
+
+HalveKernel::RowFunc get_row_func(const HalveKernel::Kernel& kernel, int bpp)
+{
+  switch(bpp)
+  {
+    case 1:  return kernel.gray;
+    case 3:  return kernel.rgb;
+    default: return kernel.rgba;
+  }
+}
+
+const int bpps[] = { 1, 3, 4 };
+
+} // namespace
+
+// checks that every HalveKernel gives the same result as the scalar
+// one for all row widths up to 100 pixels and reports the speed on a
+// large surface, e.g.: halve_test 12000 8000
+int main(int argc, char** argv)
+{
+  int width  = (argc > 2) ? atoi(argv[1]) : 12000;
+  int height = (argc > 2) ? atoi(argv[2]) : 8000;
+
+  std::vector<HalveKernel::Kernel> kernels = HalveKernel::available();
+  const HalveKernel::Kernel& scalar = kernels.front();
+  int rc = EXIT_SUCCESS;
+
+  for(const auto& kernel: kernels)
+  {
+    bool equal = true;
+    for(int bpp: bpps)
+    {
+      HalveKernel::RowFunc func     = get_row_func(kernel, bpp);
+      HalveKernel::RowFunc expected = get_row_func(scalar, bpp);
+
+      for(int src_width = 1; src_width < 200; ++src_width)
+      {
+        int dst_width = src_width / 2;
+        // exactly sized rows, so valgrind or ASan catch reads past the end
+        std::vector<uint8_t> row0(static_cast<size_t>(bpp * src_width));
+        std::vector<uint8_t> row1(row0.size());
+        for(size_t i = 0; i < row0.size(); ++i)
+        {
+          row0[i] = static_cast<uint8_t>(rand());
+          row1[i] = static_cast<uint8_t>(rand());
+        }
+
+        std::vector<uint8_t> result(static_cast<size_t>(bpp * dst_width) + 1, 0xaa);
+        std::vector<uint8_t> reference(result);
+        func(row0.data(), row1.data(), result.data(), dst_width);
+        expected(row0.data(), row1.data(), reference.data(), dst_width);
+        if (result != reference)
+        {
+          equal = false;
+        }
+      }
+    }
+    std::cout << kernel.name << ": " << (equal ? "ok" : "ERROR: result differs") << std::endl;
+    if (!equal)
+    {
+      rc = EXIT_FAILURE;
+    }
+  }
+
+  for(int bpp: bpps)
+  {
+    size_t pitch = static_cast<size_t>(bpp * width);
+    std::vector<uint8_t> src(pitch * static_cast<size_t>(height));
+    for(size_t i = 0; i < src.size(); ++i)
+    {
+      src[i] = static_cast<uint8_t>(i * 7);
+    }
+    std::vector<uint8_t> dst(src.size() / 4 + pitch);
+
+    for(const auto& kernel: kernels)
+    {
+      HalveKernel::RowFunc func = get_row_func(kernel, bpp);
+
+      double best = 0.0;
+      for(int round = 0; round < 5; ++round)
+      {
+        auto start = std::chrono::steady_clock::now();
+        for(int y = 0; y < height / 2; ++y)
+        {
+          func(&src[2 * static_cast<size_t>(y) * pitch], &src[(2 * static_cast<size_t>(y) + 1) * pitch],
+               &dst[static_cast<size_t>(y) * pitch / 2], width / 2);
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (best == 0.0 || sec < best)
+        {
+          best = sec;
+        }
+      }
+
+      std::cout << (bpp == 1 ? "L8   " : (bpp == 3 ? "RGB  " : "RGBA ")) << kernel.name << ": "
+                << static_cast<double>(src.size()) / best / 1e9 << " GB/s" << std::endl;
+    }
+  }
+
+  return rc;
+}
+
+/* EOF */
@@ -0,0 +1,141 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "job/job_handle.hpp"
+#include "job/mpsc_queue.hpp"
+
+// counts every allocation in the program
+static std::atomic<long> g_num_allocs(0);
+
+void* operator new(size_t size)
+{
+  g_num_allocs += 1;
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+template<typename Func>
+void benchmark(const char* name, int num_items, Func func)
+{
+  long allocs = g_num_allocs;
+  auto start = std::chrono::steady_clock::now();
+  func();
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << name << ": " << static_cast<int>(num_items / sec / 1000.0) << "k handles/sec, "
+            << static_cast<double>(g_num_allocs - allocs) / num_items << " allocations/handle" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  int num_items = (argc > 1) ? atoi(argv[1]) : 5000000;
+
+  benchmark("create+finish", num_items, [num_items]{
+      for(int i = 0; i < num_items; ++i)
+      {
+        JobHandle handle = JobHandle::create();
+        handle.set_finished();
+        handle.wait();
+      }
+    });
+
+  benchmark("create+abort ", num_items, [num_items]{
+      for(int i = 0; i < num_items; ++i)
+      {
+        JobHandle handle = JobHandle::create();
+        JobHandle copy = handle;
+        copy.set_aborted();
+        if (!handle.is_aborted())
+        {
+          std::cout << "ERROR: abort got lost" << std::endl;
+        }
+      }
+    });
+
+  // handles get created here and finished and destroyed by another
+  // thread, like requests that the DatabaseThread answers, they are
+  // passed over in batches, so the queue doesn't allocate per handle
+  benchmark("cross thread ", num_items, [num_items]{
+      typedef std::vector<JobHandle> Batch;
+      const int batch_size = 1000;
+      MPSCQueue<Batch*> queue(64);
+      std::thread worker([&queue, num_items, batch_size]{
+          for(int i = 0; i < num_items; i += batch_size)
+          {
+            Batch* batch;
+            queue.wait_and_pop(batch);
+            for(auto& handle: *batch)
+            {
+              handle.set_finished();
+            }
+            delete batch;
+          }
+        });
+
+      std::vector<JobHandle> handles;
+      for(int i = 0; i < num_items; i += batch_size)
+      {
+        Batch* batch = new Batch;
+        batch->reserve(batch_size);
+        for(int j = 0; j < batch_size; ++j)
+        {
+          batch->push_back(JobHandle::create());
+        }
+        handles.push_back(batch->front());
+        queue.wait_and_push(batch);
+      }
+
+      for(auto& handle: handles)
+      {
+        handle.wait();
+      }
+      worker.join();
+    });
+
+  // wait() must wake up when the handle gets finished while sleeping
+  {
+    JobHandle handle = JobHandle::create();
+    std::thread thread([handle]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        handle.set_finished();
+      });
+    handle.wait();
+    thread.join();
+    std::cout << "wait(): " << (handle.is_finished() ? "ok" : "ERROR: not finished") << std::endl;
+  }
+
+  return 0;
+}
+
+/* EOF */
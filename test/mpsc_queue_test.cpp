@@ -0,0 +1,106 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "job/mpsc_queue.hpp"
+#include "job/thread_message_queue2.hpp"
+
+template<typename Queue>
+void run_benchmark(const char* name, Queue& queue, int num_producers, int num_items)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for(int p = 0; p < num_producers; ++p)
+  {
+    producers.push_back(std::thread([&queue, num_items]{
+          for(int i = 1; i <= num_items; ++i)
+          {
+            queue.wait_and_push(i);
+          }
+        }));
+  }
+
+  long long sum = 0;
+  int total = num_producers * num_items;
+  for(int i = 0; i < total; ++i)
+  {
+    int value;
+    queue.wait_and_pop(value);
+    sum += value;
+  }
+
+  for(auto& producer: producers)
+  {
+    producer.join();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  double sec = std::chrono::duration<double>(end - start).count();
+
+  long long expected = static_cast<long long>(num_producers) * num_items * (num_items + 1) / 2;
+  std::cout << name << ": " << num_producers << " producers, "
+            << static_cast<int>(total / sec / 1000.0) << "k items/sec"
+            << (sum == expected ? "" : "  ERROR: items got lost") << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  int num_items = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+  for(int num_producers: {1, 2, 4, 8})
+  {
+    ThreadMessageQueue2<int> queue2(256);
+    run_benchmark("ThreadMessageQueue2", queue2, num_producers, num_items);
+
+    MPSCQueue<int> mpsc_queue(256);
+    run_benchmark("MPSCQueue          ", mpsc_queue, num_producers, num_items);
+  }
+
+  // force_push() must never lose data or reorder it, even when the
+  // queue overflows while the consumer is popping
+  MPSCQueue<int> small_queue(2);
+  int count = 0;
+  bool in_order = true;
+  int value;
+  for(int i = 0; i < 100; ++i)
+  {
+    small_queue.force_push(i);
+    if (i % 3 == 0 && small_queue.try_pop(value))
+    {
+      in_order = in_order && (value == count);
+      count += 1;
+    }
+  }
+  while(small_queue.try_pop(value))
+  {
+    in_order = in_order && (value == count);
+    count += 1;
+  }
+  std::cout << "force_push(): " << count << "/100 items received"
+            << (in_order ? "" : "  ERROR: items out of order") << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,174 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs/tile_generator.hpp"
+#include "math/rgb.hpp"
+#include "math/size.hpp"
+#include "util/software_surface.hpp"
+
+namespace {
+
+// the nearest neighbour scaling SoftwareSurface::scale() used to do
+SoftwareSurfacePtr scale_nearest(SoftwareSurfacePtr src, const Size& size)
+{
+  SoftwareSurfacePtr surface = SoftwareSurface::create(src->get_format(), size);
+  RGB rgb;
+  for(int y = 0; y < size.height; ++y)
+    for(int x = 0; x < size.width; ++x)
+    {
+      src->get_pixel(x * src->get_width() / size.width, y * src->get_height() / size.height, rgb);
+      surface->put_pixel(x, y, rgb);
+    }
+  return surface;
+}
+
+template<typename Func>
+double benchmark(Func func)
+{
+  double best = 0.0;
+  for(int round = 0; round < 3; ++round)
+  {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (best == 0.0 || sec < best)
+    {
+      best = sec;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  int width  = (argc > 2) ? atoi(argv[1]) : 6000;
+  int height = (argc > 2) ? atoi(argv[2]) : 4000;
+
+  // a horizontal gradient has to stay a gradient and a flat color has
+  // to stay flat, also with the negative lobes of Lanczos
+  const char* filter_names[] = { "box", "triangle", "lanczos" };
+  for(int f = 0; f < 3; ++f)
+  {
+    Resampler::Filter filter = static_cast<Resampler::Filter>(f);
+    SoftwareSurfacePtr gradient = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT, Size(1024, 64));
+    for(int y = 0; y < 64; ++y)
+      for(int x = 0; x < 1024; ++x)
+      {
+        gradient->put_pixel(x, y, RGB(static_cast<uint8_t>(x / 4), 128, 255));
+      }
+
+    int max_error = 0;
+    for(int dst_width = 64; dst_width <= 2048; dst_width = dst_width * 3 / 2)
+    {
+      SoftwareSurfacePtr result = gradient->scale(Size(dst_width, 37), filter);
+      for(int y = 0; y < result->get_height(); ++y)
+        for(int x = 2; x < result->get_width() - 2; ++x)
+        {
+          RGB rgb;
+          result->get_pixel(x, y, rgb);
+          int expected = static_cast<int>((x + 0.5) * 1024 / dst_width / 4.0);
+          max_error = std::max(max_error, abs(rgb.r - expected));
+          max_error = std::max(max_error, abs(rgb.g - 128) + abs(rgb.b - 255));
+        }
+    }
+    std::cout << filter_names[f] << ": max error " << max_error << (max_error <= 1 ? " ok" : " ERROR") << std::endl;
+  }
+
+  // the SIMD kernels must give exactly the same result as the plain ones
+  {
+    bool equal = true;
+    SoftwareSurface::Format formats[] = { SoftwareSurface::RGB_FORMAT, SoftwareSurface::RGBA_FORMAT,
+                                          SoftwareSurface::L8_FORMAT };
+    Size sizes[] = { Size(61, 77), Size(300, 13), Size(1, 1), Size(250, 190) };
+    for(int i = 0; i < 3; ++i)
+    {
+      SoftwareSurfacePtr src = SoftwareSurface::create(formats[i], Size(257, 191));
+      for(int y = 0; y < src->get_height(); ++y)
+      {
+        uint8_t* row = src->get_row_data(y);
+        for(int x = 0; x < src->get_width() * src->get_bytes_per_pixel(); ++x)
+        {
+          row[x] = static_cast<uint8_t>(rand());
+        }
+      }
+
+      for(int f = 0; f < 3; ++f)
+        for(int j = 0; j < 4; ++j)
+        {
+          SoftwareSurfacePtr results[2];
+          for(int simd = 0; simd < 2; ++simd)
+          {
+            Resampler resampler(src->get_size(), sizes[j], static_cast<Resampler::Filter>(f), simd != 0);
+            SoftwareSurfacePtr tmp = SoftwareSurface::create(formats[i], resampler.get_intermediate_size());
+            resampler.first_pass(*src, *tmp, 0, tmp->get_height());
+            results[simd] = SoftwareSurface::create(formats[i], sizes[j]);
+            resampler.second_pass(*tmp, *results[simd], 0, sizes[j].height);
+          }
+
+          for(int y = 0; y < sizes[j].height; ++y)
+          {
+            if (memcmp(results[0]->get_row_data(y), results[1]->get_row_data(y),
+                       static_cast<size_t>(sizes[j].width * src->get_bytes_per_pixel())) != 0)
+            {
+              equal = false;
+            }
+          }
+        }
+    }
+    std::cout << "simd: " << (equal ? "ok" : "ERROR: result differs") << std::endl;
+  }
+
+  SoftwareSurfacePtr surface = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT, Size(width, height));
+  for(int y = 0; y < height; ++y)
+  {
+    uint8_t* row = surface->get_row_data(y);
+    for(int x = 0; x < 3 * width; ++x)
+    {
+      row[x] = static_cast<uint8_t>(x * 7 + y * 13);
+    }
+  }
+
+  // a large reduction and one like after JPEG DCT scaling
+  Size sizes[] = { Size(width * 10 / 37, height * 10 / 37), Size(width * 2 / 3, height * 2 / 3) };
+  for(int i = 0; i < 2; ++i)
+  {
+    Size size = sizes[i];
+    std::cout << width << "x" << height << " -> " << size << ":" << std::endl;
+    std::cout << "  nearest (old):    "
+              << benchmark([&]{ scale_nearest(surface, size); }) << " sec" << std::endl;
+    for(int f = 0; f < 3; ++f)
+    {
+      Resampler::Filter filter = static_cast<Resampler::Filter>(f);
+      std::cout << "  " << filter_names[f] << ":" << std::string(17 - strlen(filter_names[f]), ' ')
+                << benchmark([&]{ surface->scale(size, filter); }) << " sec" << std::endl;
+    }
+    std::cout << "  TileGenerator:    "
+              << benchmark([&]{ TileGenerator::scale(surface, size); }) << " sec" << std::endl;
+  }
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,121 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "plugins/tar_reader.hpp"
+#include "util/exec.hpp"
+
+// compares TarReader against "tar --extract" for every member of the
+// given archives and times both, e.g.:
+//   tar cf images.tar *.jpg && tar czf images.tar.gz *.jpg
+//   tar_reader_test images.tar images.tar.gz
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cout << "Usage: " << argv[0] << " TARFILE..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int rc = EXIT_SUCCESS;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string archive = argv[i];
+
+    auto start = std::chrono::steady_clock::now();
+    TarReaderPtr reader = TarReader::get(archive);
+    std::vector<std::string> files = reader->get_filenames();
+    std::vector<BlobPtr> blobs;
+    size_t total = 0;
+    for(const auto& filename: files)
+    {
+      blobs.push_back(reader->get_file(filename));
+      total += static_cast<size_t>(blobs.back()->size());
+    }
+    double reader_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(size_t j = 0; j < files.size(); ++j)
+    {
+      Exec tar("tar");
+      tar.arg("--extract").arg("--to-stdout").arg("--file").arg(archive).arg(files[j]);
+      if (tar.exec() != 0)
+      {
+        std::cout << archive << ": " << files[j] << ": ERROR: tar failed" << std::endl;
+        rc = EXIT_FAILURE;
+        continue;
+      }
+
+      BlobPtr expected = tar.get_stdout();
+      if (expected->size() != blobs[j]->size() ||
+          memcmp(expected->get_data(), blobs[j]->get_data(), static_cast<size_t>(expected->size())) != 0)
+      {
+        std::cout << archive << ": " << files[j] << ": ERROR: content differs" << std::endl;
+        rc = EXIT_FAILURE;
+      }
+    }
+    double tar_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // members requested from several threads at once, as the loader
+    // jobs do, from a reader with nothing pending yet
+    start = std::chrono::steady_clock::now();
+    TarReaderPtr shared_reader = std::make_shared<TarReader>(archive);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next(0);
+    std::atomic<int> mismatches(0);
+    for(int t = 0; t < 4; ++t)
+    {
+      threads.push_back(std::thread([&]{
+            for(size_t j = next++; j < files.size(); j = next++)
+            {
+              BlobPtr blob = shared_reader->get_file(files[j]);
+              if (blob->size() != blobs[j]->size() ||
+                  memcmp(blob->get_data(), blobs[j]->get_data(), static_cast<size_t>(blob->size())) != 0)
+              {
+                mismatches += 1;
+              }
+            }
+          }));
+    }
+    for(auto& thread: threads)
+    {
+      thread.join();
+    }
+    double threads_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (mismatches != 0)
+    {
+      std::cout << archive << ": ERROR: " << mismatches << " members differ when read from 4 threads" << std::endl;
+      rc = EXIT_FAILURE;
+    }
+
+    std::cout << archive << ": " << files.size() << " files, " << total << " bytes\n"
+              << "  TarReader: " << reader_sec << " sec\n"
+              << "  4 threads: " << threads_sec << " sec\n"
+              << "  tar:       " << tar_sec << " sec" << std::endl;
+  }
+
+  return rc;
+}
+
+/* EOF */
@@ -0,0 +1,433 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <malloc.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "galapix/tile.hpp"
+#include "jobs/tile_generator.hpp"
+#include "math/rect.hpp"
+#include "math/size.hpp"
+#include "math/vector2i.hpp"
+#include "plugins/jpeg.hpp"
+#include "plugins/png.hpp"
+#include "util/software_surface.hpp"
+#include "util/url.hpp"
+
+// count the bytes allocated, to see how much cut_into_tiles() copies,
+// and the peak of the bytes in use
+std::atomic<size_t> g_allocated(0);
+std::atomic<size_t> g_in_use(0);
+std::atomic<size_t> g_peak(0);
+
+void* operator new(size_t size)
+{
+  void* ptr = malloc(size);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  size = malloc_usable_size(ptr);
+  g_allocated += size;
+  size_t in_use = (g_in_use += size);
+  if (in_use > g_peak)
+  {
+    g_peak = in_use;
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  g_in_use -= malloc_usable_size(ptr);
+  free(ptr);
+}
+
+namespace {
+
+bool same_blob(BlobPtr a, BlobPtr b)
+{
+  return a->size() == b->size() && memcmp(a->get_data(), b->get_data(), a->size()) == 0;
+}
+
+bool same_surface(SoftwareSurfacePtr a, SoftwareSurfacePtr b)
+{
+  if (a->get_size() != b->get_size())
+  {
+    return false;
+  }
+
+  for(int y = 0; y < a->get_height(); ++y)
+  {
+    if (memcmp(a->get_row_data(y), b->get_row_data(y),
+               static_cast<size_t>(a->get_width() * a->get_bytes_per_pixel())) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Number of bytes that differ between \a a and \a b */
+size_t count_differences(SoftwareSurfacePtr a, SoftwareSurfacePtr b)
+{
+  size_t result = 0;
+  for(int y = 0; y < a->get_height(); ++y)
+  {
+    const uint8_t* p = a->get_row_data(y);
+    const uint8_t* q = b->get_row_data(y);
+    for(int x = 0; x < a->get_width() * a->get_bytes_per_pixel(); ++x)
+    {
+      result += (p[x] != q[x]) ? 1 : 0;
+    }
+  }
+  return result;
+}
+
+std::vector<Tile> cut(SoftwareSurfacePtr surface, const Size& size, SoftwareSurface::Modifier orientation)
+{
+  std::vector<Tile> tiles;
+  TileGenerator::cut_into_tiles(surface, size, 0, 5,
+                                [&tiles](const Tile& tile) { tiles.push_back(tile); },
+                                orientation);
+  return tiles;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  int width  = (argc > 2) ? atoi(argv[1]) : 12000;
+  int height = (argc > 2) ? atoi(argv[2]) : 8000;
+
+  SoftwareSurfacePtr surface = SoftwareSurface::create(SoftwareSurface::RGB_FORMAT, Size(width, height));
+  for(int y = 0; y < height; ++y)
+  {
+    uint8_t* row = surface->get_row_data(y);
+    for(int x = 0; x < 3 * width; ++x)
+    {
+      row[x] = static_cast<uint8_t>(x * 7 + y * 13);
+    }
+  }
+
+  // the banded halve() must give the same result as the plain one
+  {
+    SoftwareSurfacePtr expected = surface->halve();
+    SoftwareSurfacePtr result   = TileGenerator::halve(surface);
+    bool equal = true;
+    for(int y = 0; y < expected->get_height(); ++y)
+    {
+      if (memcmp(expected->get_row_data(y), result->get_row_data(y),
+                 static_cast<size_t>(3 * expected->get_width())) != 0)
+      {
+        equal = false;
+        break;
+      }
+    }
+    std::cout << "halve(): " << (equal ? "ok" : "ERROR: result differs") << std::endl;
+  }
+
+  // a view from crop() must save the same as a copy of it
+  SoftwareSurfacePtr view = surface->crop(Rect(Vector2i(300, 200), Size(256, 256)));
+  SoftwareSurfacePtr copy = view->clone();
+  std::cout << "crop(): "
+            << ((same_blob(JPEG::save(view, 75), JPEG::save(copy, 75)) &&
+                 same_blob(PNG::save(view), PNG::save(copy)) &&
+                 view->get_row_data(0) == surface->get_row_data(200) + 3 * 300)
+                ? "ok" : "ERROR: view differs from copy") << std::endl;
+
+  // grayscale stays grayscale through JPEG and PNG and the tiles
+  {
+    SoftwareSurfacePtr gray = SoftwareSurface::create(SoftwareSurface::L8_FORMAT, Size(1001, 777));
+    for(int y = 0; y < gray->get_height(); ++y)
+    {
+      memcpy(gray->get_row_data(y), surface->get_row_data(y), static_cast<size_t>(gray->get_width()));
+    }
+
+    BlobPtr jpeg = JPEG::save(gray, 75);
+    BlobPtr png  = PNG::save(gray);
+    std::vector<Tile> tiles = cut(gray, Size(777, 1001), SoftwareSurface::kRot90);
+    bool ok = (JPEG::load_from_mem(jpeg->get_data(), static_cast<int>(jpeg->size()))->get_format() == SoftwareSurface::L8_FORMAT &&
+               same_surface(PNG::load_from_mem(png->get_data(), static_cast<int>(png->size())), gray) &&
+               tiles.back().get_surface()->get_format() == SoftwareSurface::L8_FORMAT);
+    std::cout << "L8: " << (ok ? "ok" : "ERROR: grayscale got lost") << std::endl;
+  }
+
+  // cutting with an orientation must give the same tiles as cutting
+  // the transformed surface, odd sizes check that halving lines up
+  {
+    SoftwareSurfacePtr odd = surface->crop(Rect(Vector2i(0, 0), Size(1001, 777)))->clone();
+    bool equal = true;
+    for(int m = 0; m < 8; ++m)
+    {
+      SoftwareSurface::Modifier mod = static_cast<SoftwareSurface::Modifier>(m);
+      SoftwareSurfacePtr transformed = odd->transform(mod);
+      std::vector<Tile> expected = cut(transformed, transformed->get_size(), SoftwareSurface::kRot0);
+      std::vector<Tile> result   = cut(odd, transformed->get_size(), mod);
+
+      equal = equal && (expected.size() == result.size());
+      for(size_t i = 0; equal && i < expected.size(); ++i)
+      {
+        equal = (expected[i].get_scale() == result[i].get_scale() &&
+                 expected[i].get_pos()   == result[i].get_pos() &&
+                 same_surface(expected[i].get_surface(), result[i].get_surface()));
+      }
+    }
+    std::cout << "cut_into_tiles() with orientation: " << (equal ? "ok" : "ERROR: tiles differ") << std::endl;
+
+    // cutting in bands must give the same tiles as cutting the whole
+    // surface, bands of 100 rows don't line up with the tiles
+    equal = true;
+    for(int band_height = 100; band_height <= 256; band_height += 156)
+      for(int m = 0; m < 8; ++m)
+      {
+        SoftwareSurface::Modifier mod = static_cast<SoftwareSurface::Modifier>(m);
+        Size transformed_size = SoftwareSurface::get_transformed_size(mod, odd->get_size());
+        std::vector<Tile> expected = cut(odd, transformed_size, mod);
+        std::vector<Tile> result;
+        int y = 0;
+        TileGenerator::cut_bands_into_tiles(odd->get_size(), 0, 5,
+                                            [&]{
+                                              SoftwareSurfacePtr band;
+                                              if (y < odd->get_height())
+                                              {
+                                                int end = std::min(y + band_height, odd->get_height());
+                                                band = odd->crop(Rect(0, y, odd->get_width(), end))->clone();
+                                                y = end;
+                                              }
+                                              return band;
+                                            },
+                                            [&result](const Tile& tile) { result.push_back(tile); },
+                                            mod);
+
+        // the order differs, so look up each tile
+        equal = equal && (expected.size() == result.size());
+        for(size_t i = 0; equal && i < expected.size(); ++i)
+        {
+          bool found = false;
+          for(size_t j = 0; !found && j < result.size(); ++j)
+          {
+            found = (expected[i].get_scale() == result[j].get_scale() &&
+                     expected[i].get_pos()   == result[j].get_pos() &&
+                     same_surface(expected[i].get_surface(), result[j].get_surface()));
+          }
+          equal = found;
+        }
+      }
+    std::cout << "cut_bands_into_tiles(): " << (equal ? "ok" : "ERROR: tiles differ") << std::endl;
+
+    // what a portrait photo cost before: transform, then cut
+    Size rotated_size(height, width);
+    size_t in_use = g_in_use;
+    g_peak = in_use;
+    auto start = std::chrono::steady_clock::now();
+    TileGenerator::cut_into_tiles(surface->transform(SoftwareSurface::kRot90), rotated_size, 0, 6,
+                                  [](const Tile&) {});
+    auto middle = std::chrono::steady_clock::now();
+    size_t peak_transform = g_peak - in_use;
+    g_peak = in_use;
+    TileGenerator::cut_into_tiles(surface, rotated_size, 0, 6, [](const Tile&) {},
+                                  SoftwareSurface::kRot90);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "rot90: transform() + cut_into_tiles(): "
+              << std::chrono::duration<double>(middle - start).count() << " sec, peak "
+              << peak_transform / (1024 * 1024) << " MiB" << std::endl;
+    std::cout << "rot90: cut_into_tiles(orientation):   "
+              << std::chrono::duration<double>(end - middle).count() << " sec, peak "
+              << (g_peak - in_use) / (1024 * 1024) << " MiB" << std::endl;
+  }
+
+  // a large JPEG decoded as a whole vs. decoded and cut in bands
+  {
+    BlobPtr jpeg = JPEG::save(surface, 75);
+    URL url = URL::from_filename("memory.jpg");
+
+    size_t in_use = g_in_use;
+    g_peak = in_use;
+    int num_tiles = 0;
+    auto start = std::chrono::steady_clock::now();
+    Size original_size;
+    TileGenerator::cut_into_tiles(TileGenerator::load_surface(url, jpeg, "image/jpeg", 0, &original_size),
+                                  original_size, 0, 6, [&num_tiles](const Tile&) { num_tiles += 1; });
+    auto middle = std::chrono::steady_clock::now();
+    size_t peak_whole = g_peak - in_use;
+    g_peak = in_use;
+    int num_band_tiles = 0;
+    TileGenerator::generate_bands(url, jpeg, 0, 6, [&num_band_tiles](const Tile&) { num_band_tiles += 1; });
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "JPEG: decode whole + cut_into_tiles(): " << num_tiles << " tiles in "
+              << std::chrono::duration<double>(middle - start).count() << " sec, peak "
+              << peak_whole / (1024 * 1024) << " MiB" << std::endl;
+    std::cout << "JPEG: generate_bands():               " << num_band_tiles << " tiles in "
+              << std::chrono::duration<double>(end - middle).count() << " sec, peak "
+              << (g_peak - in_use) / (1024 * 1024) << " MiB" << std::endl;
+
+    // a few tiles decoded on their own must be the same as the ones
+    // from decoding the whole image at that scale
+    bool equal = true;
+    double region_sec = 0.0;
+    for(int scale = 0; scale <= 1; ++scale)
+    {
+      std::vector<Tile> expected;
+      TileGenerator::cut_into_tiles(TileGenerator::load_surface(url, jpeg, "image/jpeg", scale, &original_size),
+                                    original_size, scale, scale,
+                                    [&expected](const Tile& tile) { expected.push_back(tile); });
+
+      std::vector<Vector2i> positions;
+      positions.push_back(Vector2i(3, 2));
+      positions.push_back(Vector2i(4, 2));
+      positions.push_back(Vector2i(3, 3));
+      std::vector<Tile> result;
+      auto region_start = std::chrono::steady_clock::now();
+      TileGenerator::generate_region(url, jpeg, scale, positions,
+                                     [&result](const Tile& tile) { result.push_back(tile); });
+      region_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - region_start).count();
+
+      // the bottom right tile is smaller than the others
+      positions.push_back(Vector2i(expected.back().get_pos()));
+      TileGenerator::generate_region(url, jpeg, scale, std::vector<Vector2i>(1, positions.back()),
+                                     [&result](const Tile& tile) { result.push_back(tile); });
+
+      equal = equal && (result.size() == positions.size());
+      for(size_t i = 0; equal && i < result.size(); ++i)
+      {
+        equal = false;
+        for(size_t j = 0; j < expected.size(); ++j)
+        {
+          if (expected[j].get_pos() == result[i].get_pos())
+          {
+            equal = (result[i].get_scale() == scale &&
+                     same_surface(expected[j].get_surface(), result[i].get_surface()));
+          }
+        }
+      }
+    }
+    std::cout << "JPEG: generate_region(): " << (equal ? "ok" : "ERROR: tiles differ")
+              << ", 2x3 tiles in " << region_sec << " sec" << std::endl;
+
+    // scale 0 tiles encoded again vs. cut out of the JPEG, the cut
+    // ones only differ where the chroma upsampling reaches over the
+    // border of the tile
+    auto encode_start = std::chrono::steady_clock::now();
+    std::vector<Tile> expected;
+    TileGenerator::cut_into_tiles(TileGenerator::load_surface(url, jpeg, "image/jpeg", 0, &original_size),
+                                  original_size, 0, 0,
+                                  [&expected](const Tile& tile) { expected.push_back(tile); });
+    std::vector<BlobPtr> encoded;
+    for(std::vector<Tile>::const_iterator i = expected.begin(); i != expected.end(); ++i)
+    {
+      encoded.push_back(JPEG::save(i->get_surface(), 75));
+    }
+    auto encode_end = std::chrono::steady_clock::now();
+
+    BlobPtr blob = jpeg;
+    std::vector<BlobPtr> cropped;
+    bool lossless = TileGenerator::generate_lossless(url, blob,
+                                                     [&cropped](const Vector2i&, BlobPtr data) {
+                                                       cropped.push_back(data);
+                                                     });
+    auto crop_end = std::chrono::steady_clock::now();
+
+    size_t num_bytes = 0;
+    size_t encoded_diff = 0;
+    size_t cropped_diff = 0;
+    size_t encoded_bytes = 0;
+    size_t cropped_bytes = 0;
+    bool ok = lossless && cropped.size() == expected.size();
+    for(size_t i = 0; ok && i < expected.size(); ++i)
+    {
+      SoftwareSurfacePtr a = JPEG::load_from_mem(encoded[i]->get_data(), static_cast<int>(encoded[i]->size()));
+      SoftwareSurfacePtr b = JPEG::load_from_mem(cropped[i]->get_data(), static_cast<int>(cropped[i]->size()));
+      ok = (b->get_size() == expected[i].get_surface()->get_size());
+      if (ok)
+      {
+        num_bytes += static_cast<size_t>(a->get_width() * a->get_height() * a->get_bytes_per_pixel());
+        encoded_diff += count_differences(a, expected[i].get_surface());
+        cropped_diff += count_differences(b, expected[i].get_surface());
+        encoded_bytes += encoded[i]->size();
+        cropped_bytes += cropped[i]->size();
+      }
+    }
+
+    if (!ok)
+    {
+      std::cout << "JPEG: generate_lossless(): ERROR: tiles differ" << std::endl;
+    }
+    else
+    {
+      std::cout << "JPEG: decode + encode scale 0: " << expected.size() << " tiles in "
+                << std::chrono::duration<double>(encode_end - encode_start).count() << " sec, "
+                << encoded_bytes / 1024 << " KiB, " << 100 * encoded_diff / num_bytes << "% of bytes differ" << std::endl;
+      std::cout << "JPEG: generate_lossless():     " << cropped.size() << " tiles in "
+                << std::chrono::duration<double>(crop_end - encode_end).count() << " sec, "
+                << cropped_bytes / 1024 << " KiB, " << 100 * cropped_diff / num_bytes << "% of bytes differ" << std::endl;
+    }
+
+    // thumbnails: the decoder stops at 1/8, the rest is scaled
+    for(int scale = 3; scale <= 6; ++scale)
+    {
+      auto thumb_start = std::chrono::steady_clock::now();
+      SoftwareSurfacePtr decoded = TileGenerator::load_surface(url, jpeg, "image/jpeg", scale, &original_size);
+      auto thumb_middle = std::chrono::steady_clock::now();
+      SoftwareSurfacePtr thumbnail = TileGenerator::scale_to_min_scale(decoded, original_size, scale);
+      auto thumb_end = std::chrono::steady_clock::now();
+      std::cout << "JPEG: scale " << scale << ": decode to " << decoded->get_size() << " "
+                << std::chrono::duration<double>(thumb_middle - thumb_start).count() << " sec, scale to "
+                << thumbnail->get_size() << " "
+                << std::chrono::duration<double>(thumb_end - thumb_middle).count() << " sec" << std::endl;
+    }
+
+    // scales that aren't a power of two are done by the decoder as
+    // M/8 instead of decoding at the next power of two and scaling
+    {
+      auto m8_start = std::chrono::steady_clock::now();
+      SoftwareSurfacePtr decoded = JPEG::load_from_mem(jpeg->get_data(), static_cast<int>(jpeg->size()), 3);
+      auto m8_middle = std::chrono::steady_clock::now();
+      SoftwareSurfacePtr scaled = TileGenerator::scale(JPEG::load_from_mem(jpeg->get_data(), static_cast<int>(jpeg->size()), 2),
+                                                       Size((width + 2) / 3, (height + 2) / 3));
+      auto m8_end = std::chrono::steady_clock::now();
+      std::cout << "JPEG: scale 1/3: decode 3/8 to " << decoded->get_size() << " "
+                << std::chrono::duration<double>(m8_middle - m8_start).count() << " sec, decode 1/2 + scale() "
+                << std::chrono::duration<double>(m8_end - m8_middle).count() << " sec" << std::endl;
+    }
+  }
+
+  size_t allocated = g_allocated;
+  auto start = std::chrono::steady_clock::now();
+  int num_tiles = 0;
+  TileGenerator::cut_into_tiles(surface, surface->get_size(), 0, 6,
+                                [&num_tiles](const Tile&) { num_tiles += 1; });
+  auto end = std::chrono::steady_clock::now();
+
+  std::cout << "cut_into_tiles(): " << width << "x" << height << ": "
+            << num_tiles << " tiles in "
+            << std::chrono::duration<double>(end - start).count() << " sec, "
+            << (g_allocated - allocated) / (1024 * 1024) << " MiB allocated" << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,144 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdlib.h>
+
+#include "database/file_entry.hpp"
+#include "galapix/database_thread.hpp"
+#include "galapix/tile.hpp"
+#include "job/job_handle.hpp"
+#include "job/mpsc_queue.hpp"
+#include "job/thread_message_queue2.hpp"
+#include "util/weak_functor.hpp"
+
+// counts every allocation in the program
+static std::atomic<long> g_num_allocs(0);
+
+void* operator new(size_t size)
+{
+  g_num_allocs += 1;
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+typedef DatabaseThread::TileRequest TileRequest;
+
+/** Stands in for ImageTileCache, which needs a display */
+class Receiver
+{
+public:
+  int num_received;
+
+  Receiver() : num_received(0) {}
+
+  void receive_tile(const Tile& tile) { num_received += 1; }
+};
+
+/** The callback ImageTileCache::request_tile() passes to the TileProvider */
+std::function<void (Tile)> make_callback(const std::shared_ptr<Receiver>& receiver)
+{
+  return weak(std::bind(&Receiver::receive_tile, std::placeholders::_1, std::placeholders::_2), receiver);
+}
+
+template<typename Func>
+void count_allocs(const char* name, int num_items, Func func)
+{
+  long before = g_num_allocs;
+  func();
+  long after = g_num_allocs;
+  std::cout << name << ": " << static_cast<double>(after - before) / num_items
+            << " allocations/request" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  int num_items = (argc > 1) ? atoi(argv[1]) : 100000;
+
+  FileEntry file_entry;
+  std::shared_ptr<Receiver> receiver = std::make_shared<Receiver>();
+
+  // the std::function holds a weak_ptr, which libstdc++ never keeps in
+  // its small buffer, so creating the callback always allocates once,
+  // no matter how the request is queued
+  count_allocs("callback      ", num_items, [&]{
+      for(int i = 0; i < num_items; ++i)
+      {
+        std::function<void (Tile)> callback = make_callback(receiver);
+      }
+    });
+
+  // the old way: the callback copied into a closure in a ThreadMessageQueue2
+  count_allocs("closure queue ", num_items, [&]{
+      ThreadMessageQueue2<std::function<void()>> queue;
+      for(int i = 0; i < num_items; ++i)
+      {
+        const std::function<void (Tile)>& callback = make_callback(receiver);
+        JobHandle job_handle = JobHandle::create();
+        Vector2i pos(i, i);
+        queue.wait_and_push([job_handle, file_entry, i, pos, callback]{
+            JobHandle handle = job_handle;
+            callback(Tile());
+            handle.set_finished();
+          });
+
+        std::function<void()> func;
+        while(queue.try_pop(func))
+        {
+          func();
+        }
+      }
+    });
+
+  // the new way: the callback moved into a DatabaseThread::TileRequest
+  // in a preallocated MPSCQueue, like DatabaseThread::request_tile()
+  count_allocs("typed queue   ", num_items, [&]{
+      MPSCQueue<TileRequest> queue(1024);
+      TileRequest request;
+      for(int i = 0; i < num_items; ++i)
+      {
+        JobHandle job_handle = JobHandle::create();
+        queue.force_push(TileRequest(job_handle, file_entry, i, Vector2i(i, i), make_callback(receiver)));
+
+        while(queue.try_pop(request))
+        {
+          request.callback(Tile());
+          request.job_handle.set_finished();
+        }
+      }
+    });
+
+  std::cout << "callbacks: " << (receiver->num_received == 2 * num_items ? "ok" : "ERROR: requests lost") << std::endl;
+
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,164 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "math/rect.hpp"
+#include "math/size.hpp"
+#include "math/vector2i.hpp"
+#include "util/software_surface.hpp"
+
+namespace {
+
+const char* modifier_names[] = {
+  "rot0", "rot90", "rot180", "rot270",
+  "rot0flip", "rot90flip", "rot180flip", "rot270flip"
+};
+
+// where destination pixel (x, y) comes from, as the old pixel by pixel
+// code did it, with the flips done after the rotation
+void source_pixel(SoftwareSurface::Modifier mod, const Size& src, int x, int y, int& sx, int& sy)
+{
+  const int w = src.width;
+  const int h = src.height;
+  switch(mod)
+  {
+    case SoftwareSurface::kRot0:       sx = x;         sy = y;         break;
+    case SoftwareSurface::kRot90:      sx = y;         sy = h - 1 - x; break;
+    case SoftwareSurface::kRot180:     sx = w - 1 - x; sy = h - 1 - y; break;
+    case SoftwareSurface::kRot270:     sx = w - 1 - y; sy = x;         break;
+    case SoftwareSurface::kRot0Flip:   sx = x;         sy = h - 1 - y; break;
+    case SoftwareSurface::kRot90Flip:  sx = w - 1 - y; sy = h - 1 - x; break;
+    case SoftwareSurface::kRot180Flip: sx = w - 1 - x; sy = y;         break;
+    case SoftwareSurface::kRot270Flip: sx = y;         sy = x;         break;
+  }
+}
+
+SoftwareSurfacePtr transform_reference(SoftwareSurfacePtr src, SoftwareSurface::Modifier mod)
+{
+  bool transposed = (mod == SoftwareSurface::kRot90 || mod == SoftwareSurface::kRot270 ||
+                     mod == SoftwareSurface::kRot90Flip || mod == SoftwareSurface::kRot270Flip);
+  Size size = transposed ? Size(src->get_height(), src->get_width()) : src->get_size();
+  SoftwareSurfacePtr out = SoftwareSurface::create(src->get_format(), size);
+  int bpp = src->get_bytes_per_pixel();
+  for(int y = 0; y < size.height; ++y)
+    for(int x = 0; x < size.width; ++x)
+    {
+      int sx, sy;
+      source_pixel(mod, src->get_size(), x, y, sx, sy);
+      memcpy(out->get_row_data(y) + bpp * x, src->get_row_data(sy) + bpp * sx, static_cast<size_t>(bpp));
+    }
+  return out;
+}
+
+bool equal(SoftwareSurfacePtr a, SoftwareSurfacePtr b)
+{
+  if (a->get_size() != b->get_size())
+  {
+    return false;
+  }
+
+  for(int y = 0; y < a->get_height(); ++y)
+  {
+    if (memcmp(a->get_row_data(y), b->get_row_data(y),
+               static_cast<size_t>(a->get_width() * a->get_bytes_per_pixel())) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+SoftwareSurfacePtr random_surface(SoftwareSurface::Format format, const Size& size)
+{
+  SoftwareSurfacePtr surface = SoftwareSurface::create(format, size);
+  for(int y = 0; y < size.height; ++y)
+  {
+    uint8_t* row = surface->get_row_data(y);
+    for(int x = 0; x < size.width * surface->get_bytes_per_pixel(); ++x)
+    {
+      row[x] = static_cast<uint8_t>(rand());
+    }
+  }
+  return surface;
+}
+
+} // namespace
+
+// checks all eight transforms against a pixel by pixel reference, also
+// on views from crop(), and reports the speed on a large surface,
+// e.g.: transform_test 6000 4000
+int main(int argc, char** argv)
+{
+  int width  = (argc > 2) ? atoi(argv[1]) : 6000;
+  int height = (argc > 2) ? atoi(argv[2]) : 4000;
+
+  SoftwareSurface::Format formats[] = { SoftwareSurface::RGB_FORMAT, SoftwareSurface::RGBA_FORMAT,
+                                        SoftwareSurface::L8_FORMAT };
+  const char* format_names[] = { "RGB", "RGBA", "L8" };
+  Size sizes[] = { Size(1, 1), Size(7, 3), Size(64, 64), Size(133, 71), Size(200, 1) };
+
+  bool ok = true;
+  for(int f = 0; f < 3; ++f)
+    for(int i = 0; i < 5; ++i)
+    {
+      SoftwareSurfacePtr surface = random_surface(formats[f], sizes[i]);
+      SoftwareSurfacePtr parent  = random_surface(formats[f], sizes[i] + Size(9, 5));
+      SoftwareSurfacePtr view    = parent->crop(Rect(Vector2i(4, 2), sizes[i]));
+
+      for(int m = 0; m < 8; ++m)
+      {
+        SoftwareSurface::Modifier mod = static_cast<SoftwareSurface::Modifier>(m);
+        if (!equal(surface->transform(mod), transform_reference(surface, mod)) ||
+            !equal(view->transform(mod), transform_reference(view, mod)))
+        {
+          std::cout << "ERROR: " << modifier_names[m] << " " << sizes[i]
+                    << " bpp=" << surface->get_bytes_per_pixel() << std::endl;
+          ok = false;
+        }
+      }
+    }
+  std::cout << "transform(): " << (ok ? "ok" : "ERROR") << std::endl;
+
+  for(int f = 0; f < 3; ++f)
+  {
+    SoftwareSurfacePtr surface = random_surface(formats[f], Size(width, height));
+    std::cout << width << "x" << height << " " << format_names[f] << ":" << std::endl;
+    for(int m = 1; m < 8; ++m)
+    {
+      SoftwareSurface::Modifier mod = static_cast<SoftwareSurface::Modifier>(m);
+
+      auto start = std::chrono::steady_clock::now();
+      transform_reference(surface, mod);
+      auto middle = std::chrono::steady_clock::now();
+      surface->transform(mod);
+      auto end = std::chrono::steady_clock::now();
+
+      std::cout << "  " << modifier_names[m] << ":" << std::string(12 - strlen(modifier_names[m]), ' ')
+                << "per pixel " << std::chrono::duration<double>(middle - start).count() << " sec, "
+                << "transform() " << std::chrono::duration<double>(end - middle).count() << " sec" << std::endl;
+    }
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* EOF */
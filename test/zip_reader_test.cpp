@@ -0,0 +1,86 @@
+/*
+**  Galapix - an image viewer for large image collections
+**  Copyright (C) 2011 Ingo Ruhnke <grumbel@gmx.de>
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plugins/zip.hpp"
+#include "plugins/zip_reader.hpp"
+#include "util/exec.hpp"
+
+// compares ZipReader against "unzip -p" for every member of the given
+// archives and times both, e.g.:
+//   zip -0 stored.zip *.jpg && zip deflated.zip *.txt
+//   zip_reader_test stored.zip deflated.zip
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cout << "Usage: " << argv[0] << " ZIPFILE..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int rc = EXIT_SUCCESS;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string archive = argv[i];
+
+    auto start = std::chrono::steady_clock::now();
+    ZipReaderPtr reader = ZipReader::get(archive);
+    std::vector<std::string> files = reader->get_filenames();
+    size_t total = 0;
+    for(const auto& filename: files)
+    {
+      total += static_cast<size_t>(reader->get_file(filename)->size());
+    }
+    double reader_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(const auto& filename: files)
+    {
+      Exec unzip("unzip");
+      unzip.arg("-pqq").arg(archive).arg(filename);
+      if (unzip.exec() != 0)
+      {
+        std::cout << archive << ": " << filename << ": ERROR: unzip failed" << std::endl;
+        rc = EXIT_FAILURE;
+        continue;
+      }
+
+      BlobPtr expected = unzip.get_stdout();
+      BlobPtr result   = Zip::get_file(archive, filename);
+      if (expected->size() != result->size() ||
+          memcmp(expected->get_data(), result->get_data(), static_cast<size_t>(result->size())) != 0)
+      {
+        std::cout << archive << ": " << filename << ": ERROR: content differs" << std::endl;
+        rc = EXIT_FAILURE;
+      }
+    }
+    double unzip_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << archive << ": " << files.size() << " files, " << total << " bytes\n"
+              << "  ZipReader: " << reader_sec << " sec\n"
+              << "  unzip:     " << unzip_sec << " sec (includes the comparison)" << std::endl;
+  }
+
+  return rc;
+}
+
+/* EOF */